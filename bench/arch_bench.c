@@ -0,0 +1,684 @@
+#include <arch/archiver.h>
+#include <arch/unarchiver.h>
+#include <arch/arch_errors.h>
+
+#include "../src/core/file_header.h"
+#include "../src/util/clock.h"
+#include "../src/util/file.h"
+#include "../src/util/memory.h"
+
+#include <zlib.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ===== Deterministic data ===== */
+
+typedef struct Rng
+{
+    uint64_t state;
+} Rng;
+
+static uint64_t rngNext(Rng* rng)
+{
+    // xorshift64*
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return rng->state * 2685821657736338717ull;
+}
+
+static uint64_t rngRange(Rng* rng, uint64_t lo, uint64_t hi)
+{
+    return lo + rngNext(rng) % (hi - lo + 1);
+}
+
+static const char* const WORDS[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel", "india", "juliet",
+    "kilo", "lima", "mike", "november", "oscar", "papa", "quebec", "romeo", "sierra", "tango",
+    "uniform", "victor", "whiskey", "xray", "yankee", "zulu", "the", "of", "and", "to"
+};
+
+static const char* const LOG_TEMPLATES[] = {
+    "INFO  [worker-%02u] request id=%08x path=/api/v1/items status=200 latency_ms=%u\n",
+    "INFO  [worker-%02u] request id=%08x path=/api/v1/users status=200 latency_ms=%u\n",
+    "WARN  [worker-%02u] slow query id=%08x table=orders rows=%u\n",
+    "DEBUG [worker-%02u] cache miss id=%08x key=session:%u\n",
+    "ERROR [worker-%02u] upstream timeout id=%08x retry=%u\n"
+};
+
+static const char* const SOURCE_SNIPPETS[] = {
+    "static int process(const char* input, size_t length)\n{\n    if (!input) return -1;\n",
+    "    for (size_t i = 0; i < length; i++)\n    {\n        total += input[i];\n    }\n",
+    "#include <stdio.h>\n#include <stdlib.h>\n#include <string.h>\n\n",
+    "    // TODO: handle the error path properly\n    return result;\n}\n\n",
+    "typedef struct Node\n{\n    struct Node* next;\n    void* value;\n} Node;\n\n"
+};
+
+#define COUNT_OF(a) (sizeof(a) / sizeof((a)[0]))
+
+static void fillText(Rng* rng, char* buffer, size_t size)
+{
+    size_t pos = 0;
+    while (pos < size)
+    {
+        const char* word = WORDS[rngNext(rng) % COUNT_OF(WORDS)];
+        size_t len = strlen(word);
+        for (size_t i = 0; i < len && pos < size; i++) buffer[pos++] = word[i];
+        if (pos < size) buffer[pos++] = (rngNext(rng) % 12 == 0) ? '\n' : ' ';
+    }
+}
+
+static void fillRandom(Rng* rng, unsigned char* buffer, size_t size)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t v = rngNext(rng);
+        memcpy(buffer + i, &v, 8);
+    }
+    for (; i < size; i++) buffer[i] = (unsigned char)rngNext(rng);
+}
+
+/* ===== Filesystem helpers ===== */
+
+static bool makeDirs(const char* path)
+{
+    char buffer[1024];
+    snprintf(buffer, sizeof buffer, "%s/", path);
+    return createParentDirectories(buffer);
+}
+
+static bool writeWholeFile(const char* path, const void* data, size_t size)
+{
+    if (!createParentDirectories(path)) return false;
+
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+
+    bool ok = fwrite(data, 1, size, file) == size;
+    return (fclose(file) == 0) && ok;
+}
+
+static void removeTree(const char* path)
+{
+    struct stat st;
+    if (lstat(path, &st) != 0) return;
+
+    if (S_ISDIR(st.st_mode))
+    {
+        DIR* dir = opendir(path);
+        if (dir)
+        {
+            struct dirent* entry;
+            char child[1024];
+            while ((entry = readdir(dir)) != NULL)
+            {
+                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+                snprintf(child, sizeof child, "%s/%s", path, entry->d_name);
+                removeTree(child);
+            }
+            closedir(dir);
+        }
+        rmdir(path);
+    }
+    else
+    {
+        unlink(path);
+    }
+}
+
+/* ===== Corpora ===== */
+
+typedef struct Corpus
+{
+    const char* name;
+    void (*generate)(const char* dir, unsigned scale, uint64_t* outFiles, uint64_t* outBytes);
+} Corpus;
+
+static void generateTinyText(const char* dir, unsigned scale, uint64_t* outFiles, uint64_t* outBytes)
+{
+    Rng rng = { 0x7157A11u };
+    char path[1024];
+    char data[1024];
+
+    size_t count = 10000u * scale;
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t size = (size_t)rngRange(&rng, 16, sizeof data);
+        fillText(&rng, data, size);
+
+        snprintf(path, sizeof path, "%s/d%03zu/note_%06zu.txt", dir, i % 100, i);
+        if (!writeWholeFile(path, data, size)) continue;
+
+        (*outFiles)++;
+        *outBytes += size;
+    }
+}
+
+static void generateSourceTree(const char* dir, unsigned scale, uint64_t* outFiles, uint64_t* outBytes)
+{
+    Rng rng = { 0x50C7EEu };
+    char path[1024];
+
+    size_t maxSize = 96 * 1024;
+    char* data = malloc(maxSize);
+    if (!data) return;
+
+    size_t count = 800u * scale;
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t size = (size_t)rngRange(&rng, 512, maxSize);
+        bool binary = (i % 10 == 9);
+
+        if (binary)
+        {
+            // Object-file like: mostly random with zero runs
+            fillRandom(&rng, (unsigned char*)data, size);
+            for (size_t z = 0; z < size; z += 4096) memset(data + z, 0, (size - z < 1024) ? size - z : 1024);
+        }
+        else
+        {
+            size_t pos = 0;
+            while (pos < size)
+            {
+                const char* snippet = SOURCE_SNIPPETS[rngNext(&rng) % COUNT_OF(SOURCE_SNIPPETS)];
+                size_t len = strlen(snippet);
+                if (len > size - pos) len = size - pos;
+                memcpy(data + pos, snippet, len);
+                pos += len;
+            }
+        }
+
+        snprintf(path, sizeof path, "%s/module%02zu/sub%zu/file%04zu.%s", dir, i % 17, i % 5, i, binary ? "o" : "c");
+        if (!writeWholeFile(path, data, size)) continue;
+
+        (*outFiles)++;
+        *outBytes += size;
+    }
+
+    free(data);
+}
+
+static void generateLargeLog(const char* dir, unsigned scale, uint64_t* outFiles, uint64_t* outBytes)
+{
+    Rng rng = { 0x106106u };
+    char path[1024];
+    char line[256];
+
+    snprintf(path, sizeof path, "%s/service.log", dir);
+    if (!createParentDirectories(path)) return;
+
+    FILE* file = fopen(path, "wb");
+    if (!file) return;
+
+    uint64_t target = 64ull * 1024 * 1024 * scale;
+    uint64_t written = 0;
+    uint64_t timestamp = 1767225600;
+
+    while (written < target)
+    {
+        timestamp += rngNext(&rng) % 3;
+        const char* fmt = LOG_TEMPLATES[rngNext(&rng) % COUNT_OF(LOG_TEMPLATES)];
+
+        int prefix = snprintf(line, sizeof line, "%llu ", (unsigned long long)timestamp);
+        int len = prefix + snprintf(line + prefix, sizeof line - (size_t)prefix, fmt,
+            (unsigned)(rngNext(&rng) % 32), (unsigned)rngNext(&rng), (unsigned)(rngNext(&rng) % 5000));
+
+        fwrite(line, 1, (size_t)len, file);
+        written += (uint64_t)len;
+    }
+
+    fclose(file);
+    (*outFiles)++;
+    *outBytes += written;
+}
+
+static void generateRandom(const char* dir, unsigned scale, uint64_t* outFiles, uint64_t* outBytes)
+{
+    Rng rng = { 0x4A2D0Bu };
+    char path[1024];
+
+    snprintf(path, sizeof path, "%s/random.bin", dir);
+    if (!createParentDirectories(path)) return;
+
+    FILE* file = fopen(path, "wb");
+    if (!file) return;
+
+    unsigned char chunk[65536];
+    uint64_t target = 64ull * 1024 * 1024 * scale;
+
+    for (uint64_t written = 0; written < target; written += sizeof chunk)
+    {
+        fillRandom(&rng, chunk, sizeof chunk);
+        fwrite(chunk, 1, sizeof chunk, file);
+    }
+
+    fclose(file);
+    (*outFiles)++;
+    *outBytes += target;
+}
+
+static void generateSparseImages(const char* dir, unsigned scale, uint64_t* outFiles, uint64_t* outBytes)
+{
+    Rng rng = { 0x5BA25Eu };
+    char path[1024];
+    unsigned char chunk[65536];
+
+    uint64_t imageSize = 128ull * 1024 * 1024;
+
+    for (unsigned i = 0; i < 2 * scale; i++)
+    {
+        snprintf(path, sizeof path, "%s/disk%u.img", dir, i);
+        if (!createParentDirectories(path)) return;
+
+        FILE* file = fopen(path, "wb");
+        if (!file) return;
+
+        // A few populated regions, everything else stays a hole
+        for (int region = 0; region < 16; region++)
+        {
+            uint64_t offset = (rngNext(&rng) % (imageSize / sizeof chunk - 16)) * sizeof chunk;
+            fseeko(file, (off_t)offset, SEEK_SET);
+            for (int c = 0; c < 16; c++)
+            {
+                fillRandom(&rng, chunk, sizeof chunk);
+                fwrite(chunk, 1, sizeof chunk, file);
+            }
+        }
+
+        if (ftruncate(fileno(file), (off_t)imageSize) != 0)
+        {
+            fclose(file);
+            return;
+        }
+
+        fclose(file);
+        (*outFiles)++;
+        *outBytes += imageSize;
+    }
+}
+
+static const Corpus CORPORA[] = {
+    { "tiny_text", generateTinyText },
+    { "source_tree", generateSourceTree },
+    { "large_log", generateLargeLog },
+    { "random", generateRandom },
+    { "sparse_images", generateSparseImages },
+};
+
+/* ===== Measurement ===== */
+
+typedef struct Sample
+{
+    uint64_t startNs;
+    long long readSyscalls;
+    long long writeSyscalls;
+} Sample;
+
+static void readSyscallCounts(long long* outRead, long long* outWrite)
+{
+    *outRead = -1;
+    *outWrite = -1;
+
+    FILE* file = fopen("/proc/self/io", "r");
+    if (!file) return;
+
+    char key[64];
+    long long value;
+    while (fscanf(file, "%63[^:]: %lld\n", key, &value) == 2)
+    {
+        if (strcmp(key, "syscr") == 0) *outRead = value;
+        else if (strcmp(key, "syscw") == 0) *outWrite = value;
+    }
+
+    fclose(file);
+}
+
+static long peakRssKb(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+    return usage.ru_maxrss;
+}
+
+static void sampleBegin(Sample* sample)
+{
+    readSyscallCounts(&sample->readSyscalls, &sample->writeSyscalls);
+    sample->startNs = clockNowNs();
+}
+
+static void report(const char* bench, const char* corpus, const Sample* sample, uint64_t files, uint64_t bytes, uint64_t archiveBytes, ArchResult result)
+{
+    double seconds = (double)(clockNowNs() - sample->startNs) / 1e9;
+
+    long long readSyscalls, writeSyscalls;
+    readSyscallCounts(&readSyscalls, &writeSyscalls);
+
+    printf("{\"bench\":\"%s\",\"corpus\":\"%s\",\"result\":\"%s\",\"files\":%llu,\"bytes\":%llu,"
+           "\"archive_bytes\":%llu,\"seconds\":%.6f,\"mb_per_s\":%.2f,\"files_per_s\":%.1f,"
+           "\"peak_rss_kb\":%ld,\"read_syscalls\":%lld,\"write_syscalls\":%lld}\n",
+        bench, corpus, result == ARCH_OK ? "ok" : arch_strerror(result),
+        (unsigned long long)files, (unsigned long long)bytes, (unsigned long long)archiveBytes,
+        seconds,
+        seconds > 0 ? (double)bytes / (1024.0 * 1024.0) / seconds : 0.0,
+        seconds > 0 ? (double)files / seconds : 0.0,
+        peakRssKb(),
+        (readSyscalls >= 0 && sample->readSyscalls >= 0) ? readSyscalls - sample->readSyscalls : -1,
+        (writeSyscalls >= 0 && sample->writeSyscalls >= 0) ? writeSyscalls - sample->writeSyscalls : -1);
+
+    fflush(stdout);
+}
+
+static uint64_t fileSizeOf(const char* path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+/* ===== End-to-end benchmarks ===== */
+
+static void runCorpus(const Corpus* corpus, unsigned scale, unsigned threads)
+{
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    Sample sample;
+    ArchResult r;
+
+    removeTree(corpus->name);
+
+    sampleBegin(&sample);
+    corpus->generate(corpus->name, scale, &files, &bytes);
+    report("generate", corpus->name, &sample, files, bytes, 0, ARCH_OK);
+
+    char archivePath[256];
+    char outputDir[256];
+    snprintf(archivePath, sizeof archivePath, "%s.arch", corpus->name);
+    snprintf(outputDir, sizeof outputDir, "%s.out", corpus->name);
+
+    // create
+    Archive* archive = NULL;
+    sampleBegin(&sample);
+    r = arch_create(archivePath, &archive);
+    if (r == ARCH_OK)
+    {
+        r = arch_addDirectory(archive, corpus->name);
+        arch_close(archive);
+    }
+    uint64_t archiveBytes = fileSizeOf(archivePath);
+    report("create", corpus->name, &sample, files, bytes, archiveBytes, r);
+
+    // list
+    sampleBegin(&sample);
+    r = arch_open(archivePath, &archive);
+    if (r == ARCH_OK)
+    {
+        ArchEntryInfo info;
+        size_t count = arch_getFileCount(archive);
+        for (size_t i = 0; i < count && r == ARCH_OK; i++)
+        {
+            r = arch_nextEntry(archive, &info);
+        }
+        arch_close(archive);
+    }
+    report("list", corpus->name, &sample, files, 0, archiveBytes, r);
+
+    // extract
+    removeTree(outputDir);
+    makeDirs(outputDir);
+    sampleBegin(&sample);
+    r = arch_open(archivePath, &archive);
+    if (r == ARCH_OK)
+    {
+        size_t count = arch_getFileCount(archive);
+        for (size_t i = 0; i < count && r == ARCH_OK; i++)
+        {
+            r = arch_retrieveNextFile(archive, outputDir);
+        }
+        arch_close(archive);
+    }
+    report("extract", corpus->name, &sample, files, bytes, archiveBytes, r);
+    removeTree(outputDir);
+
+    // verify
+    sampleBegin(&sample);
+    r = arch_open(archivePath, &archive);
+    if (r == ARCH_OK)
+    {
+        ArchVerifyReport verifyReport;
+        r = arch_verify(archive, threads, &verifyReport);
+        arch_freeVerifyReport(&verifyReport);
+        arch_close(archive);
+    }
+    report("verify", corpus->name, &sample, files, bytes, archiveBytes, r);
+
+    // acquire, every entry twice through a cache large enough to hold the corpus
+    ArchOpenOptions openOptions;
+    memset(&openOptions, 0, sizeof openOptions);
+    openOptions.cacheBytes = bytes * 2 + 1024 * 1024;
+
+    r = arch_openEx(archivePath, &openOptions, &archive);
+    if (r == ARCH_OK)
+    {
+        static const char* const PASSES[] = { "acquire_cold", "acquire_warm" };
+
+        size_t count = arch_getFileCount(archive);
+        for (size_t pass = 0; pass < COUNT_OF(PASSES); pass++)
+        {
+            sampleBegin(&sample);
+            for (size_t i = 0; i < count && r == ARCH_OK; i++)
+            {
+                const void* data;
+                size_t size;
+
+                r = arch_entryAcquire(archive, i, &data, &size);
+                if (r == ARCH_OK) arch_entryRelease(archive, data);
+            }
+            report(PASSES[pass], corpus->name, &sample, files, bytes, archiveBytes, r);
+        }
+        arch_close(archive);
+    }
+
+    remove(archivePath);
+    removeTree(corpus->name);
+}
+
+/* ===== Microbenchmarks ===== */
+
+static int64_t readMemory(void* context, void* buffer, size_t size)
+{
+    const unsigned char** cursor = context;
+    const unsigned char* end = cursor[1];
+
+    size_t left = (size_t)(end - cursor[0]);
+    if (size > left) size = left;
+
+    memcpy(buffer, cursor[0], size);
+    cursor[0] += size;
+    return (int64_t)size;
+}
+
+static void runMicro(unsigned scale)
+{
+    Sample sample;
+    Rng rng = { 0x3141592u };
+
+    size_t dataSize = 32u * 1024 * 1024 * scale;
+    unsigned char* text = malloc(dataSize);
+    unsigned char* random = malloc(dataSize);
+    if (!text || !random)
+    {
+        free(text);
+        free(random);
+        return;
+    }
+    fillText(&rng, (char*)text, dataSize);
+    fillRandom(&rng, random, dataSize);
+
+    // Header encode / decode
+    size_t headerCount = 200000u * scale;
+    FILE* headerFile = tmpfile();
+    if (headerFile)
+    {
+        FileHeader header;
+        initFileHeader(&header, "some/directory/tree/file_name.txt", 12345, ARCH_FLAG_COMPRESSED);
+
+        sampleBegin(&sample);
+        uint64_t p1, p2, p3;
+        bool ok = true;
+        for (size_t i = 0; i < headerCount && ok; i++)
+        {
+            ok = writeFileHeader(headerFile, &header, "some/directory/tree/file_name.txt", &p1, &p2, &p3);
+        }
+        fflush(headerFile);
+        report("header_encode", "micro", &sample, headerCount, (uint64_t)ftell64(headerFile), 0, ok ? ARCH_OK : ARCH_ERR_IO);
+
+        rewind(headerFile);
+        sampleBegin(&sample);
+        for (size_t i = 0; i < headerCount && ok; i++)
+        {
+            char* name = NULL;
+            ok = readFileHeader(headerFile, &header, &name);
+            memFree(name);
+        }
+        report("header_decode", "micro", &sample, headerCount, (uint64_t)ftell64(headerFile), 0, ok ? ARCH_OK : ARCH_ERR_IO);
+
+        fclose(headerFile);
+    }
+
+    // CRC32
+    sampleBegin(&sample);
+    volatile uLong crc = crc32_z(0L, text, dataSize);
+    (void)crc;
+    report("crc32", "micro", &sample, 1, dataSize, 0, ARCH_OK);
+
+    // sanitizeFilePath
+    static const char* const PATHS[] = {
+        "C:\\Users\\someone\\Documents\\report.docx",
+        "../../etc/passwd",
+        "./relative/path/to/file.txt",
+        "/absolute/path/with/many/components/deep/inside/file.bin",
+        "plain_name"
+    };
+    size_t sanitizeCount = 1000000u * scale;
+    sampleBegin(&sample);
+    for (size_t i = 0; i < sanitizeCount; i++)
+    {
+        memFree(sanitizeFilePath(PATHS[i % COUNT_OF(PATHS)]));
+    }
+    report("sanitize_path", "micro", &sample, sanitizeCount, 0, 0, ARCH_OK);
+
+    // Compression loops, output goes to the null device
+    FILE* sink = fopen("/dev/null", "wb");
+    if (sink)
+    {
+        const struct { const char* name; const unsigned char* data; } inputs[] = {
+            { "text", text },
+            { "random", random }
+        };
+
+        for (size_t i = 0; i < COUNT_OF(inputs); i++)
+        {
+            char name[64];
+            uint64_t origSize, compSize;
+            uint32_t crcU, crcC;
+            bool ok;
+
+            snprintf(name, sizeof name, "compress_buffer_%s", inputs[i].name);
+            sampleBegin(&sample);
+            ok = compressBuffer(inputs[i].data, dataSize, sink, &compSize, &crcU, &crcC);
+            report(name, "micro", &sample, 1, dataSize, compSize, ok ? ARCH_OK : ARCH_ERR_COMPRESSION);
+
+            const unsigned char* cursor[2] = { inputs[i].data, inputs[i].data + dataSize };
+            snprintf(name, sizeof name, "compress_stream_%s", inputs[i].name);
+            sampleBegin(&sample);
+            ok = compressStream(readMemory, cursor, sink, &origSize, &compSize, &crcU, &crcC);
+            report(name, "micro", &sample, 1, dataSize, compSize, ok ? ARCH_OK : ARCH_ERR_COMPRESSION);
+
+            // Decompression needs the compressed bytes, stage them in a temporary file
+            FILE* staged = tmpfile();
+            if (!staged) continue;
+
+            if (compressBuffer(inputs[i].data, dataSize, staged, &compSize, &crcU, &crcC))
+            {
+                rewind(staged);
+                snprintf(name, sizeof name, "decompress_stream_%s", inputs[i].name);
+                sampleBegin(&sample);
+                ArchResult r = decompressStream(staged, compSize, NULL, NULL, &crcU, &crcC);
+                report(name, "micro", &sample, 1, dataSize, compSize, r);
+            }
+
+            fclose(staged);
+        }
+
+        fclose(sink);
+    }
+
+    free(text);
+    free(random);
+}
+
+/* ===== Driver ===== */
+
+static void usage(const char* program)
+{
+    printf("Usage: %s [--dir work_dir] [--scale N] [--threads N] [--only name] [--no-micro] [--no-corpus]\n", program);
+    printf("Corpora:");
+    for (size_t i = 0; i < COUNT_OF(CORPORA); i++) printf(" %s", CORPORA[i].name);
+    printf("\nResults are printed as one JSON object per line.\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* workDir = "arch_bench_work";
+    const char* only = NULL;
+    unsigned scale = 1;
+    unsigned threads = 0;
+    bool micro = true;
+    bool corpora = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) workDir = argv[++i];
+        else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) scale = (unsigned)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = (unsigned)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) only = argv[++i];
+        else if (strcmp(argv[i], "--no-micro") == 0) micro = false;
+        else if (strcmp(argv[i], "--no-corpus") == 0) corpora = false;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (scale == 0) scale = 1;
+
+    if (!makeDirs(workDir) || chdir(workDir) != 0)
+    {
+        fprintf(stderr, "arch_bench: cannot use work directory '%s': %s\n", workDir, strerror(errno));
+        return 1;
+    }
+
+    if (micro && (!only || strcmp(only, "micro") == 0))
+    {
+        runMicro(scale);
+    }
+
+    if (corpora)
+    {
+        for (size_t i = 0; i < COUNT_OF(CORPORA); i++)
+        {
+            if (only && strcmp(only, CORPORA[i].name) != 0) continue;
+            runCorpus(&CORPORA[i], scale, threads);
+        }
+    }
+
+    return 0;
+}
@@ -20,7 +20,8 @@ typedef enum ArchResult
     ARCH_ERR_CORRUPTED,
     ARCH_ERR_OUT_OF_MEMORY,
     ARCH_ERR_COMPRESSION,
-    ARCH_ERR_INTERNAL
+    ARCH_ERR_INTERNAL,
+    ARCH_ERR_CANCELLED
 
 } ArchResult;
 
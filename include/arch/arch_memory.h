@@ -0,0 +1,43 @@
+#ifndef ARCH_MEMORY_H
+#define ARCH_MEMORY_H
+
+#include <arch/arch_errors.h>
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Archive Archive;
+
+/* ===== Memory ===== */
+
+/* Heap for everything the library allocates on behalf of one archive, zlib state included.
+   Both functions may be called from any thread working on the archive; alloc returns NULL on failure
+   and must align like malloc. */
+typedef struct ArchAllocator
+{
+    void* (*alloc)(void* userdata, size_t size);
+    void (*free)(void* userdata, void* ptr);
+    void* userdata;
+} ArchAllocator;
+
+typedef struct ArchMemoryOptions
+{
+    const ArchAllocator* allocator;   // NULL uses malloc / free, the allocator is copied
+    size_t memoryLimit;               // Hard cap in bytes, 0 for none
+} ArchMemoryOptions;
+
+/* Under a cap compression shrinks its window and hash table and I/O buffers shrink down to 4 KiB
+   to fit; a call that still doesn't fit fails with ARCH_ERR_OUT_OF_MEMORY. Archives written with a
+   smaller window read back with less memory as well. */
+
+/* Bytes currently allocated for the archive and the high-water mark since it was opened */
+ArchResult arch_getMemoryUsage(Archive* archive, size_t* outCurrent, size_t* outPeak);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ARCH_MEMORY_H
@@ -0,0 +1,39 @@
+#ifndef ARCH_PROGRESS_H
+#define ARCH_PROGRESS_H
+
+#include <arch/arch_errors.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Archive Archive;
+
+/* ===== Progress reporting and cancellation ===== */
+
+typedef struct ArchProgress
+{
+    uint64_t bytesIn;           // Source files when creating, archive payload when extracting or verifying
+    uint64_t bytesOut;          // Archive payload when creating, extracted data when extracting
+    uint64_t entriesDone;
+    const char* currentEntry;   // NULL between entries, only valid during the callback
+} ArchProgress;
+
+/* Return false to cancel. The running call stops at the next chunk boundary and returns
+   ARCH_ERR_CANCELLED, as does every later call until a callback is registered again. */
+typedef bool (*ArchProgressCallback)(void* userdata, const ArchProgress* progress);
+
+/* Invokes callback at most once per intervalMs from whichever thread is doing the work; totals count
+   from the registration. A created archive that was cancelled still holds every entry completed
+   before the cancel once arch_close returns. Register while no call is running on the archive,
+   a NULL callback turns reporting off. */
+ArchResult arch_setProgressCallback(Archive* archive, ArchProgressCallback callback, void* userdata, uint32_t intervalMs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ARCH_PROGRESS_H
@@ -0,0 +1,50 @@
+#ifndef ARCH_STATS_H
+#define ARCH_STATS_H
+
+#include <arch/arch_errors.h>
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Archive Archive;
+
+/* ===== Runtime statistics ===== */
+
+typedef enum ArchStage
+{
+    ARCH_STAGE_SCAN = 0,   // Directory walking
+    ARCH_STAGE_OPEN,       // Opening input / output files
+    ARCH_STAGE_READ,
+    ARCH_STAGE_COMPRESS,
+    ARCH_STAGE_DECOMPRESS,
+    ARCH_STAGE_CHECKSUM,
+    ARCH_STAGE_WRITE,
+    ARCH_STAGE_PATCH,      // Seeking back to fill in header fields
+    ARCH_STAGE_MKDIR,
+
+    ARCH_STAGE_COUNT
+} ArchStage;
+
+typedef struct ArchStats
+{
+    uint64_t entries;           // Entries added, extracted or verified
+    uint64_t bytesRead;         // Through the payload read loops
+    uint64_t bytesWritten;      // Through the payload write loops
+    uint64_t uncompressedBytes;
+    uint64_t compressedBytes;
+
+    uint64_t stageNs[ARCH_STAGE_COUNT]; // Cumulative over all threads
+} ArchStats;
+
+/* Counters accumulate per thread during each call and are merged into the archive when it returns */
+ArchResult arch_getStats(Archive* archive, ArchStats* outStats);
+const char* arch_stageName(ArchStage stage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ARCH_STATS_H
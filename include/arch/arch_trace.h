@@ -0,0 +1,28 @@
+#ifndef ARCH_TRACE_H
+#define ARCH_TRACE_H
+
+#include <arch/arch_errors.h>
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ===== Timeline tracing ===== */
+
+/* Records a span per entry and per stage (open, read, deflate/inflate chunk, write, header patch) for
+   every thread into per-thread ring buffers holding the last eventsPerThread events. Tracing is
+   process-wide; start, stop and write it while no archive call is running.
+   Returns ARCH_ERR_UNSUPPORTED_VERSION when the library was built without ARCH_ENABLE_TRACE. */
+ArchResult arch_traceStart(size_t eventsPerThread);
+void arch_traceStop(void);
+
+/* Writes the recorded events as Chrome trace JSON, viewable in chrome://tracing or Perfetto */
+ArchResult arch_traceWrite(const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ARCH_TRACE_H
@@ -11,12 +11,23 @@ extern "C" {
 
 #define ARCH_MAGIC 0x48435241u  /* "ARCH" */
 #define ARCH_FILE_MAGIC 0x454C4946u  /* "FILE" */
+#define ARCH_DIRECTORY_MAGIC 0x52494443u  /* "CDIR" */
+#define ARCH_COMPACT_DIRECTORY_MAGIC 0x32524443u  /* "CDR2" */
 
-#define ARCH_VERSION 1
+#define ARCH_VERSION 5              /* Newest version readers accept */
+#define ARCH_VERSION_BASE 1         /* Written unless the archive needs a newer reader */
+#define ARCH_VERSION_LONG_MATCH 2   /* Entries may carry ARCH_FLAG_LONG_MATCH */
+#define ARCH_VERSION_DELTA 3        /* Delta archive, entries may refer to a base archive */
+#define ARCH_VERSION_DELETED 4      /* Updated in place, space of removed entries is held by fillers */
+#define ARCH_VERSION_COMPACT 5      /* 64-bit entry count, compact directory; may use every feature above */
 
 /* ===== Flags ===== */
 
 #define ARCH_FLAG_COMPRESSED 0x01
+#define ARCH_FLAG_LONG_MATCH 0x02   /* Compressed payload refers to spans of earlier entries */
+#define ARCH_FLAG_BASE_REF 0x04     /* Unchanged from the base entry of the same name, no payload */
+#define ARCH_FLAG_BASE_DELTA 0x08   /* With ARCH_FLAG_LONG_MATCH: spans come from base archive entries */
+#define ARCH_FLAG_DELETED 0x10      /* Filler over free space, nameless and never in the directory */
 
 /* ===== Archive Header ===== */
 
@@ -24,9 +35,26 @@ typedef struct ArchiveHeader
 {
     uint32_t magic;
     uint16_t version;
-    uint32_t fileCount;
-    char reserved[20];
-} ArchiveHeader; // 32 bytes
+    uint64_t fileCount;       // u32 on disk before version 5
+    uint64_t directoryOffset; // 0 when there is no directory, readers then walk the file headers
+    uint64_t volumeSize;      // 0 for single-file archives
+    uint32_t baseFingerprint; // Delta archives: identifies the base they apply to, 0 otherwise
+} ArchiveHeader; // 30 bytes on disk, 34 from version 5
+
+/* ===== Directory =====
+
+   Written after the last entry: magic, u64 entry count, one record per entry and a CRC32 of the records.
+   Record: u32 volume, u64 offset of the file header within that volume, u64 origSize, u64 compSize,
+   u32 crc32_uncompressed, u32 crc32_compressed, u8 flags, u16 name length, name.
+
+   Version 5 writes a compact directory instead: magic, u64 entry count, u64 total size of all names
+   (each counted with a terminating NUL), u64 size of the packed records, the records as one deflate
+   stream and a CRC32 of the unpacked records. Numbers are LEB128 varints; a record holds
+   tag (flags << 2 | 1 when crc32_compressed equals crc32_uncompressed | 2 when compSize is 0),
+   length of the prefix shared with the previous name, suffix length, suffix, origSize, compSize unless
+   0, crc32_uncompressed (u32), crc32_compressed (u32) unless equal, and the distance of the file header
+   from the end of the previous entry's payload (zigzag, the first entry counts from the archive header).
+   Offsets are positions in the concatenated volumes. */
 
 /* ===== File Header ===== */
 
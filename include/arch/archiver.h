@@ -2,8 +2,13 @@
 #define ARCHIVER_H
 
 #include <arch/arch_errors.h>
+#include <arch/arch_memory.h>
+#include <arch/arch_progress.h>
+#include <arch/arch_stats.h>
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -11,11 +16,178 @@ extern "C" {
 
 typedef struct Archive Archive;
 
+/* Producer for arch_addStream: fills up to size bytes, returns the count, 0 at end of data or -1 on error */
+typedef int64_t (*ArchReadCallback)(void* userdata, void* buffer, size_t size);
+
+/* Order in which arch_addDirectory adds the files it finds. Entry names are the original paths either way. */
+typedef enum ArchInputOrder
+{
+    ARCH_ORDER_SCAN = 0,    // readdir order, depth first
+    ARCH_ORDER_INODE,       // By device and inode number, approximates on-disk order for small-file trees
+    ARCH_ORDER_PHYSICAL,    // By the device offset of each file's first extent (Linux FIEMAP), inode order where unknown
+    ARCH_ORDER_TYPE         // By extension, then size, so similar content ends up next to each other
+} ArchInputOrder;
+
+/* How files added from disk are read and the archive is written, for jobs that shouldn't push everything
+   else out of the page cache. The hints need Linux, elsewhere every mode behaves like buffered. */
+typedef enum ArchIoMode
+{
+    ARCH_IO_BUFFERED = 0,   // Plain buffered I/O, what was read and written stays cached
+    ARCH_IO_STREAMING,      // Inputs read ahead (fadvise SEQUENTIAL, WILLNEED) and dropped once consumed
+                            // (DONTNEED); the archive written back as it grows (sync_file_range) and dropped
+    ARCH_IO_DIRECT          // As streaming, but inputs are read with O_DIRECT where the file system allows
+} ArchIoMode;
+
+typedef struct ArchCreateOptions
+{
+    /* Split into path.001, path.002, ... of at most this many bytes each, 0 writes a single file.
+       Entries may span volumes, the directory at the end locates each one by volume and offset. */
+    uint64_t volumeSize;
+
+    ArchMemoryOptions memory;
+
+    /* A directory tree is scanned completely before the first file is added, then sorted.
+       On spinning disks inode or physical order can read small-file trees several times faster. */
+    ArchInputOrder inputOrder;
+
+    /* Window of a long-range match finder ahead of deflate, 0 for none. Spans of at least 256 bytes
+       repeated anywhere in the last longMatchWindow bytes (rounded down to a power of two, 8 MiB minimum)
+       of earlier entries are stored as references instead of being compressed again. Costs the window
+       plus an eighth of it in memory while writing. Entries still read independently: a reference only
+       ever points at an entry without references of its own. Such archives need a version 2 reader. */
+    uint64_t longMatchWindow;
+
+    /* Writes a 64-bit entry count and the compact directory: varint fields, each name stored as the
+       suffix it doesn't share with the previous one, all of it deflated. For trees of many small files
+       the directory shrinks several times over and opens that much faster. Such archives need a
+       version 5 reader. */
+    bool compactMetadata;
+
+    /* Stores entries uncompressed, each payload starting at a multiple of this many bytes (a power of
+       two up to 1 GiB, e.g. 4096 for pages or 2 MiB for huge pages), 0 compresses as usual. The gap in
+       front of a header is covered by a filler like those of removed entries, sparse where the file
+       system allows, so payloads can be used in place through arch_mapEntry. Can't be combined with
+       volumeSize or longMatchWindow. Such archives need a version 4 reader. */
+    uint64_t storeAlignment;
+
+    /* Applies to arch_addFile and arch_addDirectory inputs and to the archive itself. Streaming and
+       direct mode keep at most a few windows of 8 MiB of either in the page cache, so a large job leaves
+       co-located services their cache; arch_close then waits for the archive to reach the disk. */
+    ArchIoMode ioMode;
+} ArchCreateOptions;
+
 ArchResult arch_create(const char* path, Archive** outArchive);
+
+/* options may be NULL, zeroed fields keep the defaults of arch_create.
+   Split archives need fopencookie and return ARCH_ERR_UNSUPPORTED_VERSION on other platforms. */
+ArchResult arch_createEx(const char* path, const ArchCreateOptions* options, Archive** outArchive);
 ArchResult arch_addFile(Archive* archive, const char* path);
+
+/* Adds count files in order, as arch_addFile would one by one, with a thread opening the next few ahead
+   (statx for size and type, then a readahead of the first MiB) while the current one is compressed. On
+   network file systems that hides most of the per-file open and stat latency of small-file trees.
+   A file that can't be added is reported and skipped; the result is that of the last failure, and a
+   cancel stops the rest. arch_addDirectory goes this way too. */
+ArchResult arch_addFiles(Archive* archive, const char* const* paths, size_t count);
+
+/* Adds an entry from memory, data is compressed (or stored) straight from the caller's buffer */
+ArchResult arch_addBuffer(Archive* archive, const char* name, const void* data, size_t size);
+
+/* Adds an entry of possibly unknown length; sizeHint may be 0, the actual size is recorded at the end */
+ArchResult arch_addStream(Archive* archive, const char* name, ArchReadCallback readCallback, void* userdata, uint64_t sizeHint);
 ArchResult arch_addDirectory(Archive* archive, const char* path);
 void arch_close(Archive* archive);
 
+/* ===== Updating in place ===== */
+
+/* Opens an existing archive to remove, replace and add entries without rewriting the rest. Removed
+   entries leave free space that later additions reuse (best fit, an entry is moved there once its
+   compressed size is known), so an update costs about the bytes it changes. The directory is written
+   on arch_close. Of options only memory and inputOrder apply, the others must be 0.
+   Split archives, deltas and archives with long-range matches can't be updated in place
+   (ARCH_ERR_UNSUPPORTED_VERSION). Once free space is left, the archive needs a version 4 reader.
+
+   Crashes: opening drops the header's pointer to the directory (marking it version 4) and syncs that,
+   so until arch_close writes the new directory readers walk the entry headers instead, and every call
+   that returns leaves those in step with the entry count in the header. A process killed between calls
+   leaves an archive holding exactly the entries of the calls that completed; killed while adding, the
+   new entry is simply missing. Killed while an entry is being removed (by arch_removeEntry or at the end
+   of arch_replaceEntry) or moved by arch_compact, the headers may not walk and the archive reads as
+   corrupted; so may anything after power loss, as only arch_close syncs (before pointing the header at
+   the new directory). */
+ArchResult arch_openForUpdate(const char* path, const ArchCreateOptions* options, Archive** outArchive);
+
+/* Removes the first entry of that name. Its space is covered by a filler that readers step over, and
+   given back to the file system with fallocate(PUNCH_HOLE) where available; at the end of the archive
+   the file is simply cut short on close. */
+ArchResult arch_removeEntry(Archive* archive, const char* name);
+
+/* Stores the file at path as the new content of the entry name. The old version is only removed once the
+   new one is complete, and its space is reused for it where it fits. */
+ArchResult arch_replaceEntry(Archive* archive, const char* name, const char* path);
+
+/* Slides all entries down over the free space with large sequential copies and truncates the file, for
+   archives where removals left many holes. Not crash safe while an entry is being moved, whose copy may
+   overwrite its own old header; between moves the headers walk, see arch_openForUpdate. */
+ArchResult arch_compact(Archive* archive);
+
+/* ===== Delta archives ===== */
+
+/* Archives newDir as a delta against baseArchive, so its size follows what changed rather than the size
+   of the tree. Files with the same name and content as a base entry (compared byte for byte with the
+   decoded entry, a matching CRC32 isn't taken for it) are stored as references to it without payload;
+   a changed file is encoded with long-range matches against its base entry (and whatever else is in
+   the window), new files are compressed as usual. options may be NULL; their
+   longMatchWindow bounds how much of each base entry is matched against and defaults to 64 MiB.
+   The base must be a full archive, not a delta itself, and outPath must not name it however it is
+   spelled (ARCH_ERR_INVALID_ARGUMENT). The delta is written under a temporary name next to outPath and
+   only renamed over it once complete, so a failure, including a file that couldn't be added, leaves
+   outPath as it was. Delta archives need a version 3 reader. */
+ArchResult arch_createDelta(const char* newDir, const char* baseArchive, const char* outPath, const ArchCreateOptions* options);
+
+/* Rebuilds the full archive at outPath from a delta and the base it was made against. Entries the
+   delta stored itself and unchanged base entries are copied without recompressing where they decode on
+   their own, the rest is decoded and compressed again. outPath must name neither input and is only
+   replaced once the archive is complete, as with arch_createDelta. Deltas can also be read and
+   extracted directly, see ArchOpenOptions.baseArchive. */
+ArchResult arch_applyDelta(const char* deltaPath, const char* baseArchive, const char* outPath);
+
+/* ===== Merging ===== */
+
+/* What arch_merge does with names that occur more than once across its inputs (or within one) */
+typedef enum ArchMergeConflict
+{
+    ARCH_MERGE_KEEP_ALL = 0,    // Keep every copy in input order, arch_entryOpen finds the first
+    ARCH_MERGE_KEEP_FIRST,      // Keep the copy from the earliest input
+    ARCH_MERGE_KEEP_LAST,       // Keep the copy from the latest input, newer snapshots replace older ones
+    ARCH_MERGE_FAIL             // Fail with ARCH_ERR_INVALID_ARGUMENT before anything is written
+} ArchMergeConflict;
+
+/* Writes the entries of all inputs, in order, to a new archive without recompressing them. Headers and
+   compressed payloads are copied as stored, in the kernel (copy_file_range) where the platform and file
+   systems allow, and the directory is rebuilt; payloads aren't inflated on the way, arch_verify checks
+   them. Entries with long-range matches are decoded and compressed again since their references don't
+   carry over. Delta archives are rejected with ARCH_ERR_INVALID_ARGUMENT, apply them first, and so is
+   an outPath naming one of the inputs, however it is spelled. The output is written under a temporary
+   name next to outPath and only renamed over it once complete, a failed merge leaves outPath as it was. */
+ArchResult arch_merge(const char* outPath, const char* const* inputs, size_t inputCount, ArchMergeConflict conflictPolicy);
+
+/* Told about a name that occurs copies times across the inputs, before anything is written */
+typedef void (*ArchMergeConflictCallback)(void* userdata, const char* name, size_t copies);
+
+typedef struct ArchMergeOptions
+{
+    ArchMergeConflict conflictPolicy;
+
+    /* Called once for every name found more than once, under any policy; with ARCH_MERGE_FAIL that
+       lists every conflict behind the ARCH_ERR_INVALID_ARGUMENT. May be NULL. */
+    ArchMergeConflictCallback conflictCallback;
+    void* userdata;
+} ArchMergeOptions;
+
+/* arch_merge with a conflict callback, options may be NULL */
+ArchResult arch_mergeEx(const char* outPath, const char* const* inputs, size_t inputCount, const ArchMergeOptions* options);
+
 #ifdef __cplusplus
 }
 #endif
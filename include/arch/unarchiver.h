@@ -2,22 +2,219 @@
 #define UNARCHIVER_H
 
 #include <arch/arch_errors.h>
+#include <arch/arch_memory.h>
+#include <arch/arch_progress.h>
+#include <arch/arch_stats.h>
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct Archive Archive;
+typedef struct ArchEntryReader ArchEntryReader;
+
+typedef struct ArchEntryInfo
+{
+    const char* name; // Owned by the archive, valid until the cursor moves to another entry
+    uint64_t origSize;
+    uint64_t compSize;
+    uint32_t crc32_uncompressed;
+    uint32_t crc32_compressed;
+    uint8_t flags;
+} ArchEntryInfo;
+
+typedef struct ArchOpenOptions
+{
+    ArchMemoryOptions memory;
+
+    /* Base archive of a delta archive (see arch_createDelta), opened along with it so entries can be read
+       and extracted directly. Rejected with ARCH_ERR_INVALID_ARGUMENT unless it is the base the delta was
+       made against; ignored for other archives. Without it a delta can be listed, but entries that refer
+       to the base fail to read with ARCH_ERR_INVALID_ARGUMENT. */
+    const char* baseArchive;
+
+    /* Byte budget of the decompressed-entry cache behind arch_entryAcquire, 0 for none. It is split over
+       16 shards by entry offset, each with its own lock, evicting its least recently used entries; an
+       entry larger than a shard's sixteenth of the budget is never cached. Counts against memory. */
+    uint64_t cacheBytes;
+} ArchOpenOptions;
 
 ArchResult arch_open(const char* path, Archive** outArchive);
+
+/* options may be NULL, which is the same as arch_open */
+ArchResult arch_openEx(const char* path, const ArchOpenOptions* options, Archive** outArchive);
 ArchResult arch_retrieveNextFile(Archive* archive, const char* output_dir);
+
+/* Reads only the next entry header, leaving its payload for arch_retrieveNextFile or arch_skipEntry.
+   Calling it again skips the payload of the previously returned entry. */
+ArchResult arch_nextEntry(Archive* archive, ArchEntryInfo* outInfo);
+ArchResult arch_skipEntry(Archive* archive);
+
+/* Extracts, from the start of the archive, every entry matching at least one of the glob / path prefix
+   patterns (see arch_cli -x). Payloads of non-matching entries are skipped without being inflated. */
+ArchResult arch_extractMatching(Archive* archive, const char* output_dir, const char* const* patterns, size_t patternCount);
 void arch_close(Archive* archive);
 
 size_t arch_getFileCount(Archive* archive);
 
+/* Header fields of the entry at index (0-based, archive order) as the directory has them, without
+   touching the entry itself or the sequential cursor; here the name stays valid until arch_close.
+   The directory is loaded on first use, archives without one have their headers walked once.
+   Thread-safe like arch_entryOpenIndex. */
+ArchResult arch_getEntryInfo(Archive* archive, size_t index, ArchEntryInfo* outInfo);
+
+/* ===== Directory queries ===== */
+
+/* Entry names are '/'-separated paths; directories exist only as prefixes of them. Both queries go
+   through a name index built on first use and kept until arch_close: the entries sorted by name and a
+   hash table of names, about 24 to 40 MB per million entries on 64-bit platforms on top of the
+   directory itself. A lookup is O(1), a listing O(log n) per child. Thread-safe like
+   arch_entryOpen, which finds entries through the same index. */
+
+typedef struct ArchDirEntry
+{
+    const char* name;       // Listing: the child name, no leading path. Stat: the entry name, NULL for directories
+    bool isDirectory;
+    size_t index;           // Files: entry index for arch_getEntryInfo and arch_entryOpenIndex, SIZE_MAX otherwise
+    ArchEntryInfo info;     // Files only, zeroed for directories
+} ArchDirEntry;
+
+/* Receives one child of the listed directory, entry is only valid during the call. Return false to stop. */
+typedef bool (*ArchListCallback)(void* userdata, const ArchDirEntry* entry);
+
+/* Calls back once per immediate child of directory ("" or NULL for the top level, a trailing '/' is
+   optional) in name order: files directly inside it and subdirectories, each reported once however
+   many entries lie below it. A name held by several entries is reported for the first of them, a name
+   that is both a file and a directory is reported as both. An empty or missing directory lists nothing. */
+ArchResult arch_listDir(Archive* archive, const char* directory, ArchListCallback callback, void* userdata);
+
+/* Looks up path as a file (the first entry of that name) or else as a directory; with a trailing '/'
+   only as a directory, "" is the top level. ARCH_ERR_INVALID_ARGUMENT when it is neither. */
+ArchResult arch_stat(Archive* archive, const char* path, ArchDirEntry* outEntry);
+
+/* ===== In-process entry reading ===== */
+
+/* Readers stream the entry straight out of the archive without temporary files. The archive must stay
+   open until all its readers are closed.
+
+   Thread safety: once opened, an archive can be shared by any number of threads calling arch_entryOpen,
+   arch_entryOpenIndex, arch_readRange, arch_verify and arch_extractAll at the same time. Each reader is
+   a private cursor doing positional reads on descriptors the archive opened once (Linux; elsewhere each
+   reader reopens the file), so payload reads take no shared lock. A single reader is not thread-safe.
+   The sequential cursor (arch_nextEntry, arch_retrieveNextFile, arch_skipEntry, arch_extractMatching)
+   belongs to one thread at a time, and an index is attached before readers are shared. */
+ArchResult arch_entryOpen(Archive* archive, const char* name, ArchEntryReader** outReader);
+ArchResult arch_entryOpenIndex(Archive* archive, size_t index, ArchEntryReader** outReader);
+
+/* The CRC32 of the entry is verified once its end is reached by reading, ARCH_ERR_CORRUPTED is returned on mismatch */
+ArchResult arch_entryRead(ArchEntryReader* reader, void* buffer, size_t size, size_t* outBytesRead);
+
+/* whence is SEEK_SET, SEEK_CUR or SEEK_END. Seeks in compressed entries resume at the closest access
+   point when an index is attached (see arch_buildAccessIndex), otherwise forward seeks inflate and
+   discard and backward seeks restart inflating from the start of the entry. */
+ArchResult arch_entrySeek(ArchEntryReader* reader, int64_t offset, int whence);
+uint64_t arch_entryTell(const ArchEntryReader* reader);
+uint64_t arch_entrySize(const ArchEntryReader* reader);
+void arch_entryClose(ArchEntryReader* reader);
+
+/* ===== Decompressed entry cache ===== */
+
+typedef struct ArchCacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+    uint64_t entries;   // Held now
+    uint64_t bytes;     // Held now, within ArchOpenOptions.cacheBytes
+} ArchCacheStats;
+
+/* Borrows the whole decompressed content of entry index. With a cache (ArchOpenOptions.cacheBytes) a hit
+   is served from memory without a copy; a miss inflates the entry once, checks both CRC32s and caches it
+   for the next caller. Without one, or for entries too large to cache, the content is inflated into a
+   buffer of its own. *outData stays valid, even if the entry is evicted meanwhile, until it is handed
+   to arch_entryRelease, which must happen before arch_close. Thread-safe like arch_entryOpen. */
+ArchResult arch_entryAcquire(Archive* archive, size_t index, const void** outData, size_t* outSize);
+void arch_entryRelease(Archive* archive, const void* data);
+
+/* Counters since open, ARCH_ERR_INVALID_ARGUMENT for archives opened without a cache */
+ArchResult arch_getCacheStats(Archive* archive, ArchCacheStats* outStats);
+
+/* ===== Zero-copy access to stored entries ===== */
+
+/* Points *outData at the payload of the entry called name inside a read-only shared mapping of the
+   archive, made on the first call and kept until arch_close, so the bytes come straight from the page
+   cache without a copy of their own. Only for entries stored uncompressed (see
+   ArchCreateOptions.storeAlignment, which also makes *outData aligned) in a single-file archive: others
+   fail with ARCH_ERR_INVALID_ARGUMENT, split archives with ARCH_ERR_UNSUPPORTED_VERSION and archives
+   that can't be mapped (no mmap on the platform) with ARCH_ERR_IO. The bytes aren't checked against
+   the CRC32, arch_verify does that. Thread-safe like arch_entryOpen. */
+ArchResult arch_mapEntry(Archive* archive, const char* name, const void** outData, size_t* outSize);
+
+/* ===== Random access inside compressed entries ===== */
+
+/* Inflates every compressed entry once and records an access point (bit offset plus the 32 KiB
+   dictionary) about every spanBytes of output into the sidecar file indexPath (NULL = "<archive>.zidx").
+   The archive format is unchanged. Points take ~40 bytes of memory each, dictionaries stay on disk.
+   Entries with ARCH_FLAG_LONG_MATCH get no points, seeks in them decode forward from the start. */
+ArchResult arch_buildAccessIndex(Archive* archive, uint64_t spanBytes, const char* indexPath);
+
+/* Attaches an index built earlier for this archive, ARCH_ERR_INVALID_ARGUMENT if it belongs to another */
+ArchResult arch_loadAccessIndex(Archive* archive, const char* indexPath);
+
+/* Reads up to length bytes of entry entryIndex from offset, short only at the end of the entry.
+   With an index attached this inflates at most spanBytes before the range instead of all of it.
+   Entry readers opened after the index is attached seek through the same points. */
+ArchResult arch_readRange(Archive* archive, size_t entryIndex, uint64_t offset, void* buffer, size_t length, size_t* outBytesRead);
+
+/* ===== Parallel extraction ===== */
+
+/* Extracts every entry using threadCount threads (0 = one per CPU), independent of the read cursor.
+   Split archives are handed out a volume at a time so each volume file is read sequentially by one
+   thread, which lets volumes on different disks stream in parallel. Damaged entries don't stop the
+   others, the first error is returned. */
+ArchResult arch_extractAll(Archive* archive, const char* output_dir, unsigned threadCount);
+
+/* ===== Integrity verification ===== */
+
+typedef struct ArchVerifyEntry
+{
+    const char* name; // Owned by the archive
+    ArchResult result;
+    uint64_t origSize;
+    uint64_t compSize;
+} ArchVerifyEntry;
+
+typedef struct ArchVerifyReport
+{
+    ArchVerifyEntry* entries; // One per entry, in archive order
+    size_t entryCount;
+    size_t failedCount;
+
+    uint64_t bytesRead;     // Payload bytes read from the archive
+    uint64_t bytesVerified; // Uncompressed bytes checked
+    double seconds;
+    double throughputMBps;  // Uncompressed MB/s
+} ArchVerifyReport;
+
+/* Inflates every entry into a discarding sink and checks both CRC32s, nothing is written.
+   Entries are spread over threadCount threads (0 = one per CPU). Returns ARCH_ERR_CORRUPTED
+   when any entry failed, or ARCH_ERR_CANCELLED (unchecked entries report it too, without counting as
+   failed) when the progress callback stopped it. The report is filled either way and released with
+   arch_freeVerifyReport. */
+ArchResult arch_verify(Archive* archive, unsigned threadCount, ArchVerifyReport* outReport);
+void arch_freeVerifyReport(ArchVerifyReport* report);
+
+#ifdef __linux__
+/* Wraps the reader in a read-only FILE* (fopencookie). The FILE* takes ownership, fclose closes the reader. */
+FILE* arch_entryFopen(ArchEntryReader* reader);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
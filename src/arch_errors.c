@@ -31,6 +31,9 @@ const char* arch_strerror(ArchResult err)
         case ARCH_ERR_INTERNAL:
             return "Internal library error";
 
+        case ARCH_ERR_CANCELLED:
+            return "Operation cancelled";
+
         default:
             return "Unknown archiver error";
     }
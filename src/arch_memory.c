@@ -0,0 +1,16 @@
+#include <arch/arch_memory.h>
+
+#include "core/archive.h"
+
+ArchResult arch_getMemoryUsage(Archive* archive, size_t* outCurrent, size_t* outPeak)
+{
+    if (!archive || !outCurrent || !outPeak)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    mutexLock(&archive->memory.lock);
+    *outCurrent = archive->memory.used;
+    *outPeak = archive->memory.peak;
+    mutexUnlock(&archive->memory.lock);
+
+    return ARCH_OK;
+}
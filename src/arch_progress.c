@@ -0,0 +1,12 @@
+#include <arch/arch_progress.h>
+
+#include "core/archive.h"
+
+ArchResult arch_setProgressCallback(Archive* archive, ArchProgressCallback callback, void* userdata, uint32_t intervalMs)
+{
+    if (!archive)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    progressSetCallback(&archive->progress, callback, userdata, intervalMs);
+    return ARCH_OK;
+}
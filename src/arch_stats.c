@@ -0,0 +1,51 @@
+#include <arch/arch_stats.h>
+
+#include "core/archive.h"
+
+ArchResult arch_getStats(Archive* archive, ArchStats* outStats)
+{
+    if (!archive || !outStats)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    mutexLock(&archive->statsLock);
+    *outStats = archive->stats;
+    mutexUnlock(&archive->statsLock);
+
+    return ARCH_OK;
+}
+
+const char* arch_stageName(ArchStage stage)
+{
+    switch (stage)
+    {
+        case ARCH_STAGE_SCAN:
+            return "scan";
+
+        case ARCH_STAGE_OPEN:
+            return "open";
+
+        case ARCH_STAGE_READ:
+            return "read";
+
+        case ARCH_STAGE_COMPRESS:
+            return "compress";
+
+        case ARCH_STAGE_DECOMPRESS:
+            return "decompress";
+
+        case ARCH_STAGE_CHECKSUM:
+            return "checksum";
+
+        case ARCH_STAGE_WRITE:
+            return "write";
+
+        case ARCH_STAGE_PATCH:
+            return "patch";
+
+        case ARCH_STAGE_MKDIR:
+            return "mkdir";
+
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,216 @@
+#include <arch/arch_trace.h>
+
+#include "util/trace.h"
+
+#ifdef ARCH_ENABLE_TRACE
+
+#include "util/thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_NAME_SIZE 44
+
+typedef struct TraceEvent
+{
+    uint64_t startNs;
+    uint64_t endNs;
+    const char* category;
+    char name[TRACE_NAME_SIZE];
+} TraceEvent; // 64 bytes
+
+// Written only by its owning thread, readers look at it once tracing is stopped
+typedef struct TraceBuffer
+{
+    TraceEvent* events;
+    size_t capacity;
+    uint64_t written;
+    unsigned threadId;
+    struct TraceBuffer* next;
+} TraceBuffer;
+
+bool traceEnabled = false;
+
+static Mutex registryLock;
+static bool registryReady = false;
+static TraceBuffer* buffers = NULL;
+static size_t eventsPerBuffer = 0;
+static unsigned nextThreadId = 1;
+static unsigned generation = 0;
+static uint64_t originNs = 0;
+
+static ARCH_THREAD_LOCAL TraceBuffer* threadBuffer = NULL;
+static ARCH_THREAD_LOCAL unsigned threadGeneration = 0;
+
+// Buffers belong to the process-wide recorder and outlive any archive, they come from the C heap
+static TraceBuffer* registerThreadBuffer(void)
+{
+    TraceBuffer* buffer = calloc(1, sizeof *buffer);
+    if (!buffer) return NULL;
+
+    mutexLock(&registryLock);
+
+    buffer->capacity = eventsPerBuffer;
+    buffer->events = malloc(buffer->capacity * sizeof *buffer->events);
+    if (!buffer->events)
+    {
+        mutexUnlock(&registryLock);
+        free(buffer);
+        return NULL;
+    }
+
+    buffer->threadId = nextThreadId++;
+    buffer->next = buffers;
+    buffers = buffer;
+
+    threadGeneration = generation;
+
+    mutexUnlock(&registryLock);
+    return buffer;
+}
+
+static void freeBuffers(void)
+{
+    while (buffers)
+    {
+        TraceBuffer* next = buffers->next;
+        free(buffers->events);
+        free(buffers);
+        buffers = next;
+    }
+}
+
+void traceSpan(const char* category, const char* name, uint64_t startNs)
+{
+    uint64_t endNs = clockNowNs();
+
+    if (!threadBuffer || threadGeneration != generation)
+    {
+        threadBuffer = registerThreadBuffer();
+        if (!threadBuffer) return;
+    }
+
+    TraceEvent* event = &threadBuffer->events[threadBuffer->written % threadBuffer->capacity];
+    event->startNs = startNs;
+    event->endNs = endNs;
+    event->category = category;
+
+    size_t len = name ? strlen(name) : 0;
+    if (len >= TRACE_NAME_SIZE)
+    {
+        // Keep the tail, it is the distinctive part of a path
+        name += len - (TRACE_NAME_SIZE - 1);
+        len = TRACE_NAME_SIZE - 1;
+    }
+    if (len > 0) memcpy(event->name, name, len);
+    event->name[len] = '\0';
+
+    threadBuffer->written++;
+}
+
+ArchResult arch_traceStart(size_t eventsPerThread)
+{
+    if (eventsPerThread == 0)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    if (!registryReady)
+    {
+        if (!mutexInit(&registryLock)) return ARCH_ERR_INTERNAL;
+        registryReady = true;
+    }
+
+    mutexLock(&registryLock);
+    freeBuffers();
+    eventsPerBuffer = eventsPerThread;
+    nextThreadId = 1;
+    generation++;
+    originNs = clockNowNs();
+    mutexUnlock(&registryLock);
+
+    traceEnabled = true;
+    return ARCH_OK;
+}
+
+void arch_traceStop(void)
+{
+    traceEnabled = false;
+}
+
+static void writeJsonString(FILE* file, const char* s)
+{
+    fputc('"', file);
+    for (; *s; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(file, "\\%c", c);
+        else if (c < 0x20) fprintf(file, "\\u%04x", c);
+        else fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+ArchResult arch_traceWrite(const char* path)
+{
+    if (!path)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    if (!registryReady)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return ARCH_ERR_IO;
+
+    mutexLock(&registryLock);
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    bool first = true;
+    for (const TraceBuffer* buffer = buffers; buffer; buffer = buffer->next)
+    {
+        fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"arch-%u\"}}",
+            first ? "" : ",", buffer->threadId, buffer->threadId);
+        first = false;
+
+        // Oldest surviving event first
+        uint64_t count = buffer->written < buffer->capacity ? buffer->written : buffer->capacity;
+        for (uint64_t i = buffer->written - count; i < buffer->written; i++)
+        {
+            const TraceEvent* event = &buffer->events[i % buffer->capacity];
+
+            fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"cat\":\"%s\",\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+                buffer->threadId, event->category,
+                (double)(event->startNs - originNs) / 1000.0,
+                (double)(event->endNs - event->startNs) / 1000.0);
+            writeJsonString(file, event->name);
+            fputc('}', file);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+
+    mutexUnlock(&registryLock);
+
+    return (fclose(file) == 0) ? ARCH_OK : ARCH_ERR_IO;
+}
+
+#else
+
+ArchResult arch_traceStart(size_t eventsPerThread)
+{
+    (void)eventsPerThread;
+    return ARCH_ERR_UNSUPPORTED_VERSION;
+}
+
+void arch_traceStop(void)
+{
+}
+
+ArchResult arch_traceWrite(const char* path)
+{
+    (void)path;
+    return ARCH_ERR_UNSUPPORTED_VERSION;
+}
+
+#endif
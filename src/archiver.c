@@ -1,29 +1,104 @@
 #include <arch/archiver.h>
+#include <arch/unarchiver.h>
 
 #include "core/archive.h"
 #include "core/archive_header.h"
 #include "core/file_header.h"
 #include "util/file.h"
+#include "util/file_list.h"
+#include "util/open_ahead.h"
+#include "util/pipeline.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+#define MAX_STORE_ALIGNMENT (1u << 30)
 
 ArchResult arch_create(const char *path, Archive** outArchive)
 {
-    if (!path || !outArchive)
+    return arch_createEx(path, NULL, outArchive);
+}
+
+// A non-zero baseFingerprint makes it a delta archive against the base with that fingerprint
+static ArchResult createArchiveFile(const char* path, const ArchCreateOptions* options, uint32_t baseFingerprint, Archive** outArchive)
+{
+    const ArchMemoryOptions* memoryOptions = options ? &options->memory : NULL;
+
+    if (!path || !outArchive || !memoryOptionsValid(memoryOptions))
         return ARCH_ERR_INVALID_ARGUMENT;
 
     *outArchive = NULL;
 
-    Archive* archive = createArchive(path, "wb+");
+    uint64_t volumeSize = options ? options->volumeSize : 0;
+    ArchInputOrder inputOrder = options ? options->inputOrder : ARCH_ORDER_SCAN;
+    uint64_t storeAlignment = options ? options->storeAlignment : 0;
+    ArchIoMode ioMode = options ? options->ioMode : ARCH_IO_BUFFERED;
+
+    if (inputOrder < ARCH_ORDER_SCAN || inputOrder > ARCH_ORDER_TYPE ||
+        ioMode < ARCH_IO_BUFFERED || ioMode > ARCH_IO_DIRECT)
+    {
+        return ARCH_ERR_INVALID_ARGUMENT;
+    }
+
+    // Aligned payloads are only of use in one file, and long matches only exist in compressed entries
+    if (storeAlignment != 0 &&
+        ((storeAlignment & (storeAlignment - 1)) != 0 || storeAlignment > MAX_STORE_ALIGNMENT ||
+         volumeSize != 0 || options->longMatchWindow != 0))
+    {
+        return ARCH_ERR_INVALID_ARGUMENT;
+    }
+
+#ifndef HAVE_SPLIT_VOLUMES
+    if (volumeSize != 0)
+        return ARCH_ERR_UNSUPPORTED_VERSION;
+#endif
+
+    Archive* archive = volumeSize ? createSplitArchive(path, volumeSize, false, memoryOptions) : createArchive(path, "wb+", memoryOptions);
     if (!archive)
         return ARCH_ERR_IO;
 
+    MemoryScope scope;
+    memoryScopeEnter(&scope, &archive->memory);
+    archive->newEntries = memCalloc(1, sizeof *archive->newEntries);
+    memoryScopeLeave(&scope);
+
+    if (!archive->newEntries)
+    {
+        freeArchive(archive);
+        return ARCH_ERR_OUT_OF_MEMORY;
+    }
+
+    archive->inputOrder = inputOrder;
+    archive->storeAlignment = storeAlignment;
+    archive->ioMode = ioMode;
+    initWriteBehind(&archive->writeBehind, archive->file, ioMode);
+
+    if (options && options->longMatchWindow)
+    {
+        memoryScopeEnter(&scope, &archive->memory);
+        archive->longMatcher = longMatcherCreate(options->longMatchWindow);
+        memoryScopeLeave(&scope);
+
+        if (!archive->longMatcher)
+        {
+            freeArchive(archive);
+            return ARCH_ERR_OUT_OF_MEMORY;
+        }
+    }
+
     ArchiveHeader header;
     if (!createArchiveHeader(&header))
     {
         freeArchive(archive);
         return ARCH_ERR_INTERNAL;
     }
+    header.volumeSize = volumeSize;
+    header.baseFingerprint = baseFingerprint;
+    if (options && options->compactMetadata) header.version = ARCH_VERSION_COMPACT;
+    else if (baseFingerprint) header.version = ARCH_VERSION_DELTA;
+    else if (archive->longMatcher) header.version = ARCH_VERSION_LONG_MATCH;
+    else if (storeAlignment) header.version = ARCH_VERSION_DELETED;
+    archive->version = header.version;
 
     if (!writeArchiveHeader(archive->file, &header))
     {
@@ -35,21 +110,219 @@ ArchResult arch_create(const char *path, Archive** outArchive)
     return ARCH_OK;
 }
 
-ArchResult arch_addFile(Archive* archive, const char* path)
+ArchResult arch_createEx(const char* path, const ArchCreateOptions* options, Archive** outArchive)
+{
+    return createArchiveFile(path, options, 0, outArchive);
+}
+
+typedef struct PendingEntry
+{
+    FileHeader header;
+    int64_t headerPos;  // -1 until the header is written
+    uint64_t padding;   // Filler written in front of the header to align a stored payload
+    uint64_t compSizePos;
+    uint64_t crcUncompressedPos;
+    uint64_t crcCompressedPos;
+} PendingEntry;
+
+// Flags new entries start out with, compressed unless the archive stores them aligned
+static uint8_t getNewEntryFlags(const Archive* archive)
+{
+    return archive->storeAlignment ? 0 : ARCH_FLAG_COMPRESSED;
+}
+
+// Moves the header of a stored entry down behind a filler, so its payload starts at a multiple of the
+// alignment. The filler's own payload is skipped rather than written, a hole where the file system allows.
+static bool padStoredEntry(Archive* archive, PendingEntry* entry)
+{
+    uint64_t alignment = archive->storeAlignment;
+    if (!alignment || (entry->header.flags & ARCH_FLAG_COMPRESSED)) return true;
+
+    uint64_t dataOffset = (uint64_t)entry->headerPos + FILE_HEADER_SIZE + entry->header.nameLength;
+    uint64_t gap = (alignment - dataOffset % alignment) % alignment;
+    if (gap == 0) return true;
+
+    // Too small for the filler's header, skip to the next boundary
+    while (gap < FILE_HEADER_SIZE) gap += alignment;
+
+    FileHeader filler;
+    uint64_t compSizePos, crcUncompressedPos, crcCompressedPos;
+
+    if (!initFileHeader(&filler, "", gap - FILE_HEADER_SIZE, ARCH_FLAG_DELETED) ||
+        !writeFileHeader(archive->file, &filler, "", &compSizePos, &crcUncompressedPos, &crcCompressedPos) ||
+        fseek64(archive->file, (int64_t)(gap - FILE_HEADER_SIZE), SEEK_CUR) != 0)
+    {
+        return false;
+    }
+
+    entry->padding = gap;
+    entry->headerPos += (int64_t)gap;
+    return true;
+}
+
+static ArchResult writePendingEntryHeader(Archive* archive, PendingEntry* entry, const char* fileName)
+{
+    entry->headerPos = ftell64(archive->file);
+    if (entry->headerPos < 0)
+        return ARCH_ERR_IO;
+
+    uint64_t t = statsBegin();
+    bool ok = padStoredEntry(archive, entry) &&
+              writeFileHeader(archive->file, &entry->header, fileName, &entry->compSizePos, &entry->crcUncompressedPos, &entry->crcCompressedPos);
+    statsEnd(ARCH_STAGE_WRITE, t);
+
+    return ok ? ARCH_OK : ARCH_ERR_IO;
+}
+
+static void reuseFreeSpace(Archive* archive);
+
+// While updating in place the header's entry count follows every completed call, so readers walking the
+// headers meanwhile (see markArchiveDirty) see what is on disk. Best effort, arch_close writes it anyway.
+static void countUpdatedEntries(Archive* archive)
+{
+    updateArchiveHeaderFileCount(archive->file, archive->version, archive->fileCount);
+}
+
+static ArchResult completePendingEntry(Archive* archive, PendingEntry* entry, const char* fileName, uint64_t origSize, uint64_t compSize, uint32_t crcUncompressed, uint32_t crcCompressed)
+{
+    FileHeader* header = &entry->header;
+    ArchResult result = ARCH_OK;
+
+    uint64_t t = statsBegin();
+
+    if (origSize != header->origSize && !updateFileHeaderOrigSize(header, archive->file, entry->compSizePos, origSize))
+        result = ARCH_ERR_IO;
+    else if ((header->flags & ARCH_FLAG_COMPRESSED) && !updateFileHeaderCompSize(header, archive->file, entry->compSizePos, compSize))
+        result = ARCH_ERR_IO;
+    else if ((header->flags & ARCH_FLAG_LONG_MATCH) && !updateFileHeaderFlags(header, archive->file, entry->crcCompressedPos, header->flags))
+        result = ARCH_ERR_IO;
+    else if (!updateFileHeaderCRC32(header, archive->file, entry->crcUncompressedPos, entry->crcCompressedPos, crcUncompressed, crcCompressed))
+        result = ARCH_ERR_IO;
+
+    statsEnd(ARCH_STAGE_PATCH, t);
+
+    if (result != ARCH_OK)
+        return result;
+
+    EntryRecord record = {
+        .name = (char*)fileName,
+        .header = *header,
+        .headerOffset = (uint64_t)entry->headerPos,
+        .dataOffset = (uint64_t)entry->headerPos + FILE_HEADER_SIZE + header->nameLength
+    };
+
+    if (!appendEntryRecord(archive->newEntries, &record))
+        return ARCH_ERR_OUT_OF_MEMORY;
+
+    archive->fileCount++;
+    longMatchEntryEnd(archive->longMatcher, true);
+
+    if (archive->freeSpace)
+    {
+        archive->dataEnd = record.dataOffset + getFileHeaderPayloadSize(header);
+        countUpdatedEntries(archive);
+        reuseFreeSpace(archive);
+    }
+
+    advanceWriteBehind(&archive->writeBehind);
+
+    STATS_ADD(entries, 1);
+    STATS_ADD(uncompressedBytes, origSize);
+    STATS_ADD(compressedBytes, compSize);
+    return ARCH_OK;
+}
+
+// Cuts a failed or cancelled entry off the end of the archive, so the next one takes its place
+static void discardPendingEntry(Archive* archive, PendingEntry* entry)
+{
+    longMatchEntryEnd(archive->longMatcher, false);
+
+    if (entry->headerPos < 0) return;
+
+    // The filler in front of it goes too
+    int64_t start = entry->headerPos - (int64_t)entry->padding;
+
+    if (fseek64(archive->file, start, SEEK_SET) != 0 || !truncateArchive(archive, (uint64_t)start))
+    {
+        perror("Failed to discard incomplete entry");
+    }
+}
+
+// Large entries overlap reading, deflate and writing on three threads
+static bool entryUsesPipeline(const Archive* archive, const PendingEntry* entry)
+{
+    return !archive->longMatcher && (entry->header.flags & ARCH_FLAG_COMPRESSED) && entry->header.origSize >= PIPELINE_MIN_SIZE;
+}
+
+// Compresses an entry's payload, through the long-range matcher when the archive has one. Entries that
+// ended up with long matches get the flag, completePendingEntry writes it.
+static bool compressEntryPayload(Archive* archive, PendingEntry* entry, StreamReadFn read, void* context, uint64_t* outOrigSize, uint64_t* outCompSize, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed)
+{
+    if (entryUsesPipeline(archive, entry))
+        return pipelineCompress(read, context, archive->file, &archive->writeBehind, outOrigSize, outCompSize, outCrcUncompressed, outCrcCompressed);
+
+    if (!archive->longMatcher)
+        return compressStream(read, context, archive->file, outOrigSize, outCompSize, outCrcUncompressed, outCrcCompressed);
+
+    bool longMatch = false;
+    if (!longMatchCompress(archive->longMatcher, archive->fileCount, read, context, archive->file, outOrigSize, outCompSize, outCrcUncompressed, outCrcCompressed, &longMatch))
+        return false;
+
+    // Sources of a delta archive are entries of its base
+    if (longMatch) entry->header.flags |= ARCH_FLAG_LONG_MATCH | (archive->base ? ARCH_FLAG_BASE_DELTA : 0);
+    return true;
+}
+
+// Maps a failed payload loop to the cancellation that stopped it, if any
+static ArchResult payloadError(ArchResult error)
+{
+    return progressCancelled() ? ARCH_ERR_CANCELLED : error;
+}
+
+// opened comes from an open-ahead window and belongs to addFile from here on, NULL opens path here
+static ArchResult addFile(Archive* archive, const char* path, const OpenedFile* opened)
 {
     if (!archive || !path)
         return ARCH_ERR_INVALID_ARGUMENT;
 
+    if (!progressEntryBegin(path))
+    {
+        if (opened && opened->file) fclose(opened->file);
+        return ARCH_ERR_CANCELLED;
+    }
+
+    uint64_t traceStart = TRACE_NOW();
+
     ArchResult result = ARCH_OK;
 
     FILE* file = NULL;
     char* fileName = NULL;
 
-    FileHeader fileHeader;
+    PendingEntry entry = { .headerPos = -1 };
+    InputSource source = { .fd = -1, .directFd = -1 };
     uint64_t fileSize = 0;
 
-    if (!createFileHeader(path, ARCH_FLAG_COMPRESSED, &fileHeader, &file, &fileSize))
+    uint64_t t = statsBegin();
+    bool ready;
+
+    if (opened)
+    {
+        file = opened->file;
+        fileSize = opened->size;
+        ready = file && initFileHeaderForPath(&entry.header, path, fileSize, getNewEntryFlags(archive));
+    }
+    else
+    {
+        ready = createFileHeader(path, getNewEntryFlags(archive), &entry.header, &file, &fileSize);
+    }
+    statsEnd(ARCH_STAGE_OPEN, t);
+
+    if (!ready)
+    {
+        if (opened && file) fclose(file);
+        progressEntryEnd(false);
         return ARCH_ERR_IO;
+    }
 
     fileName = sanitizeFilePath(path);
     if (!fileName)
@@ -58,167 +331,1499 @@ ArchResult arch_addFile(Archive* archive, const char* path)
         goto cleanup;
     }
 
-    uint64_t compSizePos = 0;
-    uint64_t crcUncompressedPos = 0;
-    uint64_t crcCompressedPos = 0;
-
-    if (!writeFileHeader(archive->file, &fileHeader, fileName, &compSizePos, &crcUncompressedPos, &crcCompressedPos))
-    {
-        result = ARCH_ERR_IO;
+    result = writePendingEntryHeader(archive, &entry, fileName);
+    if (result != ARCH_OK)
         goto cleanup;
-    }
 
-    if (fileHeader.flags & ARCH_FLAG_COMPRESSED)
+    // The pipeline's writer paces the archive itself, the reader mustn't touch it meanwhile
+    openInputSource(&source, file, path, archive->ioMode, entryUsesPipeline(archive, &entry) ? NULL : &archive->writeBehind);
+
+    if (entry.header.flags & ARCH_FLAG_COMPRESSED)
     {
+        uint64_t origSize = 0;
         uint64_t compSize = 0;
         uint32_t crcUncompressed = 0;
         uint32_t crcCompressed = 0;
 
-        if (!compressFileStream(file, archive->file, &compSize, &crcUncompressed, &crcCompressed))
-        {
-            result = ARCH_ERR_COMPRESSION;
-            goto cleanup;
-        }
-
-        if (!updateFileHeaderCompSize(&fileHeader, archive->file, compSizePos, compSize))
+        if (!compressEntryPayload(archive, &entry, readInputSource, &source, &origSize, &compSize, &crcUncompressed, &crcCompressed))
         {
-            result = ARCH_ERR_IO;
+            result = payloadError(ARCH_ERR_COMPRESSION);
             goto cleanup;
         }
 
-        if (!updateFileHeaderCRC32(&fileHeader, archive->file, crcUncompressedPos, crcCompressedPos, crcUncompressed, crcCompressed))
-        {
-            result = ARCH_ERR_IO;
-            goto cleanup;
-        }
+        result = completePendingEntry(archive, &entry, fileName, origSize, compSize, crcUncompressed, crcCompressed);
     }
     else
     {
+        uint64_t size = 0;
         uint32_t crc = 0;
 
-        if (!copyFileData(file, archive->file, fileSize, &crc))
+        if (!storeStream(readInputSource, &source, archive->file, &size, &crc))
         {
-            result = ARCH_ERR_IO;
+            result = payloadError(ARCH_ERR_IO);
             goto cleanup;
         }
 
-        if (!updateFileHeaderCRC32(&fileHeader, archive->file, crcUncompressedPos, crcCompressedPos, crc, crc))
+        result = completePendingEntry(archive, &entry, fileName, size, size, crc, crc);
+    }
+
+cleanup:
+    if (result != ARCH_OK) discardPendingEntry(archive, &entry);
+    progressEntryEnd(result == ARCH_OK);
+
+    closeInputSource(&source);
+    fclose(file);
+    memFree(fileName);
+
+    TRACE_SPAN("entry", path, traceStart);
+    return result;
+}
+
+ArchResult arch_addFile(Archive* archive, const char* path)
+{
+    if (!archive)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = addFile(archive, path, NULL);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+// Adds the files in order with the next ones opened ahead. Failures are reported per file and don't
+// stop the rest, the result is that of the last file that failed.
+static ArchResult addFiles(Archive* archive, const char* const* paths, size_t count)
+{
+    OpenAhead ahead;
+    openAheadStart(&ahead, paths, count, archive->ioMode);
+
+    ArchResult result = ARCH_OK;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // Only the time spent waiting on the window counts, the opens themselves overlap
+        OpenedFile opened;
+
+        uint64_t t = statsBegin();
+        openAheadNext(&ahead, &opened);
+        statsEnd(ARCH_STAGE_OPEN, t);
+
+        ArchResult r = addFile(archive, paths[i], &opened);
+        if (r != ARCH_OK && r != ARCH_ERR_CANCELLED)
         {
-            result = ARCH_ERR_IO;
-            goto cleanup;
+            fprintf(stderr, "Failed to add %s\n", paths[i]);
         }
+        if (r != ARCH_OK) result = r;
+
+        if (result == ARCH_ERR_CANCELLED) break;
     }
 
-    archive->fileCount++;
+    openAheadStop(&ahead);
+    return result;
+}
 
-cleanup:
-    fclose(file);
-    free(fileName);
+ArchResult arch_addFiles(Archive* archive, const char* const* paths, size_t count)
+{
+    if (!archive || (!paths && count > 0))
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!paths[i])
+            return ARCH_ERR_INVALID_ARGUMENT;
+    }
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = addFiles(archive, paths, count);
+
+    leaveArchiveCall(archive, &call);
     return result;
 }
 
-ArchResult arch_addDirectory(Archive* archive, const char* dirPath)
+static ArchResult addBuffer(Archive* archive, const char* name, const void* data, size_t size)
 {
-    if (!archive || !dirPath)
+    if (!archive || !name || (!data && size > 0))
         return ARCH_ERR_INVALID_ARGUMENT;
 
+    if (!progressEntryBegin(name))
+        return ARCH_ERR_CANCELLED;
+
+    PendingEntry entry = { .headerPos = -1 };
+    uint64_t traceStart = TRACE_NOW();
+
     ArchResult result = ARCH_OK;
 
-#ifdef _WIN32
-    struct _finddata_t findFileData;
-    intptr_t hFind;
-    char searchPath[1024];
-    char pathBuffer[1024];
+    char* fileName = sanitizeFilePath(name);
+    if (!fileName)
+    {
+        result = ARCH_ERR_OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    if (!initFileHeader(&entry.header, fileName, size, getNewEntryFlags(archive)))
+    {
+        result = ARCH_ERR_INVALID_ARGUMENT;
+        goto cleanup;
+    }
+
+    result = writePendingEntryHeader(archive, &entry, fileName);
+    if (result != ARCH_OK)
+        goto cleanup;
+
+    uint64_t compSize = 0;
+    uint32_t crcUncompressed = 0;
+    uint32_t crcCompressed = 0;
 
-    snprintf(searchPath, sizeof(searchPath), "%s\\*", dirPath);
+    bool stored = !(entry.header.flags & ARCH_FLAG_COMPRESSED);
 
-    hFind = _findfirst(searchPath, &findFileData);
-    if (hFind == -1L)
+    // The matcher needs the data in its window, without it the buffer is deflated in place
+    bool written;
+    if (stored)
     {
-        return ARCH_ERR_IO;
+        BufferSource source = { data, size, 0 };
+        written = storeStream(readBufferSource, &source, archive->file, &compSize, &crcUncompressed);
+        crcCompressed = crcUncompressed;
+    }
+    else if (archive->longMatcher)
+    {
+        BufferSource source = { data, size, 0 };
+        uint64_t origSize = 0;
+        written = compressEntryPayload(archive, &entry, readBufferSource, &source, &origSize, &compSize, &crcUncompressed, &crcCompressed);
+    }
+    else
+    {
+        written = compressBuffer(data, size, archive->file, &compSize, &crcUncompressed, &crcCompressed);
     }
 
-    do {
-        // Skip "." and ".."
-        if (strcmp(findFileData.name, ".") == 0 || strcmp(findFileData.name, "..") == 0)
-        {
-            continue;
-        }
+    if (!written)
+    {
+        result = payloadError(stored ? ARCH_ERR_IO : ARCH_ERR_COMPRESSION);
+        goto cleanup;
+    }
 
-        // Build full path
-        snprintf(pathBuffer, sizeof(pathBuffer), "%s\\%s", dirPath, findFileData.name);
+    result = completePendingEntry(archive, &entry, fileName, size, compSize, crcUncompressed, crcCompressed);
 
-        // Check if directory or file
-        if (findFileData.attrib & _A_SUBDIR)
-        {
-            ArchResult r = arch_addDirectory(archive, pathBuffer);
-            if (r != ARCH_OK) result = r;
-        } 
-        else
-        {
-            ArchResult r = arch_addFile(archive, pathBuffer);
-            if (r != ARCH_OK)
-            {
-                fprintf(stderr, "Failed to add %s\n", pathBuffer);
-                result = r;
-            }
-        }
-    } while (_findnext(hFind, &findFileData) == 0);
+cleanup:
+    if (result != ARCH_OK) discardPendingEntry(archive, &entry);
+    progressEntryEnd(result == ARCH_OK);
+
+    TRACE_SPAN("entry", name, traceStart);
+    memFree(fileName);
+    return result;
+}
+
+ArchResult arch_addBuffer(Archive* archive, const char* name, const void* data, size_t size)
+{
+    if (!archive)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
 
-    _findclose(hFind);
+    ArchResult result = addBuffer(archive, name, data, size);
 
-#else
-    DIR* dir = opendir(dirPath);
-    if (!dir) return ARCH_ERR_IO;
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+static ArchResult addStream(Archive* archive, const char* name, ArchReadCallback readCallback, void* userdata, uint64_t sizeHint)
+{
+    if (!archive || !name || !readCallback)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    if (!progressEntryBegin(name))
+        return ARCH_ERR_CANCELLED;
 
-    struct dirent* entry;
-    struct stat path_stat;
-    char pathBuffer[1024]; 
+    PendingEntry entry = { .headerPos = -1 };
+    uint64_t traceStart = TRACE_NOW();
+
+    ArchResult result = ARCH_OK;
 
-    while ((entry = readdir(dir)) != NULL)
+    char* fileName = sanitizeFilePath(name);
+    if (!fileName)
     {
-        // Skip "." and ".."
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-        {
-            continue;
-        }
+        result = ARCH_ERR_OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    // The hint only pre-fills origSize, the real size is patched in once the stream ends
+    if (!initFileHeader(&entry.header, fileName, sizeHint, getNewEntryFlags(archive)))
+    {
+        result = ARCH_ERR_INVALID_ARGUMENT;
+        goto cleanup;
+    }
 
-        // Build full path
-        snprintf(pathBuffer, sizeof(pathBuffer), "%s/%s", dirPath, entry->d_name);
+    result = writePendingEntryHeader(archive, &entry, fileName);
+    if (result != ARCH_OK)
+        goto cleanup;
 
-        // Check if directory or file
-        if (stat(pathBuffer, &path_stat) != 0) continue; 
+    uint64_t origSize = 0;
+    uint64_t compSize = 0;
+    uint32_t crcUncompressed = 0;
+    uint32_t crcCompressed = 0;
 
-        if (S_ISDIR(path_stat.st_mode))
+    if (entry.header.flags & ARCH_FLAG_COMPRESSED)
+    {
+        if (!compressEntryPayload(archive, &entry, readCallback, userdata, &origSize, &compSize, &crcUncompressed, &crcCompressed))
         {
-            ArchResult r = arch_addDirectory(archive, pathBuffer);
-            if (r != ARCH_OK) result = r; 
-        } 
-        else if (S_ISREG(path_stat.st_mode))
+            result = payloadError(ARCH_ERR_COMPRESSION);
+            goto cleanup;
+        }
+    }
+    else
+    {
+        if (!storeStream(readCallback, userdata, archive->file, &origSize, &crcUncompressed))
         {
-            ArchResult r = arch_addFile(archive, pathBuffer);
-            if (r != ARCH_OK)
-            {
-                fprintf(stderr, "Failed to add %s\n", pathBuffer);
-                result = r;
-            }
+            result = payloadError(ARCH_ERR_IO);
+            goto cleanup;
         }
+
+        compSize = origSize;
+        crcCompressed = crcUncompressed;
     }
 
-    closedir(dir);
-#endif
+    result = completePendingEntry(archive, &entry, fileName, origSize, compSize, crcUncompressed, crcCompressed);
+
+cleanup:
+    if (result != ARCH_OK) discardPendingEntry(archive, &entry);
+    progressEntryEnd(result == ARCH_OK);
 
+    TRACE_SPAN("entry", name, traceStart);
+    memFree(fileName);
     return result;
 }
 
-void arch_close(Archive* archive)
+ArchResult arch_addStream(Archive* archive, const char* name, ArchReadCallback readCallback, void* userdata, uint64_t sizeHint)
 {
-    if (!archive) return;
+    if (!archive)
+        return ARCH_ERR_INVALID_ARGUMENT;
 
-    if (!archive->readOnly)
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = addStream(archive, name, readCallback, userdata, sizeHint);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+static ArchResult addDirectory(Archive* archive, const char* dirPath)
+{
+    if (!archive || !dirPath)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    FileList list = {0};
+
+    // Unreadable subdirectories are reported at the end, like failed files
+    ArchResult result = collectFiles(dirPath, archive->inputOrder, &list);
+    if (result == ARCH_ERR_OUT_OF_MEMORY || result == ARCH_ERR_CANCELLED || list.count == 0)
     {
-        updateArchiveHeaderFileCount(archive->file, archive->fileCount);
+        freeFileList(&list);
+        return result;
     }
 
+    sortFileList(&list, archive->inputOrder);
+
+    const char** paths = memAlloc(list.count * sizeof *paths);
+    if (!paths)
+    {
+        freeFileList(&list);
+        return ARCH_ERR_OUT_OF_MEMORY;
+    }
+
+    for (size_t i = 0; i < list.count; i++)
+    {
+        paths[i] = list.entries[i].path;
+    }
+
+    ArchResult r = addFiles(archive, paths, list.count);
+    if (r != ARCH_OK) result = r;
+
+    memFree(paths);
+    freeFileList(&list);
+    return result;
+}
+
+ArchResult arch_addDirectory(Archive* archive, const char* dirPath)
+{
+    if (!archive)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = addDirectory(archive, dirPath);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+// ===== Copying entries between archives =====
+
+// Reader of an entry as a StreamReadFn / ArchReadCallback, keeping the reader's error
+typedef struct EntrySource
+{
+    ArchEntryReader* reader;
+    ArchResult result;
+} EntrySource;
+
+static int64_t readEntrySource(void* context, void* buffer, size_t size)
+{
+    EntrySource* source = context;
+    size_t bytesRead;
+
+    source->result = arch_entryRead(source->reader, buffer, size, &bytesRead);
+    return source->result == ARCH_OK ? (int64_t)bytesRead : -1;
+}
+
+// Source stream for copyRawEntry, a plain file where possible so payloads can be copied in the kernel
+static FILE* openRawSource(Archive* source)
+{
+    uint64_t t = statsBegin();
+    FILE* in = source->volumeSize ? openArchiveStream(source) : fopen(source->filePath, "rb");
+    statsEnd(ARCH_STAGE_OPEN, t);
+
+    return in;
+}
+
+// Copies an entry that decodes on its own, header and payload as they are. The payload isn't inflated
+// or checked, it keeps the CRCs it was stored with for arch_verify.
+static ArchResult copyRawEntry(Archive* archive, FILE* in, const EntryRecord* record)
+{
+    if (!progressEntryBegin(record->name))
+        return ARCH_ERR_CANCELLED;
+
+    PendingEntry entry = { .header = record->header, .headerPos = -1 };
+    uint64_t payloadSize = getFileHeaderPayloadSize(&record->header);
+
+    ArchResult result = writePendingEntryHeader(archive, &entry, record->name);
+    if (result != ARCH_OK)
+        goto cleanup;
+
+    if (record->dataOffset > INT64_MAX || fseek64(in, (int64_t)record->dataOffset, SEEK_SET) != 0 ||
+        !copyFileRange(in, archive->file, payloadSize))
+    {
+        result = payloadError(ARCH_ERR_IO);
+        goto cleanup;
+    }
+
+    result = completePendingEntry(archive, &entry, record->name, record->header.origSize, payloadSize,
+                                  record->header.crc32_uncompressed, record->header.crc32_compressed);
+
+cleanup:
+    if (result != ARCH_OK) discardPendingEntry(archive, &entry);
+    progressEntryEnd(result == ARCH_OK);
+    return result;
+}
+
+// Decodes an entry of source and compresses it again, for entries whose references don't carry over
+static ArchResult recompressEntry(Archive* archive, Archive* source, size_t index, const EntryRecord* record)
+{
+    EntrySource entrySource = { NULL, ARCH_OK };
+
+    ArchResult result = arch_entryOpenIndex(source, index, &entrySource.reader);
+    if (result != ARCH_OK)
+        return result;
+
+    result = addStream(archive, record->name, readEntrySource, &entrySource, record->header.origSize);
+    if (result != ARCH_OK && entrySource.result != ARCH_OK)
+        result = entrySource.result;
+
+    arch_entryClose(entrySource.reader);
+    return result;
+}
+
+// ===== Staged outputs =====
+
+static ArchResult finishArchive(Archive* archive);
+
+// Archive written under a staging name next to its path and renamed over it once complete, so a failure
+// or crash part way leaves whatever was at the path as it was
+typedef struct StagedArchive
+{
+    const char* path;
+    char* stagingPath;
+    uint64_t volumeSize;
+    Archive* archive;
+} StagedArchive;
+
+static void removeStagedFiles(const StagedArchive* staged)
+{
+    if (staged->volumeSize) removeVolumeSet(staged->stagingPath);
+    else remove(staged->stagingPath);
+}
+
+static ArchResult createStagedArchive(StagedArchive* staged, const char* path, const ArchCreateOptions* options, uint32_t baseFingerprint)
+{
+    staged->path = path;
+    staged->volumeSize = options ? options->volumeSize : 0;
+    staged->archive = NULL;
+
+    staged->stagingPath = getStagingPath(path);
+    if (!staged->stagingPath)
+        return ARCH_ERR_OUT_OF_MEMORY;
+
+    ArchResult result = createArchiveFile(staged->stagingPath, options, baseFingerprint, &staged->archive);
+    if (result != ARCH_OK)
+    {
+        removeStagedFiles(staged);
+        memFree(staged->stagingPath);
+    }
+
+    return result;
+}
+
+// Completes the archive and moves it to its path if result is ARCH_OK, throws it away otherwise
+static ArchResult finishStagedArchive(StagedArchive* staged, ArchResult result)
+{
+    if (result == ARCH_OK)
+        result = finishArchive(staged->archive);
+
+    freeArchive(staged->archive);
+
+    if (result == ARCH_OK)
+    {
+        bool moved = staged->volumeSize
+            ? renameVolumeSet(staged->stagingPath, staged->path)
+            : syncFilePath(staged->stagingPath) && replaceFile(staged->stagingPath, staged->path);
+
+        if (!moved) result = ARCH_ERR_IO;
+    }
+
+    if (result != ARCH_OK)
+        removeStagedFiles(staged);
+
+    memFree(staged->stagingPath);
+    return result;
+}
+
+// File path of the archive at path by index, its volumes when split; NULL past the last
+static char* getArchiveFilePath(const char* path, uint64_t volumeSize, unsigned index)
+{
+    if (volumeSize) return getVolumePath(path, index);
+    return index == 0 ? memStrdup(path) : NULL;
+}
+
+// Whether an archive written to outPath (split when volumeSize is set) would replace a file of the open
+// archive source, by file identity so that no other spelling of the same path gets through
+static bool outputReplacesArchive(const char* outPath, uint64_t volumeSize, const Archive* source)
+{
+    bool same = false;
+
+    for (unsigned i = 0; !same; i++)
+    {
+        char* outFile = getArchiveFilePath(outPath, volumeSize, i);
+        FileIdentity out;
+        bool exists = outFile && getFileIdentity(outFile, &out);
+        memFree(outFile);
+
+        if (!exists) break;
+
+        for (unsigned j = 0; !same; j++)
+        {
+            char* sourceFile = getArchiveFilePath(source->filePath, source->volumeSize, j);
+            FileIdentity in;
+            bool found = sourceFile && getFileIdentity(sourceFile, &in);
+            memFree(sourceFile);
+
+            if (!found) break;
+            same = isSameFile(&out, &in);
+        }
+    }
+
+    return same;
+}
+
+// ===== Delta archives =====
+
+#define DELTA_DEFAULT_WINDOW ((uint64_t)64 << 20)
+
+static int compareRecordNames(const void* a, const void* b)
+{
+    return strcmp((*(const EntryRecord* const*)a)->name, (*(const EntryRecord* const*)b)->name);
+}
+
+// Base entries sorted by name, for looking up the counterpart of every new file
+typedef struct BaseNames
+{
+    const EntryTable* table;
+    const EntryRecord** records;
+} BaseNames;
+
+static const EntryRecord* findBaseRecord(const BaseNames* names, const char* name, size_t* outIndex)
+{
+    EntryRecord key = { .name = (char*)name };
+    const EntryRecord* keyRecord = &key;
+
+    const EntryRecord** found = bsearch(&keyRecord, names->records, names->table->count, sizeof *names->records, compareRecordNames);
+    if (!found) return NULL;
+
+    *outIndex = (size_t)(*found - names->table->entries);
+    return *found;
+}
+
+// Same bytes as the base entry, compared against the decoded entry rather than its CRC32, which
+// collides far too easily to decide whether data is stored. Failures to read count as changed, addFile
+// reports them.
+static bool fileMatchesBaseEntry(Archive* archive, const char* path, size_t baseIndex, const EntryRecord* record)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+
+    ArchEntryReader* reader = NULL;
+    unsigned char* buffer = NULL;
+    size_t bufferSize = 0;
+
+    bool same = getFileSize(file) == record->header.origSize &&
+                arch_entryOpenIndex(archive->base, baseIndex, &reader) == ARCH_OK &&
+                (bufferSize = tryAllocateBuffer(&buffer)) > 0;
+
+    // Half of the buffer for each side
+    size_t chunkSize = bufferSize / 2;
+    unsigned char* fileChunk = buffer;
+    unsigned char* entryChunk = buffer + chunkSize;
+
+    for (uint64_t left = record->header.origSize; same && left > 0; )
+    {
+        size_t want = left < chunkSize ? (size_t)left : chunkSize;
+        size_t fileRead, entryRead = 0;
+
+        same = readFile(file, (char*)fileChunk, want, &fileRead) && fileRead == want;
+
+        for (size_t done = 0; same && done < want; done += entryRead)
+        {
+            // The read reaching the end checks the entry's CRC, a damaged base entry doesn't stand in
+            same = arch_entryRead(reader, entryChunk + done, want - done, &entryRead) == ARCH_OK && entryRead > 0;
+        }
+
+        same = same && memcmp(fileChunk, entryChunk, want) == 0;
+        left -= want;
+    }
+
+    memFree(buffer);
+    arch_entryClose(reader);
+    fclose(file);
+    return same;
+}
+
+// Header-only entry standing for the unchanged base entry of the same name
+static ArchResult addBaseReference(Archive* archive, const char* fileName, const EntryRecord* baseRecord)
+{
+    if (!progressEntryBegin(fileName))
+        return ARCH_ERR_CANCELLED;
+
+    PendingEntry entry = { .headerPos = -1 };
+    ArchResult result = ARCH_OK;
+
+    if (!initFileHeader(&entry.header, fileName, baseRecord->header.origSize, ARCH_FLAG_BASE_REF))
+        result = ARCH_ERR_INVALID_ARGUMENT;
+    else if ((result = writePendingEntryHeader(archive, &entry, fileName)) == ARCH_OK)
+        result = completePendingEntry(archive, &entry, fileName, baseRecord->header.origSize, 0, baseRecord->header.crc32_uncompressed, 0);
+
+    if (result != ARCH_OK) discardPendingEntry(archive, &entry);
+    progressEntryEnd(result == ARCH_OK);
+    return result;
+}
+
+// Loads the base entry into the matcher, so the new version of the file is encoded against it
+static ArchResult primeDeltaSource(Archive* archive, size_t baseIndex)
+{
+    EntrySource source = { NULL, ARCH_OK };
+
+    ArchResult result = arch_entryOpenIndex(archive->base, baseIndex, &source.reader);
+    if (result != ARCH_OK)
+        return result;
+
+    if (!longMatchSetSource(archive->longMatcher, baseIndex, readEntrySource, &source))
+        result = source.result != ARCH_OK ? source.result : ARCH_ERR_CORRUPTED;
+
+    arch_entryClose(source.reader);
+    return result;
+}
+
+static ArchResult addDeltaFile(Archive* archive, const BaseNames* names, const char* path)
+{
+    char* fileName = sanitizeFilePath(path);
+    if (!fileName)
+        return ARCH_ERR_OUT_OF_MEMORY;
+
+    size_t baseIndex;
+    const EntryRecord* baseRecord = findBaseRecord(names, fileName, &baseIndex);
+
+    ArchResult result;
+    if (!baseRecord)
+        result = addFile(archive, path, NULL);
+    else if (fileMatchesBaseEntry(archive, path, baseIndex, baseRecord))
+        result = addBaseReference(archive, fileName, baseRecord);
+    else if ((result = primeDeltaSource(archive, baseIndex)) == ARCH_OK)
+        result = addFile(archive, path, NULL);
+
+    memFree(fileName);
+    return result;
+}
+
+static ArchResult addDeltaDirectory(Archive* archive, const char* dirPath)
+{
+    BaseNames names = { getArchiveEntryTable(archive->base), NULL };
+    if (!names.table)
+        return ARCH_ERR_CORRUPTED;
+
+    if (names.table->count > 0)
+    {
+        names.records = memAlloc(names.table->count * sizeof *names.records);
+        if (!names.records)
+            return ARCH_ERR_OUT_OF_MEMORY;
+
+        for (size_t i = 0; i < names.table->count; i++)
+            names.records[i] = &names.table->entries[i];
+
+        qsort(names.records, names.table->count, sizeof *names.records, compareRecordNames);
+    }
+
+    FileList list = {0};
+
+    ArchResult result = collectFiles(dirPath, archive->inputOrder, &list);
+    if (result != ARCH_ERR_OUT_OF_MEMORY && result != ARCH_ERR_CANCELLED)
+    {
+        sortFileList(&list, archive->inputOrder);
+
+        for (size_t i = 0; i < list.count; i++)
+        {
+            const char* path = list.entries[i].path;
+
+            ArchResult r = addDeltaFile(archive, &names, path);
+            if (r != ARCH_OK && r != ARCH_ERR_CANCELLED)
+            {
+                fprintf(stderr, "Failed to add %s\n", path);
+            }
+            if (r != ARCH_OK) result = r;
+
+            if (result == ARCH_ERR_CANCELLED) break;
+        }
+    }
+
+    freeFileList(&list);
+    memFree(names.records);
+    return result;
+}
+
+ArchResult arch_createDelta(const char* newDir, const char* baseArchive, const char* outPath, const ArchCreateOptions* options)
+{
+    if (!newDir || !baseArchive || !outPath)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchCreateOptions deltaOptions = options ? *options : (ArchCreateOptions){0};
+    if (deltaOptions.longMatchWindow == 0) deltaOptions.longMatchWindow = DELTA_DEFAULT_WINDOW;
+
+    ArchOpenOptions baseOptions = { .memory = deltaOptions.memory };
+    Archive* base;
+
+    ArchResult result = arch_openEx(baseArchive, &baseOptions, &base);
+    if (result != ARCH_OK)
+        return result;
+
+    const EntryTable* table = getArchiveEntryTable(base);
+    if (!table)
+    {
+        arch_close(base);
+        return ARCH_ERR_CORRUPTED;
+    }
+
+    // Deltas always refer to a full archive, chains of them would need every link to read an entry
+    for (size_t i = 0; i < table->count; i++)
+    {
+        if (table->entries[i].header.flags & (ARCH_FLAG_BASE_REF | ARCH_FLAG_BASE_DELTA))
+        {
+            arch_close(base);
+            return ARCH_ERR_INVALID_ARGUMENT;
+        }
+    }
+
+    // Replacing the base would leave a delta against an archive that no longer exists
+    if (outputReplacesArchive(outPath, deltaOptions.volumeSize, base))
+    {
+        arch_close(base);
+        return ARCH_ERR_INVALID_ARGUMENT;
+    }
+
+    StagedArchive staged;
+    result = createStagedArchive(&staged, outPath, &deltaOptions, getEntryTableFingerprint(table));
+    if (result != ARCH_OK)
+    {
+        arch_close(base);
+        return result;
+    }
+
+    Archive* archive = staged.archive;
+    archive->base = base;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    result = addDeltaDirectory(archive, newDir);
+
+    leaveArchiveCall(archive, &call);
+
+    return finishStagedArchive(&staged, result);
+}
+
+// Entries that refer to the base are decoded and compressed again, everything else is copied verbatim
+static ArchResult applyDeltaEntry(Archive* archive, Archive* delta, FILE* deltaIn, FILE* baseIn, size_t index, const EntryRecord* record)
+{
+    if (!fileHeaderNeedsReader(&record->header))
+        return copyRawEntry(archive, deltaIn, record);
+
+    if (record->header.flags & ARCH_FLAG_BASE_REF)
+    {
+        const EntryRecord* baseRecord = findArchiveEntry(delta->base, record->name, NULL);
+        if (baseRecord && !fileHeaderNeedsReader(&baseRecord->header) &&
+            baseRecord->header.crc32_uncompressed == record->header.crc32_uncompressed &&
+            baseRecord->header.origSize == record->header.origSize)
+        {
+            return copyRawEntry(archive, baseIn, baseRecord);
+        }
+    }
+
+    return recompressEntry(archive, delta, index, record);
+}
+
+ArchResult arch_applyDelta(const char* deltaPath, const char* baseArchive, const char* outPath)
+{
+    if (!deltaPath || !baseArchive || !outPath)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchOpenOptions deltaOptions = { .baseArchive = baseArchive };
+    Archive* delta;
+
+    ArchResult result = arch_openEx(deltaPath, &deltaOptions, &delta);
+    if (result != ARCH_OK)
+        return result;
+
+    const EntryTable* table = getArchiveEntryTable(delta);
+    // The base option is ignored for archives that aren't deltas
+    if (!delta->base || !table)
+    {
+        result = delta->base ? ARCH_ERR_CORRUPTED : ARCH_ERR_INVALID_ARGUMENT;
+        arch_close(delta);
+        return result;
+    }
+
+    if (outputReplacesArchive(outPath, 0, delta) || outputReplacesArchive(outPath, 0, delta->base))
+    {
+        arch_close(delta);
+        return ARCH_ERR_INVALID_ARGUMENT;
+    }
+
+    // A compact delta rebuilds into a compact archive
+    ArchCreateOptions outOptions = { .compactMetadata = delta->version >= ARCH_VERSION_COMPACT };
+
+    StagedArchive staged;
+    result = createStagedArchive(&staged, outPath, &outOptions, 0);
+    if (result != ARCH_OK)
+    {
+        arch_close(delta);
+        return result;
+    }
+
+    Archive* archive = staged.archive;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    FILE* deltaIn = openRawSource(delta);
+    FILE* baseIn = openRawSource(delta->base);
+    if (!deltaIn || !baseIn) result = ARCH_ERR_IO;
+
+    for (size_t i = 0; i < table->count && result == ARCH_OK; i++)
+    {
+        result = applyDeltaEntry(archive, delta, deltaIn, baseIn, i, &table->entries[i]);
+    }
+
+    if (deltaIn) fclose(deltaIn);
+    if (baseIn) fclose(baseIn);
+
+    leaveArchiveCall(archive, &call);
+
+    result = finishStagedArchive(&staged, result);
+    arch_close(delta);
+    return result;
+}
+
+// ===== Merging =====
+
+typedef struct MergeName
+{
+    const char* name;
+    size_t slot;    // Position among the entries of all inputs, in merge order
+} MergeName;
+
+static int compareMergeNames(const void* a, const void* b)
+{
+    const MergeName* x = a;
+    const MergeName* y = b;
+
+    int order = strcmp(x->name, y->name);
+    if (order != 0) return order;
+
+    return (x->slot > y->slot) - (x->slot < y->slot);
+}
+
+// Flags the entries the policy keeps, one per entry of all inputs in merge order, and reports each
+// name found more than once to the options' callback
+static ArchResult resolveMergeConflicts(const EntryTable* const* tables, size_t inputCount, size_t total, const ArchMergeOptions* options, bool* keep)
+{
+    ArchMergeConflict policy = options->conflictPolicy;
+
+    for (size_t i = 0; i < total; i++) keep[i] = true;
+
+    if ((policy == ARCH_MERGE_KEEP_ALL && !options->conflictCallback) || total == 0)
+        return ARCH_OK;
+
+    MergeName* names = memAlloc(total * sizeof *names);
+    if (!names)
+        return ARCH_ERR_OUT_OF_MEMORY;
+
+    size_t slot = 0;
+    for (size_t i = 0; i < inputCount; i++)
+    {
+        for (size_t j = 0; j < tables[i]->count; j++, slot++)
+            names[slot] = (MergeName){ tables[i]->entries[j].name, slot };
+    }
+
+    qsort(names, total, sizeof *names, compareMergeNames);
+
+    ArchResult result = ARCH_OK;
+
+    for (size_t i = 0; i < total; )
+    {
+        size_t end = i + 1;
+        while (end < total && strcmp(names[end].name, names[i].name) == 0) end++;
+
+        if (end - i > 1)
+        {
+            if (options->conflictCallback)
+                options->conflictCallback(options->userdata, names[i].name, end - i);
+
+            if (policy == ARCH_MERGE_FAIL)
+                result = ARCH_ERR_INVALID_ARGUMENT;
+
+            if (policy == ARCH_MERGE_KEEP_FIRST || policy == ARCH_MERGE_KEEP_LAST)
+            {
+                for (size_t k = i; k < end; k++) keep[names[k].slot] = false;
+                keep[names[policy == ARCH_MERGE_KEEP_FIRST ? i : end - 1].slot] = true;
+            }
+        }
+
+        i = end;
+    }
+
+    memFree(names);
+    return result;
+}
+
+static ArchResult mergeInput(Archive* archive, Archive* source, const EntryTable* table, const bool* keep)
+{
+    FILE* in = openRawSource(source);
+    if (!in)
+        return ARCH_ERR_IO;
+
+    ArchResult result = ARCH_OK;
+
+    for (size_t i = 0; i < table->count && result == ARCH_OK; i++)
+    {
+        const EntryRecord* record = &table->entries[i];
+        if (!keep[i]) continue;
+
+        result = fileHeaderNeedsReader(&record->header) ? recompressEntry(archive, source, i, record) : copyRawEntry(archive, in, record);
+    }
+
+    fclose(in);
+    return result;
+}
+
+ArchResult arch_merge(const char* outPath, const char* const* inputs, size_t inputCount, ArchMergeConflict conflictPolicy)
+{
+    ArchMergeOptions options = { .conflictPolicy = conflictPolicy };
+    return arch_mergeEx(outPath, inputs, inputCount, &options);
+}
+
+ArchResult arch_mergeEx(const char* outPath, const char* const* inputs, size_t inputCount, const ArchMergeOptions* options)
+{
+    ArchMergeOptions defaults = {0};
+    if (!options) options = &defaults;
+
+    ArchMergeConflict conflictPolicy = options->conflictPolicy;
+    if (!outPath || (!inputs && inputCount > 0) || conflictPolicy < ARCH_MERGE_KEEP_ALL || conflictPolicy > ARCH_MERGE_FAIL)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    // Inputs are opened and checked, and conflicts resolved, before the output replaces anything
+    Archive** sources = memCalloc(inputCount ? inputCount : 1, sizeof *sources);
+    const EntryTable** tables = memCalloc(inputCount ? inputCount : 1, sizeof *tables);
+    bool* keep = NULL;
+
+    ArchResult result = (sources && tables) ? ARCH_OK : ARCH_ERR_OUT_OF_MEMORY;
+    size_t total = 0;
+    ArchCreateOptions outOptions = {0};
+
+    for (size_t i = 0; i < inputCount && result == ARCH_OK; i++)
+    {
+        if (!inputs[i])
+        {
+            result = ARCH_ERR_INVALID_ARGUMENT;
+            break;
+        }
+
+        result = arch_open(inputs[i], &sources[i]);
+        if (result != ARCH_OK)
+            break;
+
+        // The output replaces its path only once complete, but an input it replaces is gone for good
+        if (outputReplacesArchive(outPath, 0, sources[i]))
+        {
+            result = ARCH_ERR_INVALID_ARGUMENT;
+            break;
+        }
+
+        tables[i] = getArchiveEntryTable(sources[i]);
+        if (!tables[i])
+        {
+            result = ARCH_ERR_CORRUPTED;
+            break;
+        }
+
+        for (size_t j = 0; j < tables[i]->count; j++)
+        {
+            if (tables[i]->entries[j].header.flags & (ARCH_FLAG_BASE_REF | ARCH_FLAG_BASE_DELTA))
+                result = ARCH_ERR_INVALID_ARGUMENT;
+        }
+
+        total += tables[i]->count;
+
+        // One compact input makes the output compact, its directory would otherwise grow back
+        if (sources[i]->version >= ARCH_VERSION_COMPACT)
+            outOptions.compactMetadata = true;
+    }
+
+    if (result == ARCH_OK)
+    {
+        keep = memAlloc(total ? total : 1);
+        result = keep ? resolveMergeConflicts(tables, inputCount, total, options, keep) : ARCH_ERR_OUT_OF_MEMORY;
+    }
+
+    StagedArchive staged;
+    if (result == ARCH_OK)
+        result = createStagedArchive(&staged, outPath, &outOptions, 0);
+
+    if (result == ARCH_OK)
+    {
+        Archive* archive = staged.archive;
+
+        ArchiveCall call;
+        enterArchiveCall(archive, &call);
+
+        size_t slot = 0;
+        for (size_t i = 0; i < inputCount && result == ARCH_OK; i++)
+        {
+            result = mergeInput(archive, sources[i], tables[i], keep + slot);
+            slot += tables[i]->count;
+        }
+
+        leaveArchiveCall(archive, &call);
+        result = finishStagedArchive(&staged, result);
+    }
+
+    for (size_t i = 0; sources && i < inputCount; i++)
+        arch_close(sources[i]);
+
+    memFree(keep);
+    memFree(tables);
+    memFree(sources);
+    return result;
+}
+
+// ===== Updating in place =====
+
+static uint64_t getRecordEnd(const EntryRecord* record)
+{
+    return record->dataOffset + getFileHeaderPayloadSize(&record->header);
+}
+
+// Header of a free extent, so readers walking the file step over it in one go
+static bool writeFiller(Archive* archive, uint64_t offset, uint64_t size)
+{
+    FileHeader header;
+    uint64_t compSizePos, crcUncompressedPos, crcCompressedPos;
+
+    if (!initFileHeader(&header, "", size - FILE_HEADER_SIZE, ARCH_FLAG_DELETED))
+        return false;
+
+    uint64_t t = statsBegin();
+    bool ok = offset <= INT64_MAX && fseek64(archive->file, (int64_t)offset, SEEK_SET) == 0 &&
+              writeFileHeader(archive->file, &header, "", &compSizePos, &crcUncompressedPos, &crcCompressedPos) &&
+              fseek64(archive->file, (int64_t)archive->dataEnd, SEEK_SET) == 0;
+    statsEnd(ARCH_STAGE_PATCH, t);
+
+    return ok;
+}
+
+// Free space at the end of the data is given up rather than kept, the directory moves down over it
+static void trimDataEnd(Archive* archive)
+{
+    FreeExtent extent;
+    while (takeFreeExtentEndingAt(archive->freeSpace, archive->dataEnd, &extent))
+        archive->dataEnd = extent.offset;
+}
+
+static ArchResult releaseExtent(Archive* archive, uint64_t offset, uint64_t size)
+{
+    FreeExtent merged;
+    if (!addFreeExtent(archive->freeSpace, offset, size, &merged))
+        return ARCH_ERR_OUT_OF_MEMORY;
+
+    if (merged.offset + merged.size == archive->dataEnd)
+    {
+        trimDataEnd(archive);
+        return fseek64(archive->file, (int64_t)archive->dataEnd, SEEK_SET) == 0 ? ARCH_OK : ARCH_ERR_IO;
+    }
+
+    if (!writeFiller(archive, merged.offset, merged.size))
+        return ARCH_ERR_IO;
+
+    // Only the filler header has to survive, the blocks behind it go back to the file system
+    punchFileHole(archive->file, merged.offset + FILE_HEADER_SIZE, merged.size - FILE_HEADER_SIZE);
+    return ARCH_OK;
+}
+
+// Moves the bytes of the record to offset, which must not overlap them from above. The header goes
+// last: until the move is complete a reader walking the headers still finds what was at offset.
+static bool moveRecordData(Archive* archive, FILE* in, EntryRecord* record, uint64_t offset)
+{
+    size_t headerSize = (size_t)(record->dataOffset - record->headerOffset);
+    uint64_t payloadSize = getRecordEnd(record) - record->dataOffset;
+
+    // Kept aside, an overlapping move may overwrite it before it is written
+    char* header = memAlloc(headerSize);
+    size_t headerRead;
+
+    bool ok = header && record->headerOffset <= INT64_MAX && offset <= INT64_MAX - headerSize &&
+              fseek64(in, (int64_t)record->headerOffset, SEEK_SET) == 0 &&
+              readFile(in, header, headerSize, &headerRead) && headerRead == headerSize &&
+              fseek64(archive->file, (int64_t)(offset + headerSize), SEEK_SET) == 0 &&
+              copyFileRange(in, archive->file, payloadSize) &&
+              fseek64(archive->file, (int64_t)offset, SEEK_SET) == 0 &&
+              writeFile(archive->file, header, headerSize) && fflush(archive->file) == 0;
+
+    memFree(header);
+    if (!ok) return false;
+
+    record->dataOffset = offset + (record->dataOffset - record->headerOffset);
+    record->headerOffset = offset;
+    return true;
+}
+
+// Moves the entry at the end of the data into the best fitting free extent, if there is one. Failing
+// to is harmless, the entry then stays where it was written.
+static void reuseFreeSpace(Archive* archive)
+{
+    EntryTable* table = archive->newEntries;
+    if (table->count == 0 || archive->freeSpace->count == 0) return;
+
+    size_t last = table->count - 1;
+    EntryRecord* record = &table->entries[last];
+    if (getRecordEnd(record) != archive->dataEnd) return;
+
+    uint64_t size = archive->dataEnd - record->headerOffset;
+    uint64_t offset, remainder;
+
+    // A remainder needs room for a filler header of its own
+    if (!allocateFreeExtent(archive->freeSpace, size, FILE_HEADER_SIZE, &offset, &remainder))
+        return;
+
+    FILE* in = openArchiveStream(archive);
+    uint64_t oldOffset = record->headerOffset;
+
+    // The remainder's filler lies inside the extent's, readers only step onto it once the entry is moved
+    if (!in || (remainder > 0 && !writeFiller(archive, offset + size, remainder)) ||
+        !moveRecordData(archive, in, record, offset))
+    {
+        // The extent may be partly overwritten, it gets a fresh filler
+        record->dataOffset = oldOffset + (record->dataOffset - record->headerOffset);
+        record->headerOffset = oldOffset;
+
+        releaseExtent(archive, offset, size);
+        fseek64(archive->file, (int64_t)archive->dataEnd, SEEK_SET);
+    }
+    else
+    {
+        // Keep the table in file order
+        size_t to = last;
+        while (to > 0 && table->entries[to - 1].headerOffset > offset) to--;
+        moveEntryRecord(table, last, to);
+
+        archive->dataEnd = oldOffset;
+        trimDataEnd(archive);
+        fseek64(archive->file, (int64_t)archive->dataEnd, SEEK_SET);
+    }
+
+    if (in) fclose(in);
+}
+
+static int compareRecordOffsets(const void* a, const void* b)
+{
+    const EntryRecord* x = a;
+    const EntryRecord* y = b;
+    return (x->headerOffset > y->headerOffset) - (x->headerOffset < y->headerOffset);
+}
+
+// Collects the gaps between entries, which removals left covered by fillers
+static ArchResult findFreeSpace(Archive* archive)
+{
+    EntryTable* table = archive->newEntries;
+    if (table->count > 1)
+        qsort(table->entries, table->count, sizeof *table->entries, compareRecordOffsets);
+
+    uint64_t end = getArchiveHeaderSize(archive->version);
+
+    for (size_t i = 0; i < table->count; i++)
+    {
+        const EntryRecord* record = &table->entries[i];
+
+        // Entries that refer to others by index would lose their sources when entries move or go
+        if (fileHeaderNeedsReader(&record->header) || record->headerOffset < end ||
+            (record->headerOffset > end && record->headerOffset - end < FILE_HEADER_SIZE))
+        {
+            return fileHeaderNeedsReader(&record->header) ? ARCH_ERR_UNSUPPORTED_VERSION : ARCH_ERR_CORRUPTED;
+        }
+
+        if (record->headerOffset > end && !addFreeExtent(archive->freeSpace, end, record->headerOffset - end, NULL))
+            return ARCH_ERR_OUT_OF_MEMORY;
+
+        end = getRecordEnd(record);
+    }
+
+    archive->dataEnd = end;
+    return ARCH_OK;
+}
+
+// Appends go where the directory is, and removals and moves change the data it describes, long before
+// arch_close writes the new one. So the header stops pointing at it first, and readers walk the entry
+// headers instead, which every completed call leaves in step with the header's entry count. Fillers may
+// appear from now on, the version says so until arch_close sets the final one.
+static ArchResult markArchiveDirty(Archive* archive)
+{
+    bool ok = updateArchiveHeaderDirectoryOffset(archive->file, archive->version, 0) &&
+              (archive->version >= ARCH_VERSION_DELETED || updateArchiveHeaderVersion(archive->file, ARCH_VERSION_DELETED)) &&
+              syncFile(archive->file);
+
+    archive->directoryOffset = 0;
+    return ok ? ARCH_OK : ARCH_ERR_IO;
+}
+
+static ArchResult openForUpdate(Archive* archive)
+{
+    ArchiveHeader header;
+
+    if (!readArchiveHeader(archive->file, &header))
+        return ARCH_ERR_IO;
+    if (header.magic != ARCH_MAGIC)
+        return ARCH_ERR_NOT_AN_ARCHIVE;
+    if (header.version > ARCH_VERSION || header.volumeSize != 0 || header.baseFingerprint != 0)
+        return ARCH_ERR_UNSUPPORTED_VERSION;
+
+    archive->version = header.version;
+    archive->fileCount = (size_t)header.fileCount;
+    archive->directoryOffset = header.directoryOffset;
+
+    archive->newEntries = loadEntryTable(archive->file, header.version, archive->fileCount, header.directoryOffset, 0);
+    archive->freeSpace = createFreeSpace();
+    if (!archive->newEntries || !archive->freeSpace)
+        return archive->newEntries ? ARCH_ERR_OUT_OF_MEMORY : ARCH_ERR_CORRUPTED;
+
+    ArchResult result = findFreeSpace(archive);
+    if (result == ARCH_OK)
+        result = markArchiveDirty(archive);
+    if (result != ARCH_OK)
+        return result;
+
+    // Appends go where the directory was, it is written anew on close
+    return fseek64(archive->file, (int64_t)archive->dataEnd, SEEK_SET) == 0 ? ARCH_OK : ARCH_ERR_IO;
+}
+
+ArchResult arch_openForUpdate(const char* path, const ArchCreateOptions* options, Archive** outArchive)
+{
+    const ArchMemoryOptions* memoryOptions = options ? &options->memory : NULL;
+
+    if (!path || !outArchive || !memoryOptionsValid(memoryOptions))
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    *outArchive = NULL;
+
+    ArchInputOrder inputOrder = options ? options->inputOrder : ARCH_ORDER_SCAN;
+
+    if ((options && (options->volumeSize != 0 || options->longMatchWindow != 0 || options->storeAlignment != 0 ||
+                     options->ioMode != ARCH_IO_BUFFERED)) ||
+        inputOrder < ARCH_ORDER_SCAN || inputOrder > ARCH_ORDER_TYPE)
+    {
+        return ARCH_ERR_INVALID_ARGUMENT;
+    }
+
+    Archive* archive = createArchive(path, "rb+", memoryOptions);
+    if (!archive)
+        return ARCH_ERR_IO;
+
+    archive->inputOrder = inputOrder;
+
+    MemoryScope scope;
+    memoryScopeEnter(&scope, &archive->memory);
+    ArchResult result = openForUpdate(archive);
+    memoryScopeLeave(&scope);
+
+    if (result != ARCH_OK)
+    {
+        freeArchive(archive);
+        return result;
+    }
+
+    *outArchive = archive;
+    return ARCH_OK;
+}
+
+static ArchResult removeEntry(Archive* archive, const char* name)
+{
+    size_t index;
+    const EntryRecord* record = findEntryRecord(archive->newEntries, name, &index);
+    if (!record)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    uint64_t offset = record->headerOffset;
+    uint64_t size = getRecordEnd(record) - offset;
+
+    removeEntryRecord(archive->newEntries, index);
+    archive->fileCount--;
+
+    ArchResult result = releaseExtent(archive, offset, size);
+    countUpdatedEntries(archive);
+    return result;
+}
+
+ArchResult arch_removeEntry(Archive* archive, const char* name)
+{
+    if (!archive || !archive->freeSpace || !name)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = removeEntry(archive, name);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+static ArchResult replaceEntry(Archive* archive, const char* name, const char* path)
+{
+    const EntryRecord* record = findEntryRecord(archive->newEntries, name, NULL);
+    if (!record)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    uint64_t oldOffset = record->headerOffset;
+
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return ARCH_ERR_IO;
+
+    // The new version is complete before the old one goes, a failure leaves the entry as it was
+    FileSource source = { file, false };
+    ArchResult result = addStream(archive, name, readFileSource, &source, getFileSize(file));
+    fclose(file);
+
+    if (result != ARCH_OK)
+        return result;
+
+    for (size_t i = 0; i < archive->newEntries->count; i++)
+    {
+        record = &archive->newEntries->entries[i];
+        if (record->headerOffset != oldOffset) continue;
+
+        uint64_t size = getRecordEnd(record) - oldOffset;
+
+        removeEntryRecord(archive->newEntries, i);
+        archive->fileCount--;
+
+        result = releaseExtent(archive, oldOffset, size);
+        countUpdatedEntries(archive);
+
+        // The old place may fit the new version now
+        if (result == ARCH_OK) reuseFreeSpace(archive);
+        break;
+    }
+
+    return result;
+}
+
+ArchResult arch_replaceEntry(Archive* archive, const char* name, const char* path)
+{
+    if (!archive || !archive->freeSpace || !name || !path)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = replaceEntry(archive, name, path);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+// Slides every entry down over the free space before it, then cuts the file off after the last one
+static ArchResult compact(Archive* archive)
+{
+    EntryTable* table = archive->newEntries;
+
+    FILE* in = openArchiveStream(archive);
+    if (!in)
+        return ARCH_ERR_IO;
+
+    ArchResult result = ARCH_OK;
+    uint64_t end = getArchiveHeaderSize(archive->version);
+
+    for (size_t i = 0; i < table->count; i++)
+    {
+        EntryRecord* record = &table->entries[i];
+
+        if (record->headerOffset == end)
+        {
+            end = getRecordEnd(record);
+            continue;
+        }
+
+        // Moving down, an overlapping copy reads every byte before it is overwritten
+        if (!moveRecordData(archive, in, record, end))
+        {
+            result = payloadError(ARCH_ERR_IO);
+            break;
+        }
+
+        end = getRecordEnd(record);
+
+        // What is left of the old copy gets a filler up to the next entry, so that between moves the
+        // headers can be walked. Moved gaps are at least a header long.
+        uint64_t next = i + 1 < table->count ? table->entries[i + 1].headerOffset : archive->dataEnd;
+        if (next - end >= FILE_HEADER_SIZE && !writeFiller(archive, end, next - end))
+        {
+            result = payloadError(ARCH_ERR_IO);
+            break;
+        }
+    }
+
+    fclose(in);
+
+    if (result != ARCH_OK)
+    {
+        // Entries before the failed one have moved, the space behind them may hold partial copies
+        clearFreeSpace(archive->freeSpace);
+        findFreeSpace(archive);
+
+        if (archive->freeSpace->count > 0 && archive->freeSpace->extents[0].offset == end)
+            writeFiller(archive, end, archive->freeSpace->extents[0].size);
+
+        fseek64(archive->file, (int64_t)archive->dataEnd, SEEK_SET);
+        return result;
+    }
+
+    clearFreeSpace(archive->freeSpace);
+    archive->dataEnd = end;
+
+    if (fseek64(archive->file, (int64_t)end, SEEK_SET) != 0 || !truncateArchive(archive, end))
+        return ARCH_ERR_IO;
+
+    return ARCH_OK;
+}
+
+ArchResult arch_compact(Archive* archive)
+{
+    if (!archive || !archive->freeSpace)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = compact(archive);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+// Appends the directory and points the header at it. Without one readers fall back to walking the
+// file headers, so a failure only costs lookup speed. An archive updated in place is synced in between,
+// its header never points at a directory that hasn't reached the disk.
+static void writeDirectory(Archive* archive)
+{
+    if (!archive->newEntries) return;
+
+    int64_t directoryOffset = ftell64(archive->file);
+    if (directoryOffset <= 0) return;
+
+    if (!writeEntryDirectory(archive->file, archive->newEntries, archive->version, archive->volumeSize) ||
+        (archive->freeSpace && !syncFile(archive->file)) ||
+        !updateArchiveHeaderDirectoryOffset(archive->file, archive->version, (uint64_t)directoryOffset))
+    {
+        perror("Failed to write archive directory");
+
+        if (fseek64(archive->file, directoryOffset, SEEK_SET) == 0)
+            truncateArchive(archive, (uint64_t)directoryOffset);
+    }
+}
+
+// Writes what only goes out on close: the directory, the entry count and the version. Fails where the
+// header can't be completed; a missing directory only costs lookup speed and isn't counted.
+static ArchResult finishArchive(Archive* archive)
+{
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    // An updated archive gets its directory right after the last entry, whatever followed is cut off
+    if (archive->freeSpace)
+        fseek64(archive->file, (int64_t)archive->dataEnd, SEEK_SET);
+
+    uint64_t t = statsBegin();
+    writeDirectory(archive);
+    statsEnd(ARCH_STAGE_WRITE, t);
+
+    t = statsBegin();
+    bool ok = updateArchiveHeaderFileCount(archive->file, archive->version, archive->fileCount);
+
+    if (archive->freeSpace)
+    {
+        int64_t end = ftell64(archive->file);
+        if (end > 0) truncateArchive(archive, (uint64_t)end);
+
+        // Back to the version it was opened with where no filler is left
+        uint16_t version = archive->freeSpace->count > 0 && archive->version < ARCH_VERSION_DELETED ? ARCH_VERSION_DELETED : archive->version;
+        ok = updateArchiveHeaderVersion(archive->file, version) && ok;
+    }
+    statsEnd(ARCH_STAGE_PATCH, t);
+
+    t = statsBegin();
+    finishWriteBehind(&archive->writeBehind);
+    ok = fflush(archive->file) == 0 && ok;
+    statsEnd(ARCH_STAGE_WRITE, t);
+
+    leaveArchiveCall(archive, &call);
+    return ok ? ARCH_OK : ARCH_ERR_IO;
+}
+
+void arch_close(Archive* archive)
+{
+    if (!archive) return;
+
+    if (!archive->readOnly)
+        finishArchive(archive);
+
     freeArchive(archive);
 }
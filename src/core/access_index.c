@@ -0,0 +1,535 @@
+#include "access_index.h"
+#include "file_header.h"
+#include "../util/file.h"
+#include "../util/memory.h"
+#include "../util/stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define POINT_RECORD_SIZE 25
+
+typedef struct PointList
+{
+    AccessPoint* points;
+    size_t count;
+    size_t capacity;
+} PointList;
+
+static bool appendPoint(PointList* list, const AccessPoint* point)
+{
+    if (list->count == list->capacity)
+    {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+
+        AccessPoint* points = memRealloc(list->points, capacity * sizeof *points);
+        if (!points) return false;
+
+        list->points = points;
+        list->capacity = capacity;
+    }
+
+    list->points[list->count++] = *point;
+    return true;
+}
+
+static ArchResult mapZlibError(int ret)
+{
+    switch (ret)
+    {
+        case Z_MEM_ERROR:
+            return ARCH_ERR_OUT_OF_MEMORY;
+
+        case Z_DATA_ERROR:
+        case Z_NEED_DICT:
+            return ARCH_ERR_CORRUPTED;
+
+        default:
+            return ARCH_ERR_COMPRESSION;
+    }
+}
+
+// compress2 / uncompress, with the stream state taken from the archive's memory
+static ArchResult packWindow(unsigned char* packed, uLongf* length, const unsigned char* window, uInt windowSize)
+{
+    z_stream strm = {0};
+    if (!memoryDeflateInit(&strm, 0)) return ARCH_ERR_OUT_OF_MEMORY;
+
+    strm.next_in = (z_const Bytef*)window;
+    strm.avail_in = windowSize;
+    strm.next_out = packed;
+    strm.avail_out = (uInt)*length;
+
+    int ret = deflate(&strm, Z_FINISH);
+    *length = strm.total_out;
+
+    deflateEnd(&strm);
+    return ret == Z_STREAM_END ? ARCH_OK : ARCH_ERR_COMPRESSION;
+}
+
+static bool unpackWindow(unsigned char* window, uLongf* windowSize, const unsigned char* packed, uInt length)
+{
+    z_stream strm = {0};
+    memoryBindStream(&strm);
+    if (inflateInit(&strm) != Z_OK) return false;
+
+    strm.next_in = (z_const Bytef*)packed;
+    strm.avail_in = length;
+    strm.next_out = window;
+    strm.avail_out = (uInt)*windowSize;
+
+    int ret = inflate(&strm, Z_FINISH);
+    *windowSize = strm.total_out;
+
+    inflateEnd(&strm);
+    return ret == Z_STREAM_END;
+}
+
+// Deflates the dictionary into the index file and records the point
+static ArchResult writePoint(FILE* indexFile, PointList* list, AccessPoint* point, const unsigned char* window, unsigned char* packed, uLong packedSize)
+{
+    uLongf length = packedSize;
+    ArchResult result = packWindow(packed, &length, window, point->windowSize);
+    if (result != ARCH_OK)
+        return result;
+
+    point->windowLength = (uint32_t)length;
+
+    unsigned char fields[POINT_RECORD_SIZE];
+    write_u64_le(fields, point->outOffset);
+    write_u64_le(fields + 8, point->inOffset);
+    fields[16] = point->bits;
+    write_u32_le(fields + 17, point->windowSize);
+    write_u32_le(fields + 21, point->windowLength);
+
+    if (!writeFile(indexFile, (const char*)fields, sizeof fields))
+        return ARCH_ERR_IO;
+
+    int64_t windowPos = ftell64(indexFile);
+    if (windowPos < 0 || !writeFile(indexFile, (const char*)packed, length))
+        return ARCH_ERR_IO;
+
+    point->windowPos = (uint64_t)windowPos;
+
+    return appendPoint(list, point) ? ARCH_OK : ARCH_ERR_OUT_OF_MEMORY;
+}
+
+// One inflate pass over the payload, stopping at every block boundary to see whether a point is due
+static ArchResult indexEntry(FILE* archiveFile, const EntryRecord* record, uint64_t span, FILE* indexFile, PointList* list)
+{
+    const FileHeader* header = &record->header;
+
+    if (record->dataOffset > INT64_MAX || fseek64(archiveFile, (int64_t)record->dataOffset, SEEK_SET) != 0)
+        return ARCH_ERR_IO;
+
+    unsigned char* inBuf = NULL;
+    size_t inBufSize = tryAllocateBuffer(&inBuf);
+
+    // Output goes round a 32 KiB ring, which always holds the dictionary for the current position
+    unsigned char* window = memAlloc(ACCESS_WINDOW_SIZE);
+    unsigned char* dictionary = memAlloc(ACCESS_WINDOW_SIZE);
+
+    uLong packedSize = compressBound(ACCESS_WINDOW_SIZE);
+    unsigned char* packed = memAlloc(packedSize);
+
+    if (inBufSize == 0 || !window || !dictionary || !packed)
+    {
+        memFree(inBuf);
+        memFree(window);
+        memFree(dictionary);
+        memFree(packed);
+        return ARCH_ERR_OUT_OF_MEMORY;
+    }
+
+    ArchResult result = ARCH_OK;
+
+    z_stream strm = {0};
+    memoryBindStream(&strm);
+
+    if (inflateInit(&strm) != Z_OK)
+    {
+        result = ARCH_ERR_INTERNAL;
+        goto cleanup;
+    }
+
+    uint64_t compLeft = header->compSize;
+    uint64_t lastPoint = 0;
+
+    strm.next_out = window;
+    strm.avail_out = ACCESS_WINDOW_SIZE;
+
+    int ret;
+    do
+    {
+        if (strm.avail_in == 0)
+        {
+            size_t toRead = (compLeft < inBufSize) ? (size_t)compLeft : inBufSize;
+            size_t bytesRead = 0;
+
+            uint64_t t = statsBegin();
+            bool readOk = toRead > 0 && readFile(archiveFile, (char*)inBuf, toRead, &bytesRead);
+            statsEnd(ARCH_STAGE_READ, t);
+
+            if (!readOk || bytesRead == 0)
+            {
+                result = readOk || toRead == 0 ? ARCH_ERR_CORRUPTED : ARCH_ERR_IO;
+                break;
+            }
+
+            STATS_ADD(bytesRead, bytesRead);
+            compLeft -= bytesRead;
+
+            strm.next_in = inBuf;
+            strm.avail_in = (uInt)bytesRead;
+        }
+
+        if (strm.avail_out == 0)
+        {
+            strm.next_out = window;
+            strm.avail_out = ACCESS_WINDOW_SIZE;
+        }
+
+        uint64_t t = statsBegin();
+        ret = inflate(&strm, Z_BLOCK);
+        statsEnd(ARCH_STAGE_DECOMPRESS, t);
+
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+        {
+            result = mapZlibError(ret);
+            break;
+        }
+
+        // At a block boundary that is not the end of the stream
+        bool boundary = (strm.data_type & 128) && !(strm.data_type & 64);
+
+        if (boundary && strm.total_out - lastPoint >= span)
+        {
+            size_t ringPos = ACCESS_WINDOW_SIZE - strm.avail_out;
+
+            AccessPoint point = {
+                .outOffset = strm.total_out,
+                .inOffset = strm.total_in,
+                .bits = (uint8_t)(strm.data_type & 7),
+                .windowSize = strm.total_out < ACCESS_WINDOW_SIZE ? (uint32_t)strm.total_out : ACCESS_WINDOW_SIZE
+            };
+
+            // Unroll the ring, oldest bytes first
+            if (point.windowSize == ACCESS_WINDOW_SIZE)
+            {
+                memcpy(dictionary, window + ringPos, ACCESS_WINDOW_SIZE - ringPos);
+                memcpy(dictionary + ACCESS_WINDOW_SIZE - ringPos, window, ringPos);
+            }
+            else
+            {
+                memcpy(dictionary, window, point.windowSize);
+            }
+
+            result = writePoint(indexFile, list, &point, dictionary, packed, packedSize);
+            if (result != ARCH_OK) break;
+
+            lastPoint = strm.total_out;
+        }
+    } while (ret != Z_STREAM_END);
+
+    if (result == ARCH_OK && strm.total_out != header->origSize)
+        result = ARCH_ERR_CORRUPTED;
+
+    inflateEnd(&strm);
+
+cleanup:
+    memFree(inBuf);
+    memFree(window);
+    memFree(dictionary);
+    memFree(packed);
+    return result;
+}
+
+static AccessIndex* allocateIndex(const char* path, size_t entryCount)
+{
+    AccessIndex* index = memCalloc(1, sizeof *index);
+    if (!index) return NULL;
+
+    index->path = memStrdup(path);
+    index->entries = memCalloc(entryCount ? entryCount : 1, sizeof *index->entries);
+    index->entryCount = entryCount;
+
+    if (!index->path || !index->entries)
+    {
+        freeAccessIndex(index);
+        return NULL;
+    }
+
+    return index;
+}
+
+AccessIndex* buildAccessIndex(FILE* archiveFile, const EntryTable* table, uint64_t span, const char* path, ArchResult* outResult)
+{
+    *outResult = ARCH_ERR_INVALID_ARGUMENT;
+    if (!archiveFile || !table || !path || span == 0) return NULL;
+
+    *outResult = ARCH_ERR_OUT_OF_MEMORY;
+    AccessIndex* index = allocateIndex(path, table->count);
+    if (!index) return NULL;
+
+    index->span = span;
+
+    *outResult = ARCH_ERR_IO;
+    FILE* indexFile = fopen(path, "wb");
+    if (!indexFile)
+    {
+        freeAccessIndex(index);
+        return NULL;
+    }
+
+    ArchResult result = ARCH_OK;
+
+    unsigned char prefix[20];
+    write_u32_le(prefix, ACCESS_INDEX_MAGIC);
+    write_u64_le(prefix + 4, table->count);
+    write_u64_le(prefix + 12, span);
+
+    if (!writeFile(indexFile, (const char*)prefix, sizeof prefix))
+        result = ARCH_ERR_IO;
+
+    for (size_t i = 0; i < table->count && result == ARCH_OK; i++)
+    {
+        const EntryRecord* record = &table->entries[i];
+        PointList list = {0};
+
+        // Identifies the entry, so an index is never applied to another archive
+        unsigned char fields[16];
+        write_u32_le(fields, record->header.crc32_compressed);
+        write_u64_le(fields + 4, getFileHeaderPayloadSize(&record->header));
+
+        int64_t countPos = ftell64(indexFile) + 12;
+        write_u32_le(fields + 12, 0);
+
+        if (countPos < 12 || !writeFile(indexFile, (const char*)fields, sizeof fields))
+        {
+            result = ARCH_ERR_IO;
+            break;
+        }
+
+        // Long-match entries inflate to their literals only, offsets in there don't map to the content
+        if ((record->header.flags & ARCH_FLAG_COMPRESSED) && !(record->header.flags & ARCH_FLAG_LONG_MATCH))
+            result = indexEntry(archiveFile, record, span, indexFile, &list);
+
+        index->entries[i].points = list.points;
+        index->entries[i].count = list.count;
+
+        if (result == ARCH_OK && list.count > 0)
+        {
+            unsigned char count[4];
+            write_u32_le(count, (uint32_t)list.count);
+
+            int64_t endPos = ftell64(indexFile);
+            if (endPos < 0 || fseek64(indexFile, countPos, SEEK_SET) != 0 ||
+                !writeFile(indexFile, (const char*)count, sizeof count) || fseek64(indexFile, endPos, SEEK_SET) != 0)
+            {
+                result = ARCH_ERR_IO;
+            }
+        }
+    }
+
+    if (fclose(indexFile) != 0 && result == ARCH_OK)
+        result = ARCH_ERR_IO;
+
+    if (result != ARCH_OK)
+    {
+        remove(path);
+        freeAccessIndex(index);
+        *outResult = result;
+        return NULL;
+    }
+
+    index->file = openSingleVolume(path);
+
+    *outResult = ARCH_OK;
+    return index;
+}
+
+AccessIndex* loadAccessIndex(const EntryTable* table, const char* path, ArchResult* outResult)
+{
+    *outResult = ARCH_ERR_INVALID_ARGUMENT;
+    if (!table || !path) return NULL;
+
+    *outResult = ARCH_ERR_IO;
+    FILE* indexFile = fopen(path, "rb");
+    if (!indexFile) return NULL;
+
+    AccessIndex* index = allocateIndex(path, table->count);
+    ArchResult result = index ? ARCH_OK : ARCH_ERR_OUT_OF_MEMORY;
+
+    unsigned char prefix[20];
+    size_t read;
+
+    if (result == ARCH_OK)
+    {
+        if (!readFile(indexFile, (char*)prefix, sizeof prefix, &read) || read != sizeof prefix ||
+            read_u32_le(prefix) != ACCESS_INDEX_MAGIC)
+            result = ARCH_ERR_NOT_AN_ARCHIVE;
+        else if (read_u64_le(prefix + 4) != table->count)
+            result = ARCH_ERR_INVALID_ARGUMENT;
+        else
+            index->span = read_u64_le(prefix + 12);
+    }
+
+    for (size_t i = 0; i < table->count && result == ARCH_OK; i++)
+    {
+        const EntryRecord* record = &table->entries[i];
+        EntryAccess* access = &index->entries[i];
+
+        unsigned char fields[16];
+        if (!readFile(indexFile, (char*)fields, sizeof fields, &read) || read != sizeof fields)
+        {
+            result = ARCH_ERR_CORRUPTED;
+            break;
+        }
+
+        if (read_u32_le(fields) != record->header.crc32_compressed ||
+            read_u64_le(fields + 4) != getFileHeaderPayloadSize(&record->header))
+        {
+            // Built for a different archive
+            result = ARCH_ERR_INVALID_ARGUMENT;
+            break;
+        }
+
+        uint32_t count = read_u32_le(fields + 12);
+        if (count == 0) continue;
+
+        access->points = memCalloc(count, sizeof *access->points);
+        if (!access->points)
+        {
+            result = ARCH_ERR_OUT_OF_MEMORY;
+            break;
+        }
+
+        for (uint32_t p = 0; p < count; p++)
+        {
+            unsigned char point[POINT_RECORD_SIZE];
+            if (!readFile(indexFile, (char*)point, sizeof point, &read) || read != sizeof point)
+            {
+                result = ARCH_ERR_CORRUPTED;
+                break;
+            }
+
+            AccessPoint* ap = &access->points[p];
+            ap->outOffset = read_u64_le(point);
+            ap->inOffset = read_u64_le(point + 8);
+            ap->bits = point[16];
+            ap->windowSize = read_u32_le(point + 17);
+            ap->windowLength = read_u32_le(point + 21);
+
+            int64_t windowPos = ftell64(indexFile);
+            if (ap->bits > 7 || ap->windowSize > ACCESS_WINDOW_SIZE || ap->outOffset > record->header.origSize ||
+                ap->inOffset > record->header.compSize || windowPos < 0 ||
+                fseek64(indexFile, ap->windowLength, SEEK_CUR) != 0)
+            {
+                result = ARCH_ERR_CORRUPTED;
+                break;
+            }
+
+            ap->windowPos = (uint64_t)windowPos;
+            access->count++;
+        }
+    }
+
+    fclose(indexFile);
+
+    if (result != ARCH_OK)
+    {
+        freeAccessIndex(index);
+        *outResult = result;
+        return NULL;
+    }
+
+    index->file = openSingleVolume(path);
+
+    *outResult = ARCH_OK;
+    return index;
+}
+
+void freeAccessIndex(AccessIndex* index)
+{
+    if (!index) return;
+
+    if (index->entries)
+    {
+        for (size_t i = 0; i < index->entryCount; i++)
+        {
+            memFree(index->entries[i].points);
+        }
+    }
+
+    releaseVolumeSet(index->file);
+    memFree(index->entries);
+    memFree(index->path);
+    memFree(index);
+}
+
+FILE* openAccessIndexStream(const AccessIndex* index)
+{
+    if (!index) return NULL;
+
+    return index->file ? openVolumeStream(index->file) : fopen(index->path, "rb");
+}
+
+const AccessPoint* findAccessPoint(const EntryAccess* access, uint64_t offset)
+{
+    if (!access || access->count == 0 || access->points[0].outOffset > offset) return NULL;
+
+    // Points are in ascending order, binary search for the last one not past offset
+    size_t low = 0;
+    size_t high = access->count;
+    while (high - low > 1)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (access->points[mid].outOffset <= offset)
+            low = mid;
+        else
+            high = mid;
+    }
+
+    return &access->points[low];
+}
+
+ArchResult restoreAccessPoint(z_stream* strm, FILE* archiveFile, uint64_t dataOffset, FILE* indexFile, const AccessPoint* point)
+{
+    unsigned char packed[ACCESS_WINDOW_SIZE + 64];
+    unsigned char dictionary[ACCESS_WINDOW_SIZE];
+
+    if (point->windowLength > sizeof packed)
+        return ARCH_ERR_CORRUPTED;
+
+    size_t read;
+    if (point->windowPos > INT64_MAX || fseek64(indexFile, (int64_t)point->windowPos, SEEK_SET) != 0 ||
+        !readFile(indexFile, (char*)packed, point->windowLength, &read) || read != point->windowLength)
+        return ARCH_ERR_IO;
+
+    uLongf windowSize = sizeof dictionary;
+    if (!unpackWindow(dictionary, &windowSize, packed, point->windowLength) || windowSize != point->windowSize)
+        return ARCH_ERR_CORRUPTED;
+
+    // The payload is a zlib stream, past its header the blocks are raw deflate
+    if (inflateReset2(strm, -15) != Z_OK)
+        return ARCH_ERR_INTERNAL;
+
+    uint64_t start = dataOffset + point->inOffset - (point->bits ? 1 : 0);
+    if (start > INT64_MAX || fseek64(archiveFile, (int64_t)start, SEEK_SET) != 0)
+        return ARCH_ERR_IO;
+
+    if (point->bits)
+    {
+        int byte = fgetc(archiveFile);
+        if (byte == EOF)
+            return ARCH_ERR_CORRUPTED;
+
+        if (inflatePrime(strm, point->bits, byte >> (8 - point->bits)) != Z_OK)
+            return ARCH_ERR_INTERNAL;
+    }
+
+    if (windowSize > 0 && inflateSetDictionary(strm, dictionary, (uInt)windowSize) != Z_OK)
+        return ARCH_ERR_INTERNAL;
+
+    return ARCH_OK;
+}
@@ -0,0 +1,59 @@
+#ifndef ACCESS_INDEX_H
+#define ACCESS_INDEX_H
+
+#include <arch/arch_errors.h>
+
+#include "entry_table.h"
+#include "volume.h"
+
+#include <zlib.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define ACCESS_INDEX_MAGIC 0x5844495Au  /* "ZIDX" */
+#define ACCESS_WINDOW_SIZE 32768
+
+// Place inside a compressed payload where inflating can resume without the data before it
+typedef struct AccessPoint
+{
+    uint64_t outOffset;     // Uncompressed position
+    uint64_t inOffset;      // Payload byte holding the first bit of the next deflate block
+    uint8_t bits;           // Bits of the previous byte that already belong to that block
+    uint32_t windowSize;    // Dictionary bytes, less than 32 KiB only near the start of an entry
+    uint64_t windowPos;     // Deflated dictionary, located in the index file
+    uint32_t windowLength;
+} AccessPoint;
+
+typedef struct EntryAccess
+{
+    AccessPoint* points;
+    size_t count;
+} EntryAccess;
+
+// The points stay in memory (~40 bytes each), the dictionaries are read back from the index file on use
+typedef struct AccessIndex
+{
+    char* path;
+    VolumeSet* file;      // Shared descriptor of the index file, NULL where streams reopen it by path
+    uint64_t span;
+    EntryAccess* entries; // Parallel to the entry table
+    size_t entryCount;
+} AccessIndex;
+
+AccessIndex* buildAccessIndex(FILE* archiveFile, const EntryTable* table, uint64_t span, const char* path, ArchResult* outResult);
+AccessIndex* loadAccessIndex(const EntryTable* table, const char* path, ArchResult* outResult);
+void freeAccessIndex(AccessIndex* index);
+
+// Private cursor on the index file for reading dictionaries
+FILE* openAccessIndexStream(const AccessIndex* index);
+
+// Last point at or before offset, NULL when there is none
+const AccessPoint* findAccessPoint(const EntryAccess* access, uint64_t offset);
+
+// Positions archiveFile and strm (inflateInit'ed) so that inflating continues at point->outOffset
+ArchResult restoreAccessPoint(z_stream* strm, FILE* archiveFile, uint64_t dataOffset, FILE* indexFile, const AccessPoint* point);
+
+#endif // ACCESS_INDEX_H
@@ -1,34 +1,141 @@
 #include "archive.h"
+#include "../util/file.h"
 
-#include <stdlib.h>
 #include <string.h>
 
-Archive* createArchive(const char* path, const char* fileMode)
+static Archive* allocateArchive(const char* path, const ArchMemoryOptions* memoryOptions)
 {
-    if (!path || !fileMode) return NULL;
+    if (!memoryOptionsValid(memoryOptions)) return NULL;
+
+    const ArchAllocator* allocator = memoryOptions ? memoryOptions->allocator : NULL;
 
-    Archive* archive = malloc(sizeof *archive);
+    Archive* archive = memoryAllocRaw(allocator, sizeof *archive);
     if (!archive) return NULL;
 
-    archive->readOnly = fileMode[0] == "r";
+    if (!memoryInit(&archive->memory, memoryOptions))
+    {
+        memoryFreeRaw(allocator, archive);
+        return NULL;
+    }
+
+    if (!mutexInit(&archive->statsLock))
+    {
+        memoryDestroy(&archive->memory);
+        memoryFreeRaw(allocator, archive);
+        return NULL;
+    }
+
+    if (!mutexInit(&archive->tableLock))
+    {
+        mutexDestroy(&archive->statsLock);
+        memoryDestroy(&archive->memory);
+        memoryFreeRaw(allocator, archive);
+        return NULL;
+    }
+
+    if (!progressInit(&archive->progress))
+    {
+        mutexDestroy(&archive->tableLock);
+        mutexDestroy(&archive->statsLock);
+        memoryDestroy(&archive->memory);
+        memoryFreeRaw(allocator, archive);
+        return NULL;
+    }
+
+    archive->readOnly = false;
+    archive->file = NULL;
+    archive->volumes = NULL;
+    archive->volumeSize = 0;
+    archive->directoryOffset = 0;
+
+    archive->fileCount = 0;
+    archive->currentFileIndex = 0;
+
+    archive->entryPending = false;
+    archive->entryName = NULL;
+    archive->entryDataOffset = 0;
+
+    archive->entryTable = NULL;
+    archive->nameIndex = NULL;
+    archive->newEntries = NULL;
+    archive->inputOrder = ARCH_ORDER_SCAN;
+    archive->longMatcher = NULL;
+    archive->storeAlignment = 0;
+    archive->ioMode = ARCH_IO_BUFFERED;
+    initWriteBehind(&archive->writeBehind, NULL, ARCH_IO_BUFFERED);
+    archive->accessIndex = NULL;
+    archive->cache = NULL;
+    archive->mapping = NULL;
+    archive->mappingSize = 0;
+    archive->base = NULL;
+    archive->freeSpace = NULL;
+    archive->dataEnd = 0;
+    archive->version = ARCH_VERSION_BASE;
+
+    memset(&archive->stats, 0, sizeof archive->stats);
+
+    MemoryScope scope;
+    memoryScopeEnter(&scope, &archive->memory);
+    archive->filePath = memStrdup(path);
+    memoryScopeLeave(&scope);
 
-    archive->filePath = strdup(path);
     if (!archive->filePath)
     {
-        free(archive);
+        freeArchive(archive);
         return NULL;
     }
 
+    return archive;
+}
+
+Archive* createArchive(const char* path, const char* fileMode, const ArchMemoryOptions* memoryOptions)
+{
+    if (!path || !fileMode) return NULL;
+
+    Archive* archive = allocateArchive(path, memoryOptions);
+    if (!archive) return NULL;
+
+    archive->readOnly = fileMode[0] == 'r' && !strchr(fileMode, '+');
+
     archive->file = fopen(path, fileMode);
     if (!archive->file)
     {
-        free((char*)archive->filePath);
-        free(archive);
+        freeArchive(archive);
         return NULL;
     }
 
-    archive->fileCount = 0;
-    archive->currentFileIndex = 0;
+    // Streams for readers share one descriptor, without it every stream opens the file again
+    if (archive->readOnly)
+    {
+        MemoryScope scope;
+        memoryScopeEnter(&scope, &archive->memory);
+        archive->volumes = openSingleVolume(path);
+        memoryScopeLeave(&scope);
+    }
+
+    return archive;
+}
+
+Archive* createSplitArchive(const char* basePath, uint64_t volumeSize, bool readOnly, const ArchMemoryOptions* memoryOptions)
+{
+    if (!basePath || volumeSize == 0) return NULL;
+
+    Archive* archive = allocateArchive(basePath, memoryOptions);
+    if (!archive) return NULL;
+
+    archive->readOnly = readOnly;
+    archive->volumeSize = volumeSize;
+
+    MemoryScope scope;
+    memoryScopeEnter(&scope, &archive->memory);
+    archive->volumes = openVolumeSet(basePath, volumeSize, !readOnly);
+    archive->file = openVolumeStream(archive->volumes);
+    memoryScopeLeave(&scope);
+    if (!archive->file)
+    {
+        freeArchive(archive);
+        return NULL;
+    }
 
     return archive;
 }
@@ -42,9 +149,137 @@ void freeArchive(Archive *archive)
         fflush(archive->file);
         fclose(archive->file);
     }
-    if (archive->filePath)
+    releaseVolumeSet(archive->volumes);
+    memFree((char*)archive->filePath);
+    memFree(archive->entryName);
+    freeNameIndex(archive->nameIndex);
+    freeEntryTable(archive->entryTable);
+    freeEntryTable(archive->newEntries);
+    longMatcherFree(archive->longMatcher);
+    freeAccessIndex(archive->accessIndex);
+    freeEntryCache(archive->cache);
+    unmapFile(archive->mapping, archive->mappingSize);
+    freeArchive(archive->base);
+    freeFreeSpace(archive->freeSpace);
+    progressDestroy(&archive->progress);
+    mutexDestroy(&archive->tableLock);
+    mutexDestroy(&archive->statsLock);
+
+    // Copied out, the allocator lives inside the block it frees
+    ArchAllocator allocator = archive->memory.allocator;
+    memoryDestroy(&archive->memory);
+    memoryFreeRaw(&allocator, archive);
+}
+
+const EntryTable* getArchiveEntryTable(Archive* archive)
+{
+    if (!archive || !archive->readOnly) return NULL;
+
+    mutexLock(&archive->tableLock);
+
+    if (!archive->entryTable)
+    {
+        MemoryScope scope;
+        memoryScopeEnter(&scope, &archive->memory);
+
+        // Loaded through a stream of its own, the sequential cursor of archive->file may be in use
+        FILE* file = openArchiveStream(archive);
+        if (file)
+        {
+            archive->entryTable = loadEntryTable(file, archive->version, archive->fileCount, archive->directoryOffset, archive->volumeSize);
+            fclose(file);
+        }
+
+        memoryScopeLeave(&scope);
+    }
+
+    const EntryTable* table = archive->entryTable;
+    mutexUnlock(&archive->tableLock);
+
+    return table;
+}
+
+const NameIndex* getArchiveNameIndex(Archive* archive)
+{
+    const EntryTable* table = getArchiveEntryTable(archive);
+    if (!table) return NULL;
+
+    mutexLock(&archive->tableLock);
+
+    if (!archive->nameIndex)
+    {
+        MemoryScope scope;
+        memoryScopeEnter(&scope, &archive->memory);
+        archive->nameIndex = createNameIndex(table);
+        memoryScopeLeave(&scope);
+    }
+
+    const NameIndex* index = archive->nameIndex;
+    mutexUnlock(&archive->tableLock);
+
+    return index;
+}
+
+const EntryRecord* findArchiveEntry(Archive* archive, const char* name, size_t* outIndex)
+{
+    const NameIndex* index = getArchiveNameIndex(archive);
+    if (!index) return findEntryRecord(getArchiveEntryTable(archive), name, outIndex);
+
+    const EntryRecord* record = findIndexedName(index, name);
+    if (record && outIndex) *outIndex = (size_t)(record - archive->entryTable->entries);
+
+    return record;
+}
+
+const unsigned char* getArchiveMapping(Archive* archive, uint64_t* outSize)
+{
+    if (!archive || !archive->readOnly || archive->volumeSize) return NULL;
+
+    mutexLock(&archive->tableLock);
+
+    if (!archive->mapping)
+        archive->mapping = mapFile(archive->file, &archive->mappingSize);
+
+    const unsigned char* mapping = archive->mapping;
+    *outSize = archive->mappingSize;
+    mutexUnlock(&archive->tableLock);
+
+    return mapping;
+}
+
+FILE* openArchiveStream(Archive* archive)
+{
+    if (!archive) return NULL;
+
+    return archive->volumes ? openVolumeStream(archive->volumes) : fopen(archive->filePath, "rb");
+}
+
+bool truncateArchive(Archive* archive, uint64_t size)
+{
+    if (!archive || archive->readOnly) return false;
+
+    if (archive->volumeSize)
     {
-        free((char*)archive->filePath);
+        return fflush(archive->file) == 0 && truncateVolumeSet(archive->volumes, size);
     }
-    free(archive);
+
+    return truncateFile(archive->file, size);
+}
+
+void enterArchiveCall(Archive* archive, ArchiveCall* call)
+{
+    statsScopeEnter(&call->stats);
+    progressScopeEnter(&call->progress, &archive->progress);
+    memoryScopeEnter(&call->memory, &archive->memory);
+}
+
+void leaveArchiveCall(Archive* archive, ArchiveCall* call)
+{
+    memoryScopeLeave(&call->memory);
+    progressScopeLeave(&call->progress);
+    statsScopeLeave(&call->stats);
+
+    mutexLock(&archive->statsLock);
+    statsMerge(&archive->stats, &call->stats.local);
+    mutexUnlock(&archive->statsLock);
 }
@@ -1,6 +1,22 @@
 #ifndef ARCHIVE_H
 #define ARCHIVE_H
 
+#include <arch/arch_types.h>
+#include <arch/archiver.h>
+
+#include "access_index.h"
+#include "entry_cache.h"
+#include "entry_table.h"
+#include "free_space.h"
+#include "name_index.h"
+#include "volume.h"
+#include "../util/long_match.h"
+#include "../util/memory.h"
+#include "../util/page_cache.h"
+#include "../util/progress.h"
+#include "../util/stats.h"
+#include "../util/thread.h"
+
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -8,13 +24,94 @@
 typedef struct Archive
 {
     bool readOnly;
-    const char* filePath;
+    const char* filePath;   // Base name without the volume suffix for split archives
     FILE* file;
+
+    // Split archives write and read through a stream over all volumes. Read-only single-file archives
+    // keep a one-volume set next to file, so openArchiveStream hands out cursors on a shared descriptor.
+    VolumeSet* volumes;
+    uint64_t volumeSize;    // 0 unless split
+
+    uint64_t directoryOffset;   // 0 when the archive has no directory
     size_t fileCount;
     size_t currentFileIndex;
+
+    // Header of the entry the read cursor is positioned at (payload not consumed yet)
+    bool entryPending;
+    FileHeader entryHeader;
+    char* entryName;
+    uint64_t entryDataOffset;
+
+    // Loaded on first random access, see getArchiveEntryTable; immutable from then on
+    Mutex tableLock;
+    EntryTable* entryTable;
+    NameIndex* nameIndex;   // Built over entryTable on the first lookup by name
+
+    // Entries completed by a writer, stored as the directory on close
+    EntryTable* newEntries;
+    ArchInputOrder inputOrder;
+    LongMatcher* longMatcher;   // NULL unless long-range matching was asked for
+    uint64_t storeAlignment;    // Non-zero: entries are stored, payloads start at multiples of it
+    ArchIoMode ioMode;
+    WriteBehind writeBehind;    // Of new archives outside buffered mode
+
+    // Optional restart points for compressed entries, parallel to entryTable
+    AccessIndex* accessIndex;
+
+    // Decompressed entries for arch_entryAcquire, NULL unless a budget was given on open
+    EntryCache* cache;
+
+    // Read-only single-file archives: the whole file, mapped on the first arch_mapEntry
+    const unsigned char* mapping;
+    uint64_t mappingSize;
+
+    // Base of a delta archive, opened along with it (read-only) or while writing one, and owned
+    struct Archive* base;
+
+    // Archives opened for update: space of removed entries, each extent covered by one ARCH_FLAG_DELETED
+    // filler, and the end of the last entry, where appends and the directory go. NULL for new archives.
+    FreeSpace* freeSpace;
+    uint64_t dataEnd;
+    uint16_t version;
+
+    // Totals of all finished calls, guarded by statsLock
+    Mutex statsLock;
+    ArchStats stats;
+
+    Progress progress;
+
+    // Every allocation made for the archive, the Archive itself comes raw from the same allocator
+    Memory memory;
 } Archive;
 
-Archive* createArchive(const char* path, const char* fileMode);
+// Per-call state of a public API call, bound to the calling thread
+typedef struct ArchiveCall
+{
+    StatsScope stats;
+    ProgressScope progress;
+    MemoryScope memory;
+} ArchiveCall;
+
+// memoryOptions may be NULL for the C heap without a cap
+Archive* createArchive(const char* path, const char* fileMode, const ArchMemoryOptions* memoryOptions);
+Archive* createSplitArchive(const char* basePath, uint64_t volumeSize, bool readOnly, const ArchMemoryOptions* memoryOptions);
 void freeArchive(Archive* archive);
 
+// Thread-safe, the table is loaded once and then shared by every reader
+const EntryTable* getArchiveEntryTable(Archive* archive);
+// Same for the name index, NULL without a table or memory for the index
+const NameIndex* getArchiveNameIndex(Archive* archive);
+// First entry of that name through the name index, or by a linear search where it can't be built
+const EntryRecord* findArchiveEntry(Archive* archive, const char* name, size_t* outIndex);
+
+// Thread-safe, maps the file once for arch_mapEntry; NULL for split or writable archives and where mapping fails
+const unsigned char* getArchiveMapping(Archive* archive, uint64_t* outSize);
+
+// Independent read cursor, positional reads on the shared descriptors where the platform allows
+FILE* openArchiveStream(Archive* archive);
+bool truncateArchive(Archive* archive, uint64_t size);
+
+void enterArchiveCall(Archive* archive, ArchiveCall* call);
+void leaveArchiveCall(Archive* archive, ArchiveCall* call);
+
 #endif // ARCHIVE_H
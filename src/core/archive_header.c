@@ -9,13 +9,20 @@ bool createArchiveHeader(ArchiveHeader* header)
     if (!header) return false;
 
     header->magic = ARCH_MAGIC;
-    header->version = ARCH_VERSION;
+    header->version = ARCH_VERSION_BASE;
     header->fileCount = 0;
-    memset(header->reserved, 0, sizeof(header->reserved));
+    header->directoryOffset = 0;
+    header->volumeSize = 0;
+    header->baseFingerprint = 0;
 
     return true;
 }
 
+uint64_t getArchiveHeaderSize(uint16_t version)
+{
+    return version >= ARCH_VERSION_COMPACT ? ARCHIVE_HEADER_SIZE_COMPACT : ARCHIVE_HEADER_SIZE;
+}
+
 void freeArchiveHeader(ArchiveHeader *header)
 {
     if (header) free(header);
@@ -25,18 +32,66 @@ bool writeArchiveHeader(FILE* file, const ArchiveHeader* header)
 {
     if (!writeFile(file, (const char*)&header->magic, sizeof(header->magic))) return false;
     if (!writeFile(file, (const char*)&header->version, sizeof(header->version))) return false;
-    if (!writeFile(file, (const char*)&header->fileCount, sizeof(header->fileCount))) return false;
-    if (!writeFile(file, header->reserved, sizeof(header->reserved))) return false;
+
+    if (header->version >= ARCH_VERSION_COMPACT)
+    {
+        if (!writeFile(file, (const char*)&header->fileCount, sizeof(header->fileCount))) return false;
+    }
+    else
+    {
+        if (header->fileCount > UINT32_MAX) return false;
+
+        uint32_t fileCount = (uint32_t)header->fileCount;
+        if (!writeFile(file, (const char*)&fileCount, sizeof(fileCount))) return false;
+    }
+
+    if (!writeFile(file, (const char*)&header->directoryOffset, sizeof(header->directoryOffset))) return false;
+    if (!writeFile(file, (const char*)&header->volumeSize, sizeof(header->volumeSize))) return false;
+    if (!writeFile(file, (const char*)&header->baseFingerprint, sizeof(header->baseFingerprint))) return false;
     return true;
 }
 
-bool updateArchiveHeaderFileCount(FILE* file, uint32_t fileCount)
+bool updateArchiveHeaderFileCount(FILE* file, uint16_t version, uint64_t fileCount)
 {
+    bool wide = version >= ARCH_VERSION_COMPACT;
+    if (!wide && fileCount > UINT32_MAX) return false;
+
     int64_t origPos = ftell64(file);
     if (origPos < 0) return false;
 
+    uint32_t narrowCount = (uint32_t)fileCount;
+
     if (fseek(file, 6, SEEK_SET) != 0) return false;
-    if (!writeFile(file, (const char*)&fileCount, sizeof(fileCount))) return false;
+    if (wide && !writeFile(file, (const char*)&fileCount, sizeof(fileCount))) return false;
+    if (!wide && !writeFile(file, (const char*)&narrowCount, sizeof(narrowCount))) return false;
+    fflush(file);
+
+    if (fseek64(file, origPos, SEEK_SET) != 0) return false;
+
+    return true;
+}
+
+bool updateArchiveHeaderVersion(FILE* file, uint16_t version)
+{
+    int64_t origPos = ftell64(file);
+    if (origPos < 0) return false;
+
+    if (fseek(file, 4, SEEK_SET) != 0) return false;
+    if (!writeFile(file, (const char*)&version, sizeof(version))) return false;
+    fflush(file);
+
+    if (fseek64(file, origPos, SEEK_SET) != 0) return false;
+
+    return true;
+}
+
+bool updateArchiveHeaderDirectoryOffset(FILE* file, uint16_t version, uint64_t directoryOffset)
+{
+    int64_t origPos = ftell64(file);
+    if (origPos < 0) return false;
+
+    if (fseek(file, version >= ARCH_VERSION_COMPACT ? 14 : 10, SEEK_SET) != 0) return false;
+    if (!writeFile(file, (const char*)&directoryOffset, sizeof(directoryOffset))) return false;
     fflush(file);
 
     if (fseek64(file, origPos, SEEK_SET) != 0) return false;
@@ -74,24 +129,44 @@ bool readArchiveHeader(FILE* file, ArchiveHeader* header)
 
     header->version = read_u16_le(version);
 
-    // Files count
+    // Files count, 64 bits from version 5 on
     unsigned char fileCount[sizeof header->fileCount];
+    size_t countSize = header->version >= ARCH_VERSION_COMPACT ? 8 : 4;
 
-    readFile(file, fileCount, sizeof fileCount, &read);
+    readFile(file, fileCount, countSize, &read);
 
-    if (read != sizeof fileCount)
+    if (read != countSize)
     {
         perror("Failed to read files count");
         return false;
     }
 
-    header->fileCount = read_u32_le(fileCount);
+    header->fileCount = countSize == 8 ? read_u64_le(fileCount) : read_u32_le(fileCount);
+
+    // Directory offset and volume size, zero in archives written before they existed
+    unsigned char directory[sizeof header->directoryOffset + sizeof header->volumeSize];
+
+    readFile(file, directory, sizeof directory, &read);
+    if (read != sizeof directory)
+    {
+        perror("Failed to read archive layout");
+        return false;
+    }
+
+    header->directoryOffset = read_u64_le(directory);
+    header->volumeSize = read_u64_le(directory + sizeof header->directoryOffset);
 
-    // Reserved bytes
-    if (fseek(file, sizeof header->reserved, SEEK_CUR) != 0)
+    // Base fingerprint, reserved and zero before delta archives
+    unsigned char fingerprint[sizeof header->baseFingerprint];
+
+    readFile(file, fingerprint, sizeof fingerprint, &read);
+    if (read != sizeof fingerprint)
     {
+        perror("Failed to read base fingerprint");
         return false;
     }
 
+    header->baseFingerprint = read_u32_le(fingerprint);
+
     return true;
 }
@@ -7,11 +7,21 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#define ARCHIVE_HEADER_SIZE 30 // On-disk size, the in-memory struct is padded
+#define ARCHIVE_HEADER_SIZE_COMPACT 34 // Version 5 on, the entry count takes 64 bits
+
+// Where the first entry starts in an archive of that version
+uint64_t getArchiveHeaderSize(uint16_t version);
+
 bool createArchiveHeader(ArchiveHeader* header);
 void freeArchiveHeader(ArchiveHeader* header);
 
 bool writeArchiveHeader(FILE* file, const ArchiveHeader* header);
-bool updateArchiveHeaderFileCount(FILE* file, uint32_t fileCount);
+// Counts beyond UINT32_MAX need version 5, false otherwise
+bool updateArchiveHeaderFileCount(FILE* file, uint16_t version, uint64_t fileCount);
+// Only between versions of the same header layout, before 5 or from 5 on
+bool updateArchiveHeaderVersion(FILE* file, uint16_t version);
+bool updateArchiveHeaderDirectoryOffset(FILE* file, uint16_t version, uint64_t directoryOffset);
 bool readArchiveHeader(FILE* file, ArchiveHeader* header);
 
 #endif // ARCHIVE_HEADER_H
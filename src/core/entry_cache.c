@@ -0,0 +1,281 @@
+#include "entry_cache.h"
+#include "../util/memory.h"
+
+#include <string.h>
+
+// Finalizer of MurmurHash3, entry offsets differ mostly in their low and middle bits
+static uint64_t hashKey(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDull;
+    key ^= key >> 33;
+    key *= 0xC4CEB9FE1A85EC53ull;
+    key ^= key >> 33;
+    return key;
+}
+
+static CacheShard* getShard(EntryCache* cache, uint64_t hash)
+{
+    return &cache->shards[hash % ENTRY_CACHE_SHARDS];
+}
+
+static CacheItem** getBucket(CacheShard* shard, uint64_t hash)
+{
+    return &shard->buckets[(size_t)(hash / ENTRY_CACHE_SHARDS) & shard->bucketMask];
+}
+
+EntryCache* createEntryCache(uint64_t budget)
+{
+    EntryCache* cache = memCalloc(1, sizeof *cache);
+    if (!cache) return NULL;
+
+    size_t ready = 0;
+    for (; ready < ENTRY_CACHE_SHARDS; ready++)
+    {
+        CacheShard* shard = &cache->shards[ready];
+
+        shard->budget = budget / ENTRY_CACHE_SHARDS;
+        shard->bucketMask = 63;
+        shard->buckets = memCalloc(shard->bucketMask + 1, sizeof *shard->buckets);
+
+        if (!shard->buckets || !mutexInit(&shard->lock))
+        {
+            memFree(shard->buckets);
+            break;
+        }
+    }
+
+    if (ready < ENTRY_CACHE_SHARDS)
+    {
+        for (size_t i = 0; i < ready; i++)
+        {
+            mutexDestroy(&cache->shards[i].lock);
+            memFree(cache->shards[i].buckets);
+        }
+        memFree(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+void freeEntryCache(EntryCache* cache)
+{
+    if (!cache) return;
+
+    for (size_t i = 0; i < ENTRY_CACHE_SHARDS; i++)
+    {
+        CacheShard* shard = &cache->shards[i];
+
+        CacheItem* item = shard->newest;
+        while (item)
+        {
+            CacheItem* older = item->older;
+            memFree(item);
+            item = older;
+        }
+
+        memFree(shard->buckets);
+        mutexDestroy(&shard->lock);
+    }
+
+    memFree(cache);
+}
+
+static void unlinkRecent(CacheShard* shard, CacheItem* item)
+{
+    if (item->newer) item->newer->older = item->older;
+    else shard->newest = item->older;
+
+    if (item->older) item->older->newer = item->newer;
+    else shard->oldest = item->newer;
+
+    item->newer = NULL;
+    item->older = NULL;
+}
+
+static void linkNewest(CacheShard* shard, CacheItem* item)
+{
+    item->older = shard->newest;
+    item->newer = NULL;
+
+    if (shard->newest) shard->newest->newer = item;
+    else shard->oldest = item;
+
+    shard->newest = item;
+}
+
+static CacheItem* findItem(CacheShard* shard, uint64_t hash, uint64_t key)
+{
+    CacheItem* item = *getBucket(shard, hash);
+    while (item && item->key != key) item = item->chain;
+    return item;
+}
+
+// Drops the cache's reference, the item goes once the last borrower releases it
+static void evictItem(CacheShard* shard, CacheItem* item)
+{
+    CacheItem** link = getBucket(shard, hashKey(item->key));
+    while (*link != item) link = &(*link)->chain;
+    *link = item->chain;
+
+    unlinkRecent(shard, item);
+    shard->count--;
+    shard->bytes -= item->size;
+    shard->evictions++;
+
+    item->cached = false;
+    if (--item->refs == 0) memFree(item);
+}
+
+// Doubles the buckets once they hold more items than buckets, a failure only makes chains longer
+static void growBuckets(CacheShard* shard)
+{
+    size_t bucketCount = (shard->bucketMask + 1) * 2;
+
+    CacheItem** buckets = memCalloc(bucketCount, sizeof *buckets);
+    if (!buckets) return;
+
+    CacheItem** old = shard->buckets;
+    size_t oldCount = shard->bucketMask + 1;
+
+    shard->buckets = buckets;
+    shard->bucketMask = bucketCount - 1;
+
+    for (size_t i = 0; i < oldCount; i++)
+    {
+        CacheItem* item = old[i];
+        while (item)
+        {
+            CacheItem* next = item->chain;
+            CacheItem** bucket = getBucket(shard, hashKey(item->key));
+
+            item->chain = *bucket;
+            *bucket = item;
+            item = next;
+        }
+    }
+
+    memFree(old);
+}
+
+CacheItem* acquireCacheItem(EntryCache* cache, uint64_t key)
+{
+    uint64_t hash = hashKey(key);
+    CacheShard* shard = getShard(cache, hash);
+
+    mutexLock(&shard->lock);
+
+    CacheItem* item = findItem(shard, hash, key);
+    if (item)
+    {
+        item->refs++;
+        unlinkRecent(shard, item);
+        linkNewest(shard, item);
+        shard->hits++;
+    }
+    else
+    {
+        shard->misses++;
+    }
+
+    mutexUnlock(&shard->lock);
+    return item;
+}
+
+CacheItem* allocateCacheItem(uint64_t key, size_t size)
+{
+    if (size > SIZE_MAX - sizeof(CacheItem)) return NULL;
+
+    CacheItem* item = memAlloc(sizeof(CacheItem) + size);
+    if (!item) return NULL;
+
+    memset(item, 0, sizeof *item);
+    item->key = key;
+    item->size = size;
+    item->refs = 1;
+    return item;
+}
+
+CacheItem* insertCacheItem(EntryCache* cache, CacheItem* item)
+{
+    uint64_t hash = hashKey(item->key);
+    CacheShard* shard = getShard(cache, hash);
+
+    if (item->size > shard->budget) return item;
+
+    mutexLock(&shard->lock);
+
+    // Another reader of the same entry got here first, its copy is the one to share
+    CacheItem* existing = findItem(shard, hash, item->key);
+    if (existing)
+    {
+        existing->refs++;
+        unlinkRecent(shard, existing);
+        linkNewest(shard, existing);
+        mutexUnlock(&shard->lock);
+
+        releaseCacheItem(item);
+        return existing;
+    }
+
+    while (shard->oldest && shard->bytes + item->size > shard->budget)
+        evictItem(shard, shard->oldest);
+
+    if (shard->count >= shard->bucketMask + 1) growBuckets(shard);
+
+    CacheItem** bucket = getBucket(shard, hash);
+    item->chain = *bucket;
+    *bucket = item;
+    linkNewest(shard, item);
+
+    item->shard = shard;
+    item->cached = true;
+    item->refs++;
+
+    shard->count++;
+    shard->bytes += item->size;
+    shard->insertions++;
+
+    mutexUnlock(&shard->lock);
+    return item;
+}
+
+void releaseCacheItem(CacheItem* item)
+{
+    if (!item) return;
+
+    CacheShard* shard = item->shard;
+
+    // Never shared, the caller holds the only reference
+    if (!shard)
+    {
+        memFree(item);
+        return;
+    }
+
+    mutexLock(&shard->lock);
+    bool last = --item->refs == 0;
+    mutexUnlock(&shard->lock);
+
+    if (last) memFree(item);
+}
+
+void getEntryCacheStats(EntryCache* cache, ArchCacheStats* outStats)
+{
+    memset(outStats, 0, sizeof *outStats);
+
+    for (size_t i = 0; i < ENTRY_CACHE_SHARDS; i++)
+    {
+        CacheShard* shard = &cache->shards[i];
+
+        mutexLock(&shard->lock);
+        outStats->hits += shard->hits;
+        outStats->misses += shard->misses;
+        outStats->insertions += shard->insertions;
+        outStats->evictions += shard->evictions;
+        outStats->entries += shard->count;
+        outStats->bytes += shard->bytes;
+        mutexUnlock(&shard->lock);
+    }
+}
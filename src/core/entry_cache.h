@@ -0,0 +1,78 @@
+#ifndef ENTRY_CACHE_H
+#define ENTRY_CACHE_H
+
+#include <arch/unarchiver.h>
+
+#include "../util/thread.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ENTRY_CACHE_SHARDS 16
+
+struct CacheShard;
+
+// Decompressed content of one entry. Counted references: one per borrower and one while the cache
+// holds it, so an evicted item stays valid until its last borrower lets go.
+typedef struct CacheItem
+{
+    uint64_t key;
+    size_t size;
+    size_t refs;
+    struct CacheShard* shard;   // NULL for items that never entered the cache
+    bool cached;
+
+    struct CacheItem* newer;    // LRU list of the shard
+    struct CacheItem* older;
+    struct CacheItem* chain;    // Hash bucket
+
+    unsigned char data[];
+} CacheItem;
+
+typedef struct CacheShard
+{
+    Mutex lock;
+
+    CacheItem** buckets;
+    size_t bucketMask;
+    size_t count;
+
+    CacheItem* newest;
+    CacheItem* oldest;
+    uint64_t bytes;
+    uint64_t budget;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+} CacheShard;
+
+// Keys are spread over the shards so concurrent readers of different entries rarely share a lock.
+// Each shard keeps its share of the budget by evicting its least recently used items.
+typedef struct EntryCache
+{
+    CacheShard shards[ENTRY_CACHE_SHARDS];
+} EntryCache;
+
+EntryCache* createEntryCache(uint64_t budget);
+// Items still borrowed are freed too, borrowers must be done before
+void freeEntryCache(EntryCache* cache);
+
+// A borrowed reference to the item of key, or NULL (counted as a miss)
+CacheItem* acquireCacheItem(EntryCache* cache, uint64_t key);
+
+// Uncached item of size bytes with one reference for the caller
+CacheItem* allocateCacheItem(uint64_t key, size_t size);
+
+// Hands a filled item from allocateCacheItem to the cache and returns the one to use: the item itself,
+// or one another thread inserted meanwhile, in which case item is released. Items larger than a shard's
+// budget stay uncached. The caller keeps one reference to the result either way.
+CacheItem* insertCacheItem(EntryCache* cache, CacheItem* item);
+
+void releaseCacheItem(CacheItem* item);
+
+void getEntryCacheStats(EntryCache* cache, ArchCacheStats* outStats);
+
+#endif // ENTRY_CACHE_H
@@ -0,0 +1,663 @@
+#include "entry_table.h"
+#include "archive_header.h"
+#include "file_header.h"
+#include "../util/file.h"
+#include "../util/memory.h"
+
+#include <zlib.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+// Names of a compact directory live in the table's block and go with it
+static void freeRecordName(const EntryTable* table, char* name)
+{
+    uintptr_t address = (uintptr_t)name;
+    uintptr_t block = (uintptr_t)table->names;
+
+    if (!table->names || address < block || address >= block + table->namesSize)
+        memFree(name);
+}
+
+static EntryTable* walkFileHeaders(FILE* archiveFile, uint16_t version, size_t fileCount)
+{
+    if (!archiveFile) return NULL;
+
+    int64_t origPos = ftell64(archiveFile);
+    if (origPos < 0) return NULL;
+
+    EntryTable* table = memCalloc(1, sizeof *table);
+    if (!table) return NULL;
+
+    if (fileCount > 0)
+    {
+        table->entries = memCalloc(fileCount, sizeof *table->entries);
+        if (!table->entries) goto fail;
+        table->capacity = fileCount;
+    }
+
+    if (fseek64(archiveFile, (int64_t)getArchiveHeaderSize(version), SEEK_SET) != 0) goto fail;
+
+    while (table->count < fileCount)
+    {
+        EntryRecord* record = &table->entries[table->count];
+
+        int64_t headerPos = ftell64(archiveFile);
+        if (headerPos < 0) goto fail;
+
+        if (!readFileHeader(archiveFile, &record->header, &record->name)) goto fail;
+        table->count++;
+
+        if (record->header.magic != ARCH_FILE_MAGIC) goto fail;
+
+        record->headerOffset = (uint64_t)headerPos;
+        record->dataOffset = record->headerOffset + FILE_HEADER_SIZE + record->header.nameLength;
+
+        uint64_t payloadSize = getFileHeaderPayloadSize(&record->header);
+        if (payloadSize > INT64_MAX || fseek64(archiveFile, (int64_t)payloadSize, SEEK_CUR) != 0) goto fail;
+
+        // Fillers over removed entries are stepped over, they aren't counted
+        if (record->header.flags & ARCH_FLAG_DELETED)
+            removeEntryRecord(table, table->count - 1);
+    }
+
+    if (fseek64(archiveFile, origPos, SEEK_SET) != 0) goto fail;
+
+    return table;
+
+fail:
+    fseek64(archiveFile, origPos, SEEK_SET);
+    freeEntryTable(table);
+    return NULL;
+}
+
+#define DIRECTORY_RECORD_SIZE 39
+
+static EntryTable* readEntryDirectory(FILE* archiveFile, size_t fileCount, uint64_t directoryOffset, uint64_t volumeSize)
+{
+    if (directoryOffset > INT64_MAX || fseek64(archiveFile, (int64_t)directoryOffset, SEEK_SET) != 0) return NULL;
+
+    unsigned char prefix[12];
+    size_t read;
+    if (!readFile(archiveFile, (char*)prefix, sizeof prefix, &read) || read != sizeof prefix) return NULL;
+
+    if (read_u32_le(prefix) != ARCH_DIRECTORY_MAGIC || read_u64_le(prefix + 4) != fileCount) return NULL;
+
+    EntryTable* table = memCalloc(1, sizeof *table);
+    if (!table) return NULL;
+
+    if (fileCount > 0)
+    {
+        table->entries = memCalloc(fileCount, sizeof *table->entries);
+        if (!table->entries) goto fail;
+        table->capacity = fileCount;
+    }
+
+    uint32_t crc = crc32(0L, Z_NULL, 0);
+
+    for (size_t i = 0; i < fileCount; i++)
+    {
+        EntryRecord* record = &table->entries[i];
+
+        unsigned char fields[DIRECTORY_RECORD_SIZE];
+        if (!readFile(archiveFile, (char*)fields, sizeof fields, &read) || read != sizeof fields) goto fail;
+        crc = crc32(crc, fields, sizeof fields);
+
+        uint32_t volume = read_u32_le(fields);
+        uint64_t offset = read_u64_le(fields + 4);
+
+        FileHeader* header = &record->header;
+        header->magic = ARCH_FILE_MAGIC;
+        header->origSize = read_u64_le(fields + 12);
+        header->compSize = read_u64_le(fields + 20);
+        header->crc32_uncompressed = read_u32_le(fields + 28);
+        header->crc32_compressed = read_u32_le(fields + 32);
+        header->flags = fields[36];
+        header->nameLength = read_u16_le(fields + 37);
+
+        record->name = memAlloc((size_t)header->nameLength + 1);
+        if (!record->name) goto fail;
+        table->count++;
+
+        if (!readFile(archiveFile, record->name, header->nameLength, &read) || read != header->nameLength) goto fail;
+        record->name[header->nameLength] = '\0';
+        crc = crc32(crc, (const unsigned char*)record->name, header->nameLength);
+
+        if ((volumeSize == 0 && volume != 0) || (volumeSize != 0 && offset >= volumeSize)) goto fail;
+
+        record->headerOffset = (uint64_t)volume * volumeSize + offset;
+        record->dataOffset = record->headerOffset + FILE_HEADER_SIZE + header->nameLength;
+    }
+
+    unsigned char stored[4];
+    if (!readFile(archiveFile, (char*)stored, sizeof stored, &read) || read != sizeof stored) goto fail;
+    if (read_u32_le(stored) != crc) goto fail;
+
+    return table;
+
+fail:
+    freeEntryTable(table);
+    return NULL;
+}
+
+/* ===== Compact directory ===== */
+
+#define PACKED_CHUNK (64 * 1024)
+#define PACKED_PREFIX_SIZE 28
+#define PACKED_FIELDS_SIZE 40   // Fixed part of a record at most, varints at full length
+
+static uint64_t zigzagEncode(uint64_t value)
+{
+    return (value << 1) ^ (0 - (value >> 63));
+}
+
+static uint64_t zigzagDecode(uint64_t value)
+{
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+typedef struct PackedWriter
+{
+    FILE* file;
+    z_stream strm;
+    uint64_t packedSize;
+    uint32_t crc;
+    size_t used;
+    unsigned char raw[PACKED_CHUNK];
+    unsigned char out[PACKED_CHUNK];
+} PackedWriter;
+
+static bool deflatePacked(PackedWriter* writer, int flush)
+{
+    writer->crc = crc32(writer->crc, writer->raw, (uInt)writer->used);
+    writer->strm.next_in = writer->raw;
+    writer->strm.avail_in = (uInt)writer->used;
+
+    int ret;
+    do
+    {
+        writer->strm.next_out = writer->out;
+        writer->strm.avail_out = sizeof writer->out;
+
+        ret = deflate(&writer->strm, flush);
+        if (ret == Z_STREAM_ERROR) return false;
+
+        size_t have = sizeof writer->out - writer->strm.avail_out;
+        if (!writeFile(writer->file, (const char*)writer->out, have)) return false;
+        writer->packedSize += have;
+    }
+    while (flush == Z_FINISH ? ret != Z_STREAM_END : writer->strm.avail_out == 0);
+
+    writer->used = 0;
+    return true;
+}
+
+static bool putPacked(PackedWriter* writer, const void* data, size_t size)
+{
+    const unsigned char* bytes = data;
+
+    while (size > 0)
+    {
+        if (writer->used == sizeof writer->raw && !deflatePacked(writer, Z_NO_FLUSH)) return false;
+
+        size_t chunk = sizeof writer->raw - writer->used;
+        if (chunk > size) chunk = size;
+
+        memcpy(writer->raw + writer->used, bytes, chunk);
+        writer->used += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+
+    return true;
+}
+
+static bool writeCompactDirectory(FILE* archiveFile, const EntryTable* table, uint16_t version)
+{
+    int64_t prefixPos = ftell64(archiveFile);
+    if (prefixPos < 0) return false;
+
+    uint64_t namesSize = 0;
+    for (size_t i = 0; i < table->count; i++)
+    {
+        namesSize += (uint64_t)table->entries[i].header.nameLength + 1;
+    }
+
+    unsigned char prefix[PACKED_PREFIX_SIZE];
+    write_u32_le(prefix, ARCH_COMPACT_DIRECTORY_MAGIC);
+    write_u64_le(prefix + 4, table->count);
+    write_u64_le(prefix + 12, namesSize);
+    write_u64_le(prefix + 20, 0); // Packed size, known at the end
+    if (!writeFile(archiveFile, (const char*)prefix, sizeof prefix)) return false;
+
+    PackedWriter* writer = memCalloc(1, sizeof *writer);
+    if (!writer) return false;
+
+    writer->file = archiveFile;
+    writer->crc = crc32(0L, Z_NULL, 0);
+
+    if (!memoryDeflateInit(&writer->strm, 0))
+    {
+        memFree(writer);
+        return false;
+    }
+
+    bool ok = true;
+    const char* previousName = "";
+    uint16_t previousLength = 0;
+    uint64_t previousEnd = getArchiveHeaderSize(version);
+
+    for (size_t i = 0; ok && i < table->count; i++)
+    {
+        const EntryRecord* record = &table->entries[i];
+        const FileHeader* header = &record->header;
+
+        uint16_t shared = 0;
+        while (shared < previousLength && shared < header->nameLength && previousName[shared] == record->name[shared])
+            shared++;
+
+        uint64_t tag = (uint64_t)header->flags << 2;
+        if (header->crc32_compressed == header->crc32_uncompressed) tag |= 1;
+        if (header->compSize == 0) tag |= 2;
+
+        unsigned char fields[PACKED_FIELDS_SIZE];
+        size_t size = write_varint(fields, tag);
+        size += write_varint(fields + size, shared);
+        size += write_varint(fields + size, header->nameLength - shared);
+
+        ok = putPacked(writer, fields, size) && putPacked(writer, record->name + shared, header->nameLength - shared);
+
+        size = write_varint(fields, header->origSize);
+        if (!(tag & 2)) size += write_varint(fields + size, header->compSize);
+        write_u32_le(fields + size, header->crc32_uncompressed);
+        size += 4;
+        if (!(tag & 1))
+        {
+            write_u32_le(fields + size, header->crc32_compressed);
+            size += 4;
+        }
+        // Entries normally follow each other, the distance is 0 but for fillers and reordered tables
+        size += write_varint(fields + size, zigzagEncode(record->headerOffset - previousEnd));
+
+        ok = ok && putPacked(writer, fields, size);
+
+        previousName = record->name;
+        previousLength = header->nameLength;
+        previousEnd = record->dataOffset + getFileHeaderPayloadSize(header);
+    }
+
+    ok = ok && deflatePacked(writer, Z_FINISH);
+    deflateEnd(&writer->strm);
+
+    unsigned char stored[8];
+    write_u32_le(stored, writer->crc);
+    ok = ok && writeFile(archiveFile, (const char*)stored, 4);
+
+    int64_t endPos = ftell64(archiveFile);
+    write_u64_le(stored, writer->packedSize);
+    memFree(writer);
+
+    return ok && endPos >= 0 &&
+           fseek64(archiveFile, prefixPos + 20, SEEK_SET) == 0 &&
+           writeFile(archiveFile, (const char*)stored, sizeof stored) &&
+           fseek64(archiveFile, endPos, SEEK_SET) == 0;
+}
+
+typedef struct PackedReader
+{
+    FILE* file;
+    z_stream strm;
+    uint64_t packedLeft;
+    bool finished;
+    uint32_t crc;
+    size_t checked;     // out[checked, pos) is consumed but not in crc yet
+    size_t pos;
+    size_t end;
+    unsigned char in[PACKED_CHUNK];
+    unsigned char out[PACKED_CHUNK];
+} PackedReader;
+
+// Makes size unpacked bytes available at out + pos, returns fewer only where the stream ends or fails
+static size_t fillPacked(PackedReader* reader, size_t size)
+{
+    if (reader->end - reader->pos >= size || reader->finished) return reader->end - reader->pos;
+
+    reader->crc = crc32(reader->crc, reader->out + reader->checked, (uInt)(reader->pos - reader->checked));
+    memmove(reader->out, reader->out + reader->pos, reader->end - reader->pos);
+    reader->end -= reader->pos;
+    reader->pos = 0;
+    reader->checked = 0;
+
+    while (reader->end < size && !reader->finished)
+    {
+        if (reader->strm.avail_in == 0 && reader->packedLeft > 0)
+        {
+            size_t chunk = reader->packedLeft < sizeof reader->in ? (size_t)reader->packedLeft : sizeof reader->in;
+            size_t read;
+            if (!readFile(reader->file, (char*)reader->in, chunk, &read) || read != chunk) break;
+
+            reader->packedLeft -= chunk;
+            reader->strm.next_in = reader->in;
+            reader->strm.avail_in = (uInt)chunk;
+        }
+
+        reader->strm.next_out = reader->out + reader->end;
+        reader->strm.avail_out = (uInt)(sizeof reader->out - reader->end);
+
+        int ret = inflate(&reader->strm, Z_NO_FLUSH);
+        reader->end = sizeof reader->out - reader->strm.avail_out;
+
+        if (ret == Z_STREAM_END) reader->finished = true;
+        else if (ret != Z_OK) break;
+    }
+
+    return reader->end - reader->pos < size ? reader->end - reader->pos : size;
+}
+
+static const unsigned char* takePacked(PackedReader* reader, size_t size)
+{
+    if (fillPacked(reader, size) < size) return NULL;
+
+    const unsigned char* data = reader->out + reader->pos;
+    reader->pos += size;
+    return data;
+}
+
+static bool takePackedVarint(PackedReader* reader, uint64_t* value)
+{
+    size_t available = fillPacked(reader, 10);
+    size_t size = read_varint(reader->out + reader->pos, available, value);
+
+    reader->pos += size;
+    return size != 0;
+}
+
+static bool takePackedU32(PackedReader* reader, uint32_t* value)
+{
+    const unsigned char* data = takePacked(reader, 4);
+    if (data) *value = read_u32_le(data);
+    return data != NULL;
+}
+
+// Reads the records of a compact directory into table, whose entries and name block are allocated
+static bool readPackedRecords(PackedReader* reader, EntryTable* table, size_t fileCount, uint16_t version)
+{
+    size_t namesUsed = 0;
+    const char* previousName = "";
+    uint64_t previousLength = 0;
+    uint64_t previousEnd = getArchiveHeaderSize(version);
+
+    for (size_t i = 0; i < fileCount; i++)
+    {
+        EntryRecord* record = &table->entries[i];
+        FileHeader* header = &record->header;
+
+        uint64_t tag, shared, suffix;
+        if (!takePackedVarint(reader, &tag) || !takePackedVarint(reader, &shared) || !takePackedVarint(reader, &suffix)) return false;
+
+        if ((tag >> 2) > UINT8_MAX || shared > previousLength || suffix > UINT16_MAX - shared) return false;
+        if (shared + suffix + 1 > table->namesSize - namesUsed) return false;
+
+        const unsigned char* suffixBytes = takePacked(reader, (size_t)suffix);
+        if (!suffixBytes) return false;
+
+        record->name = table->names + namesUsed;
+        memcpy(record->name, previousName, (size_t)shared);
+        memcpy(record->name + shared, suffixBytes, (size_t)suffix);
+        record->name[shared + suffix] = '\0';
+        namesUsed += (size_t)(shared + suffix + 1);
+        table->count++;
+
+        header->magic = ARCH_FILE_MAGIC;
+        header->flags = (uint8_t)(tag >> 2);
+        header->nameLength = (uint16_t)(shared + suffix);
+        header->compSize = 0;
+
+        uint64_t gap;
+        if (!takePackedVarint(reader, &header->origSize)) return false;
+        if (!(tag & 2) && !takePackedVarint(reader, &header->compSize)) return false;
+        if (!takePackedU32(reader, &header->crc32_uncompressed)) return false;
+        header->crc32_compressed = header->crc32_uncompressed;
+        if (!(tag & 1) && !takePackedU32(reader, &header->crc32_compressed)) return false;
+        if (!takePackedVarint(reader, &gap)) return false;
+
+        record->headerOffset = previousEnd + zigzagDecode(gap);
+        record->dataOffset = record->headerOffset + FILE_HEADER_SIZE + header->nameLength;
+
+        previousName = record->name;
+        previousLength = header->nameLength;
+        previousEnd = record->dataOffset + getFileHeaderPayloadSize(header);
+    }
+
+    // Every name accounted for and nothing left over
+    return namesUsed == table->namesSize && fillPacked(reader, 1) == 0 && reader->finished;
+}
+
+static EntryTable* readCompactDirectory(FILE* archiveFile, uint16_t version, size_t fileCount, uint64_t directoryOffset)
+{
+    if (directoryOffset > INT64_MAX || fseek64(archiveFile, (int64_t)directoryOffset, SEEK_SET) != 0) return NULL;
+
+    unsigned char prefix[PACKED_PREFIX_SIZE];
+    size_t read;
+    if (!readFile(archiveFile, (char*)prefix, sizeof prefix, &read) || read != sizeof prefix) return NULL;
+
+    uint64_t namesSize = read_u64_le(prefix + 12);
+    uint64_t packedSize = read_u64_le(prefix + 20);
+
+    if (read_u32_le(prefix) != ARCH_COMPACT_DIRECTORY_MAGIC || read_u64_le(prefix + 4) != fileCount) return NULL;
+    if (namesSize < fileCount || namesSize > SIZE_MAX) return NULL;
+
+    EntryTable* table = memCalloc(1, sizeof *table);
+    if (!table) return NULL;
+
+    if (fileCount > 0)
+    {
+        table->entries = memCalloc(fileCount, sizeof *table->entries);
+        if (!table->entries) goto fail;
+        table->capacity = fileCount;
+
+        table->names = memAlloc((size_t)namesSize);
+        if (!table->names) goto fail;
+        table->namesSize = (size_t)namesSize;
+    }
+
+    PackedReader* reader = memCalloc(1, sizeof *reader);
+    if (!reader) goto fail;
+
+    reader->file = archiveFile;
+    reader->packedLeft = packedSize;
+    reader->crc = crc32(0L, Z_NULL, 0);
+
+    memoryBindStream(&reader->strm);
+    if (inflateInit(&reader->strm) != Z_OK)
+    {
+        memFree(reader);
+        goto fail;
+    }
+
+    bool ok = readPackedRecords(reader, table, fileCount, version);
+    inflateEnd(&reader->strm);
+
+    uint32_t crc = crc32(reader->crc, reader->out + reader->checked, (uInt)(reader->pos - reader->checked));
+    memFree(reader);
+    if (!ok) goto fail;
+
+    unsigned char stored[4];
+    uint64_t crcOffset = directoryOffset + PACKED_PREFIX_SIZE + packedSize;
+    if (crcOffset > INT64_MAX || fseek64(archiveFile, (int64_t)crcOffset, SEEK_SET) != 0) goto fail;
+    if (!readFile(archiveFile, (char*)stored, sizeof stored, &read) || read != sizeof stored) goto fail;
+    if (read_u32_le(stored) != crc) goto fail;
+
+    return table;
+
+fail:
+    freeEntryTable(table);
+    return NULL;
+}
+
+EntryTable* loadEntryTable(FILE* archiveFile, uint16_t version, size_t fileCount, uint64_t directoryOffset, uint64_t volumeSize)
+{
+    if (!archiveFile) return NULL;
+
+    if (directoryOffset != 0)
+    {
+        int64_t origPos = ftell64(archiveFile);
+        if (origPos < 0) return NULL;
+
+        EntryTable* table = version >= ARCH_VERSION_COMPACT
+            ? readCompactDirectory(archiveFile, version, fileCount, directoryOffset)
+            : readEntryDirectory(archiveFile, fileCount, directoryOffset, volumeSize);
+
+        if (fseek64(archiveFile, origPos, SEEK_SET) != 0)
+        {
+            freeEntryTable(table);
+            return NULL;
+        }
+
+        // A damaged directory is not fatal, the headers themselves still describe every entry
+        if (table) return table;
+    }
+
+    return walkFileHeaders(archiveFile, version, fileCount);
+}
+
+bool appendEntryRecord(EntryTable* table, const EntryRecord* record)
+{
+    if (!table || !record || !record->name) return false;
+
+    if (table->count == table->capacity)
+    {
+        size_t capacity = table->capacity ? table->capacity * 2 : 64;
+
+        EntryRecord* entries = memRealloc(table->entries, capacity * sizeof *entries);
+        if (!entries) return false;
+
+        table->entries = entries;
+        table->capacity = capacity;
+    }
+
+    char* name = memStrdup(record->name);
+    if (!name) return false;
+
+    EntryRecord* copy = &table->entries[table->count++];
+    *copy = *record;
+    copy->name = name;
+    return true;
+}
+
+void removeEntryRecord(EntryTable* table, size_t index)
+{
+    if (!table || index >= table->count) return;
+
+    freeRecordName(table, table->entries[index].name);
+    memmove(&table->entries[index], &table->entries[index + 1], (table->count - index - 1) * sizeof *table->entries);
+    table->count--;
+}
+
+void moveEntryRecord(EntryTable* table, size_t from, size_t to)
+{
+    if (!table || from >= table->count || to >= table->count || from == to) return;
+
+    EntryRecord record = table->entries[from];
+
+    if (from < to)
+        memmove(&table->entries[from], &table->entries[from + 1], (to - from) * sizeof *table->entries);
+    else
+        memmove(&table->entries[to + 1], &table->entries[to], (from - to) * sizeof *table->entries);
+
+    table->entries[to] = record;
+}
+
+bool writeEntryDirectory(FILE* archiveFile, const EntryTable* table, uint16_t version, uint64_t volumeSize)
+{
+    if (!archiveFile || !table) return false;
+
+    if (version >= ARCH_VERSION_COMPACT)
+        return writeCompactDirectory(archiveFile, table, version);
+
+    unsigned char prefix[12];
+    write_u32_le(prefix, ARCH_DIRECTORY_MAGIC);
+    write_u64_le(prefix + 4, table->count);
+    if (!writeFile(archiveFile, (const char*)prefix, sizeof prefix)) return false;
+
+    uint32_t crc = crc32(0L, Z_NULL, 0);
+
+    for (size_t i = 0; i < table->count; i++)
+    {
+        const EntryRecord* record = &table->entries[i];
+        const FileHeader* header = &record->header;
+
+        uint64_t volume = volumeSize ? record->headerOffset / volumeSize : 0;
+        uint64_t offset = volumeSize ? record->headerOffset % volumeSize : record->headerOffset;
+        if (volume > UINT32_MAX) return false;
+
+        unsigned char fields[DIRECTORY_RECORD_SIZE];
+        write_u32_le(fields, (uint32_t)volume);
+        write_u64_le(fields + 4, offset);
+        write_u64_le(fields + 12, header->origSize);
+        write_u64_le(fields + 20, header->compSize);
+        write_u32_le(fields + 28, header->crc32_uncompressed);
+        write_u32_le(fields + 32, header->crc32_compressed);
+        fields[36] = header->flags;
+        write_u16_le(fields + 37, header->nameLength);
+
+        crc = crc32(crc, fields, sizeof fields);
+        crc = crc32(crc, (const unsigned char*)record->name, header->nameLength);
+
+        if (!writeFile(archiveFile, (const char*)fields, sizeof fields)) return false;
+        if (!writeFile(archiveFile, record->name, header->nameLength)) return false;
+    }
+
+    unsigned char stored[4];
+    write_u32_le(stored, crc);
+    return writeFile(archiveFile, (const char*)stored, sizeof stored);
+}
+
+void freeEntryTable(EntryTable* table)
+{
+    if (!table) return;
+
+    for (size_t i = 0; i < table->count; i++)
+    {
+        freeRecordName(table, table->entries[i].name);
+    }
+    memFree(table->entries);
+    memFree(table->names);
+    memFree(table);
+}
+
+const EntryRecord* findEntryRecord(const EntryTable* table, const char* name, size_t* outIndex)
+{
+    if (!table || !name) return NULL;
+
+    for (size_t i = 0; i < table->count; i++)
+    {
+        if (strcmp(table->entries[i].name, name) == 0)
+        {
+            if (outIndex) *outIndex = i;
+            return &table->entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+uint32_t getEntryTableFingerprint(const EntryTable* table)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+
+    for (size_t i = 0; i < table->count; i++)
+    {
+        const EntryRecord* record = &table->entries[i];
+
+        unsigned char fields[12];
+        write_u64_le(fields, record->header.origSize);
+        write_u32_le(fields + 8, record->header.crc32_uncompressed);
+
+        crc = crc32(crc, (const Bytef*)record->name, (uInt)strlen(record->name) + 1);
+        crc = crc32(crc, fields, sizeof fields);
+    }
+
+    // Zero marks archives that aren't deltas
+    return crc ? (uint32_t)crc : 1;
+}
@@ -0,0 +1,48 @@
+#ifndef ENTRY_TABLE_H
+#define ENTRY_TABLE_H
+
+#include <arch/arch_types.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct EntryRecord
+{
+    char* name;
+    FileHeader header;
+    uint64_t headerOffset;
+    uint64_t dataOffset;
+} EntryRecord;
+
+typedef struct EntryTable
+{
+    EntryRecord* entries;
+    size_t count;
+    size_t capacity;
+
+    // Names read from a compact directory share this block, other names are allocated one by one
+    char* names;
+    size_t namesSize;
+} EntryTable;
+
+// Reads the directory when there is one, otherwise walks all file headers (payloads are seeked over).
+// The stream position is restored afterwards.
+EntryTable* loadEntryTable(FILE* archiveFile, uint16_t version, size_t fileCount, uint64_t directoryOffset, uint64_t volumeSize);
+void freeEntryTable(EntryTable* table);
+
+// Copies the record, the name included
+bool appendEntryRecord(EntryTable* table, const EntryRecord* record);
+void removeEntryRecord(EntryTable* table, size_t index);
+// Shifts the records in between, keeps tables in file order when an entry moves
+void moveEntryRecord(EntryTable* table, size_t from, size_t to);
+// Archives of version 5 and later get the compact directory
+bool writeEntryDirectory(FILE* archiveFile, const EntryTable* table, uint16_t version, uint64_t volumeSize);
+
+const EntryRecord* findEntryRecord(const EntryTable* table, const char* name, size_t* outIndex);
+
+// CRC32 over every name, size and content CRC32, identifies the base of a delta archive
+uint32_t getEntryTableFingerprint(const EntryTable* table);
+
+#endif // ENTRY_TABLE_H
@@ -1,5 +1,6 @@
 #include "file_header.h"
 #include "../util/file.h"
+#include "../util/memory.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -8,40 +9,50 @@ bool createFileHeader(const char* path, uint8_t flags, FileHeader* header, FILE*
 {
     if (!header || !path) return false;
 
-    FILE* file = NULL;
-    char* fileName = NULL;
-
-    file = fopen(path, "rb");
+    FILE* file = fopen(path, "rb");
     if (!file) return false;
 
     *outOrigSize = getFileSize(file);
 
-    fileName = sanitizeFilePath(path);
-    if (!fileName)
+    if (!initFileHeaderForPath(header, path, *outOrigSize, flags))
     {
         fclose(file);
         return false;
     }
 
+    *outFile = file;
+    return true;
+}
+
+bool initFileHeaderForPath(FileHeader* header, const char* path, uint64_t origSize, uint8_t flags)
+{
+    if (!header || !path) return false;
+
+    char* fileName = sanitizeFilePath(path);
+    if (!fileName) return false;
+
+    bool ok = initFileHeader(header, fileName, origSize, flags);
+
+    memFree(fileName);
+    return ok;
+}
+
+bool initFileHeader(FileHeader* header, const char* fileName, uint64_t origSize, uint8_t flags)
+{
+    if (!header || !fileName) return false;
+
     size_t nameLen = strlen(fileName);
-    if (nameLen > UINT16_MAX) goto cleanup;
+    if (nameLen > UINT16_MAX) return false;
 
     header->magic = ARCH_FILE_MAGIC;
     header->nameLength = (uint16_t)nameLen;
-    header->origSize = *outOrigSize;
+    header->origSize = origSize;
     header->compSize = 0;
     header->crc32_uncompressed = 0;
     header->crc32_compressed = 0;
     header->flags = flags;
 
-    free(fileName);
-    *outFile = file;
     return true;
-
-cleanup:
-    if (file) fclose(file);
-    free(fileName);
-    return false;
 }
 
 void freeFileHeader(FileHeader *header)
@@ -108,6 +119,36 @@ bool updateFileHeaderCompSize(FileHeader* header, FILE *file, uint64_t compSizeP
     return true;
 }
 
+bool updateFileHeaderOrigSize(FileHeader* header, FILE* file, uint64_t compSizePos, uint64_t origSize)
+{
+    int64_t origPos = ftell64(file);
+    if (origPos < 0) return false;
+
+    // origSize is stored right before the compressed size
+    if (fseek64(file, (int64_t)(compSizePos - sizeof(origSize)), SEEK_SET) != 0) return false;
+    if (!writeFile(file, (const char*)&origSize, sizeof(origSize))) return false;
+
+    if (fseek64(file, origPos, SEEK_SET) != 0) return false;
+
+    header->origSize = origSize;
+    return true;
+}
+
+bool updateFileHeaderFlags(FileHeader* header, FILE* file, uint64_t crc32CompressedPos, uint8_t flags)
+{
+    int64_t origPos = ftell64(file);
+    if (origPos < 0) return false;
+
+    // flags follow the compressed CRC32
+    if (fseek64(file, (int64_t)(crc32CompressedPos + sizeof(header->crc32_compressed)), SEEK_SET) != 0) return false;
+    if (!writeFile(file, (const char*)&flags, sizeof(flags))) return false;
+
+    if (fseek64(file, origPos, SEEK_SET) != 0) return false;
+
+    header->flags = flags;
+    return true;
+}
+
 bool updateFileHeaderCRC32(FileHeader *header, FILE *file, uint64_t crc32UncompressedPos, uint64_t crc32CompressedPos, uint32_t crc32Uncompressed, uint32_t crc32Compressed)
 {
     int64_t origPos = ftell64(file);
@@ -194,7 +235,7 @@ bool readFileHeader(FILE* archiveFile, FileHeader* header, char** fileName)
     header->flags = flags[0];
 
     // File name
-    *fileName = malloc((size_t)header->nameLength + 1);
+    *fileName = memAlloc((size_t)header->nameLength + 1);
     if (!*fileName)
     {
         perror("malloc failed");
@@ -203,10 +244,23 @@ bool readFileHeader(FILE* archiveFile, FileHeader* header, char** fileName)
     if (!readFile(archiveFile, *fileName, header->nameLength, &read) || read != header->nameLength)
     {
         perror("Failed to read file name");
-        free(*fileName);
+        memFree(*fileName);
         return false;
     }
     (*fileName)[header->nameLength] = '\0';
 
     return true;
 }
+
+uint64_t getFileHeaderPayloadSize(const FileHeader* header)
+{
+    // Stored entries never get their compSize patched, their payload is origSize bytes
+    if (header->flags & ARCH_FLAG_BASE_REF) return 0;
+
+    return (header->flags & ARCH_FLAG_COMPRESSED) ? header->compSize : header->origSize;
+}
+
+bool fileHeaderNeedsReader(const FileHeader* header)
+{
+    return (header->flags & (ARCH_FLAG_LONG_MATCH | ARCH_FLAG_BASE_REF)) != 0;
+}
@@ -7,14 +7,26 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#define FILE_HEADER_SIZE 31 // On-disk size without the file name
+
 bool createFileHeader(const char* path, uint8_t flags, FileHeader* header, FILE** outFile, uint64_t* outOrigSize);
+// createFileHeader for a file opened elsewhere, whose size is known
+bool initFileHeaderForPath(FileHeader* header, const char* path, uint64_t origSize, uint8_t flags);
+bool initFileHeader(FileHeader* header, const char* fileName, uint64_t origSize, uint8_t flags);
 void freeFileHeader(FileHeader* header);
 
 bool writeFileHeader(FILE* file, const FileHeader* header, const char* fileName, uint64_t* outCompSizePos, uint64_t* outCrcUncompressedPos, uint64_t* outCrcCompressedPos);
 
+bool updateFileHeaderOrigSize(FileHeader* header, FILE* file, uint64_t compSizePos, uint64_t origSize);
 bool updateFileHeaderCompSize(FileHeader* header, FILE* file, uint64_t compSizePos, uint64_t compSize);
+bool updateFileHeaderFlags(FileHeader* header, FILE* file, uint64_t crc32CompressedPos, uint8_t flags);
 bool updateFileHeaderCRC32(FileHeader* header, FILE* file, uint64_t crc32UncompressedPos, uint64_t crc32CompressedPos, uint32_t crc32Uncompressed, uint32_t crc32Compressed);
 
 bool readFileHeader(FILE* archiveFile, FileHeader* header, char** fileName);
 
+uint64_t getFileHeaderPayloadSize(const FileHeader* header);
+
+// Entries that can't be decoded from their own payload alone: long matches and base references
+bool fileHeaderNeedsReader(const FileHeader* header);
+
 #endif // FILE_HEADER_H
@@ -0,0 +1,119 @@
+#include "free_space.h"
+#include "../util/memory.h"
+
+#include <string.h>
+
+FreeSpace* createFreeSpace(void)
+{
+    return memCalloc(1, sizeof(FreeSpace));
+}
+
+void freeFreeSpace(FreeSpace* space)
+{
+    if (!space) return;
+
+    memFree(space->extents);
+    memFree(space);
+}
+
+static void removeExtent(FreeSpace* space, size_t index)
+{
+    memmove(&space->extents[index], &space->extents[index + 1], (space->count - index - 1) * sizeof *space->extents);
+    space->count--;
+}
+
+bool addFreeExtent(FreeSpace* space, uint64_t offset, uint64_t size, FreeExtent* outMerged)
+{
+    if (!space || size == 0) return false;
+
+    // First extent starting after the new one
+    size_t index = 0;
+    while (index < space->count && space->extents[index].offset < offset) index++;
+
+    FreeExtent merged = { offset, size };
+
+    if (index < space->count && space->extents[index].offset == offset + size)
+    {
+        merged.size += space->extents[index].size;
+        removeExtent(space, index);
+    }
+
+    if (index > 0 && space->extents[index - 1].offset + space->extents[index - 1].size == offset)
+    {
+        FreeExtent* previous = &space->extents[index - 1];
+        previous->size += merged.size;
+
+        if (outMerged) *outMerged = *previous;
+        return true;
+    }
+
+    if (space->count == space->capacity)
+    {
+        size_t capacity = space->capacity ? space->capacity * 2 : 16;
+
+        FreeExtent* extents = memRealloc(space->extents, capacity * sizeof *extents);
+        if (!extents) return false;
+
+        space->extents = extents;
+        space->capacity = capacity;
+    }
+
+    memmove(&space->extents[index + 1], &space->extents[index], (space->count - index) * sizeof *space->extents);
+    space->extents[index] = merged;
+    space->count++;
+
+    if (outMerged) *outMerged = merged;
+    return true;
+}
+
+bool takeFreeExtentEndingAt(FreeSpace* space, uint64_t end, FreeExtent* outExtent)
+{
+    if (!space || space->count == 0) return false;
+
+    // Extents never overlap, only the last one can reach the end of the data
+    FreeExtent* last = &space->extents[space->count - 1];
+    if (last->offset + last->size != end) return false;
+
+    *outExtent = *last;
+    space->count--;
+    return true;
+}
+
+bool allocateFreeExtent(FreeSpace* space, uint64_t size, uint64_t minRemainder, uint64_t* outOffset, uint64_t* outRemainder)
+{
+    if (!space || size == 0) return false;
+
+    size_t best = space->count;
+
+    for (size_t i = 0; i < space->count; i++)
+    {
+        uint64_t available = space->extents[i].size;
+        bool fits = available == size || (available > size && available - size >= minRemainder);
+
+        if (fits && (best == space->count || available < space->extents[best].size))
+            best = i;
+    }
+
+    if (best == space->count) return false;
+
+    FreeExtent* extent = &space->extents[best];
+    *outOffset = extent->offset;
+    *outRemainder = extent->size - size;
+
+    if (*outRemainder == 0)
+    {
+        removeExtent(space, best);
+    }
+    else
+    {
+        extent->offset += size;
+        extent->size -= size;
+    }
+
+    return true;
+}
+
+void clearFreeSpace(FreeSpace* space)
+{
+    if (space) space->count = 0;
+}
@@ -0,0 +1,37 @@
+#ifndef FREE_SPACE_H
+#define FREE_SPACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte range of an archive opened for update that no entry uses any more
+typedef struct FreeExtent
+{
+    uint64_t offset;
+    uint64_t size;
+} FreeExtent;
+
+typedef struct FreeSpace
+{
+    FreeExtent* extents;    // Sorted by offset, neighbours are always merged
+    size_t count;
+    size_t capacity;
+} FreeSpace;
+
+FreeSpace* createFreeSpace(void);
+void freeFreeSpace(FreeSpace* space);
+
+// Adds [offset, offset + size) and merges it with the extents it touches, outMerged receives the result
+bool addFreeExtent(FreeSpace* space, uint64_t offset, uint64_t size, FreeExtent* outMerged);
+
+// Takes the extent ending exactly at end, false if there is none
+bool takeFreeExtentEndingAt(FreeSpace* space, uint64_t end, FreeExtent* outExtent);
+
+// Best fit for size bytes: the smallest extent that fits exactly or leaves at least minRemainder bytes.
+// The remainder stays free at outOffset + size and is returned in outRemainder (0 for an exact fit).
+bool allocateFreeExtent(FreeSpace* space, uint64_t size, uint64_t minRemainder, uint64_t* outOffset, uint64_t* outRemainder);
+
+void clearFreeSpace(FreeSpace* space);
+
+#endif // FREE_SPACE_H
@@ -0,0 +1,128 @@
+#include "name_index.h"
+#include "../util/memory.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// FNV-1a
+static uint64_t hashName(const char* name)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    for (; *name; name++)
+    {
+        hash ^= (unsigned char)*name;
+        hash *= 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+static int compareRecordNames(const void* a, const void* b)
+{
+    const EntryRecord* x = *(const EntryRecord* const*)a;
+    const EntryRecord* y = *(const EntryRecord* const*)b;
+
+    int order = strcmp(x->name, y->name);
+    if (order != 0) return order;
+
+    // Records of one table, their addresses follow the entry order
+    return (x > y) - (x < y);
+}
+
+NameIndex* createNameIndex(const EntryTable* table)
+{
+    if (!table) return NULL;
+
+    NameIndex* index = memCalloc(1, sizeof *index);
+    if (!index) return NULL;
+
+    size_t count = table->count;
+    size_t slotCount = 16;
+    while (slotCount / 2 < count && slotCount < SIZE_MAX / 2 / sizeof *index->slots) slotCount *= 2;
+
+    index->sorted = memAlloc((count ? count : 1) * sizeof *index->sorted);
+    index->slots = memCalloc(slotCount, sizeof *index->slots);
+    if (!index->sorted || !index->slots || slotCount / 2 < count)
+    {
+        freeNameIndex(index);
+        return NULL;
+    }
+
+    index->count = count;
+    index->slotMask = slotCount - 1;
+
+    bool ordered = true;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const EntryRecord* record = &table->entries[i];
+
+        index->sorted[i] = record;
+        if (i > 0 && strcmp(table->entries[i - 1].name, record->name) > 0) ordered = false;
+
+        // The first entry of a name wins, as with a linear search
+        size_t slot = (size_t)hashName(record->name) & index->slotMask;
+        while (index->slots[slot] && strcmp(index->slots[slot]->name, record->name) != 0)
+            slot = (slot + 1) & index->slotMask;
+
+        if (!index->slots[slot]) index->slots[slot] = record;
+    }
+
+    // Archives made from a sorted file list need no sort
+    if (!ordered)
+        qsort(index->sorted, count, sizeof *index->sorted, compareRecordNames);
+
+    return index;
+}
+
+void freeNameIndex(NameIndex* index)
+{
+    if (!index) return;
+
+    memFree(index->sorted);
+    memFree(index->slots);
+    memFree(index);
+}
+
+const EntryRecord* findIndexedName(const NameIndex* index, const char* name)
+{
+    if (!index || !name) return NULL;
+
+    size_t slot = (size_t)hashName(name) & index->slotMask;
+
+    while (index->slots[slot])
+    {
+        if (strcmp(index->slots[slot]->name, name) == 0) return index->slots[slot];
+        slot = (slot + 1) & index->slotMask;
+    }
+
+    return NULL;
+}
+
+void findIndexedPrefix(const NameIndex* index, const char* prefix, size_t length, size_t from, size_t* outBegin, size_t* outEnd)
+{
+    // Cut to length bytes, names keep their order, so those starting with prefix are one run
+    size_t low = from;
+    size_t high = index->count;
+
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (strncmp(index->sorted[middle]->name, prefix, length) < 0) low = middle + 1;
+        else high = middle;
+    }
+
+    *outBegin = low;
+    high = index->count;
+
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (strncmp(index->sorted[middle]->name, prefix, length) <= 0) low = middle + 1;
+        else high = middle;
+    }
+
+    *outEnd = low;
+}
@@ -0,0 +1,31 @@
+#ifndef NAME_INDEX_H
+#define NAME_INDEX_H
+
+#include "entry_table.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Lookup structures over the names of an entry table, built once and then read-only. Holds pointers into
+// the table, which must outlive it. Per million entries: 8 MB of sorted pointers and 16 to 32 MB of hash
+// slots (load factor between 1/4 and 1/2), the names themselves stay in the table.
+typedef struct NameIndex
+{
+    const EntryRecord** sorted;     // Ordered by name, equal names by entry index
+    size_t count;
+
+    const EntryRecord** slots;      // Open addressing with linear probing, the first entry of each name
+    size_t slotMask;
+} NameIndex;
+
+NameIndex* createNameIndex(const EntryTable* table);
+void freeNameIndex(NameIndex* index);
+
+// The entry of that name with the lowest index, NULL if there is none
+const EntryRecord* findIndexedName(const NameIndex* index, const char* name);
+
+// Positions [*outBegin, *outEnd) in sorted whose names start with the length bytes of prefix,
+// searched from position from on
+void findIndexedPrefix(const NameIndex* index, const char* prefix, size_t length, size_t from, size_t* outBegin, size_t* outEnd);
+
+#endif // NAME_INDEX_H
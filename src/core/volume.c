@@ -0,0 +1,491 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE // fopencookie
+#endif
+
+#include "volume.h"
+#include "../util/file.h"
+#include "../util/memory.h"
+#include "../util/thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+char* getVolumePath(const char* basePath, unsigned index)
+{
+    if (!basePath) return NULL;
+
+    size_t size = strlen(basePath) + 16;
+    char* path = memAlloc(size);
+    if (!path) return NULL;
+
+    snprintf(path, size, "%s.%03u", basePath, index + 1);
+    return path;
+}
+
+char* getVolumeBasePath(const char* firstVolumePath)
+{
+    if (!firstVolumePath) return NULL;
+
+    size_t len = strlen(firstVolumePath);
+    if (len <= 4 || strcmp(firstVolumePath + len - 4, ".001") != 0) return NULL;
+
+    char* basePath = memAlloc(len - 3);
+    if (!basePath) return NULL;
+
+    memcpy(basePath, firstVolumePath, len - 4);
+    basePath[len - 4] = '\0';
+    return basePath;
+}
+
+#ifdef HAVE_SPLIT_VOLUMES
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+struct VolumeSet
+{
+    char* basePath;
+    uint64_t volumeSize;
+    bool writable;
+
+    // Guards everything below, the I/O itself runs unlocked on the cached descriptors. A read-only
+    // set opens all of its volumes up front, so readers never take the lock to find a descriptor.
+    Mutex lock;
+    unsigned refs;
+    int* fds;           // -1 while a volume has not been opened yet
+    unsigned fdCount;
+    uint64_t size;      // Logical size of the whole set
+};
+
+typedef struct VolumeStream
+{
+    VolumeSet* set;
+    uint64_t position;
+} VolumeStream;
+
+static bool growVolumes(VolumeSet* set, unsigned count)
+{
+    if (count <= set->fdCount) return true;
+
+    int* fds = memRealloc(set->fds, count * sizeof *fds);
+    if (!fds) return false;
+
+    for (unsigned i = set->fdCount; i < count; i++) fds[i] = -1;
+
+    set->fds = fds;
+    set->fdCount = count;
+    return true;
+}
+
+// Returns -1 with errno ENOENT when a read-only set has no such volume
+static int getVolumeFd(VolumeSet* set, unsigned index)
+{
+    mutexLock(&set->lock);
+
+    int fd = -1;
+    if (growVolumes(set, index + 1))
+    {
+        fd = set->fds[index];
+        if (fd < 0)
+        {
+            char* path = getVolumePath(set->basePath, index);
+            if (path)
+            {
+                fd = set->writable ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0644) : open(path, O_RDONLY);
+                memFree(path);
+            }
+            set->fds[index] = fd;
+        }
+    }
+
+    mutexUnlock(&set->lock);
+    return fd;
+}
+
+static uint64_t scanVolumeSetSize(VolumeSet* set)
+{
+    uint64_t size = 0;
+
+    for (unsigned index = 0;; index++)
+    {
+        int fd = getVolumeFd(set, index);
+        if (fd < 0) break;
+
+        off_t end = lseek(fd, 0, SEEK_END);
+        if (end < 0) break;
+
+        size = (uint64_t)index * set->volumeSize + (uint64_t)end;
+        if ((uint64_t)end < set->volumeSize) break;
+    }
+
+    return size;
+}
+
+static void removeVolumesFrom(const char* basePath, unsigned first)
+{
+    for (unsigned index = first;; index++)
+    {
+        char* path = getVolumePath(basePath, index);
+        if (!path) return;
+
+        int removed = unlink(path);
+        memFree(path);
+
+        if (removed != 0) return;
+    }
+}
+
+VolumeSet* openVolumeSet(const char* basePath, uint64_t volumeSize, bool writable)
+{
+    if (!basePath || volumeSize == 0) return NULL;
+
+    VolumeSet* set = memCalloc(1, sizeof *set);
+    if (!set) return NULL;
+
+    set->basePath = memStrdup(basePath);
+    if (!set->basePath || !mutexInit(&set->lock))
+    {
+        memFree(set->basePath);
+        memFree(set);
+        return NULL;
+    }
+
+    set->volumeSize = volumeSize;
+    set->writable = writable;
+    set->refs = 1;
+
+    if (writable)
+    {
+        removeVolumesFrom(basePath, 0);
+
+        // The first volume always exists, even for an archive that is never written to
+        if (getVolumeFd(set, 0) < 0)
+        {
+            releaseVolumeSet(set);
+            return NULL;
+        }
+    }
+    else
+    {
+        if (getVolumeFd(set, 0) < 0)
+        {
+            releaseVolumeSet(set);
+            return NULL;
+        }
+        set->size = scanVolumeSetSize(set);
+    }
+
+    return set;
+}
+
+VolumeSet* openSingleVolume(const char* path)
+{
+    if (!path) return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    off_t end = lseek(fd, 0, SEEK_END);
+
+    VolumeSet* set = memCalloc(1, sizeof *set);
+    if (!set || end < 0 || !(set->basePath = memStrdup(path)) || !growVolumes(set, 1) || !mutexInit(&set->lock))
+    {
+        if (set)
+        {
+            memFree(set->fds);
+            memFree(set->basePath);
+            memFree(set);
+        }
+        close(fd);
+        return NULL;
+    }
+
+    // Never split, every position falls into the first volume
+    set->volumeSize = UINT64_MAX;
+    set->writable = false;
+    set->refs = 1;
+    set->fds[0] = fd;
+    set->size = (uint64_t)end;
+
+    return set;
+}
+
+void releaseVolumeSet(VolumeSet* set)
+{
+    if (!set) return;
+
+    mutexLock(&set->lock);
+    bool last = --set->refs == 0;
+    mutexUnlock(&set->lock);
+
+    if (!last) return;
+
+    for (unsigned i = 0; i < set->fdCount; i++)
+    {
+        if (set->fds[i] >= 0) close(set->fds[i]);
+    }
+
+    mutexDestroy(&set->lock);
+    memFree(set->fds);
+    memFree(set->basePath);
+    memFree(set);
+}
+
+static ssize_t volumeRead(void* cookie, char* buffer, size_t size)
+{
+    VolumeStream* stream = cookie;
+    VolumeSet* set = stream->set;
+
+    size_t total = 0;
+    while (total < size)
+    {
+        unsigned index = (unsigned)(stream->position / set->volumeSize);
+        uint64_t offset = stream->position % set->volumeSize;
+
+        uint64_t room = set->volumeSize - offset;
+        size_t chunk = (size - total < room) ? size - total : (size_t)room;
+
+        // Past the last volume is the end of the archive
+        int fd;
+        if (!set->writable)
+        {
+            fd = index < set->fdCount ? set->fds[index] : -1;
+            if (fd < 0) break;
+        }
+        else if ((fd = getVolumeFd(set, index)) < 0)
+        {
+            if (errno == ENOENT) break;
+            return -1;
+        }
+
+        ssize_t n = pread(fd, buffer + total, chunk, (off_t)offset);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+
+        total += (size_t)n;
+        stream->position += (uint64_t)n;
+    }
+
+    return (ssize_t)total;
+}
+
+static ssize_t volumeWrite(void* cookie, const char* buffer, size_t size)
+{
+    VolumeStream* stream = cookie;
+    VolumeSet* set = stream->set;
+
+    size_t total = 0;
+    while (total < size)
+    {
+        unsigned index = (unsigned)(stream->position / set->volumeSize);
+        uint64_t offset = stream->position % set->volumeSize;
+
+        uint64_t room = set->volumeSize - offset;
+        size_t chunk = (size - total < room) ? size - total : (size_t)room;
+
+        int fd = getVolumeFd(set, index);
+        if (fd < 0) return -1;
+
+        ssize_t n = pwrite(fd, buffer + total, chunk, (off_t)offset);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        total += (size_t)n;
+        stream->position += (uint64_t)n;
+    }
+
+    mutexLock(&set->lock);
+    if (stream->position > set->size) set->size = stream->position;
+    mutexUnlock(&set->lock);
+
+    return (ssize_t)total;
+}
+
+static int volumeSeek(void* cookie, off64_t* offset, int whence)
+{
+    VolumeStream* stream = cookie;
+
+    int64_t base;
+    switch (whence)
+    {
+        case SEEK_SET:
+            base = 0;
+            break;
+
+        case SEEK_CUR:
+            base = (int64_t)stream->position;
+            break;
+
+        case SEEK_END:
+            mutexLock(&stream->set->lock);
+            base = (int64_t)stream->set->size;
+            mutexUnlock(&stream->set->lock);
+            break;
+
+        default:
+            return -1;
+    }
+
+    if (base + *offset < 0) return -1;
+
+    stream->position = (uint64_t)(base + *offset);
+    *offset = (off64_t)stream->position;
+    return 0;
+}
+
+static int volumeClose(void* cookie)
+{
+    VolumeStream* stream = cookie;
+
+    releaseVolumeSet(stream->set);
+    memFree(stream);
+    return 0;
+}
+
+FILE* openVolumeStream(VolumeSet* set)
+{
+    if (!set) return NULL;
+
+    VolumeStream* stream = memCalloc(1, sizeof *stream);
+    if (!stream) return NULL;
+
+    stream->set = set;
+
+    cookie_io_functions_t io = {
+        .read = volumeRead,
+        .write = set->writable ? volumeWrite : NULL,
+        .seek = volumeSeek,
+        .close = volumeClose
+    };
+
+    FILE* file = fopencookie(stream, set->writable ? "w+" : "r", io);
+    if (!file)
+    {
+        memFree(stream);
+        return NULL;
+    }
+
+    mutexLock(&set->lock);
+    set->refs++;
+    mutexUnlock(&set->lock);
+
+    return file;
+}
+
+bool truncateVolumeSet(VolumeSet* set, uint64_t size)
+{
+    if (!set || !set->writable) return false;
+
+    unsigned last = (unsigned)(size / set->volumeSize);
+    uint64_t lastSize = size % set->volumeSize;
+
+    bool ok = true;
+
+    mutexLock(&set->lock);
+
+    // Volumes past the new end are dropped entirely
+    for (unsigned i = last + 1; i < set->fdCount; i++)
+    {
+        if (set->fds[i] >= 0)
+        {
+            close(set->fds[i]);
+            set->fds[i] = -1;
+        }
+    }
+    removeVolumesFrom(set->basePath, last + 1);
+
+    if (last < set->fdCount && set->fds[last] >= 0)
+        ok = ftruncate(set->fds[last], (off_t)lastSize) == 0;
+
+    set->size = size;
+
+    mutexUnlock(&set->lock);
+    return ok;
+}
+
+bool renameVolumeSet(const char* fromBase, const char* toBase)
+{
+    unsigned index = 0;
+
+    for (;; index++)
+    {
+        char* from = getVolumePath(fromBase, index);
+        char* to = getVolumePath(toBase, index);
+
+        bool exists = from && access(from, F_OK) == 0;
+        bool ok = from && to && (!exists || (syncFilePath(from) && replaceFile(from, to)));
+
+        memFree(from);
+        memFree(to);
+
+        if (!ok) return false;
+        if (!exists) break;
+    }
+
+    // The first volume always exists, a set without it isn't one
+    if (index == 0) return false;
+
+    removeVolumesFrom(toBase, index);
+    return true;
+}
+
+void removeVolumeSet(const char* basePath)
+{
+    removeVolumesFrom(basePath, 0);
+}
+
+#else
+
+VolumeSet* openVolumeSet(const char* basePath, uint64_t volumeSize, bool writable)
+{
+    (void)basePath;
+    (void)volumeSize;
+    (void)writable;
+    return NULL;
+}
+
+VolumeSet* openSingleVolume(const char* path)
+{
+    (void)path;
+    return NULL;
+}
+
+void releaseVolumeSet(VolumeSet* set)
+{
+    (void)set;
+}
+
+FILE* openVolumeStream(VolumeSet* set)
+{
+    (void)set;
+    return NULL;
+}
+
+bool truncateVolumeSet(VolumeSet* set, uint64_t size)
+{
+    (void)set;
+    (void)size;
+    return false;
+}
+
+bool renameVolumeSet(const char* fromBase, const char* toBase)
+{
+    (void)fromBase;
+    (void)toBase;
+    return false;
+}
+
+void removeVolumeSet(const char* basePath)
+{
+    (void)basePath;
+}
+
+#endif
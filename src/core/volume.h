@@ -0,0 +1,38 @@
+#ifndef VOLUME_H
+#define VOLUME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Split archives are one logical byte stream cut into fixed-size files name.001, name.002, ...
+// Streams map their position onto the volume files with positional I/O, so any number of them
+// can read or write different volumes at the same time.
+#ifdef __linux__
+    #define HAVE_SPLIT_VOLUMES 1
+#endif
+
+typedef struct VolumeSet VolumeSet;
+
+// Volume file name, index counts from 0 (name.001)
+char* getVolumePath(const char* basePath, unsigned index);
+// "name" for "name.001", NULL for any other path
+char* getVolumeBasePath(const char* firstVolumePath);
+
+// A writable set starts empty, volumes left over from an earlier archive of the same name are removed
+VolumeSet* openVolumeSet(const char* basePath, uint64_t volumeSize, bool writable);
+// Read-only set over one ordinary file, gives single-file archives the same shared-descriptor streams
+VolumeSet* openSingleVolume(const char* path);
+void releaseVolumeSet(VolumeSet* set);
+
+// Returns a seekable FILE* over the whole set, holding a reference until it is closed
+FILE* openVolumeStream(VolumeSet* set);
+
+bool truncateVolumeSet(VolumeSet* set, uint64_t size);
+
+// Moves the closed volumes of fromBase over those of toBase, each synced to disk first, and removes
+// volumes of toBase beyond the last one moved. A failure part way leaves toBase a mix of both sets.
+bool renameVolumeSet(const char* fromBase, const char* toBase);
+void removeVolumeSet(const char* basePath);
+
+#endif // VOLUME_H
@@ -0,0 +1,949 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE // fopencookie
+#endif
+
+#include "entry_reader.h"
+
+#include "core/access_index.h"
+#include "core/archive.h"
+#include "core/entry_table.h"
+#include "util/file.h"
+#include "util/long_match.h"
+#include "util/memory.h"
+#include "util/progress.h"
+#include "util/stats.h"
+
+#include <zlib.h>
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Readers on the source entries of a long-match entry, most recently used first
+#define LONG_MATCH_SOURCES 4
+
+struct ArchEntryReader
+{
+    Memory* memory;   // The archive's, for allocations after open
+    size_t entryIndex;
+
+    FILE* file;
+    FileHeader header;
+    uint64_t dataOffset;
+    uint64_t streamSize;    // Bytes of the zlib stream, compSize unless match records follow it
+
+    z_stream strm;
+    bool strmReady;
+    bool streamEnd;
+
+    unsigned char* inBuf;
+    size_t inBufSize;
+    uint64_t compConsumed;
+
+    uint64_t position;
+
+    // Restart points from the archive's access index, the dictionaries are read through indexFile
+    const EntryAccess* access;
+    const AccessIndex* index;
+    FILE* indexFile;
+
+    // Only meaningful while every byte from the start has passed through arch_entryRead
+    uint32_t crc;
+    bool crcTracked;
+    uint32_t streamCrc;
+
+    // Long-match entries: the match records, the one being replayed and readers on its sources, which
+    // are entries of the same archive or for ARCH_FLAG_BASE_DELTA of the base
+    Archive* sourceArchive;
+    const EntryTable* sourceTable;
+    unsigned char* matches;
+    size_t matchesSize;
+    uint32_t matchesCrc;    // Of the records and the trailer, to complete the compressed CRC
+    const unsigned char* matchCursor;
+    uint64_t literalsLeft;  // Until the next match, UINT64_MAX after the last one
+    uint64_t matchLeft;
+    size_t matchEntry;
+    uint64_t matchOffset;
+    ArchEntryReader* sources[LONG_MATCH_SOURCES];
+};
+
+static ArchResult mapInflateError(int ret)
+{
+    switch (ret)
+    {
+        case Z_MEM_ERROR:
+            return ARCH_ERR_OUT_OF_MEMORY;
+
+        case Z_DATA_ERROR:
+        case Z_NEED_DICT:
+            return ARCH_ERR_CORRUPTED;
+
+        case Z_STREAM_ERROR:
+            return ARCH_ERR_INTERNAL;
+
+        default:
+            return ARCH_ERR_COMPRESSION;
+    }
+}
+
+static ArchResult restartEntry(ArchEntryReader* reader)
+{
+    if (fseek64(reader->file, (int64_t)reader->dataOffset, SEEK_SET) != 0)
+        return ARCH_ERR_IO;
+
+    if (reader->strmReady)
+    {
+        // Back to a zlib stream, an access point may have switched it to raw deflate
+        if (inflateReset2(&reader->strm, 15) != Z_OK)
+            return ARCH_ERR_INTERNAL;
+
+        reader->strm.next_in = reader->inBuf;
+        reader->strm.avail_in = 0;
+    }
+
+    reader->streamEnd = false;
+    reader->compConsumed = 0;
+    reader->position = 0;
+    reader->crc = crc32(0L, Z_NULL, 0);
+    reader->crcTracked = true;
+    reader->streamCrc = crc32(0L, Z_NULL, 0);
+
+    reader->matchCursor = reader->matches;
+    reader->literalsLeft = 0;
+    reader->matchLeft = 0;
+
+    return ARCH_OK;
+}
+
+// Loads the match records from the end of a long-match payload
+static ArchResult loadMatches(ArchEntryReader* reader)
+{
+    uint64_t compSize = reader->header.compSize;
+    unsigned char trailer[LONG_MATCH_TRAILER_SIZE];
+    size_t bytesRead;
+
+    if (compSize < sizeof trailer)
+        return ARCH_ERR_CORRUPTED;
+
+    if (fseek64(reader->file, (int64_t)(reader->dataOffset + compSize - sizeof trailer), SEEK_SET) != 0 ||
+        !readFile(reader->file, (char*)trailer, sizeof trailer, &bytesRead))
+    {
+        return ARCH_ERR_IO;
+    }
+
+    uint64_t size = read_u64_le(trailer);
+    if (bytesRead != sizeof trailer || size == 0 || size > compSize - sizeof trailer || size > SIZE_MAX)
+        return ARCH_ERR_CORRUPTED;
+
+    reader->streamSize = compSize - sizeof trailer - size;
+    reader->matchesSize = (size_t)size;
+
+    reader->matches = memAlloc(reader->matchesSize);
+    if (!reader->matches)
+        return ARCH_ERR_OUT_OF_MEMORY;
+
+    if (fseek64(reader->file, (int64_t)(reader->dataOffset + reader->streamSize), SEEK_SET) != 0 ||
+        !readFile(reader->file, (char*)reader->matches, reader->matchesSize, &bytesRead))
+    {
+        return ARCH_ERR_IO;
+    }
+
+    if (bytesRead != reader->matchesSize)
+        return ARCH_ERR_CORRUPTED;
+
+    reader->matchesCrc = (uint32_t)crc32_z(0L, reader->matches, reader->matchesSize);
+    reader->matchesCrc = crc32(reader->matchesCrc, trailer, sizeof trailer);
+    return ARCH_OK;
+}
+
+// Resumes inflating at an access point, the CRC can no longer be followed from there
+static ArchResult resumeAtPoint(ArchEntryReader* reader, const AccessPoint* point)
+{
+    if (!reader->indexFile)
+    {
+        reader->indexFile = openAccessIndexStream(reader->index);
+        if (!reader->indexFile)
+            return ARCH_ERR_IO;
+    }
+
+    ArchResult result = restoreAccessPoint(&reader->strm, reader->file, reader->dataOffset, reader->indexFile, point);
+    if (result != ARCH_OK)
+        return result;
+
+    reader->strm.next_in = reader->inBuf;
+    reader->strm.avail_in = 0;
+
+    reader->streamEnd = false;
+    reader->compConsumed = point->inOffset;
+    reader->position = point->outOffset;
+    reader->crcTracked = false;
+
+    return ARCH_OK;
+}
+
+static ArchResult openReader(Archive* archive, size_t index, const EntryRecord* record, ArchEntryReader** outReader);
+
+// A reference to an unchanged entry is served by a reader on the base entry itself
+static ArchResult openBaseReference(Archive* archive, const EntryRecord* record, ArchEntryReader** outReader)
+{
+    if (!archive->base)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    const EntryTable* table = getArchiveEntryTable(archive->base);
+    if (!table)
+        return ARCH_ERR_IO;
+
+    size_t index;
+    const EntryRecord* baseRecord = findArchiveEntry(archive->base, record->name, &index);
+
+    if (!baseRecord || baseRecord->header.origSize != record->header.origSize ||
+        baseRecord->header.crc32_uncompressed != record->header.crc32_uncompressed)
+    {
+        return ARCH_ERR_CORRUPTED;
+    }
+
+    MemoryScope scope;
+    memoryScopeEnter(&scope, &archive->base->memory);
+    ArchResult result = openReader(archive->base, index, baseRecord, outReader);
+    memoryScopeLeave(&scope);
+
+    return result;
+}
+
+static ArchResult openReader(Archive* archive, size_t index, const EntryRecord* record, ArchEntryReader** outReader)
+{
+    if (record->header.flags & ARCH_FLAG_BASE_REF)
+        return openBaseReference(archive, record, outReader);
+
+    ArchEntryReader* reader = memCalloc(1, sizeof *reader);
+    if (!reader)
+        return ARCH_ERR_OUT_OF_MEMORY;
+
+    ArchResult result = ARCH_OK;
+
+    reader->memory = &archive->memory;
+    reader->entryIndex = index;
+    reader->header = record->header;
+    reader->dataOffset = record->dataOffset;
+    reader->streamSize = record->header.compSize;
+
+    reader->file = openArchiveStream(archive);
+    if (!reader->file)
+    {
+        result = ARCH_ERR_IO;
+        goto fail;
+    }
+
+    if (reader->header.flags & ARCH_FLAG_COMPRESSED)
+    {
+        reader->inBufSize = tryAllocateBuffer(&reader->inBuf);
+        if (reader->inBufSize == 0)
+        {
+            result = ARCH_ERR_OUT_OF_MEMORY;
+            goto fail;
+        }
+
+        memoryBindStream(&reader->strm);
+        if (inflateInit(&reader->strm) != Z_OK)
+        {
+            result = ARCH_ERR_INTERNAL;
+            goto fail;
+        }
+        reader->strmReady = true;
+
+        if (reader->header.flags & ARCH_FLAG_LONG_MATCH)
+        {
+            reader->sourceArchive = (reader->header.flags & ARCH_FLAG_BASE_DELTA) ? archive->base : archive;
+            if (!reader->sourceArchive)
+            {
+                result = ARCH_ERR_INVALID_ARGUMENT;
+                goto fail;
+            }
+
+            reader->sourceTable = getArchiveEntryTable(reader->sourceArchive);
+            if (!reader->sourceTable)
+            {
+                result = ARCH_ERR_IO;
+                goto fail;
+            }
+
+            result = loadMatches(reader);
+            if (result != ARCH_OK)
+                goto fail;
+        }
+
+        // Points of long-match entries count literals only, they can't be used to seek
+        mutexLock(&archive->tableLock);
+        if (archive->accessIndex && !(reader->header.flags & ARCH_FLAG_LONG_MATCH))
+        {
+            reader->access = &archive->accessIndex->entries[index];
+            reader->index = archive->accessIndex;
+        }
+        mutexUnlock(&archive->tableLock);
+    }
+
+    result = restartEntry(reader);
+    if (result != ARCH_OK)
+        goto fail;
+
+    *outReader = reader;
+    return ARCH_OK;
+
+fail:
+    arch_entryClose(reader);
+    return result;
+}
+
+ArchResult arch_entryOpen(Archive* archive, const char* name, ArchEntryReader** outReader)
+{
+    if (!archive || !name || !outReader)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    *outReader = NULL;
+
+    const EntryTable* table = getArchiveEntryTable(archive);
+    if (!table)
+        return archive->readOnly ? ARCH_ERR_IO : ARCH_ERR_INVALID_ARGUMENT;
+
+    size_t index;
+    const EntryRecord* record = findArchiveEntry(archive, name, &index);
+    if (!record)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    MemoryScope scope;
+    memoryScopeEnter(&scope, &archive->memory);
+    ArchResult result = openReader(archive, index, record, outReader);
+    memoryScopeLeave(&scope);
+
+    return result;
+}
+
+ArchResult arch_entryOpenIndex(Archive* archive, size_t index, ArchEntryReader** outReader)
+{
+    if (!archive || !outReader)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    *outReader = NULL;
+
+    const EntryTable* table = getArchiveEntryTable(archive);
+    if (!table)
+        return archive->readOnly ? ARCH_ERR_IO : ARCH_ERR_INVALID_ARGUMENT;
+
+    if (index >= table->count)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    MemoryScope scope;
+    memoryScopeEnter(&scope, &archive->memory);
+    ArchResult result = openReader(archive, index, &table->entries[index], outReader);
+    memoryScopeLeave(&scope);
+
+    return result;
+}
+
+static ArchResult readStored(ArchEntryReader* reader, unsigned char* buffer, size_t size, size_t* outBytesRead)
+{
+    uint64_t remaining = reader->header.origSize - reader->position;
+    size_t toRead = (remaining < size) ? (size_t)remaining : size;
+
+    size_t bytesRead = 0;
+    if (toRead > 0)
+    {
+        if (!readFile(reader->file, (char*)buffer, toRead, &bytesRead))
+            return ARCH_ERR_IO;
+
+        if (bytesRead != toRead)
+            return ARCH_ERR_CORRUPTED;
+    }
+
+    *outBytesRead = bytesRead;
+    return ARCH_OK;
+}
+
+static ArchResult readCompressed(ArchEntryReader* reader, unsigned char* buffer, size_t size, size_t* outBytesRead)
+{
+    z_stream* strm = &reader->strm;
+
+    strm->next_out = buffer;
+    strm->avail_out = (uInt)size;
+
+    while (strm->avail_out > 0 && !reader->streamEnd)
+    {
+        if (strm->avail_in == 0)
+        {
+            uint64_t compLeft = reader->streamSize - reader->compConsumed;
+            if (compLeft == 0)
+                return ARCH_ERR_CORRUPTED;
+
+            size_t toRead = (compLeft < reader->inBufSize) ? (size_t)compLeft : reader->inBufSize;
+            size_t bytesRead;
+            if (!readFile(reader->file, (char*)reader->inBuf, toRead, &bytesRead))
+                return ARCH_ERR_IO;
+
+            if (bytesRead == 0)
+                return ARCH_ERR_CORRUPTED;
+
+            if (reader->crcTracked) reader->streamCrc = crc32(reader->streamCrc, reader->inBuf, (uInt)bytesRead);
+
+            reader->compConsumed += bytesRead;
+            strm->next_in = reader->inBuf;
+            strm->avail_in = (uInt)bytesRead;
+        }
+
+        int ret = inflate(strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END)
+        {
+            reader->streamEnd = true;
+        }
+        else if (ret != Z_OK)
+        {
+            fprintf(stderr, "inflate error: %d\n", ret);
+            return mapInflateError(ret);
+        }
+    }
+
+    *outBytesRead = size - strm->avail_out;
+    return ARCH_OK;
+}
+
+// Reads length bytes at offset of the source entry of the current match
+static ArchResult readMatchSource(ArchEntryReader* reader, unsigned char* buffer, size_t length)
+{
+    const EntryRecord* record = &reader->sourceTable->entries[reader->matchEntry];
+
+    // Sources in the same archive never have matches of their own, which bounds every read to a single hop
+    bool sameArchive = !(reader->header.flags & ARCH_FLAG_BASE_DELTA);
+
+    if ((sameArchive && (record->header.flags & ARCH_FLAG_LONG_MATCH)) || reader->matchOffset > record->header.origSize ||
+        length > record->header.origSize - reader->matchOffset)
+    {
+        return ARCH_ERR_CORRUPTED;
+    }
+
+    size_t slot = 0;
+    while (slot < LONG_MATCH_SOURCES && reader->sources[slot] && reader->sources[slot]->entryIndex != reader->matchEntry)
+    {
+        slot++;
+    }
+
+    ArchEntryReader* source = (slot < LONG_MATCH_SOURCES) ? reader->sources[slot] : NULL;
+
+    if (!source)
+    {
+        MemoryScope scope;
+        memoryScopeEnter(&scope, &reader->sourceArchive->memory);
+        ArchResult r = openReader(reader->sourceArchive, reader->matchEntry, record, &source);
+        memoryScopeLeave(&scope);
+
+        if (r != ARCH_OK) return r;
+
+        // Takes a free slot, or the least recently used one when all are taken
+        if (slot == LONG_MATCH_SOURCES)
+        {
+            slot--;
+            arch_entryClose(reader->sources[slot]);
+        }
+    }
+
+    memmove(reader->sources + 1, reader->sources, slot * sizeof *reader->sources);
+    reader->sources[0] = source;
+
+    if (source->position != reader->matchOffset)
+    {
+        ArchResult r = arch_entrySeek(source, (int64_t)reader->matchOffset, SEEK_SET);
+        if (r != ARCH_OK) return r;
+    }
+
+    for (size_t done = 0; done < length; )
+    {
+        size_t bytesRead;
+        ArchResult r = arch_entryRead(source, buffer + done, length - done, &bytesRead);
+        if (r != ARCH_OK) return r;
+        if (bytesRead == 0) return ARCH_ERR_CORRUPTED;
+
+        done += bytesRead;
+    }
+
+    return ARCH_OK;
+}
+
+// Interleaves inflated literals with spans of the source entries, as the match records say
+static ArchResult readLongMatch(ArchEntryReader* reader, unsigned char* buffer, size_t size, size_t* outBytesRead)
+{
+    size_t done = 0;
+
+    while (done < size)
+    {
+        if (reader->literalsLeft > 0)
+        {
+            size_t want = size - done;
+            if (reader->literalsLeft < want) want = (size_t)reader->literalsLeft;
+
+            size_t bytesRead;
+            ArchResult r = readCompressed(reader, buffer + done, want, &bytesRead);
+            if (r != ARCH_OK) return r;
+            if (bytesRead == 0) return ARCH_ERR_CORRUPTED;
+
+            if (reader->literalsLeft != UINT64_MAX) reader->literalsLeft -= bytesRead;
+            done += bytesRead;
+        }
+        else if (reader->matchLeft > 0)
+        {
+            size_t want = size - done;
+            if (reader->matchLeft < want) want = (size_t)reader->matchLeft;
+
+            ArchResult r = readMatchSource(reader, buffer + done, want);
+            if (r != ARCH_OK) return r;
+
+            reader->matchOffset += want;
+            reader->matchLeft -= want;
+            done += want;
+        }
+        else if (reader->matchCursor == reader->matches + reader->matchesSize)
+        {
+            reader->literalsLeft = UINT64_MAX;
+        }
+        else
+        {
+            const unsigned char* end = reader->matches + reader->matchesSize;
+
+            uint64_t literals, length, source, offset;
+
+            if (!readLongMatchVarint(&reader->matchCursor, end, &literals) ||
+                !readLongMatchVarint(&reader->matchCursor, end, &length) ||
+                !readLongMatchVarint(&reader->matchCursor, end, &source) ||
+                !readLongMatchVarint(&reader->matchCursor, end, &offset) ||
+                length == 0)
+            {
+                return ARCH_ERR_CORRUPTED;
+            }
+
+            // Base sources are named by index, earlier entries of this archive by how far back they are
+            if (reader->header.flags & ARCH_FLAG_BASE_DELTA)
+            {
+                if (source >= reader->sourceTable->count) return ARCH_ERR_CORRUPTED;
+                reader->matchEntry = (size_t)source;
+            }
+            else
+            {
+                if (source == 0 || source > reader->entryIndex) return ARCH_ERR_CORRUPTED;
+                reader->matchEntry = reader->entryIndex - (size_t)source;
+            }
+
+            reader->literalsLeft = literals;
+            reader->matchLeft = length;
+            reader->matchOffset = offset;
+        }
+    }
+
+    *outBytesRead = done;
+    return ARCH_OK;
+}
+
+ArchResult arch_entryRead(ArchEntryReader* reader, void* buffer, size_t size, size_t* outBytesRead)
+{
+    if (!reader || (!buffer && size > 0) || !outBytesRead)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    *outBytesRead = 0;
+
+    // avail_out is a uInt, larger requests are simply served short
+    if (size > UINT32_MAX) size = UINT32_MAX;
+
+    uint64_t remaining = reader->header.origSize - reader->position;
+    if (remaining == 0 || size == 0)
+        return ARCH_OK;
+
+    if (remaining < size) size = (size_t)remaining;
+
+    size_t bytesRead = 0;
+    ArchResult result;
+
+    if (reader->header.flags & ARCH_FLAG_LONG_MATCH)
+        result = readLongMatch(reader, buffer, size, &bytesRead);
+    else if (reader->header.flags & ARCH_FLAG_COMPRESSED)
+        result = readCompressed(reader, buffer, size, &bytesRead);
+    else
+        result = readStored(reader, buffer, size, &bytesRead);
+
+    if (result != ARCH_OK)
+        return result;
+
+    if (bytesRead == 0)
+        return ARCH_ERR_CORRUPTED;
+
+    reader->position += bytesRead;
+
+    if (reader->crcTracked)
+    {
+        reader->crc = crc32(reader->crc, buffer, (uInt)bytesRead);
+
+        if (reader->position == reader->header.origSize && reader->crc != reader->header.crc32_uncompressed)
+            return ARCH_ERR_CORRUPTED;
+    }
+
+    *outBytesRead = bytesRead;
+    return ARCH_OK;
+}
+
+ArchResult arch_entrySeek(ArchEntryReader* reader, int64_t offset, int whence)
+{
+    if (!reader)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    int64_t base;
+    switch (whence)
+    {
+        case SEEK_SET: base = 0; break;
+        case SEEK_CUR: base = (int64_t)reader->position; break;
+        case SEEK_END: base = (int64_t)reader->header.origSize; break;
+        default: return ARCH_ERR_INVALID_ARGUMENT;
+    }
+
+    if ((offset < 0 && base + offset < 0) || (offset > 0 && base > INT64_MAX - offset))
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    uint64_t target = (uint64_t)(base + offset);
+    if (target > reader->header.origSize)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    if (target == reader->position)
+        return ARCH_OK;
+
+    if (!(reader->header.flags & ARCH_FLAG_COMPRESSED))
+    {
+        if (fseek64(reader->file, (int64_t)(reader->dataOffset + target), SEEK_SET) != 0)
+            return ARCH_ERR_IO;
+
+        reader->position = target;
+        reader->crcTracked = (target == 0);
+        if (target == 0) reader->crc = crc32(0L, Z_NULL, 0);
+        return ARCH_OK;
+    }
+
+    // Jump to the closest access point when it beats inflating on from here
+    const AccessPoint* point = findAccessPoint(reader->access, target);
+
+    if (point && (target < reader->position || point->outOffset > reader->position))
+    {
+        MemoryScope scope;
+        memoryScopeEnter(&scope, reader->memory);
+        ArchResult r = resumeAtPoint(reader, point);
+        memoryScopeLeave(&scope);
+
+        if (r != ARCH_OK) return r;
+    }
+    else if (target < reader->position)
+    {
+        ArchResult r = restartEntry(reader);
+        if (r != ARCH_OK) return r;
+    }
+
+    unsigned char discard[16384];
+    while (reader->position < target)
+    {
+        uint64_t left = target - reader->position;
+        size_t chunk = (left < sizeof discard) ? (size_t)left : sizeof discard;
+
+        size_t bytesRead;
+        ArchResult r = arch_entryRead(reader, discard, chunk, &bytesRead);
+        if (r != ARCH_OK) return r;
+    }
+
+    return ARCH_OK;
+}
+
+uint64_t arch_entryTell(const ArchEntryReader* reader)
+{
+    return reader ? reader->position : 0;
+}
+
+uint64_t arch_entrySize(const ArchEntryReader* reader)
+{
+    return reader ? reader->header.origSize : 0;
+}
+
+void arch_entryClose(ArchEntryReader* reader)
+{
+    if (!reader) return;
+
+    for (size_t i = 0; i < LONG_MATCH_SOURCES; i++)
+    {
+        arch_entryClose(reader->sources[i]);
+    }
+
+    if (reader->strmReady) inflateEnd(&reader->strm);
+    if (reader->file) fclose(reader->file);
+    if (reader->indexFile) fclose(reader->indexFile);
+    memFree(reader->matches);
+    memFree(reader->inBuf);
+    memFree(reader);
+}
+
+// Inflates past the last byte of output to the end of the zlib stream, whose adler32 and the compressed
+// CRC32 over the whole payload are checked on the way
+static ArchResult finishStream(ArchEntryReader* reader)
+{
+    unsigned char extra;
+    size_t bytesRead;
+
+    ArchResult result = readCompressed(reader, &extra, 1, &bytesRead);
+    if (result != ARCH_OK)
+        return result;
+
+    if (bytesRead != 0 || !reader->streamEnd || reader->compConsumed != reader->streamSize)
+        return ARCH_ERR_CORRUPTED;
+
+    uint32_t crc = reader->streamCrc;
+    if (reader->matches)
+        crc = (uint32_t)crc32_combine(crc, reader->matchesCrc, (z_off_t)(reader->matchesSize + LONG_MATCH_TRAILER_SIZE));
+
+    return crc == reader->header.crc32_compressed ? ARCH_OK : ARCH_ERR_CORRUPTED;
+}
+
+ArchResult streamEntry(Archive* archive, size_t index, StreamWriteFn write, void* context)
+{
+    ArchEntryReader* reader = NULL;
+    unsigned char* buffer = NULL;
+
+    ArchResult result = arch_entryOpenIndex(archive, index, &reader);
+    if (result != ARCH_OK)
+        return result;
+
+    size_t bufferSize = tryAllocateBuffer(&buffer);
+    if (bufferSize == 0)
+    {
+        result = ARCH_ERR_OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    while (reader->position < reader->header.origSize)
+    {
+        size_t bytesRead;
+
+        uint64_t t = statsBegin();
+        result = arch_entryRead(reader, buffer, bufferSize, &bytesRead);
+        statsEnd(ARCH_STAGE_DECOMPRESS, t);
+
+        if (result != ARCH_OK)
+            goto cleanup;
+
+        if (write)
+        {
+            t = statsBegin();
+            bool writeOk = write(context, buffer, bytesRead);
+            statsEnd(ARCH_STAGE_WRITE, t);
+
+            if (!writeOk)
+            {
+                result = ARCH_ERR_IO;
+                goto cleanup;
+            }
+        }
+
+        if (!progressAdvance(bytesRead, write ? bytesRead : 0))
+        {
+            result = ARCH_ERR_CANCELLED;
+            goto cleanup;
+        }
+    }
+
+    // The CRC of the content was checked by the last read
+    if (reader->header.flags & ARCH_FLAG_COMPRESSED)
+        result = finishStream(reader);
+
+cleanup:
+    memFree(buffer);
+    arch_entryClose(reader);
+    return result;
+}
+
+/* ===== Decompressed entry cache ===== */
+
+// Inflates the whole entry into the item and checks both CRC32s
+static ArchResult readWholeEntry(Archive* archive, size_t index, CacheItem* item)
+{
+    ArchEntryReader* reader;
+
+    ArchResult result = arch_entryOpenIndex(archive, index, &reader);
+    if (result != ARCH_OK)
+        return result;
+
+    size_t done = 0;
+    while (result == ARCH_OK && done < item->size)
+    {
+        size_t bytesRead;
+
+        uint64_t t = statsBegin();
+        result = arch_entryRead(reader, item->data + done, item->size - done, &bytesRead);
+        statsEnd(ARCH_STAGE_DECOMPRESS, t);
+
+        if (result == ARCH_OK && bytesRead == 0)
+            result = ARCH_ERR_CORRUPTED;
+
+        done += bytesRead;
+    }
+
+    if (result == ARCH_OK && (reader->header.flags & ARCH_FLAG_COMPRESSED))
+        result = finishStream(reader);
+
+    arch_entryClose(reader);
+    return result;
+}
+
+static ArchResult entryAcquire(Archive* archive, size_t index, const void** outData, size_t* outSize)
+{
+    const EntryTable* table = getArchiveEntryTable(archive);
+    if (!table)
+        return archive->readOnly ? ARCH_ERR_IO : ARCH_ERR_INVALID_ARGUMENT;
+
+    if (index >= table->count)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    const EntryRecord* record = &table->entries[index];
+    if (record->header.origSize > SIZE_MAX)
+        return ARCH_ERR_OUT_OF_MEMORY;
+
+    // Where the entry lies identifies it for as long as the archive is open
+    uint64_t key = record->headerOffset;
+    CacheItem* item = archive->cache ? acquireCacheItem(archive->cache, key) : NULL;
+
+    if (!item)
+    {
+        item = allocateCacheItem(key, (size_t)record->header.origSize);
+        if (!item)
+            return ARCH_ERR_OUT_OF_MEMORY;
+
+        ArchResult result = readWholeEntry(archive, index, item);
+        if (result != ARCH_OK)
+        {
+            releaseCacheItem(item);
+            return result;
+        }
+
+        if (archive->cache)
+            item = insertCacheItem(archive->cache, item);
+    }
+
+    *outData = item->data;
+    *outSize = item->size;
+    return ARCH_OK;
+}
+
+ArchResult arch_entryAcquire(Archive* archive, size_t index, const void** outData, size_t* outSize)
+{
+    if (!archive || !outData || !outSize)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    *outData = NULL;
+    *outSize = 0;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = entryAcquire(archive, index, outData, outSize);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+void arch_entryRelease(Archive* archive, const void* data)
+{
+    if (!archive || !data) return;
+
+    releaseCacheItem((CacheItem*)((const unsigned char*)data - offsetof(CacheItem, data)));
+}
+
+ArchResult arch_getCacheStats(Archive* archive, ArchCacheStats* outStats)
+{
+    if (!archive || !outStats || !archive->cache)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    getEntryCacheStats(archive->cache, outStats);
+    return ARCH_OK;
+}
+
+/* ===== Zero-copy access to stored entries ===== */
+
+static ArchResult mapEntry(Archive* archive, const char* name, const void** outData, size_t* outSize)
+{
+    if (archive->volumeSize)
+        return ARCH_ERR_UNSUPPORTED_VERSION;
+
+    const EntryTable* table = getArchiveEntryTable(archive);
+    if (!table)
+        return archive->readOnly ? ARCH_ERR_IO : ARCH_ERR_INVALID_ARGUMENT;
+
+    const EntryRecord* record = findArchiveEntry(archive, name, NULL);
+    if (!record || (record->header.flags & (ARCH_FLAG_COMPRESSED | ARCH_FLAG_BASE_REF)))
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    uint64_t mappingSize;
+    const unsigned char* mapping = getArchiveMapping(archive, &mappingSize);
+    if (!mapping)
+        return ARCH_ERR_IO;
+
+    // A directory pointing past the end must not turn into a fault on first access
+    uint64_t size = record->header.origSize;
+    if (record->dataOffset > mappingSize || size > mappingSize - record->dataOffset)
+        return ARCH_ERR_CORRUPTED;
+
+    *outData = mapping + record->dataOffset;
+    *outSize = (size_t)size;
+    return ARCH_OK;
+}
+
+ArchResult arch_mapEntry(Archive* archive, const char* name, const void** outData, size_t* outSize)
+{
+    if (!archive || !name || !outData || !outSize)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    *outData = NULL;
+    *outSize = 0;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = mapEntry(archive, name, outData, outSize);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+#ifdef __linux__
+
+static ssize_t cookieRead(void* cookie, char* buffer, size_t size)
+{
+    size_t bytesRead;
+    if (arch_entryRead(cookie, buffer, size, &bytesRead) != ARCH_OK) return -1;
+    return (ssize_t)bytesRead;
+}
+
+static int cookieSeek(void* cookie, off64_t* offset, int whence)
+{
+    if (arch_entrySeek(cookie, *offset, whence) != ARCH_OK) return -1;
+    *offset = (off64_t)arch_entryTell(cookie);
+    return 0;
+}
+
+static int cookieClose(void* cookie)
+{
+    arch_entryClose(cookie);
+    return 0;
+}
+
+FILE* arch_entryFopen(ArchEntryReader* reader)
+{
+    if (!reader) return NULL;
+
+    cookie_io_functions_t io = {
+        .read = cookieRead,
+        .write = NULL,
+        .seek = cookieSeek,
+        .close = cookieClose
+    };
+
+    return fopencookie(reader, "rb", io);
+}
+
+#endif
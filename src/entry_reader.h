@@ -0,0 +1,15 @@
+#ifndef ENTRY_READER_H
+#define ENTRY_READER_H
+
+#include <arch/unarchiver.h>
+
+#include "util/file.h"
+
+#include <stddef.h>
+
+// Streams entry index of a read-only archive through an entry reader into write (NULL discards) and checks
+// both CRC32s, like decompressStream does. The way to decode ARCH_FLAG_LONG_MATCH entries, which need
+// their source entries. Reports progress, must run inside a call on the archive.
+ArchResult streamEntry(Archive* archive, size_t index, StreamWriteFn write, void* context);
+
+#endif // ENTRY_READER_H
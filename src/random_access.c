@@ -0,0 +1,126 @@
+#include <arch/unarchiver.h>
+
+#include "core/access_index.h"
+#include "core/archive.h"
+#include "util/file.h"
+#include "util/memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static char* defaultIndexPath(const Archive* archive)
+{
+    size_t size = strlen(archive->filePath) + sizeof ".zidx";
+
+    char* path = memAlloc(size);
+    if (path) snprintf(path, size, "%s.zidx", archive->filePath);
+    return path;
+}
+
+static ArchResult buildArchiveIndex(Archive* archive, uint64_t spanBytes, const char* indexPath)
+{
+    const EntryTable* table = getArchiveEntryTable(archive);
+    if (!table)
+        return ARCH_ERR_CORRUPTED;
+
+    uint64_t t = statsBegin();
+    FILE* file = openArchiveStream(archive);
+    statsEnd(ARCH_STAGE_OPEN, t);
+
+    if (!file)
+        return ARCH_ERR_IO;
+
+    ArchResult result;
+    AccessIndex* index = buildAccessIndex(file, table, spanBytes, indexPath, &result);
+    fclose(file);
+
+    if (!index)
+        return result;
+
+    mutexLock(&archive->tableLock);
+    freeAccessIndex(archive->accessIndex);
+    archive->accessIndex = index;
+    mutexUnlock(&archive->tableLock);
+    return ARCH_OK;
+}
+
+ArchResult arch_buildAccessIndex(Archive* archive, uint64_t spanBytes, const char* indexPath)
+{
+    if (!archive || !archive->readOnly || spanBytes == 0)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    char* path = indexPath ? NULL : defaultIndexPath(archive);
+    ArchResult result = (indexPath || path) ? buildArchiveIndex(archive, spanBytes, indexPath ? indexPath : path) : ARCH_ERR_OUT_OF_MEMORY;
+    memFree(path);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+ArchResult arch_loadAccessIndex(Archive* archive, const char* indexPath)
+{
+    if (!archive || !archive->readOnly)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    const EntryTable* table = getArchiveEntryTable(archive);
+    if (!table)
+        return ARCH_ERR_CORRUPTED;
+
+    MemoryScope scope;
+    memoryScopeEnter(&scope, &archive->memory);
+
+    char* path = indexPath ? NULL : defaultIndexPath(archive);
+    ArchResult result = ARCH_ERR_OUT_OF_MEMORY;
+    AccessIndex* index = (indexPath || path) ? loadAccessIndex(table, indexPath ? indexPath : path, &result) : NULL;
+    memFree(path);
+
+    memoryScopeLeave(&scope);
+
+    if (!index)
+        return result;
+
+    mutexLock(&archive->tableLock);
+    freeAccessIndex(archive->accessIndex);
+    archive->accessIndex = index;
+    mutexUnlock(&archive->tableLock);
+    return ARCH_OK;
+}
+
+ArchResult arch_readRange(Archive* archive, size_t entryIndex, uint64_t offset, void* buffer, size_t length, size_t* outBytesRead)
+{
+    if (!archive || (!buffer && length > 0) || !outBytesRead)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    *outBytesRead = 0;
+
+    ArchEntryReader* reader;
+    ArchResult result = arch_entryOpenIndex(archive, entryIndex, &reader);
+    if (result != ARCH_OK)
+        return result;
+
+    if (offset > arch_entrySize(reader) || offset > INT64_MAX)
+    {
+        arch_entryClose(reader);
+        return ARCH_ERR_INVALID_ARGUMENT;
+    }
+
+    result = arch_entrySeek(reader, (int64_t)offset, SEEK_SET);
+
+    size_t total = 0;
+    while (result == ARCH_OK && total < length)
+    {
+        size_t bytesRead;
+        result = arch_entryRead(reader, (unsigned char*)buffer + total, length - total, &bytesRead);
+        if (bytesRead == 0) break;
+
+        total += bytesRead;
+    }
+
+    arch_entryClose(reader);
+
+    *outBytesRead = total;
+    return result;
+}
@@ -1,9 +1,13 @@
 #include <arch/unarchiver.h>
 
+#include "entry_reader.h"
 #include "core/archive.h"
 #include "core/archive_header.h"
 #include "core/file_header.h"
 #include "util/file.h"
+#include "util/pattern.h"
+#include "util/pipeline.h"
+#include "util/thread.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -11,70 +15,283 @@
 
 ArchResult arch_open(const char* path, Archive** outArchive)
 {
-    if (!path || !outArchive)
+    return arch_openEx(path, NULL, outArchive);
+}
+
+// The base of a delta shares its memory options but is never a delta itself
+static ArchResult openBase(Archive* archive, const ArchOpenOptions* options, uint32_t fingerprint)
+{
+    ArchOpenOptions baseOptions = *options;
+    baseOptions.baseArchive = NULL;
+
+    Archive* base;
+    ArchResult result = arch_openEx(options->baseArchive, &baseOptions, &base);
+    if (result != ARCH_OK)
+        return result;
+
+    const EntryTable* table = getArchiveEntryTable(base);
+    if (!table)
+    {
+        arch_close(base);
+        return ARCH_ERR_IO;
+    }
+
+    if (getEntryTableFingerprint(table) != fingerprint)
+    {
+        arch_close(base);
+        return ARCH_ERR_INVALID_ARGUMENT;
+    }
+
+    archive->base = base;
+    return ARCH_OK;
+}
+
+ArchResult arch_openEx(const char* path, const ArchOpenOptions* options, Archive** outArchive)
+{
+    const ArchMemoryOptions* memoryOptions = options ? &options->memory : NULL;
+
+    if (!path || !outArchive || !memoryOptionsValid(memoryOptions))
         return ARCH_ERR_INVALID_ARGUMENT;
 
     *outArchive = NULL;
-    Archive* archive = createArchive(path, "rb");
+    Archive* archive = createArchive(path, "rb", memoryOptions);
+    char* basePath = NULL;
+
     if (!archive)
-        return ARCH_ERR_IO;
+    {
+        // A split archive may be opened by its base name, the header lives in the first volume
+        char* firstVolume = getVolumePath(path, 0);
+        archive = firstVolume ? createArchive(firstVolume, "rb", memoryOptions) : NULL;
+        memFree(firstVolume);
+
+        if (!archive)
+            return ARCH_ERR_IO;
+
+        basePath = memStrdup(path);
+        if (!basePath)
+        {
+            freeArchive(archive);
+            return ARCH_ERR_OUT_OF_MEMORY;
+        }
+    }
 
     ArchiveHeader header;
+    ArchResult result = ARCH_OK;
+
     if (!readArchiveHeader(archive->file, &header))
-    {
-        freeArchive(archive);
-        return ARCH_ERR_IO;
-    }
+        result = ARCH_ERR_IO;
+    else if (header.magic != ARCH_MAGIC)
+        result = ARCH_ERR_NOT_AN_ARCHIVE;
+    else if (header.version > ARCH_VERSION)
+        result = ARCH_ERR_UNSUPPORTED_VERSION;
 
-    if (header.magic != ARCH_MAGIC)
+    if (result == ARCH_OK && header.volumeSize != 0)
     {
+        // Reopen over all volumes, the path was either the base name or the first volume
         freeArchive(archive);
-        return ARCH_ERR_NOT_AN_ARCHIVE;
+        archive = NULL;
+
+        if (!basePath) basePath = getVolumeBasePath(path);
+
+#ifdef HAVE_SPLIT_VOLUMES
+        if (!basePath)
+            result = ARCH_ERR_INVALID_ARGUMENT;
+        else if (!(archive = createSplitArchive(basePath, header.volumeSize, true, memoryOptions)))
+            result = ARCH_ERR_IO;
+        else if (fseek64(archive->file, (int64_t)getArchiveHeaderSize(header.version), SEEK_SET) != 0)
+            result = ARCH_ERR_IO;
+#else
+        result = ARCH_ERR_UNSUPPORTED_VERSION;
+#endif
     }
 
-    if (header.version > ARCH_VERSION)
+    memFree(basePath);
+
+    if (result != ARCH_OK)
     {
         freeArchive(archive);
-        return ARCH_ERR_UNSUPPORTED_VERSION;
+        return result;
     }
 
-    archive->fileCount = header.fileCount;
+    archive->version = header.version;
+    archive->directoryOffset = header.directoryOffset;
+
+    archive->fileCount = (size_t)header.fileCount;
     archive->currentFileIndex = 0;
     archive->readOnly = true;
 
+    if (options && options->cacheBytes)
+    {
+        MemoryScope scope;
+        memoryScopeEnter(&scope, &archive->memory);
+        archive->cache = createEntryCache(options->cacheBytes);
+        memoryScopeLeave(&scope);
+
+        if (!archive->cache)
+        {
+            freeArchive(archive);
+            return ARCH_ERR_OUT_OF_MEMORY;
+        }
+    }
+
+    if (options && options->baseArchive && header.baseFingerprint != 0)
+    {
+        result = openBase(archive, options, header.baseFingerprint);
+        if (result != ARCH_OK)
+        {
+            freeArchive(archive);
+            return result;
+        }
+    }
+
     *outArchive = archive;
     return ARCH_OK;
 }
 
-ArchResult arch_retrieveNextFile(Archive* archive, const char* output_dir)
+static ArchResult readNextEntryHeader(Archive* archive)
 {
-    if (!archive || !output_dir)
-        return ARCH_ERR_INVALID_ARGUMENT;
+    if (archive->entryPending)
+        return ARCH_OK;
 
     if (archive->currentFileIndex >= archive->fileCount)
         return ARCH_ERR_INVALID_ARGUMENT;
-    
-    char* fileName = NULL;
-    char* filePath = NULL;
-    FILE* file = NULL;
-    ArchResult result = ARCH_OK;
 
-    FileHeader header;
-    if (!readFileHeader(archive->file, &header, &fileName))
+    // Fillers left by removed entries are stepped over
+    do
     {
-        result = ARCH_ERR_IO;
-        goto cleanup;
+        memFree(archive->entryName);
+        archive->entryName = NULL;
+
+        uint64_t t = statsBegin();
+        bool ok = readFileHeader(archive->file, &archive->entryHeader, &archive->entryName);
+        statsEnd(ARCH_STAGE_READ, t);
+
+        if (!ok)
+            return ARCH_ERR_IO;
+
+        if (archive->entryHeader.magic != ARCH_FILE_MAGIC)
+            return ARCH_ERR_CORRUPTED;
+
+        uint64_t fillerSize = archive->entryHeader.origSize;
+        if ((archive->entryHeader.flags & ARCH_FLAG_DELETED) &&
+            (fillerSize > INT64_MAX || fseek64(archive->file, (int64_t)fillerSize, SEEK_CUR) != 0))
+        {
+            return ARCH_ERR_IO;
+        }
     }
+    while (archive->entryHeader.flags & ARCH_FLAG_DELETED);
 
-    if (header.magic != ARCH_FILE_MAGIC)
+    int64_t dataOffset = ftell64(archive->file);
+    if (dataOffset < 0)
+        return ARCH_ERR_IO;
+
+    archive->entryDataOffset = (uint64_t)dataOffset;
+    archive->entryPending = true;
+    return ARCH_OK;
+}
+
+static void finishEntry(Archive* archive)
+{
+    archive->entryPending = false;
+    archive->currentFileIndex++;
+}
+
+static ArchResult rewindArchive(Archive* archive)
+{
+    if (fseek64(archive->file, (int64_t)getArchiveHeaderSize(archive->version), SEEK_SET) != 0)
+        return ARCH_ERR_IO;
+
+    archive->entryPending = false;
+    archive->currentFileIndex = 0;
+    return ARCH_OK;
+}
+
+static ArchResult skipEntry(Archive* archive);
+
+static ArchResult nextEntry(Archive* archive, ArchEntryInfo* outInfo)
+{
+    if (!archive || !outInfo || !archive->readOnly)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    if (archive->entryPending)
     {
-        result = ARCH_ERR_CORRUPTED;
-        goto cleanup;
+        ArchResult r = skipEntry(archive);
+        if (r != ARCH_OK) return r;
     }
 
+    ArchResult result = readNextEntryHeader(archive);
+    if (result != ARCH_OK)
+        return result;
+
+    const FileHeader* header = &archive->entryHeader;
+
+    outInfo->name = archive->entryName;
+    outInfo->origSize = header->origSize;
+    outInfo->compSize = getFileHeaderPayloadSize(header);
+    outInfo->crc32_uncompressed = header->crc32_uncompressed;
+    outInfo->crc32_compressed = header->crc32_compressed;
+    outInfo->flags = header->flags;
+
+    return ARCH_OK;
+}
+
+ArchResult arch_nextEntry(Archive* archive, ArchEntryInfo* outInfo)
+{
+    if (!archive)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = nextEntry(archive, outInfo);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+static ArchResult skipEntry(Archive* archive)
+{
+    if (!archive || !archive->readOnly)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchResult result = readNextEntryHeader(archive);
+    if (result != ARCH_OK)
+        return result;
+
+    uint64_t payloadSize = getFileHeaderPayloadSize(&archive->entryHeader);
+    if (payloadSize > INT64_MAX || fseek64(archive->file, (int64_t)payloadSize, SEEK_CUR) != 0)
+        result = ARCH_ERR_IO;
+
+    finishEntry(archive);
+    return result;
+}
+
+ArchResult arch_skipEntry(Archive* archive)
+{
+    if (!archive)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = skipEntry(archive);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+// Writes the payload at the stream position to output_dir/fileName, a cancelled copy is removed again.
+// Long-match entries are decoded through a reader on entry index, in is moved past their payload.
+static ArchResult writeEntryFile(Archive* archive, size_t index, FILE* in, const FileHeader* header, const char* fileName, const char* output_dir)
+{
+    ArchResult result = ARCH_OK;
+
+    char* filePath = NULL;
+    FILE* file = NULL;
+
     size_t filePathSize = strlen(output_dir) + sizeof(DIR_SEP) + strlen(fileName) + 1;
     
-    filePath = malloc(filePathSize);
+    filePath = memAlloc(filePathSize);
     if (!filePath)
     {
         result = ARCH_ERR_OUT_OF_MEMORY;
@@ -89,28 +306,46 @@ ArchResult arch_retrieveNextFile(Archive* archive, const char* output_dir)
         goto cleanup;
     }
 
+    uint64_t t = statsBegin();
     file = fopen(filePath, "wb");
+    statsEnd(ARCH_STAGE_OPEN, t);
+
     if (!file)
     {
         result = ARCH_ERR_IO;
         goto cleanup;
     }
 
-    if (header.flags & ARCH_FLAG_COMPRESSED)
+    if (fileHeaderNeedsReader(header))
+    {
+        result = streamEntry(archive, index, writeFileSink, file);
+        if (result != ARCH_OK)
+            goto cleanup;
+
+        uint64_t payloadSize = getFileHeaderPayloadSize(header);
+        if (payloadSize > INT64_MAX || fseek64(in, (int64_t)payloadSize, SEEK_CUR) != 0)
+        {
+            result = ARCH_ERR_IO;
+            goto cleanup;
+        }
+    }
+    else if (header->flags & ARCH_FLAG_COMPRESSED)
     {
         uint32_t crcUncompressed = 0;
         uint32_t crcCompressed = 0;
 
-        ArchResult decompResult = decompressFileStream(archive->file, file, header.compSize, &crcUncompressed, &crcCompressed);
-        
+        ArchResult decompResult = (header->compSize >= PIPELINE_MIN_SIZE)
+                                  ? pipelineDecompress(in, header->compSize, writeFileSink, file, &crcUncompressed, &crcCompressed)
+                                  : decompressFileStream(in, file, header->compSize, &crcUncompressed, &crcCompressed);
+
         if (decompResult != ARCH_OK)
         {
             result = decompResult;
             goto cleanup;
         }
 
-        if (crcUncompressed != header.crc32_uncompressed ||
-            crcCompressed != header.crc32_compressed)
+        if (crcUncompressed != header->crc32_uncompressed ||
+            crcCompressed != header->crc32_compressed)
         {
             result = ARCH_ERR_CORRUPTED;
             goto cleanup;
@@ -120,30 +355,581 @@ ArchResult arch_retrieveNextFile(Archive* archive, const char* output_dir)
     {
         uint32_t crc = 0;
 
-        if (!copyFileData(archive->file, file, header.origSize, &crc))
+        if (!copyFileData(in, file, header->origSize, &crc))
         {
-            result = ARCH_ERR_IO;
+            result = progressCancelled() ? ARCH_ERR_CANCELLED : ARCH_ERR_IO;
             goto cleanup;
         }
         
-        if (crc != header.crc32_uncompressed)
+        if (crc != header->crc32_uncompressed)
         {
             result = ARCH_ERR_CORRUPTED;
             goto cleanup;
         }
     }
 
+    STATS_ADD(entries, 1);
+    STATS_ADD(uncompressedBytes, header->origSize);
+    STATS_ADD(compressedBytes, getFileHeaderPayloadSize(header));
+
 cleanup:
-    free(filePath);
-    free(fileName);
     if (file) fclose(file);
+    if (result == ARCH_ERR_CANCELLED) remove(filePath);
 
-    archive->currentFileIndex++;
+    memFree(filePath);
+    return result;
+}
+
+static ArchResult retrieveNextFile(Archive* archive, const char* output_dir)
+{
+    if (!archive || !output_dir)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    if (archive->currentFileIndex >= archive->fileCount)
+        return ARCH_ERR_INVALID_ARGUMENT;
+    
+    uint64_t traceStart = TRACE_NOW();
+
+    ArchResult result = readNextEntryHeader(archive);
+    if (result != ARCH_OK)
+    {
+        finishEntry(archive);
+        return result;
+    }
+
+    // Cancelled before anything was written, the entry stays pending for the next call
+    if (!progressEntryBegin(archive->entryName))
+        return ARCH_ERR_CANCELLED;
+
+    result = writeEntryFile(archive, archive->currentFileIndex, archive->file, &archive->entryHeader, archive->entryName, output_dir);
+
+    progressEntryEnd(result == ARCH_OK);
+    TRACE_SPAN("entry", archive->entryName, traceStart);
+
+    if (result == ARCH_ERR_CANCELLED)
+    {
+        // Rewind to the payload, a later call extracts the entry again
+        if (fseek64(archive->file, (int64_t)archive->entryDataOffset, SEEK_SET) != 0)
+        {
+            result = ARCH_ERR_IO;
+            finishEntry(archive);
+        }
+    }
+    else
+    {
+        finishEntry(archive);
+    }
+
+    return result;
+}
+
+ArchResult arch_retrieveNextFile(Archive* archive, const char* output_dir)
+{
+    if (!archive)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = retrieveNextFile(archive, output_dir);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+static int compareEntryIndices(const void* a, const void* b)
+{
+    size_t x = *(const size_t*)a;
+    size_t y = *(const size_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Only the names sharing a pattern's literal prefix are matched, and only matches are read: their
+// indices are gathered from the name index and extracted in archive order, seeking to each payload
+static ArchResult extractIndexed(Archive* archive, const EntryTable* table, const NameIndex* index, const char* output_dir, const char* const* patterns, size_t patternCount)
+{
+    ArchResult result = ARCH_OK;
+
+    size_t* matches = NULL;
+    size_t matchCount = 0;
+    size_t matchCapacity = 0;
+
+    for (size_t p = 0; p < patternCount; p++)
+    {
+        if (!patterns[p]) continue;
+
+        size_t begin, end;
+        findIndexedPrefix(index, patterns[p], getPatternPrefixLength(patterns[p]), 0, &begin, &end);
+
+        for (size_t i = begin; i < end; i++)
+        {
+            const EntryRecord* record = index->sorted[i];
+            if (!matchPathPattern(patterns[p], record->name)) continue;
+
+            if (matchCount == matchCapacity)
+            {
+                size_t capacity = matchCapacity ? matchCapacity * 2 : 64;
+                size_t* grown = memRealloc(matches, capacity * sizeof *matches);
+                if (!grown)
+                {
+                    result = ARCH_ERR_OUT_OF_MEMORY;
+                    goto cleanup;
+                }
+
+                matches = grown;
+                matchCapacity = capacity;
+            }
+
+            matches[matchCount++] = (size_t)(record - table->entries);
+        }
+    }
+
+    // Patterns may overlap, each entry is written once
+    if (matchCount > 0) qsort(matches, matchCount, sizeof *matches, compareEntryIndices);
+
+    for (size_t i = 0; i < matchCount; i++)
+    {
+        if (i > 0 && matches[i] == matches[i - 1]) continue;
+
+        const EntryRecord* record = &table->entries[matches[i]];
+        uint64_t traceStart = TRACE_NOW();
+
+        if (!progressEntryBegin(record->name))
+        {
+            result = ARCH_ERR_CANCELLED;
+            break;
+        }
+
+        if (record->dataOffset > INT64_MAX || fseek64(archive->file, (int64_t)record->dataOffset, SEEK_SET) != 0)
+            result = ARCH_ERR_IO;
+        else
+            result = writeEntryFile(archive, matches[i], archive->file, &record->header, record->name, output_dir);
+
+        progressEntryEnd(result == ARCH_OK);
+        TRACE_SPAN("entry", record->name, traceStart);
+
+        if (result != ARCH_OK) break;
+    }
+
+cleanup:
+    // The cursor ends up past the last entry, as after the sequential walk
+    archive->entryPending = false;
+    archive->currentFileIndex = archive->fileCount;
+
+    memFree(matches);
     return result;
 }
 
+static ArchResult extractMatching(Archive* archive, const char* output_dir, const char* const* patterns, size_t patternCount)
+{
+    if (!archive || !output_dir || (!patterns && patternCount > 0) || !archive->readOnly)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    // Without an entry table or index (damaged directory, out of memory) every header is walked
+    const EntryTable* table = getArchiveEntryTable(archive);
+    const NameIndex* index = table ? getArchiveNameIndex(archive) : NULL;
+    if (index)
+        return extractIndexed(archive, table, index, output_dir, patterns, patternCount);
+
+    ArchResult result = rewindArchive(archive);
+    if (result != ARCH_OK)
+        return result;
+
+    while (archive->currentFileIndex < archive->fileCount)
+    {
+        ArchEntryInfo info;
+        result = nextEntry(archive, &info);
+        if (result != ARCH_OK)
+            return result;
+
+        if (matchAnyPathPattern(patterns, patternCount, info.name))
+            result = retrieveNextFile(archive, output_dir);
+        else
+            result = skipEntry(archive);
+
+        if (result != ARCH_OK)
+            return result;
+    }
+
+    return ARCH_OK;
+}
+
+ArchResult arch_extractMatching(Archive* archive, const char* output_dir, const char* const* patterns, size_t patternCount)
+{
+    if (!archive)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = extractMatching(archive, output_dir, patterns, patternCount);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+// A run of entries handed to one worker. For split archives that is every entry starting in one
+// volume, so each volume file is streamed front to back by a single thread.
+typedef struct ExtractUnit
+{
+    size_t first;
+    size_t end;
+} ExtractUnit;
+
+typedef struct ExtractJob
+{
+    Archive* archive;
+    const EntryTable* table;
+    const char* outputDir;
+
+    ExtractUnit* units;
+    size_t unitCount;
+
+    Mutex lock;
+    size_t nextUnit;
+    ArchResult result;
+} ExtractJob;
+
+static void extractWorker(void* arg)
+{
+    ExtractJob* job = arg;
+
+    ArchiveCall call;
+    enterArchiveCall(job->archive, &call);
+
+    uint64_t t = statsBegin();
+    FILE* file = openArchiveStream(job->archive);
+    statsEnd(ARCH_STAGE_OPEN, t);
+
+    for (;;)
+    {
+        mutexLock(&job->lock);
+        size_t unit = job->nextUnit++;
+        bool stop = job->result == ARCH_ERR_CANCELLED;
+        mutexUnlock(&job->lock);
+
+        if (unit >= job->unitCount || stop) break;
+
+        for (size_t i = job->units[unit].first; i < job->units[unit].end; i++)
+        {
+            const EntryRecord* record = &job->table->entries[i];
+            uint64_t traceStart = TRACE_NOW();
+
+            ArchResult result;
+            if (!file)
+                result = ARCH_ERR_IO;
+            else if (!progressEntryBegin(record->name))
+                result = ARCH_ERR_CANCELLED;
+            else
+            {
+                if (record->dataOffset > INT64_MAX || fseek64(file, (int64_t)record->dataOffset, SEEK_SET) != 0)
+                    result = ARCH_ERR_IO;
+                else
+                    result = writeEntryFile(job->archive, i, file, &record->header, record->name, job->outputDir);
+
+                progressEntryEnd(result == ARCH_OK);
+            }
+
+            TRACE_SPAN("entry", record->name, traceStart);
+
+            if (result != ARCH_OK)
+            {
+                // Keep going past damaged entries, the first error is reported; a cancel wins over it
+                mutexLock(&job->lock);
+                if (job->result == ARCH_OK || result == ARCH_ERR_CANCELLED) job->result = result;
+                mutexUnlock(&job->lock);
+
+                if (result == ARCH_ERR_CANCELLED) break;
+            }
+        }
+    }
+
+    if (file) fclose(file);
+
+    leaveArchiveCall(job->archive, &call);
+}
+
+ArchResult arch_extractAll(Archive* archive, const char* output_dir, unsigned threadCount)
+{
+    if (!archive || !output_dir || !archive->readOnly)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    const EntryTable* table = getArchiveEntryTable(archive);
+    if (!table)
+        return ARCH_ERR_CORRUPTED;
+
+    if (table->count == 0)
+        return ARCH_OK;
+
+    ExtractJob job = {
+        .archive = archive,
+        .table = table,
+        .outputDir = output_dir,
+        .result = ARCH_OK
+    };
+
+    MemoryScope scope;
+    memoryScopeEnter(&scope, &archive->memory);
+    job.units = memAlloc(table->count * sizeof *job.units);
+    memoryScopeLeave(&scope);
+
+    if (!job.units)
+        return ARCH_ERR_OUT_OF_MEMORY;
+
+    for (size_t i = 0; i < table->count; i++)
+    {
+        uint64_t offset = table->entries[i].headerOffset;
+
+        bool sameVolume = archive->volumeSize != 0 && job.unitCount > 0 &&
+            table->entries[i - 1].headerOffset / archive->volumeSize == offset / archive->volumeSize;
+
+        if (sameVolume)
+        {
+            job.units[job.unitCount - 1].end = i + 1;
+        }
+        else
+        {
+            job.units[job.unitCount++] = (ExtractUnit){ i, i + 1 };
+        }
+    }
+
+    if (!mutexInit(&job.lock))
+    {
+        memFree(job.units);
+        return ARCH_ERR_INTERNAL;
+    }
+
+    if (threadCount == 0) threadCount = getCpuCount();
+    if (threadCount > job.unitCount) threadCount = (unsigned)job.unitCount;
+
+    Thread* threads = memCalloc(threadCount, sizeof *threads);
+    unsigned started = 0;
+
+    if (threads)
+    {
+        for (; started < threadCount - 1; started++)
+        {
+            if (!threadCreate(&threads[started], extractWorker, &job)) break;
+        }
+    }
+
+    extractWorker(&job);
+
+    for (unsigned i = 0; i < started; i++)
+    {
+        threadJoin(threads[i]);
+    }
+
+    memFree(threads);
+    mutexDestroy(&job.lock);
+    memFree(job.units);
+
+    return job.result;
+}
+
 size_t arch_getFileCount(Archive *archive)
 {
     if (!archive) return 0;
     return archive->fileCount;
 }
+
+static void fillEntryInfo(const EntryRecord* record, ArchEntryInfo* outInfo)
+{
+    outInfo->name = record->name;
+    outInfo->origSize = record->header.origSize;
+    outInfo->compSize = getFileHeaderPayloadSize(&record->header);
+    outInfo->crc32_uncompressed = record->header.crc32_uncompressed;
+    outInfo->crc32_compressed = record->header.crc32_compressed;
+    outInfo->flags = record->header.flags;
+}
+
+static ArchResult getEntryInfo(Archive* archive, size_t index, ArchEntryInfo* outInfo)
+{
+    if (!archive->readOnly)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    const EntryTable* table = getArchiveEntryTable(archive);
+    if (!table)
+        return ARCH_ERR_CORRUPTED;
+
+    if (index >= table->count)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    fillEntryInfo(&table->entries[index], outInfo);
+    return ARCH_OK;
+}
+
+ArchResult arch_getEntryInfo(Archive* archive, size_t index, ArchEntryInfo* outInfo)
+{
+    if (!archive || !outInfo)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = getEntryInfo(archive, index, outInfo);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+// Table and name index of a read-only archive
+static ArchResult getNameIndex(Archive* archive, const EntryTable** outTable, const NameIndex** outIndex)
+{
+    if (!archive->readOnly)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    *outTable = getArchiveEntryTable(archive);
+    if (!*outTable)
+        return ARCH_ERR_CORRUPTED;
+
+    *outIndex = getArchiveNameIndex(archive);
+    return *outIndex ? ARCH_OK : ARCH_ERR_OUT_OF_MEMORY;
+}
+
+static ArchResult listDir(Archive* archive, const char* directory, ArchListCallback callback, void* userdata)
+{
+    const EntryTable* table;
+    const NameIndex* index;
+
+    ArchResult result = getNameIndex(archive, &table, &index);
+    if (result != ARCH_OK)
+        return result;
+
+    size_t length = strlen(directory);
+    while (length > 0 && directory[length - 1] == '/') length--;
+
+    // "directory/", followed by the child at hand; names are at most UINT16_MAX bytes
+    char* path = memAlloc(length + 1 + UINT16_MAX + 2);
+    if (!path)
+        return ARCH_ERR_OUT_OF_MEMORY;
+
+    memcpy(path, directory, length);
+    size_t pathLength = length;
+    if (length > 0) path[pathLength++] = '/';
+
+    size_t position, end;
+    findIndexedPrefix(index, path, pathLength, 0, &position, &end);
+
+    while (position < end)
+    {
+        const EntryRecord* record = index->sorted[position];
+        const char* child = record->name + pathLength;
+        const char* slash = strchr(child, '/');
+
+        ArchDirEntry entry;
+        memset(&entry, 0, sizeof entry);
+
+        if (!slash)
+        {
+            entry.name = child;
+            entry.index = (size_t)(record - table->entries);
+            fillEntryInfo(record, &entry.info);
+
+            // Further entries of the same name are hidden behind the first
+            do position++;
+            while (position < end && strcmp(index->sorted[position]->name, record->name) == 0);
+
+            if (!callback(userdata, &entry))
+                break;
+        }
+        else
+        {
+            size_t childLength = (size_t)(slash - child);
+            memcpy(path + pathLength, child, childLength);
+            path[pathLength + childLength] = '\0';
+
+            entry.name = path + pathLength;
+            entry.isDirectory = true;
+            entry.index = SIZE_MAX;
+
+            if (!callback(userdata, &entry))
+                break;
+
+            // Everything below the subdirectory is skipped by one search
+            size_t subtree;
+            path[pathLength + childLength] = '/';
+            findIndexedPrefix(index, path, pathLength + childLength + 1, position, &subtree, &position);
+        }
+    }
+
+    memFree(path);
+    return ARCH_OK;
+}
+
+ArchResult arch_listDir(Archive* archive, const char* directory, ArchListCallback callback, void* userdata)
+{
+    if (!archive || !callback)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = listDir(archive, directory ? directory : "", callback, userdata);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
+
+static ArchResult statPath(Archive* archive, const char* path, ArchDirEntry* outEntry)
+{
+    const EntryTable* table;
+    const NameIndex* index;
+
+    ArchResult result = getNameIndex(archive, &table, &index);
+    if (result != ARCH_OK)
+        return result;
+
+    memset(outEntry, 0, sizeof *outEntry);
+    outEntry->index = SIZE_MAX;
+
+    size_t length = strlen(path);
+    bool directoryOnly = length > 0 && path[length - 1] == '/';
+    while (length > 0 && path[length - 1] == '/') length--;
+
+    if (length == 0)
+    {
+        outEntry->isDirectory = true;
+        return ARCH_OK;
+    }
+
+    const EntryRecord* record = directoryOnly ? NULL : findIndexedName(index, path);
+    if (record)
+    {
+        outEntry->name = record->name;
+        outEntry->index = (size_t)(record - table->entries);
+        fillEntryInfo(record, &outEntry->info);
+        return ARCH_OK;
+    }
+
+    char* prefix = memAlloc(length + 1);
+    if (!prefix)
+        return ARCH_ERR_OUT_OF_MEMORY;
+
+    memcpy(prefix, path, length);
+    prefix[length] = '/';
+
+    size_t begin, end;
+    findIndexedPrefix(index, prefix, length + 1, 0, &begin, &end);
+    memFree(prefix);
+
+    if (begin == end)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    outEntry->isDirectory = true;
+    return ARCH_OK;
+}
+
+ArchResult arch_stat(Archive* archive, const char* path, ArchDirEntry* outEntry)
+{
+    if (!archive || !path || !outEntry)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchiveCall call;
+    enterArchiveCall(archive, &call);
+
+    ArchResult result = statPath(archive, path, outEntry);
+
+    leaveArchiveCall(archive, &call);
+    return result;
+}
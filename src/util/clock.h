@@ -0,0 +1,9 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+// Monotonic clock, only meaningful for measuring intervals
+uint64_t clockNowNs(void);
+
+#endif // CLOCK_H
@@ -1,18 +1,42 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE // copy_file_range
+#endif
+
 #include "file.h"
+#include "memory.h"
+#include "progress.h"
+#include "stats.h"
 
 #include <zlib.h>
 
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+#define MIN_BUFFER_SIZE 4096
+
 size_t tryAllocateBuffer(unsigned char** buffer)
 {
-    size_t sizes[] = {65536, 32768, 16384, 8192, 4096};
-    
-    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    size_t sizes[] = {65536, 32768, 16384, 8192, MIN_BUFFER_SIZE};
+    size_t count = sizeof(sizes) / sizeof(sizes[0]);
+
+    // Under a memory cap take at most a quarter of what is left, so a second buffer and the codec state still fit
+    size_t budget = memoryAvailable() / 4;
+
+    for (size_t i = 0; i < count; i++)
     {
-        *buffer = malloc(sizes[i]);
+        if (sizes[i] > budget && i + 1 < count) continue;
+
+        *buffer = memAlloc(sizes[i]);
         if (*buffer)
         {
             return sizes[i];
@@ -46,6 +70,60 @@ uint64_t read_u64_le(const unsigned char b[8])
     return res;
 }
 
+void write_u16_le(unsigned char b[2], uint16_t value)
+{
+    b[0] = (unsigned char)value;
+    b[1] = (unsigned char)(value >> 8);
+}
+
+void write_u32_le(unsigned char b[4], uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        b[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+void write_u64_le(unsigned char b[8], uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        b[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+size_t write_varint(unsigned char b[10], uint64_t value)
+{
+    size_t size = 0;
+    while (value >= 0x80)
+    {
+        b[size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    b[size++] = (unsigned char)value;
+    return size;
+}
+
+size_t read_varint(const unsigned char* b, size_t size, uint64_t* value)
+{
+    uint64_t result = 0;
+
+    for (size_t i = 0; i < size && i < 10; i++)
+    {
+        uint64_t bits = b[i] & 0x7F;
+        if (i == 9 && bits > 1) return 0;
+
+        result |= bits << (7 * i);
+        if (!(b[i] & 0x80))
+        {
+            *value = result;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
 bool readFile(FILE* file, char* buffer, size_t buffer_size, size_t* outBytesRead)
 {
     if (!file || !buffer || !outBytesRead) return false;
@@ -78,7 +156,7 @@ bool writeFile(FILE* file, const char* buffer, size_t bytes)
 
 bool copyFileData(FILE* in, FILE* out, uint64_t fileSize, uint32_t* outCrc)
 {
-    if (!in || !out) return false;
+    if (!in) return false;
 
     unsigned char* buffer = NULL;
     size_t buffer_size = tryAllocateBuffer(&buffer);
@@ -96,26 +174,111 @@ bool copyFileData(FILE* in, FILE* out, uint64_t fileSize, uint32_t* outCrc)
         size_t chunk = (bytesLeft < buffer_size) ? (size_t)bytesLeft : buffer_size;
         size_t readBytes;
 
-        if (!readFile(in, (char*)buffer, chunk, &readBytes)) goto cleanup;
+        uint64_t t = statsBegin();
+        bool readOk = readFile(in, (char*)buffer, chunk, &readBytes);
+        statsEnd(ARCH_STAGE_READ, t);
+
+        if (!readOk) goto cleanup;
         if (readBytes == 0) goto cleanup;
+        STATS_ADD(bytesRead, readBytes);
 
         // Update CRC
+        t = statsBegin();
         *outCrc = crc32(*outCrc, buffer, (uInt)readBytes);
+        statsEnd(ARCH_STAGE_CHECKSUM, t);
         
-        // Write chunk
-        if (!writeFile(out, (const char*)buffer, readBytes)) goto cleanup;
+        // Write chunk, a NULL output only checksums
+        if (out)
+        {
+            t = statsBegin();
+            bool writeOk = writeFile(out, (const char*)buffer, readBytes);
+            statsEnd(ARCH_STAGE_WRITE, t);
+
+            if (!writeOk) goto cleanup;
+            STATS_ADD(bytesWritten, readBytes);
+        }
         
         bytesLeft -= readBytes;
+
+        if (!progressAdvance(readBytes, out ? readBytes : 0)) goto cleanup;
     }
 
-    free(buffer);
+    memFree(buffer);
     return true;
 
 cleanup:
-    free(buffer);
+    memFree(buffer);
     return false;
 }
 
+bool copyFileRange(FILE* in, FILE* out, uint64_t size)
+{
+    if (!in || !out) return false;
+
+#ifdef __linux__
+    int inFd = fileno(in);
+    int outFd = fileno(out);
+
+    int64_t inPos = ftell64(in);
+    int64_t outPos = ftell64(out);
+
+    // Cookie streams have no descriptor, and stdio buffers must be empty before the kernel writes behind them
+    if (inFd >= 0 && outFd >= 0 && inPos >= 0 && outPos >= 0 && fflush(out) == 0)
+    {
+        loff_t inOffset = (loff_t)inPos;
+        loff_t outOffset = (loff_t)outPos;
+
+        while (size > 0)
+        {
+            size_t chunk = size < ((size_t)1 << 30) ? (size_t)size : ((size_t)1 << 30);
+
+            uint64_t t = statsBegin();
+            ssize_t copied = copy_file_range(inFd, &inOffset, outFd, &outOffset, chunk, 0);
+            statsEnd(ARCH_STAGE_WRITE, t);
+
+            // Unsupported across these files (EXDEV, EINVAL, ...), the rest goes through a buffer
+            if (copied < 0) break;
+            if (copied == 0) return false;
+
+            STATS_ADD(bytesRead, (uint64_t)copied);
+            STATS_ADD(bytesWritten, (uint64_t)copied);
+            size -= (uint64_t)copied;
+
+            if (!progressAdvance((uint64_t)copied, (uint64_t)copied)) return false;
+        }
+
+        if (fseek64(in, (int64_t)inOffset, SEEK_SET) != 0 || fseek64(out, (int64_t)outOffset, SEEK_SET) != 0)
+            return false;
+    }
+#endif
+
+    uint32_t crc;
+    return size == 0 || copyFileData(in, out, size, &crc);
+}
+
+bool truncateFile(FILE* file, uint64_t size)
+{
+    if (!file || fflush(file) != 0) return false;
+
+#ifdef _WIN32
+    return _chsize_s(_fileno(file), (__int64)size) == 0;
+#else
+    return ftruncate(fileno(file), (off_t)size) == 0;
+#endif
+}
+
+bool punchFileHole(FILE* file, uint64_t offset, uint64_t size)
+{
+    if (!file || size == 0 || fflush(file) != 0) return false;
+
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+    return fallocate(fileno(file), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)size) == 0;
+#else
+    (void)offset;
+    return false;
+#endif
+}
+
 uint64_t getFileSize(FILE* file)
 {
     if (!file) return 0;
@@ -133,6 +296,35 @@ uint64_t getFileSize(FILE* file)
     return (uint64_t)size;
 }
 
+const void* mapFile(FILE* file, uint64_t* outSize)
+{
+    if (!file || !outSize) return NULL;
+
+#ifndef _WIN32
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size > SIZE_MAX) return NULL;
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fileno(file), 0);
+    if (data == MAP_FAILED) return NULL;
+
+    *outSize = (uint64_t)st.st_size;
+    return data;
+#else
+    return NULL;
+#endif
+}
+
+void unmapFile(const void* data, uint64_t size)
+{
+    if (!data) return;
+
+#ifndef _WIN32
+    munmap((void*)data, (size_t)size);
+#else
+    (void)size;
+#endif
+}
+
 char* getFileName(const char* filePath, bool stripExtension)
 {
     if (!filePath) return NULL;
@@ -159,7 +351,7 @@ char* sanitizeFilePath(const char *inputPath)
 {
     if (!inputPath) return NULL;
 
-    char* safePath = strdup(inputPath);
+    char* safePath = memStrdup(inputPath);
     if (!safePath) return NULL;
 
     for (char* p = safePath; *p; p++)
@@ -235,7 +427,9 @@ bool createParentDirectories(const char* filepath)
 {
     if (!filepath) return false;
 
-    char* path_copy = strdup(filepath);
+    uint64_t t = statsBegin();
+
+    char* path_copy = memStrdup(filepath);
     if (!path_copy) return false;
 
     // Find the last separator (either / or \)
@@ -245,7 +439,7 @@ bool createParentDirectories(const char* filepath)
 
     if (!last_sep) 
     {
-        free(path_copy);
+        memFree(path_copy);
         return true; 
     }
 
@@ -277,43 +471,188 @@ bool createParentDirectories(const char* filepath)
     
     MKDIR(path_copy);
 
-    free(path_copy);
+    memFree(path_copy);
+    statsEnd(ARCH_STAGE_MKDIR, t);
     return true;
 }
 
-bool compressFileStream(FILE* inFile, FILE* outFile, uint64_t* outCompSize, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed)
+bool getFileIdentity(const char* path, FileIdentity* outIdentity)
+{
+    if (!path || !outIdentity) return false;
+
+#ifdef _WIN32
+    // st_ino is always 0 on Windows, the file index comes from the handle
+    HANDLE handle = CreateFileA(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                                OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+
+    BY_HANDLE_FILE_INFORMATION info;
+    BOOL ok = GetFileInformationByHandle(handle, &info);
+    CloseHandle(handle);
+    if (!ok) return false;
+
+    outIdentity->device = info.dwVolumeSerialNumber;
+    outIdentity->inode = ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+
+    outIdentity->device = (uint64_t)st.st_dev;
+    outIdentity->inode = (uint64_t)st.st_ino;
+#endif
+
+    return true;
+}
+
+bool isSameFile(const FileIdentity* a, const FileIdentity* b)
 {
-    if (!inFile || !outFile || !outCompSize || !outCrcUncompressed || !outCrcCompressed) return false;
+    return a->device == b->device && a->inode == b->inode;
+}
+
+char* getStagingPath(const char* path)
+{
+    static atomic_uint counter;
+
+    if (!path) return NULL;
+
+#ifdef _WIN32
+    unsigned long pid = (unsigned long)GetCurrentProcessId();
+#else
+    unsigned long pid = (unsigned long)getpid();
+#endif
+
+    size_t size = strlen(path) + 48;
+    char* stagingPath = memAlloc(size);
+    if (!stagingPath) return NULL;
+
+    snprintf(stagingPath, size, "%s.tmp-%lu-%u", path, pid, atomic_fetch_add(&counter, 1));
+    return stagingPath;
+}
+
+bool syncFile(FILE* file)
+{
+    if (!file || fflush(file) != 0) return false;
+
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+bool syncFilePath(const char* path)
+{
+    if (!path) return false;
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+
+    BOOL ok = FlushFileBuffers(handle);
+    CloseHandle(handle);
+    return ok != 0;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+#endif
+}
+
+bool replaceFile(const char* from, const char* to)
+{
+    if (!from || !to) return false;
+
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+static bool deflateToFile(z_stream* strm, int flush, unsigned char* outBuf, size_t outBufSize, FILE* outFile, uint64_t* totalWritten, uint32_t* crcCompressed)
+{
+    do
+    {
+        strm->next_out = outBuf;
+        strm->avail_out = (uInt)outBufSize;
+
+        uLong consumedBefore = strm->total_in;
+
+        uint64_t t = statsBegin();
+        int ret = deflate(strm, flush);
+        statsEnd(ARCH_STAGE_COMPRESS, t);
+
+        if (ret == Z_STREAM_ERROR)
+        {
+            fprintf(stderr, "deflate error: Z_STREAM_ERROR\n");
+            return false;
+        }
+
+        size_t have = outBufSize - strm->avail_out;
+        if (have > 0)
+        {
+            t = statsBegin();
+            *crcCompressed = crc32(*crcCompressed, outBuf, (uInt)have);
+            statsEnd(ARCH_STAGE_CHECKSUM, t);
+
+            t = statsBegin();
+            bool writeOk = writeFile(outFile, (const char*)outBuf, have);
+            statsEnd(ARCH_STAGE_WRITE, t);
+
+            if (!writeOk) return false;
+
+            *totalWritten += have;
+            STATS_ADD(bytesWritten, have);
+        }
+
+        if (!progressAdvance(strm->total_in - consumedBefore, have)) return false;
+    } while (strm->avail_out == 0);
+
+    return true;
+}
+
+bool compressStream(StreamReadFn read, void* context, FILE* outFile, uint64_t* outOrigSize, uint64_t* outCompSize, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed)
+{
+    if (!read || !outFile || !outOrigSize || !outCompSize || !outCrcUncompressed || !outCrcCompressed) return false;
 
     unsigned char* inBuf = NULL;
     unsigned char* outBuf = NULL;
 
+    // The stream comes first, under a memory cap the window matters more than buffer sizes
+    z_stream strm = {0};
+
+    if (!memoryDeflateInit(&strm, 2 * MIN_BUFFER_SIZE))
+    {
+        fprintf(stderr, "deflateInit failed\n");
+        return false;
+    }
+
     size_t inBufSize = tryAllocateBuffer(&inBuf);
     size_t outBufSize = tryAllocateBuffer(&outBuf);
     if (inBufSize == 0 || outBufSize == 0)
     {
+        deflateEnd(&strm);
         goto cleanup;
     }
     size_t buffer_size = (inBufSize < outBufSize) ? inBufSize : outBufSize;
 
+    uint64_t totalRead = 0;
     uint64_t totalWritten = 0;
 
     *outCrcUncompressed = 0;
     *outCrcCompressed = 0;
 
-    z_stream strm = {0};
-
-    if (deflateInit(&strm, Z_DEFAULT_COMPRESSION) != Z_OK)
-    {
-        fprintf(stderr, "deflateInit failed\n");
-        goto cleanup;
-    }
-
     int flush;
     do
     {
-        size_t readBytes;
-        if (!readFile(inFile, (char*)inBuf, buffer_size, &readBytes))
+        uint64_t t = statsBegin();
+        int64_t readBytes = read(context, inBuf, buffer_size);
+        statsEnd(ARCH_STAGE_READ, t);
+
+        if (readBytes < 0 || (uint64_t)readBytes > buffer_size)
         {
             deflateEnd(&strm);
             goto cleanup;
@@ -321,59 +660,192 @@ bool compressFileStream(FILE* inFile, FILE* outFile, uint64_t* outCompSize, uint
 
         if (readBytes > 0)
         {
+            t = statsBegin();
             *outCrcUncompressed = crc32(*outCrcUncompressed, inBuf, (uInt)readBytes);
+            statsEnd(ARCH_STAGE_CHECKSUM, t);
+
+            totalRead += (uint64_t)readBytes;
+            STATS_ADD(bytesRead, (uint64_t)readBytes);
         }
 
-        flush = feof(inFile) ? Z_FINISH : Z_NO_FLUSH;
+        flush = (readBytes == 0) ? Z_FINISH : Z_NO_FLUSH;
         strm.next_in = inBuf;
         strm.avail_in = (uInt)readBytes;
 
-        do
+        if (!deflateToFile(&strm, flush, outBuf, buffer_size, outFile, &totalWritten, outCrcCompressed))
         {
-            strm.next_out = outBuf;
-            strm.avail_out = buffer_size;
+            deflateEnd(&strm);
+            goto cleanup;
+        }
+    } while (flush != Z_FINISH);
 
-            int ret = deflate(&strm, flush);
-            if (ret == Z_STREAM_ERROR)
-            {
-                deflateEnd(&strm);
-                fprintf(stderr, "deflate error: Z_STREAM_ERROR\n");
-                goto cleanup;
-            }
+    deflateEnd(&strm);
 
-            size_t have = buffer_size - strm.avail_out;
-            if (have > 0)
-            {
-                *outCrcCompressed = crc32(*outCrcCompressed, outBuf, (uInt)have);
+    *outOrigSize = totalRead;
+    *outCompSize = totalWritten;
 
-                if (!writeFile(outFile, (const char*)outBuf, have))
-                {
-                    deflateEnd(&strm);
-                    goto cleanup;
-                }
+    memFree(inBuf);
+    memFree(outBuf);
+    return true;
 
-                totalWritten += have;
-            }
-        } while (strm.avail_out == 0);
-    } while (flush != Z_FINISH || strm.avail_in > 0);
+cleanup:
+    memFree(inBuf);
+    memFree(outBuf);
+    return false;
+}
 
-    deflateEnd(&strm);
+bool storeStream(StreamReadFn read, void* context, FILE* outFile, uint64_t* outSize, uint32_t* outCrc)
+{
+    if (!read || !outFile || !outSize || !outCrc) return false;
 
-    *outCompSize = totalWritten;
+    unsigned char* buffer = NULL;
+    size_t buffer_size = tryAllocateBuffer(&buffer);
+    if (buffer_size == 0) return false;
+
+    *outSize = 0;
+    *outCrc = crc32(0L, Z_NULL, 0);
+
+    for (;;)
+    {
+        uint64_t t = statsBegin();
+        int64_t readBytes = read(context, buffer, buffer_size);
+        statsEnd(ARCH_STAGE_READ, t);
+
+        if (readBytes < 0 || (uint64_t)readBytes > buffer_size) goto cleanup;
+        if (readBytes == 0) break;
+        STATS_ADD(bytesRead, (uint64_t)readBytes);
 
-    free(inBuf);
-    free(outBuf);
+        t = statsBegin();
+        *outCrc = crc32(*outCrc, buffer, (uInt)readBytes);
+        statsEnd(ARCH_STAGE_CHECKSUM, t);
+
+        t = statsBegin();
+        bool writeOk = writeFile(outFile, (const char*)buffer, (size_t)readBytes);
+        statsEnd(ARCH_STAGE_WRITE, t);
+
+        if (!writeOk) goto cleanup;
+        STATS_ADD(bytesWritten, (uint64_t)readBytes);
+
+        *outSize += (uint64_t)readBytes;
+
+        if (!progressAdvance((uint64_t)readBytes, (uint64_t)readBytes)) goto cleanup;
+    }
+
+    memFree(buffer);
     return true;
 
 cleanup:
-    free(inBuf);
-    free(outBuf);
+    memFree(buffer);
     return false;
 }
 
+int64_t readFileSource(void* context, void* buffer, size_t size)
+{
+    FileSource* source = context;
+
+    // A short read already hit EOF, don't issue another read just to see 0 bytes
+    if (source->eof) return 0;
+
+    size_t readBytes;
+    if (!readFile(source->file, buffer, size, &readBytes)) return -1;
+
+    source->eof = feof(source->file) != 0;
+    return (int64_t)readBytes;
+}
+
+int64_t readBufferSource(void* context, void* buffer, size_t size)
+{
+    BufferSource* source = context;
+
+    size_t left = source->size - source->offset;
+    if (size > left) size = left;
+
+    if (size > 0) memcpy(buffer, source->data + source->offset, size);
+    source->offset += size;
+    return (int64_t)size;
+}
+
+bool compressFileStream(FILE* inFile, FILE* outFile, uint64_t* outCompSize, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed)
+{
+    if (!inFile) return false;
+
+    FileSource source = { inFile, false };
+    uint64_t origSize;
+
+    return compressStream(readFileSource, &source, outFile, &origSize, outCompSize, outCrcUncompressed, outCrcCompressed);
+}
+
+bool compressBuffer(const void* data, size_t size, FILE* outFile, uint64_t* outCompSize, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed)
+{
+    if ((!data && size > 0) || !outFile || !outCompSize || !outCrcUncompressed || !outCrcCompressed) return false;
+
+    z_stream strm = {0};
+
+    if (!memoryDeflateInit(&strm, MIN_BUFFER_SIZE))
+    {
+        fprintf(stderr, "deflateInit failed\n");
+        return false;
+    }
+
+    unsigned char* outBuf = NULL;
+    size_t outBufSize = tryAllocateBuffer(&outBuf);
+    if (outBufSize == 0)
+    {
+        deflateEnd(&strm);
+        return false;
+    }
+
+    uint64_t totalWritten = 0;
+
+    uint64_t t = statsBegin();
+    *outCrcUncompressed = (uint32_t)crc32_z(0L, data, size);
+    *outCrcCompressed = 0;
+    statsEnd(ARCH_STAGE_CHECKSUM, t);
+
+    // The caller's buffer is deflated in place, with Z_FINISH from the first call. Only inputs beyond
+    // what avail_in can express are fed in several pieces.
+    const unsigned char* next = data;
+    size_t left = size;
+    bool ok = true;
+
+    do
+    {
+        uInt piece = (left > UINT32_MAX) ? UINT32_MAX : (uInt)left;
+
+        strm.next_in = (z_const Bytef*)next;
+        strm.avail_in = piece;
+
+        next += piece;
+        left -= piece;
+
+        ok = deflateToFile(&strm, left == 0 ? Z_FINISH : Z_NO_FLUSH, outBuf, outBufSize, outFile, &totalWritten, outCrcCompressed);
+    } while (ok && left > 0);
+
+    deflateEnd(&strm);
+    memFree(outBuf);
+
+    if (!ok) return false;
+
+    *outCompSize = totalWritten;
+    return true;
+}
+
+bool writeFileSink(void* context, const void* buffer, size_t size)
+{
+    return writeFile((FILE*)context, buffer, size);
+}
+
 ArchResult decompressFileStream(FILE* inFile, FILE* outFile, uint64_t compSize, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed)
 {
-    if (!inFile || !outFile || !outCrcUncompressed || !outCrcCompressed)
+    if (!outFile)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    return decompressStream(inFile, compSize, writeFileSink, outFile, outCrcUncompressed, outCrcCompressed);
+}
+
+ArchResult decompressStream(FILE* inFile, uint64_t compSize, StreamWriteFn write, void* context, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed)
+{
+    if (!inFile || !outCrcUncompressed || !outCrcCompressed)
         return ARCH_ERR_INVALID_ARGUMENT;
 
     ArchResult result = ARCH_OK;
@@ -394,7 +866,8 @@ ArchResult decompressFileStream(FILE* inFile, FILE* outFile, uint64_t compSize,
     *outCrcCompressed = 0;
 
     z_stream strm = {0};
-    
+    memoryBindStream(&strm);
+
     if (inflateInit(&strm) != Z_OK)
     {
         result = ARCH_ERR_INTERNAL;
@@ -411,29 +884,53 @@ ArchResult decompressFileStream(FILE* inFile, FILE* outFile, uint64_t compSize,
                         : buffer_size;
 
         size_t bytesRead;
-        if (!readFile(inFile, (char*)inBuf, toRead, &bytesRead) || (bytesRead == 0 && !feof(inFile)))
+        uint64_t t = statsBegin();
+        bool readOk = readFile(inFile, (char*)inBuf, toRead, &bytesRead);
+        statsEnd(ARCH_STAGE_READ, t);
+
+        if (!readOk)
         {
             inflateEnd(&strm);
+            result = ARCH_ERR_IO;
             goto cleanup;
         }
 
-        if (bytesRead > 0)
+        // Payload cut short by the end of the archive
+        if (bytesRead == 0)
         {
-            *outCrcCompressed = crc32(*outCrcCompressed, inBuf, (uInt)bytesRead);
+            inflateEnd(&strm);
+            result = ARCH_ERR_CORRUPTED;
+            goto cleanup;
         }
 
+        t = statsBegin();
+        *outCrcCompressed = crc32(*outCrcCompressed, inBuf, (uInt)bytesRead);
+        statsEnd(ARCH_STAGE_CHECKSUM, t);
+
         totalRead += bytesRead;
+        STATS_ADD(bytesRead, bytesRead);
 
         strm.next_in = inBuf;
         strm.avail_in = (uInt)bytesRead;
 
-        while (strm.avail_in > 0)
+        // Keep going while output fills up, inflate may still hold pending output with no input left
+        do
         {
             strm.next_out = outBuf;
             strm.avail_out = buffer_size;
 
+            uLong consumedBefore = strm.total_in;
+
+            t = statsBegin();
             ret = inflate(&strm, Z_NO_FLUSH);
-            if (ret != Z_OK && ret != Z_STREAM_END)
+            statsEnd(ARCH_STAGE_DECOMPRESS, t);
+
+            if (ret == Z_BUF_ERROR)
+            {
+                // No progress possible without more input
+                ret = Z_OK;
+            }
+            else if (ret != Z_OK && ret != Z_STREAM_END)
             {
                 inflateEnd(&strm);
                 switch (ret)
@@ -462,15 +959,33 @@ ArchResult decompressFileStream(FILE* inFile, FILE* outFile, uint64_t compSize,
             size_t have = buffer_size - strm.avail_out;
             if (have > 0)
             {
+                t = statsBegin();
                 *outCrcUncompressed = crc32(*outCrcUncompressed, outBuf, (uInt)have);
+                statsEnd(ARCH_STAGE_CHECKSUM, t);
 
-                if (!writeFile(outFile, (const char*)outBuf, have))
+                if (write)
                 {
-                    inflateEnd(&strm);
-                    goto cleanup;
+                    t = statsBegin();
+                    bool writeOk = write(context, outBuf, have);
+                    statsEnd(ARCH_STAGE_WRITE, t);
+
+                    if (!writeOk)
+                    {
+                        inflateEnd(&strm);
+                        result = ARCH_ERR_IO;
+                        goto cleanup;
+                    }
+                    STATS_ADD(bytesWritten, have);
                 }
             }
-        }
+
+            if (!progressAdvance(strm.total_in - consumedBefore, write ? have : 0))
+            {
+                inflateEnd(&strm);
+                result = ARCH_ERR_CANCELLED;
+                goto cleanup;
+            }
+        } while (ret != Z_STREAM_END && (strm.avail_in > 0 || strm.avail_out == 0));
     }
 
     inflateEnd(&strm);
@@ -481,7 +996,7 @@ ArchResult decompressFileStream(FILE* inFile, FILE* outFile, uint64_t compSize,
     }
 
 cleanup:
-    free(inBuf);
-    free(outBuf);
+    memFree(inBuf);
+    memFree(outBuf);
     return result;
 }
@@ -31,15 +31,39 @@
     #define DIR_SEP '/'
 #endif
 
+size_t tryAllocateBuffer(unsigned char** buffer);
+
 uint16_t read_u16_le(const unsigned char b[2]);
 uint32_t read_u32_le(const unsigned char b[4]);
 uint64_t read_u64_le(const unsigned char b[8]);
 
+void write_u16_le(unsigned char b[2], uint16_t value);
+void write_u32_le(unsigned char b[4], uint32_t value);
+void write_u64_le(unsigned char b[8], uint64_t value);
+
+// LEB128: 7 bits per byte, low bits first, at most 10 bytes
+size_t write_varint(unsigned char b[10], uint64_t value);
+// Returns the bytes consumed, 0 when the value runs past size or doesn't fit 64 bits
+size_t read_varint(const unsigned char* b, size_t size, uint64_t* value);
+
 bool readFile(FILE* file, char* buffer, size_t buffer_size, size_t* outbytesRead);
 bool writeFile(FILE* file, const char* buffer, size_t bytes);
 bool copyFileData(FILE* in, FILE* out, uint64_t fileSize, uint32_t* outCrc);
+// Like copyFileData without the CRC, from the current position of in to that of out. Between files the
+// kernel copies the range itself where it can (copy_file_range, reflinks on CoW file systems).
+bool copyFileRange(FILE* in, FILE* out, uint64_t size);
+bool truncateFile(FILE* file, uint64_t size);
+// Gives the blocks of a range back to the file system, the file keeps its size and reads zeros there.
+// Best effort: false where the platform or file system can't, the data is then just left in place.
+bool punchFileHole(FILE* file, uint64_t offset, uint64_t size);
 
 uint64_t getFileSize(FILE* file);
+
+// Read-only shared mapping of the whole file, NULL where the platform has no mmap, the file is empty or
+// doesn't fit the address space. Stays valid after the file is closed, until unmapFile.
+const void* mapFile(FILE* file, uint64_t* outSize);
+void unmapFile(const void* data, uint64_t size);
+// Plain malloc, the result belongs to the caller rather than an archive
 char* getFileName(const char* filePath, bool stripExtension);
 
 char* sanitizeFilePath(const char* inputPath);
@@ -47,7 +71,62 @@ char* sanitizeFilePath(const char* inputPath);
 bool isDirectory(const char* path);
 bool createParentDirectories(const char* filePath);
 
+// Two paths name the same file exactly when their identities are equal, however they are spelled
+typedef struct FileIdentity
+{
+    uint64_t device;
+    uint64_t inode;     // File index on Windows
+} FileIdentity;
+
+// False where nothing exists at path
+bool getFileIdentity(const char* path, FileIdentity* outIdentity);
+bool isSameFile(const FileIdentity* a, const FileIdentity* b);
+
+// Unused name in the directory of path, unique to the process and call, for writing a file that then
+// replaces path through replaceFile. Plain memAlloc.
+char* getStagingPath(const char* path);
+// Flushes the stream and waits until what was written to it has reached the disk
+bool syncFile(FILE* file);
+// Same for the file at path
+bool syncFilePath(const char* path);
+// Renames from to to, atomically replacing whatever was at to
+bool replaceFile(const char* from, const char* to);
+
+// The copy and (de)compression loops report to the calling thread's progress scope after every
+// chunk; a cancel makes them fail, compare progressCancelled() to tell it apart from an I/O error
+
+// Returns the number of bytes placed in buffer, 0 at end of input or -1 on error
+typedef int64_t (*StreamReadFn)(void* context, void* buffer, size_t size);
+
+typedef struct FileSource
+{
+    FILE* file;
+    bool eof;
+} FileSource;
+
+typedef struct BufferSource
+{
+    const unsigned char* data;
+    size_t size;
+    size_t offset;
+} BufferSource;
+
+int64_t readFileSource(void* context, void* buffer, size_t size);
+int64_t readBufferSource(void* context, void* buffer, size_t size);
+
+bool compressStream(StreamReadFn read, void* context, FILE* outFile, uint64_t* outOrigSize, uint64_t* outCompSize, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed);
+// Copies the stream to outFile as it is, for stored entries
+bool storeStream(StreamReadFn read, void* context, FILE* outFile, uint64_t* outSize, uint32_t* outCrc);
+bool compressBuffer(const void* data, size_t size, FILE* outFile, uint64_t* outCompSize, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed);
 bool compressFileStream(FILE* inFile, FILE* outFile, uint64_t* outCompSize, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed);
+// Consumes size bytes of output, returns false on failure
+typedef bool (*StreamWriteFn)(void* context, const void* buffer, size_t size);
+
+// Sink writing to the FILE* passed as context
+bool writeFileSink(void* context, const void* buffer, size_t size);
+
+// A NULL write function discards the output, only the CRCs are computed
+ArchResult decompressStream(FILE* inFile, uint64_t compSize, StreamWriteFn write, void* context, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed);
 ArchResult decompressFileStream(FILE* inFile, FILE* outFile, uint64_t compSize, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed);
 
 #endif // FILE_H
\ No newline at end of file
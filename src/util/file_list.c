@@ -0,0 +1,290 @@
+#include "file_list.h"
+#include "file.h"
+#include "memory.h"
+#include "progress.h"
+#include "stats.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+    #include <fcntl.h>
+    #include <linux/fiemap.h>
+    #include <linux/fs.h>
+    #include <sys/ioctl.h>
+    #include <unistd.h>
+#endif
+
+// Device offset of the first extent, false where the filesystem can't tell (tmpfs, inline data, ...)
+static bool getPhysicalLocation(const char* path, uint64_t* outPhysical)
+{
+#ifdef FS_IOC_FIEMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    uint64_t request[(sizeof(struct fiemap) + sizeof(struct fiemap_extent)) / sizeof(uint64_t) + 1];
+    memset(request, 0, sizeof request);
+
+    struct fiemap* map = (struct fiemap*)request;
+    map->fm_length = FIEMAP_MAX_OFFSET;
+    map->fm_extent_count = 1;
+
+    bool ok = ioctl(fd, FS_IOC_FIEMAP, map) == 0 && map->fm_mapped_extents > 0 &&
+        !(map->fm_extents[0].fe_flags & FIEMAP_EXTENT_UNKNOWN);
+    if (ok) *outPhysical = map->fm_extents[0].fe_physical;
+
+    close(fd);
+    return ok;
+#else
+    (void)path;
+    (void)outPhysical;
+    return false;
+#endif
+}
+
+static bool appendFile(FileList* list, const char* path, uint64_t size, uint64_t device, uint64_t inode, ArchInputOrder order)
+{
+    if (list->count == list->capacity)
+    {
+        size_t capacity = list->capacity ? list->capacity * 2 : 256;
+
+        FileListEntry* entries = memRealloc(list->entries, capacity * sizeof *entries);
+        if (!entries) return false;
+
+        list->entries = entries;
+        list->capacity = capacity;
+    }
+
+    char* copy = memStrdup(path);
+    if (!copy) return false;
+
+    FileListEntry* entry = &list->entries[list->count];
+    entry->path = copy;
+    entry->size = size;
+    entry->device = device;
+    entry->inode = inode;
+    entry->physical = UINT64_MAX;
+    entry->scanIndex = list->count;
+
+    if (order == ARCH_ORDER_PHYSICAL)
+    {
+        uint64_t t = statsBegin();
+        if (!getPhysicalLocation(path, &entry->physical)) entry->physical = UINT64_MAX;
+        statsEnd(ARCH_STAGE_SCAN, t);
+    }
+
+    list->count++;
+    return true;
+}
+
+#ifdef _WIN32
+static int findNextTimed(intptr_t hFind, struct _finddata_t* findFileData)
+{
+    uint64_t t = statsBegin();
+    int result = _findnext(hFind, findFileData);
+    statsEnd(ARCH_STAGE_SCAN, t);
+    return result;
+}
+#endif
+
+ArchResult collectFiles(const char* dirPath, ArchInputOrder order, FileList* list)
+{
+    if (!dirPath || !list)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    ArchResult result = ARCH_OK;
+
+#ifdef _WIN32
+    struct _finddata_t findFileData;
+    intptr_t hFind;
+    char searchPath[1024];
+    char pathBuffer[1024];
+
+    snprintf(searchPath, sizeof(searchPath), "%s\\*", dirPath);
+
+    uint64_t t = statsBegin();
+    hFind = _findfirst(searchPath, &findFileData);
+    statsEnd(ARCH_STAGE_SCAN, t);
+
+    if (hFind == -1L)
+    {
+        return ARCH_ERR_IO;
+    }
+
+    do {
+        // Skip "." and ".."
+        if (strcmp(findFileData.name, ".") == 0 || strcmp(findFileData.name, "..") == 0)
+        {
+            continue;
+        }
+
+        snprintf(pathBuffer, sizeof(pathBuffer), "%s\\%s", dirPath, findFileData.name);
+
+        if (findFileData.attrib & _A_SUBDIR)
+        {
+            ArchResult r = collectFiles(pathBuffer, order, list);
+            if (r != ARCH_OK) result = r;
+        }
+        else if (!appendFile(list, pathBuffer, findFileData.size, 0, 0, order))
+        {
+            result = ARCH_ERR_OUT_OF_MEMORY;
+        }
+    } while (result != ARCH_ERR_OUT_OF_MEMORY && result != ARCH_ERR_CANCELLED && findNextTimed(hFind, &findFileData) == 0);
+
+    _findclose(hFind);
+
+#else
+    uint64_t t = statsBegin();
+    DIR* dir = opendir(dirPath);
+    statsEnd(ARCH_STAGE_SCAN, t);
+
+    if (!dir) return ARCH_ERR_IO;
+
+    struct dirent* entry;
+    struct stat path_stat;
+    char pathBuffer[1024];
+
+    for (;;)
+    {
+        t = statsBegin();
+        entry = readdir(dir);
+        statsEnd(ARCH_STAGE_SCAN, t);
+
+        if (!entry) break;
+
+        // Skip "." and ".."
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        snprintf(pathBuffer, sizeof(pathBuffer), "%s/%s", dirPath, entry->d_name);
+
+        t = statsBegin();
+        int statResult = stat(pathBuffer, &path_stat);
+        statsEnd(ARCH_STAGE_SCAN, t);
+
+        if (statResult != 0) continue;
+
+        if (S_ISDIR(path_stat.st_mode))
+        {
+            ArchResult r = collectFiles(pathBuffer, order, list);
+            if (r != ARCH_OK) result = r;
+        }
+        else if (S_ISREG(path_stat.st_mode) &&
+                 !appendFile(list, pathBuffer, (uint64_t)path_stat.st_size, (uint64_t)path_stat.st_dev, (uint64_t)path_stat.st_ino, order))
+        {
+            result = ARCH_ERR_OUT_OF_MEMORY;
+        }
+
+        if (result == ARCH_ERR_OUT_OF_MEMORY || result == ARCH_ERR_CANCELLED) break;
+    }
+
+    closedir(dir);
+#endif
+
+    // Large trees take a while to scan, give the progress callback a chance to cancel
+    if (result != ARCH_ERR_OUT_OF_MEMORY && !progressAdvance(0, 0))
+        result = ARCH_ERR_CANCELLED;
+
+    return result;
+}
+
+static int compareScanIndex(const FileListEntry* a, const FileListEntry* b)
+{
+    return (a->scanIndex > b->scanIndex) - (a->scanIndex < b->scanIndex);
+}
+
+static int compareU64(uint64_t a, uint64_t b)
+{
+    return (a > b) - (a < b);
+}
+
+static int compareInode(const void* left, const void* right)
+{
+    const FileListEntry* a = left;
+    const FileListEntry* b = right;
+
+    int c = compareU64(a->device, b->device);
+    if (c == 0) c = compareU64(a->inode, b->inode);
+    return c ? c : compareScanIndex(a, b);
+}
+
+// Files without a known extent go last, in inode order
+static int comparePhysical(const void* left, const void* right)
+{
+    const FileListEntry* a = left;
+    const FileListEntry* b = right;
+
+    int c = compareU64(a->device, b->device);
+    if (c == 0) c = compareU64(a->physical, b->physical);
+    return c ? c : compareInode(left, right);
+}
+
+// Extension of the last path component, "" without one
+static const char* getExtension(const char* path)
+{
+    const char* name = strrchr(path, DIR_SEP);
+    name = name ? name + 1 : path;
+
+    const char* dot = strrchr(name, '.');
+    return (dot && dot != name) ? dot + 1 : "";
+}
+
+static int compareType(const void* left, const void* right)
+{
+    const FileListEntry* a = left;
+    const FileListEntry* b = right;
+
+    const unsigned char* x = (const unsigned char*)getExtension(a->path);
+    const unsigned char* y = (const unsigned char*)getExtension(b->path);
+
+    while (*x && tolower(*x) == tolower(*y))
+    {
+        x++;
+        y++;
+    }
+
+    int c = tolower(*x) - tolower(*y);
+    if (c == 0) c = compareU64(a->size, b->size);
+    return c ? c : compareScanIndex(a, b);
+}
+
+void sortFileList(FileList* list, ArchInputOrder order)
+{
+    if (!list || list->count < 2) return;
+
+    switch (order)
+    {
+        case ARCH_ORDER_INODE:
+            qsort(list->entries, list->count, sizeof *list->entries, compareInode);
+            break;
+
+        case ARCH_ORDER_PHYSICAL:
+            qsort(list->entries, list->count, sizeof *list->entries, comparePhysical);
+            break;
+
+        case ARCH_ORDER_TYPE:
+            qsort(list->entries, list->count, sizeof *list->entries, compareType);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void freeFileList(FileList* list)
+{
+    if (!list) return;
+
+    for (size_t i = 0; i < list->count; i++)
+    {
+        memFree(list->entries[i].path);
+    }
+    memFree(list->entries);
+
+    list->entries = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef FILE_LIST_H
+#define FILE_LIST_H
+
+#include <arch/archiver.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct FileListEntry
+{
+    char* path;
+    uint64_t size;
+    uint64_t device;
+    uint64_t inode;
+    uint64_t physical;  // Device offset of the first extent, UINT64_MAX unless looked up and known
+    size_t scanIndex;   // Position in readdir order, keeps every ordering stable
+} FileListEntry;
+
+typedef struct FileList
+{
+    FileListEntry* entries;
+    size_t count;
+    size_t capacity;
+} FileList;
+
+// Regular files below dirPath, recursively and in readdir order. Unreadable directories are skipped
+// and reported as ARCH_ERR_IO once the rest has been collected; running out of memory stops the scan.
+// Physical locations are only looked up (one open per file) for ARCH_ORDER_PHYSICAL.
+ArchResult collectFiles(const char* dirPath, ArchInputOrder order, FileList* list);
+void sortFileList(FileList* list, ArchInputOrder order);
+void freeFileList(FileList* list);
+
+#endif // FILE_LIST_H
@@ -0,0 +1,557 @@
+#include "long_match.h"
+#include "memory.h"
+#include "progress.h"
+#include "stats.h"
+
+#include <zlib.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_LENGTH 64          // Bytes covered by the rolling hash, also the shortest candidate
+#define SAMPLE_MASK 63          // A position is indexed when the low hash bits are zero, one in 64
+#define MIN_LENGTH 256          // Shorter matches aren't worth a seek in the source entry
+#define BLOCK_SIZE ((uint64_t)1 << 20)
+
+typedef struct LongMatchSource
+{
+    size_t index;       // Archive entry
+    uint64_t start;     // Stream position of its first byte
+    uint64_t size;
+} LongMatchSource;
+
+struct LongMatcher
+{
+    // The last windowSize bytes of every entry compressed so far, by stream position
+    unsigned char* ring;
+    uint64_t windowSize;
+    uint64_t mask;
+    uint64_t total;
+
+    // Buzhash over the last HASH_LENGTH bytes, rolled through every byte of the stream
+    uint64_t gear[256];
+    uint64_t hash;
+    uint64_t rolled;
+
+    // Sampled positions (plus one, 0 is empty) by hash
+    uint64_t* table;
+    uint64_t tableMask;
+
+    // Entries still in the window that may be matched against, in stream order
+    LongMatchSource* sources;
+    size_t sourceCount;
+    size_t sourceCapacity;
+
+    size_t entryIndex;
+    uint64_t entryStart;
+    bool entryMatched;
+
+    bool external;  // Sources belong to a base archive, see longMatchSetSource
+};
+
+// State of one longMatchCompress, the read function deflate pulls the literals through
+typedef struct LongMatchStream
+{
+    LongMatcher* matcher;
+    StreamReadFn read;
+    void* context;
+    bool finished;
+
+    uint64_t origSize;
+    uint32_t crc;
+
+    unsigned char* literals;
+    size_t literalSize;
+    size_t literalPos;
+
+    // Match records written after the zlib stream
+    unsigned char* records;
+    size_t recordSize;
+    size_t recordCapacity;
+
+    uint64_t literalStart;  // First byte not yet handed out as literal or covered by a match
+    uint64_t literalRun;    // Literals since the previous record
+
+    bool matchOpen;
+    uint64_t matchStart;
+    uint64_t matchLength;
+    uint64_t matchSource;   // Next source byte to compare
+    const LongMatchSource* source;
+} LongMatchStream;
+
+static uint64_t splitmix64(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+LongMatcher* longMatcherCreate(uint64_t windowSize)
+{
+    if (windowSize < LONG_MATCH_MIN_WINDOW) windowSize = LONG_MATCH_MIN_WINDOW;
+
+    // Down to a power of two, never more than asked for
+    uint64_t size = LONG_MATCH_MIN_WINDOW;
+    while (size <= windowSize / 2) size *= 2;
+
+    if (size > SIZE_MAX / 2) return NULL;
+
+    LongMatcher* matcher = memCalloc(1, sizeof *matcher);
+    if (!matcher) return NULL;
+
+    matcher->windowSize = size;
+    matcher->mask = size - 1;
+    matcher->tableMask = size / HASH_LENGTH - 1;
+
+    matcher->ring = memAlloc((size_t)size);
+    matcher->table = memCalloc((size_t)(size / HASH_LENGTH), sizeof *matcher->table);
+    if (!matcher->ring || !matcher->table)
+    {
+        longMatcherFree(matcher);
+        return NULL;
+    }
+
+    // Fixed seed, the same input always compresses to the same archive
+    uint64_t seed = 0x4C4F4E474D415443ull;
+    for (int i = 0; i < 256; i++)
+    {
+        matcher->gear[i] = splitmix64(&seed);
+    }
+
+    return matcher;
+}
+
+void longMatcherFree(LongMatcher* matcher)
+{
+    if (!matcher) return;
+
+    memFree(matcher->ring);
+    memFree(matcher->table);
+    memFree(matcher->sources);
+    memFree(matcher);
+}
+
+static inline unsigned char ringByte(const LongMatcher* matcher, uint64_t pos)
+{
+    return matcher->ring[pos & matcher->mask];
+}
+
+// Oldest stream position still held by the ring
+static inline uint64_t windowLow(const LongMatcher* matcher)
+{
+    return matcher->total > matcher->windowSize ? matcher->total - matcher->windowSize : 0;
+}
+
+static inline void rollHash(LongMatcher* matcher, uint64_t pos)
+{
+    // Rotating by HASH_LENGTH is a no-op on 64 bits, so the leaving byte drops out with a plain xor
+    uint64_t h = (matcher->hash << 1) | (matcher->hash >> 63);
+    h ^= matcher->gear[ringByte(matcher, pos)];
+    if (matcher->rolled >= HASH_LENGTH) h ^= matcher->gear[ringByte(matcher, pos - HASH_LENGTH)];
+
+    matcher->hash = h;
+    matcher->rolled++;
+}
+
+static const LongMatchSource* findSource(const LongMatcher* matcher, uint64_t pos)
+{
+    size_t low = 0;
+    size_t high = matcher->sourceCount;
+
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (matcher->sources[mid].start <= pos)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (low == 0) return NULL;
+
+    const LongMatchSource* source = &matcher->sources[low - 1];
+    return pos < source->start + source->size ? source : NULL;
+}
+
+static void emitLiterals(LongMatchStream* stream, uint64_t end)
+{
+    const LongMatcher* matcher = stream->matcher;
+
+    for (uint64_t pos = stream->literalStart; pos < end; )
+    {
+        size_t offset = (size_t)(pos & matcher->mask);
+        size_t chunk = (size_t)(matcher->windowSize - offset);
+        if (chunk > end - pos) chunk = (size_t)(end - pos);
+
+        memcpy(stream->literals + stream->literalSize, matcher->ring + offset, chunk);
+        stream->literalSize += chunk;
+        pos += chunk;
+    }
+
+    stream->literalRun += end - stream->literalStart;
+    stream->literalStart = end;
+}
+
+static bool appendVarint(LongMatchStream* stream, uint64_t value)
+{
+    if (stream->recordCapacity - stream->recordSize < 10)
+    {
+        size_t capacity = stream->recordCapacity ? stream->recordCapacity * 2 : 4096;
+        unsigned char* grown = memRealloc(stream->records, capacity);
+        if (!grown) return false;
+
+        stream->records = grown;
+        stream->recordCapacity = capacity;
+    }
+
+    while (value >= 0x80)
+    {
+        stream->records[stream->recordSize++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    stream->records[stream->recordSize++] = (unsigned char)value;
+    return true;
+}
+
+// Records the open match, or gives its bytes back to the literals when it stayed short
+static bool closeMatch(LongMatchStream* stream)
+{
+    stream->matchOpen = false;
+
+    if (stream->matchLength < MIN_LENGTH) return true;
+
+    const LongMatcher* matcher = stream->matcher;
+    const LongMatchSource* source = stream->source;
+
+    if (!appendVarint(stream, stream->literalRun) ||
+        !appendVarint(stream, stream->matchLength) ||
+        !appendVarint(stream, matcher->external ? source->index : matcher->entryIndex - source->index) ||
+        !appendVarint(stream, stream->matchSource - stream->matchLength - source->start))
+    {
+        return false;
+    }
+
+    // Deflate never sees these bytes, count them here
+    progressAdvance(stream->matchLength, 0);
+
+    stream->literalRun = 0;
+    stream->literalStart = stream->matchStart + stream->matchLength;
+    return true;
+}
+
+// Checks a candidate from the table against the HASH_LENGTH bytes ending before end, grows it back over
+// pending literals and opens a match on success
+static void tryMatch(LongMatchStream* stream, uint64_t candidate, uint64_t end)
+{
+    const LongMatcher* matcher = stream->matcher;
+
+    const LongMatchSource* source = findSource(matcher, candidate);
+    if (!source) return;
+
+    uint64_t low = windowLow(matcher);
+    if (source->start > low) low = source->start;
+
+    uint64_t sourceEnd = source->start + source->size;
+    uint64_t start = end - HASH_LENGTH;
+
+    if (candidate < low || candidate + HASH_LENGTH > sourceEnd) return;
+
+    for (uint64_t i = 0; i < HASH_LENGTH; i++)
+    {
+        if (ringByte(matcher, candidate + i) != ringByte(matcher, start + i)) return;
+    }
+
+    // Bytes before literalStart were handed out already
+    if (start < stream->literalStart)
+    {
+        candidate += stream->literalStart - start;
+        start = stream->literalStart;
+    }
+
+    while (start > stream->literalStart && candidate > low && ringByte(matcher, candidate - 1) == ringByte(matcher, start - 1))
+    {
+        start--;
+        candidate--;
+    }
+
+    emitLiterals(stream, start);
+
+    stream->matchOpen = true;
+    stream->matchStart = start;
+    stream->matchLength = end - start;
+    stream->matchSource = candidate + (end - start);
+    stream->source = source;
+}
+
+static bool scanBlock(LongMatchStream* stream, uint64_t blockStart, uint64_t blockEnd)
+{
+    LongMatcher* matcher = stream->matcher;
+    uint64_t low = windowLow(matcher);
+
+    for (uint64_t pos = blockStart; pos < blockEnd; pos++)
+    {
+        if (stream->matchOpen)
+        {
+            uint64_t source = stream->matchSource;
+            const LongMatchSource* s = stream->source;
+
+            if (source >= low && source < s->start + s->size && ringByte(matcher, source) == ringByte(matcher, pos))
+            {
+                stream->matchSource++;
+                stream->matchLength++;
+                rollHash(matcher, pos);
+                continue;
+            }
+
+            if (!closeMatch(stream)) return false;
+        }
+
+        rollHash(matcher, pos);
+
+        if (matcher->rolled < HASH_LENGTH || (matcher->hash & SAMPLE_MASK) != 0) continue;
+
+        uint64_t* slot = &matcher->table[(matcher->hash >> 6) & matcher->tableMask];
+        if (*slot) tryMatch(stream, *slot - 1, pos + 1);
+
+        // Once an entry has a match it can't be a source, don't crowd out useful positions
+        uint64_t hashed = pos + 1 - HASH_LENGTH;
+        if (!stream->matchOpen && stream->recordSize == 0 && !matcher->external) *slot = hashed + 1;
+    }
+
+    // An open match may go on in the next block, pending literals are handed out now
+    if (!stream->matchOpen) emitLiterals(stream, blockEnd);
+
+    return true;
+}
+
+// Reads the next block of input into the ring, 0 at end of input
+static int64_t readBlock(LongMatchStream* stream)
+{
+    LongMatcher* matcher = stream->matcher;
+    uint64_t got = 0;
+
+    while (got < BLOCK_SIZE)
+    {
+        uint64_t pos = matcher->total + got;
+        size_t offset = (size_t)(pos & matcher->mask);
+        size_t chunk = (size_t)(matcher->windowSize - offset);
+        if (chunk > BLOCK_SIZE - got) chunk = (size_t)(BLOCK_SIZE - got);
+
+        int64_t readBytes = stream->read(stream->context, matcher->ring + offset, chunk);
+        if (readBytes < 0 || (uint64_t)readBytes > chunk) return -1;
+        if (readBytes == 0) break;
+
+        uint64_t t = statsBegin();
+        stream->crc = crc32(stream->crc, matcher->ring + offset, (uInt)readBytes);
+        statsEnd(ARCH_STAGE_CHECKSUM, t);
+
+        got += (uint64_t)readBytes;
+    }
+
+    matcher->total += got;
+    stream->origSize += got;
+    return (int64_t)got;
+}
+
+static int64_t readLiterals(void* context, void* buffer, size_t size)
+{
+    LongMatchStream* stream = context;
+
+    while (stream->literalPos == stream->literalSize)
+    {
+        if (stream->finished) return 0;
+
+        stream->literalPos = 0;
+        stream->literalSize = 0;
+
+        uint64_t blockStart = stream->matcher->total;
+
+        int64_t got = readBlock(stream);
+        if (got < 0) return -1;
+
+        if (got == 0)
+        {
+            if (stream->matchOpen && !closeMatch(stream)) return -1;
+            emitLiterals(stream, stream->matcher->total);
+            stream->finished = true;
+        }
+        else if (!scanBlock(stream, blockStart, stream->matcher->total))
+        {
+            return -1;
+        }
+    }
+
+    size_t available = stream->literalSize - stream->literalPos;
+    if (size > available) size = available;
+
+    memcpy(buffer, stream->literals + stream->literalPos, size);
+    stream->literalPos += size;
+    return (int64_t)size;
+}
+
+bool longMatchCompress(LongMatcher* matcher, size_t entryIndex, StreamReadFn read, void* context, FILE* outFile, uint64_t* outOrigSize, uint64_t* outCompSize, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed, bool* outLongMatch)
+{
+    if (!matcher || !read || !outFile || !outOrigSize || !outCompSize || !outCrcUncompressed || !outCrcCompressed || !outLongMatch) return false;
+
+    matcher->entryIndex = entryIndex;
+    matcher->entryStart = matcher->total;
+    matcher->entryMatched = false;
+
+    LongMatchStream stream = {
+        .matcher = matcher,
+        .read = read,
+        .context = context,
+        .crc = crc32(0L, Z_NULL, 0),
+        .literalStart = matcher->total
+    };
+
+    // A block of literals plus a match that ended too short to keep, carried over from the block before
+    stream.literals = memAlloc((size_t)BLOCK_SIZE + MIN_LENGTH);
+    if (!stream.literals) return false;
+
+    uint64_t literalSize;
+    uint32_t literalCrc;
+
+    bool ok = compressStream(readLiterals, &stream, outFile, &literalSize, outCompSize, &literalCrc, outCrcCompressed);
+
+    if (ok && stream.recordSize > 0)
+    {
+        unsigned char trailer[LONG_MATCH_TRAILER_SIZE];
+        write_u64_le(trailer, stream.recordSize);
+
+        uint64_t t = statsBegin();
+        ok = writeFile(outFile, (const char*)stream.records, stream.recordSize) && writeFile(outFile, (const char*)trailer, sizeof trailer);
+        statsEnd(ARCH_STAGE_WRITE, t);
+
+        *outCrcCompressed = (uint32_t)crc32_z(*outCrcCompressed, stream.records, stream.recordSize);
+        *outCrcCompressed = crc32(*outCrcCompressed, trailer, sizeof trailer);
+        *outCompSize += stream.recordSize + sizeof trailer;
+        STATS_ADD(bytesWritten, stream.recordSize + sizeof trailer);
+    }
+
+    matcher->entryMatched = stream.recordSize > 0;
+
+    *outOrigSize = stream.origSize;
+    *outCrcUncompressed = stream.crc;
+    *outLongMatch = stream.recordSize > 0;
+
+    memFree(stream.literals);
+    memFree(stream.records);
+    return ok;
+}
+
+void longMatchEntryEnd(LongMatcher* matcher, bool kept)
+{
+    if (!matcher) return;
+
+    uint64_t size = matcher->total - matcher->entryStart;
+
+    if (kept && !matcher->entryMatched && !matcher->external && size > 0)
+    {
+        if (matcher->sourceCount == matcher->sourceCapacity)
+        {
+            size_t capacity = matcher->sourceCapacity ? matcher->sourceCapacity * 2 : 64;
+            LongMatchSource* grown = memRealloc(matcher->sources, capacity * sizeof *grown);
+
+            // Without room the entry just isn't matched against, nothing is lost
+            if (grown)
+            {
+                matcher->sources = grown;
+                matcher->sourceCapacity = capacity;
+            }
+        }
+
+        if (matcher->sourceCount < matcher->sourceCapacity)
+        {
+            matcher->sources[matcher->sourceCount++] = (LongMatchSource){ matcher->entryIndex, matcher->entryStart, size };
+        }
+    }
+
+    // Drop sources that have left the window entirely
+    uint64_t low = windowLow(matcher);
+    size_t evicted = 0;
+    while (evicted < matcher->sourceCount && matcher->sources[evicted].start + matcher->sources[evicted].size <= low)
+    {
+        evicted++;
+    }
+
+    if (evicted > 0)
+    {
+        memmove(matcher->sources, matcher->sources + evicted, (matcher->sourceCount - evicted) * sizeof *matcher->sources);
+        matcher->sourceCount -= evicted;
+    }
+
+    // Ending an entry that never reached the matcher is a no-op
+    matcher->entryStart = matcher->total;
+    matcher->entryMatched = false;
+}
+
+bool longMatchSetSource(LongMatcher* matcher, size_t index, StreamReadFn read, void* context)
+{
+    if (!matcher || !read) return false;
+
+    matcher->external = true;
+    matcher->sourceCount = 0;
+
+    uint64_t start = matcher->total;
+
+    for (;;)
+    {
+        size_t offset = (size_t)(matcher->total & matcher->mask);
+        size_t chunk = (size_t)(matcher->windowSize - offset);
+        if (chunk > BLOCK_SIZE) chunk = (size_t)BLOCK_SIZE;
+
+        int64_t readBytes = read(context, matcher->ring + offset, chunk);
+        if (readBytes < 0 || (uint64_t)readBytes > chunk) return false;
+        if (readBytes == 0) break;
+
+        uint64_t end = matcher->total + (uint64_t)readBytes;
+        matcher->total = end;
+
+        for (uint64_t pos = end - (uint64_t)readBytes; pos < end; pos++)
+        {
+            rollHash(matcher, pos);
+
+            uint64_t hashed = pos + 1 - HASH_LENGTH;
+            if (matcher->rolled >= HASH_LENGTH && (matcher->hash & SAMPLE_MASK) == 0)
+                matcher->table[(matcher->hash >> 6) & matcher->tableMask] = hashed + 1;
+        }
+    }
+
+    if (matcher->total == start) return true;
+
+    if (matcher->sourceCapacity == 0)
+    {
+        matcher->sources = memAlloc(sizeof *matcher->sources);
+        if (!matcher->sources) return false;
+        matcher->sourceCapacity = 1;
+    }
+
+    matcher->sources[0] = (LongMatchSource){ index, start, matcher->total - start };
+    matcher->sourceCount = 1;
+
+    matcher->entryStart = matcher->total;
+    return true;
+}
+
+bool readLongMatchVarint(const unsigned char** cursor, const unsigned char* end, uint64_t* outValue)
+{
+    uint64_t value = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        if (*cursor == end) return false;
+
+        unsigned char byte = *(*cursor)++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80))
+        {
+            *outValue = value;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,44 @@
+#ifndef LONG_MATCH_H
+#define LONG_MATCH_H
+
+#include "file.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Long-range matching ahead of deflate, for repeats far beyond its 32 KiB window.
+
+   Payload of an ARCH_FLAG_LONG_MATCH entry: a zlib stream of the literal bytes (the entry with every
+   matched span cut out), then the match stream, then its size as u64. The match stream is a list of
+   varint records: literal bytes since the previous match, length, entry index delta, offset in that
+   entry. Sources are always earlier entries without long matches of their own, so any entry decodes
+   with at most one hop and stays independently readable. */
+
+#define LONG_MATCH_MIN_WINDOW ((uint64_t)8 << 20)
+#define LONG_MATCH_TRAILER_SIZE 8
+
+typedef struct LongMatcher LongMatcher;
+
+// Window rounded down to a power of two, allocated from the current memory; NULL if it doesn't fit
+LongMatcher* longMatcherCreate(uint64_t windowSize);
+void longMatcherFree(LongMatcher* matcher);
+
+// Like compressStream, for entry entryIndex of the archive. Without a single match the payload is a plain
+// zlib stream and outLongMatch is false, otherwise the entry needs ARCH_FLAG_LONG_MATCH.
+bool longMatchCompress(LongMatcher* matcher, size_t entryIndex, StreamReadFn read, void* context, FILE* outFile, uint64_t* outOrigSize, uint64_t* outCompSize, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed, bool* outLongMatch);
+
+// Delta encoding: makes entry index of another archive, read to its end through read, the only source.
+// From then on records name sources by absolute index (ARCH_FLAG_BASE_DELTA) and no entry of this
+// archive becomes a source. Sources larger than the window are matched against their tail only.
+bool longMatchSetSource(LongMatcher* matcher, size_t index, StreamReadFn read, void* context);
+
+// Ends the entry of the last longMatchCompress; kept entries without matches become sources for later ones.
+// Harmless for entries that didn't go through the matcher.
+void longMatchEntryEnd(LongMatcher* matcher, bool kept);
+
+// Decodes one varint of the match stream, false when it runs past end or overflows
+bool readLongMatchVarint(const unsigned char** cursor, const unsigned char* end, uint64_t* outValue);
+
+#endif // LONG_MATCH_H
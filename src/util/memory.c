@@ -0,0 +1,252 @@
+#include "memory.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+ARCH_THREAD_LOCAL Memory* currentMemory = NULL;
+
+// Prefix of every block, keeps the payload aligned like malloc
+typedef union MemoryBlock
+{
+    struct
+    {
+        Memory* owner;
+        size_t size;
+    } info;
+    max_align_t align;
+} MemoryBlock;
+
+static void* heapAlloc(void* userdata, size_t size)
+{
+    (void)userdata;
+    return malloc(size);
+}
+
+static void heapFree(void* userdata, void* ptr)
+{
+    (void)userdata;
+    free(ptr);
+}
+
+bool memoryOptionsValid(const ArchMemoryOptions* options)
+{
+    return !options || !options->allocator || (options->allocator->alloc && options->allocator->free);
+}
+
+bool memoryInit(Memory* memory, const ArchMemoryOptions* options)
+{
+    if (!memoryOptionsValid(options)) return false;
+
+    memset(memory, 0, sizeof *memory);
+
+    if (options && options->allocator)
+    {
+        memory->allocator = *options->allocator;
+    }
+    else
+    {
+        memory->allocator.alloc = heapAlloc;
+        memory->allocator.free = heapFree;
+    }
+
+    memory->limit = options ? options->memoryLimit : 0;
+
+    return mutexInit(&memory->lock);
+}
+
+void memoryDestroy(Memory* memory)
+{
+    mutexDestroy(&memory->lock);
+}
+
+void memoryScopeEnter(MemoryScope* scope, Memory* memory)
+{
+    scope->previous = currentMemory;
+    currentMemory = memory;
+}
+
+void memoryScopeLeave(MemoryScope* scope)
+{
+    currentMemory = scope->previous;
+}
+
+void* memoryAllocRaw(const ArchAllocator* allocator, size_t size)
+{
+    return allocator ? allocator->alloc(allocator->userdata, size) : malloc(size);
+}
+
+void memoryFreeRaw(const ArchAllocator* allocator, void* ptr)
+{
+    if (!ptr) return;
+
+    if (allocator)
+        allocator->free(allocator->userdata, ptr);
+    else
+        free(ptr);
+}
+
+static bool reserve(Memory* memory, size_t size)
+{
+    bool ok = true;
+
+    mutexLock(&memory->lock);
+    if (memory->limit && (memory->used > memory->limit || size > memory->limit - memory->used))
+    {
+        ok = false;
+    }
+    else
+    {
+        memory->used += size;
+        if (memory->used > memory->peak) memory->peak = memory->used;
+    }
+    mutexUnlock(&memory->lock);
+
+    return ok;
+}
+
+static void release(Memory* memory, size_t size)
+{
+    mutexLock(&memory->lock);
+    memory->used -= size;
+    mutexUnlock(&memory->lock);
+}
+
+static void* allocateFrom(Memory* memory, size_t size)
+{
+    if (size > SIZE_MAX - sizeof(MemoryBlock)) return NULL;
+    size_t total = sizeof(MemoryBlock) + size;
+
+    MemoryBlock* block;
+    if (memory)
+    {
+        if (!reserve(memory, total)) return NULL;
+
+        block = memory->allocator.alloc(memory->allocator.userdata, total);
+        if (!block)
+        {
+            release(memory, total);
+            return NULL;
+        }
+    }
+    else
+    {
+        block = malloc(total);
+        if (!block) return NULL;
+    }
+
+    block->info.owner = memory;
+    block->info.size = size;
+    return block + 1;
+}
+
+void* memAlloc(size_t size)
+{
+    return allocateFrom(currentMemory, size);
+}
+
+void* memCalloc(size_t count, size_t size)
+{
+    if (size && count > SIZE_MAX / size) return NULL;
+
+    void* ptr = memAlloc(count * size);
+    if (ptr) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void* memRealloc(void* ptr, size_t size)
+{
+    if (!ptr) return memAlloc(size);
+
+    MemoryBlock* block = (MemoryBlock*)ptr - 1;
+
+    // Grown blocks stay with the memory they came from
+    void* grown = allocateFrom(block->info.owner, size);
+    if (!grown) return NULL;
+
+    memcpy(grown, ptr, block->info.size < size ? block->info.size : size);
+    memFree(ptr);
+    return grown;
+}
+
+char* memStrdup(const char* str)
+{
+    size_t size = strlen(str) + 1;
+
+    char* copy = memAlloc(size);
+    if (copy) memcpy(copy, str, size);
+    return copy;
+}
+
+void memFree(void* ptr)
+{
+    if (!ptr) return;
+
+    MemoryBlock* block = (MemoryBlock*)ptr - 1;
+    Memory* memory = block->info.owner;
+
+    if (!memory)
+    {
+        free(block);
+        return;
+    }
+
+    size_t total = sizeof(MemoryBlock) + block->info.size;
+    memory->allocator.free(memory->allocator.userdata, block);
+    release(memory, total);
+}
+
+size_t memoryAvailable(void)
+{
+    Memory* memory = currentMemory;
+    if (!memory || !memory->limit) return SIZE_MAX;
+
+    mutexLock(&memory->lock);
+    size_t available = memory->used < memory->limit ? memory->limit - memory->used : 0;
+    mutexUnlock(&memory->lock);
+
+    return available;
+}
+
+static voidpf zlibAlloc(voidpf opaque, uInt items, uInt size)
+{
+    if (size && items > SIZE_MAX / size) return Z_NULL;
+    return allocateFrom(opaque, (size_t)items * size);
+}
+
+static void zlibFree(voidpf opaque, voidpf address)
+{
+    (void)opaque;
+    memFree(address);
+}
+
+void memoryBindStream(z_stream* strm)
+{
+    strm->zalloc = zlibAlloc;
+    strm->zfree = zlibFree;
+    strm->opaque = currentMemory;
+}
+
+// zlib's documented footprint of a deflate stream, plus its state struct
+static size_t deflateMemory(int windowBits, int memLevel)
+{
+    return ((size_t)1 << (windowBits + 2)) + ((size_t)1 << (memLevel + 9)) + 8192;
+}
+
+bool memoryDeflateInit(z_stream* strm, size_t reserve)
+{
+    int windowBits = 15;
+    int memLevel = 8;
+
+    size_t available = memoryAvailable();
+    while ((windowBits > 9 || memLevel > 1) && deflateMemory(windowBits, memLevel) + reserve > available)
+    {
+        if (windowBits > 9 && (windowBits - 7 >= memLevel || memLevel == 1))
+            windowBits--;
+        else
+            memLevel--;
+    }
+
+    memoryBindStream(strm);
+    return deflateInit2(strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, memLevel, Z_DEFAULT_STRATEGY) == Z_OK;
+}
@@ -0,0 +1,62 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <arch/arch_memory.h>
+
+#include "thread.h"
+
+#include <zlib.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Allocator and accounting of one archive
+typedef struct Memory
+{
+    ArchAllocator allocator;
+    size_t limit;   // 0 for none
+
+    Mutex lock;
+    size_t used;
+    size_t peak;
+} Memory;
+
+typedef struct MemoryScope
+{
+    Memory* previous;
+} MemoryScope;
+
+// Memory of the archive the calling thread works on, NULL allocates from the C heap without a cap
+extern ARCH_THREAD_LOCAL Memory* currentMemory;
+
+// NULL options are valid, an allocator needs both functions
+bool memoryOptionsValid(const ArchMemoryOptions* options);
+
+bool memoryInit(Memory* memory, const ArchMemoryOptions* options);
+void memoryDestroy(Memory* memory);
+
+void memoryScopeEnter(MemoryScope* scope, Memory* memory);
+void memoryScopeLeave(MemoryScope* scope);
+
+// Raw blocks straight from the allocator (NULL for the C heap), neither tagged nor counted; for the Archive itself
+void* memoryAllocRaw(const ArchAllocator* allocator, size_t size);
+void memoryFreeRaw(const ArchAllocator* allocator, void* ptr);
+
+// Blocks remember the memory they came from, so memFree is safe from any thread or scope
+void* memAlloc(size_t size);
+void* memCalloc(size_t count, size_t size);
+void* memRealloc(void* ptr, size_t size);
+char* memStrdup(const char* str);
+void memFree(void* ptr);
+
+// Bytes left under the cap of the current memory, SIZE_MAX without one
+size_t memoryAvailable(void);
+
+// Routes the allocations of a stream to the current memory, call before its init
+void memoryBindStream(z_stream* strm);
+
+// Bound deflate stream at the default level. Under a cap the window and hash table shrink until the state
+// fits with reserve bytes to spare for the caller's buffers; inflate accepts any window, readers need nothing.
+bool memoryDeflateInit(z_stream* strm, size_t reserve);
+
+#endif // MEMORY_H
@@ -0,0 +1,163 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE // statx
+#endif
+
+#include "open_ahead.h"
+#include "file.h"
+
+#include <string.h>
+
+#ifdef __linux__
+    #include <fcntl.h>
+#endif
+
+// Size and type in one call that doesn't touch the file's data; plain stat where statx is missing
+static bool statRegularFile(const char* path, uint64_t* outSize)
+{
+#if defined(__linux__) && defined(STATX_SIZE)
+    struct statx st;
+    if (statx(AT_FDCWD, path, AT_STATX_SYNC_AS_STAT, STATX_TYPE | STATX_SIZE, &st) == 0)
+    {
+        if ((st.stx_mask & (STATX_TYPE | STATX_SIZE)) != (STATX_TYPE | STATX_SIZE)) return false;
+
+        *outSize = st.stx_size;
+        return S_ISREG(st.stx_mode);
+    }
+#endif
+
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(path, &info) != 0) return false;
+
+    *outSize = (uint64_t)info.st_size;
+    return (info.st_mode & _S_IFREG) != 0;
+#else
+    struct stat info;
+    if (stat(path, &info) != 0) return false;
+
+    *outSize = (uint64_t)info.st_size;
+    return S_ISREG(info.st_mode);
+#endif
+}
+
+static void openFile(const OpenAhead* ahead, const char* path, OpenedFile* outFile)
+{
+    memset(outFile, 0, sizeof *outFile);
+
+    // Only regular files are opened, a FIFO or device would block or never end
+    uint64_t size;
+    if (!statRegularFile(path, &size)) return;
+
+    outFile->file = fopen(path, "rb");
+    if (!outFile->file) return;
+
+    outFile->size = size;
+
+#ifdef __linux__
+    if (ahead->readAhead && size > 0)
+        posix_fadvise(fileno(outFile->file), 0, (off_t)(size < OPEN_AHEAD_BYTES ? size : OPEN_AHEAD_BYTES), POSIX_FADV_WILLNEED);
+#else
+    (void)ahead;
+#endif
+}
+
+static void openAheadWorker(void* arg)
+{
+    OpenAhead* ahead = arg;
+
+    mutexLock(&ahead->lock);
+
+    while (!ahead->stopping && ahead->opened < ahead->count)
+    {
+        if (ahead->opened - ahead->taken == OPEN_AHEAD_FILES)
+        {
+            condWait(&ahead->changed, &ahead->lock);
+            continue;
+        }
+
+        // The slot is free until opened moves past it, nobody else touches it meanwhile
+        size_t index = ahead->opened;
+        mutexUnlock(&ahead->lock);
+
+        OpenedFile file;
+        openFile(ahead, ahead->paths[index], &file);
+
+        mutexLock(&ahead->lock);
+        ahead->slots[index % OPEN_AHEAD_FILES] = file;
+        ahead->opened++;
+        condBroadcast(&ahead->changed);
+    }
+
+    mutexUnlock(&ahead->lock);
+}
+
+void openAheadStart(OpenAhead* ahead, const char* const* paths, size_t count, ArchIoMode mode)
+{
+    memset(ahead, 0, sizeof *ahead);
+
+    ahead->paths = paths;
+    ahead->count = count;
+    ahead->readAhead = mode != ARCH_IO_DIRECT;
+
+    // A single file has nothing to overlap with
+    if (count < 2) return;
+
+    if (!mutexInit(&ahead->lock)) return;
+
+    if (!condInit(&ahead->changed))
+    {
+        mutexDestroy(&ahead->lock);
+        return;
+    }
+
+    ahead->threaded = threadCreate(&ahead->thread, openAheadWorker, ahead);
+    if (!ahead->threaded)
+    {
+        condDestroy(&ahead->changed);
+        mutexDestroy(&ahead->lock);
+    }
+}
+
+void openAheadNext(OpenAhead* ahead, OpenedFile* outFile)
+{
+    if (!ahead->threaded)
+    {
+        openFile(ahead, ahead->paths[ahead->taken++], outFile);
+        return;
+    }
+
+    mutexLock(&ahead->lock);
+
+    while (ahead->opened == ahead->taken)
+    {
+        condWait(&ahead->changed, &ahead->lock);
+    }
+
+    *outFile = ahead->slots[ahead->taken % OPEN_AHEAD_FILES];
+    ahead->taken++;
+    condBroadcast(&ahead->changed);
+
+    mutexUnlock(&ahead->lock);
+}
+
+void openAheadStop(OpenAhead* ahead)
+{
+    if (!ahead->threaded) return;
+
+    mutexLock(&ahead->lock);
+    ahead->stopping = true;
+    condBroadcast(&ahead->changed);
+    mutexUnlock(&ahead->lock);
+
+    threadJoin(ahead->thread);
+
+    for (size_t i = ahead->taken; i < ahead->opened; i++)
+    {
+        FILE* file = ahead->slots[i % OPEN_AHEAD_FILES].file;
+        if (file) fclose(file);
+    }
+
+    condDestroy(&ahead->changed);
+    mutexDestroy(&ahead->lock);
+    ahead->threaded = false;
+}
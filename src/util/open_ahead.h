@@ -0,0 +1,51 @@
+#ifndef OPEN_AHEAD_H
+#define OPEN_AHEAD_H
+
+#include <arch/archiver.h>
+
+#include "thread.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Files kept open ahead of the one being added, and how much of each is read ahead
+#define OPEN_AHEAD_FILES 16
+#define OPEN_AHEAD_BYTES (1u << 20)
+
+typedef struct OpenedFile
+{
+    FILE* file;     // NULL when the path isn't a regular file or couldn't be opened
+    uint64_t size;  // From statx, no seeks needed
+} OpenedFile;
+
+// Opens a list of input files in order on a thread of its own, staying up to OPEN_AHEAD_FILES ahead of
+// the caller, and asks for the start of each to be read ahead, so metadata round trips and the first
+// reads overlap with compressing the files before. Without the thread the caller opens each file itself.
+typedef struct OpenAhead
+{
+    const char* const* paths;
+    size_t count;
+    bool readAhead;     // Not for direct I/O, whose reads bypass the cache
+
+    OpenedFile slots[OPEN_AHEAD_FILES];
+
+    Mutex lock;
+    Cond changed;
+    size_t opened;      // Files handed to the slots so far
+    size_t taken;       // Files the caller took out of them
+    bool stopping;
+
+    bool threaded;
+    Thread thread;
+} OpenAhead;
+
+// paths must outlive the OpenAhead
+void openAheadStart(OpenAhead* ahead, const char* const* paths, size_t count, ArchIoMode mode);
+// The next file in list order, which then belongs to the caller. Waits until it is open.
+void openAheadNext(OpenAhead* ahead, OpenedFile* outFile);
+// Closes the files opened and not taken, the rest of the list may be left unopened
+void openAheadStop(OpenAhead* ahead);
+
+#endif // OPEN_AHEAD_H
@@ -0,0 +1,244 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE // sync_file_range, O_DIRECT
+#endif
+
+#include "page_cache.h"
+#include "memory.h"
+
+#include <string.h>
+
+#ifdef __linux__
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+// O_DIRECT transfers: buffer, offset and size aligned to the logical block size, 4 KiB covers all common ones
+#define DIRECT_ALIGNMENT 4096
+#define DIRECT_BLOCK_SIZE (1u << 20)
+
+void initWriteBehind(WriteBehind* output, FILE* file, ArchIoMode mode)
+{
+    memset(output, 0, sizeof *output);
+
+#ifdef __linux__
+    if (mode != ARCH_IO_BUFFERED && file && fileno(file) >= 0)
+        output->file = file;
+#else
+    (void)file;
+    (void)mode;
+#endif
+}
+
+#ifdef __linux__
+// Everything before end is on disk and out of the page cache afterwards
+static void dropWritten(WriteBehind* output, int fd, uint64_t end)
+{
+    if (end <= output->dropped) return;
+
+    uint64_t size = end - output->dropped;
+    sync_file_range(fd, (off64_t)output->dropped, (off64_t)size, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(fd, (off_t)output->dropped, (off_t)size, POSIX_FADV_DONTNEED);
+
+    output->dropped = end;
+}
+#endif
+
+void advanceWriteBehind(WriteBehind* output)
+{
+#ifdef __linux__
+    if (!output || !output->file) return;
+
+    int64_t end = ftell64(output->file);
+    if (end < 0 || (uint64_t)end < output->started + PAGE_CACHE_WINDOW) return;
+
+    if (fflush(output->file) != 0) return;
+    int fd = fileno(output->file);
+
+    // Start the new window on its way and wait for the one before, which has had a window's time to finish
+    sync_file_range(fd, (off64_t)output->started, (off64_t)((uint64_t)end - output->started), SYNC_FILE_RANGE_WRITE);
+    dropWritten(output, fd, output->started);
+
+    output->started = (uint64_t)end;
+#else
+    (void)output;
+#endif
+}
+
+void finishWriteBehind(WriteBehind* output)
+{
+#ifdef __linux__
+    if (!output || !output->file || fflush(output->file) != 0) return;
+
+    int fd = fileno(output->file);
+
+    // Header fields patched on close lie anywhere, the whole file goes (a length of 0 runs to its end)
+    sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    output->file = NULL;
+#else
+    (void)output;
+#endif
+}
+
+void openInputSource(InputSource* source, FILE* file, const char* path, ArchIoMode mode, WriteBehind* output)
+{
+    memset(source, 0, sizeof *source);
+
+    source->buffered.file = file;
+    source->mode = mode;
+    source->fd = -1;
+    source->directFd = -1;
+    source->output = output;
+
+#ifdef __linux__
+    if (mode == ARCH_IO_BUFFERED) return;
+
+    source->fd = fileno(file);
+    if (source->fd >= 0) posix_fadvise(source->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (mode != ARCH_IO_DIRECT || !path) return;
+
+    source->blockMemory = memAlloc(DIRECT_BLOCK_SIZE + DIRECT_ALIGNMENT);
+    if (!source->blockMemory) return;
+
+    source->directFd = open(path, O_RDONLY | O_DIRECT);
+    if (source->directFd < 0)
+    {
+        memFree(source->blockMemory);
+        source->blockMemory = NULL;
+        return;
+    }
+
+    uintptr_t address = (uintptr_t)source->blockMemory;
+    source->block = (unsigned char*)((address + DIRECT_ALIGNMENT - 1) & ~(uintptr_t)(DIRECT_ALIGNMENT - 1));
+#else
+    (void)path;
+#endif
+}
+
+#ifdef __linux__
+// Keeps readahead a window in front of the reader and lets go of what it is done with. Direct reads
+// bypass the cache, for them only the output is paced.
+static void adviseInput(InputSource* source)
+{
+    bool cached = source->fd >= 0 && source->directFd < 0;
+
+    if (cached && source->offset + PAGE_CACHE_WINDOW / 2 >= source->advised)
+    {
+        posix_fadvise(source->fd, (off_t)source->advised, PAGE_CACHE_WINDOW, POSIX_FADV_WILLNEED);
+        source->advised += PAGE_CACHE_WINDOW;
+    }
+
+    if (source->offset >= source->dropped + PAGE_CACHE_WINDOW)
+    {
+        if (cached) posix_fadvise(source->fd, (off_t)source->dropped, (off_t)(source->offset - source->dropped), POSIX_FADV_DONTNEED);
+        source->dropped = source->offset;
+
+        // The output grows with the input, pacing it here keeps large entries from piling up dirty pages
+        advanceWriteBehind(source->output);
+    }
+}
+
+static void stopDirect(InputSource* source)
+{
+    close(source->directFd);
+    source->directFd = -1;
+    memFree(source->blockMemory);
+    source->blockMemory = NULL;
+    source->block = NULL;
+}
+
+// Continues with buffered reads where the direct ones left off
+static bool fallBackToBuffered(InputSource* source)
+{
+    uint64_t offset = source->directOffset;
+    stopDirect(source);
+
+    source->advised = offset;
+    source->dropped = offset;
+
+    return offset <= INT64_MAX && fseek64(source->buffered.file, (int64_t)offset, SEEK_SET) == 0;
+}
+
+static int64_t readDirect(InputSource* source, void* buffer, size_t size)
+{
+    if (source->blockPos == source->blockFill)
+    {
+        ssize_t got;
+        do got = read(source->directFd, source->block, DIRECT_BLOCK_SIZE);
+        while (got < 0 && errno == EINTR);
+
+        if (got < 0) return -1;
+
+        source->blockFill = (size_t)got;
+        source->blockPos = 0;
+        source->directOffset += (uint64_t)got;
+
+        // Short at the end of the file, but also wherever the file system likes; either way another
+        // direct read would start unaligned. The buffered stream finds out which it was.
+        source->directDone = (size_t)got < DIRECT_BLOCK_SIZE;
+
+        if (got == 0) return 0;
+    }
+
+    size_t left = source->blockFill - source->blockPos;
+    if (size > left) size = left;
+
+    memcpy(buffer, source->block + source->blockPos, size);
+    source->blockPos += size;
+    return (int64_t)size;
+}
+#endif
+
+int64_t readInputSource(void* context, void* buffer, size_t size)
+{
+    InputSource* source = context;
+
+#ifdef __linux__
+    int64_t got = -1;
+
+    if (source->directFd >= 0 && source->directDone && source->blockPos == source->blockFill)
+    {
+        if (!fallBackToBuffered(source)) return -1;
+    }
+
+    if (source->directFd >= 0)
+    {
+        got = readDirect(source, buffer, size);
+
+        // Some file systems accept O_DIRECT on open and refuse the reads, stream through the cache there.
+        // Nothing at all only ends the file once the buffered stream agrees.
+        if ((got < 0 && errno == EINVAL) || got == 0)
+        {
+            if (!fallBackToBuffered(source)) return -1;
+        }
+    }
+
+    if (source->directFd < 0)
+        got = readFileSource(&source->buffered, buffer, size);
+
+    if (got > 0)
+    {
+        source->offset += (uint64_t)got;
+        adviseInput(source);
+    }
+    return got;
+#else
+    return readFileSource(&source->buffered, buffer, size);
+#endif
+}
+
+void closeInputSource(InputSource* source)
+{
+#ifdef __linux__
+    if (source->directFd >= 0) stopDirect(source);
+
+    // Whatever of the file is still cached was only there for us
+    if (source->fd >= 0) posix_fadvise(source->fd, 0, 0, POSIX_FADV_DONTNEED);
+    source->fd = -1;
+#else
+    (void)source;
+#endif
+}
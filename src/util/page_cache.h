@@ -0,0 +1,59 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <arch/archiver.h>
+
+#include "file.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Inputs are read ahead by a window and dropped a window at a time, outputs written back the same way
+#define PAGE_CACHE_WINDOW (8u << 20)
+
+// Written back as it grows and dropped behind, for a file only ever appended to. Inactive (file NULL)
+// in buffered mode, on streams without a descriptor and on platforms without sync_file_range.
+typedef struct WriteBehind
+{
+    FILE* file;
+    uint64_t started;   // Write-back was started for everything before
+    uint64_t dropped;   // Written back and let go before
+} WriteBehind;
+
+void initWriteBehind(WriteBehind* output, FILE* file, ArchIoMode mode);
+// Cheap unless a window has filled up since the last call, the stream's position is the end of the data
+void advanceWriteBehind(WriteBehind* output);
+// Waits for the rest to reach the disk and drops it, the file is complete
+void finishWriteBehind(WriteBehind* output);
+
+// An input file read front to back as ArchIoMode asks. Direct mode falls back to streaming where the
+// file system refuses O_DIRECT.
+typedef struct InputSource
+{
+    FileSource buffered;
+    ArchIoMode mode;
+    int fd;                 // Of buffered.file for the hints, -1 without
+    uint64_t offset;        // Bytes handed out
+    uint64_t advised;       // Readahead was asked for up to here
+    uint64_t dropped;       // Pages before were let go
+
+    int directFd;           // -1 unless reading with O_DIRECT
+    void* blockMemory;      // Holds block, aligned for O_DIRECT
+    unsigned char* block;
+    size_t blockFill;
+    size_t blockPos;
+    uint64_t directOffset;  // Bytes read through directFd
+    bool directDone;        // Buffered reads take over once block is used up
+
+    WriteBehind* output;    // Paced as the input is consumed, may be NULL
+} InputSource;
+
+// file stays the caller's, path is reopened for O_DIRECT
+void openInputSource(InputSource* source, FILE* file, const char* path, ArchIoMode mode, WriteBehind* output);
+// StreamReadFn over an InputSource
+int64_t readInputSource(void* context, void* buffer, size_t size);
+void closeInputSource(InputSource* source);
+
+#endif // PAGE_CACHE_H
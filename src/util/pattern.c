@@ -0,0 +1,161 @@
+#include "pattern.h"
+#include "memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static bool matchClass(const char** pattern, char c, bool* outMatched)
+{
+    const char* p = *pattern + 1;
+
+    bool negate = (*p == '!' || *p == '^');
+    if (negate) p++;
+
+    bool matched = false;
+    bool first = true;
+
+    while (*p && (*p != ']' || first))
+    {
+        first = false;
+
+        if (p[1] == '-' && p[2] && p[2] != ']')
+        {
+            if ((unsigned char)c >= (unsigned char)p[0] && (unsigned char)c <= (unsigned char)p[2])
+                matched = true;
+            p += 3;
+        }
+        else
+        {
+            if (*p == c)
+                matched = true;
+            p++;
+        }
+    }
+
+    // Unterminated class, treat '[' literally
+    if (*p != ']') return false;
+
+    *pattern = p + 1;
+    *outMatched = (matched != negate);
+    return true;
+}
+
+static bool matchFrom(const char* p, const char* s, const char* end)
+{
+    while (*p)
+    {
+        if (p[0] == '*' && p[1] == '*')
+        {
+            p += 2;
+
+            // "**/" may also match zero directories
+            if (*p == '/' && matchFrom(p + 1, s, end)) return true;
+
+            for (;; s++)
+            {
+                if (matchFrom(p, s, end)) return true;
+                if (s == end) return false;
+            }
+        }
+
+        if (*p == '*')
+        {
+            p++;
+            for (;; s++)
+            {
+                if (matchFrom(p, s, end)) return true;
+                if (s == end || *s == '/') return false;
+            }
+        }
+
+        if (s == end) return false;
+
+        if (*p == '?')
+        {
+            if (*s == '/') return false;
+            p++;
+            s++;
+            continue;
+        }
+
+        if (*p == '[' && *s != '/')
+        {
+            bool matched;
+            if (matchClass(&p, *s, &matched))
+            {
+                if (!matched) return false;
+                s++;
+                continue;
+            }
+        }
+
+        if (*p != *s) return false;
+        p++;
+        s++;
+    }
+
+    return s == end;
+}
+
+bool matchPathPattern(const char* pattern, const char* path)
+{
+    if (!pattern || !path) return false;
+
+    // A trailing slash only marks the pattern as a directory
+    size_t patternLen = strlen(pattern);
+    char* trimmed = NULL;
+    if (patternLen > 1 && pattern[patternLen - 1] == '/')
+    {
+        trimmed = memStrdup(pattern);
+        if (!trimmed) return false;
+        while (patternLen > 1 && trimmed[patternLen - 1] == '/')
+        {
+            trimmed[--patternLen] = '\0';
+        }
+        pattern = trimmed;
+    }
+
+    bool matched = false;
+
+    // Whole path first, then every leading directory ("a/b/c" -> "a", "a/b")
+    const char* end = path + strlen(path);
+    if (matchFrom(pattern, path, end))
+    {
+        matched = true;
+    }
+    else
+    {
+        for (const char* s = path; s < end && !matched; s++)
+        {
+            if (*s == '/' && s != path)
+            {
+                matched = matchFrom(pattern, path, s);
+            }
+        }
+    }
+
+    memFree(trimmed);
+    return matched;
+}
+
+bool matchAnyPathPattern(const char* const* patterns, size_t patternCount, const char* path)
+{
+    for (size_t i = 0; i < patternCount; i++)
+    {
+        if (matchPathPattern(patterns[i], path)) return true;
+    }
+    return false;
+}
+
+size_t getPatternPrefixLength(const char* pattern)
+{
+    size_t length = strcspn(pattern, "*?[");
+
+    // Trailing slashes of a plain path only mark a directory, the entry itself may be a file of that name
+    if (pattern[length] == '\0')
+    {
+        while (length > 1 && pattern[length - 1] == '/') length--;
+    }
+
+    return length;
+}
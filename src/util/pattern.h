@@ -0,0 +1,15 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Glob syntax: '*' and '?' stop at '/', '**' crosses directories, '[a-z]' / '[!a-z]' classes.
+   A pattern also matches everything below a directory it matches, so plain paths act as prefixes. */
+bool matchPathPattern(const char* pattern, const char* path);
+bool matchAnyPathPattern(const char* const* patterns, size_t patternCount, const char* path);
+
+// Length of the literal start of pattern, up to its first wildcard: every path it matches begins with it
+size_t getPatternPrefixLength(const char* pattern);
+
+#endif // PATTERN_H
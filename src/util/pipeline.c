@@ -0,0 +1,651 @@
+#include "pipeline.h"
+#include "memory.h"
+#include "progress.h"
+#include "stats.h"
+#include "thread.h"
+
+#include <zlib.h>
+
+#include <stdatomic.h>
+#include <string.h>
+
+#define PIPELINE_CHUNK_SIZE (256u << 10)
+
+// Chunks circulating between two stages; enough for either side to run ahead while the other catches up
+#define PIPELINE_DEPTH 4
+
+// A stage waiting on the next chunk spins briefly, then yields, then sleeps until it shows up
+#define SPIN_LIMIT 256
+#define YIELD_LIMIT 1024
+#define SLEEP_US 50
+
+#define CACHE_LINE 64
+
+typedef struct Chunk
+{
+    size_t size;
+    bool last;      // End of the stream, after this chunk's data
+    unsigned char data[];
+} Chunk;
+
+// Single producer, single consumer. Head and tail only ever grow and live on lines of their own.
+// Pushing never waits: a ring holds at most the PIPELINE_DEPTH chunks of its link.
+typedef struct ChunkRing
+{
+    _Alignas(CACHE_LINE) atomic_size_t head;
+    _Alignas(CACHE_LINE) atomic_size_t tail;
+    Chunk* slots[PIPELINE_DEPTH];
+} ChunkRing;
+
+// Two adjacent stages: chunks travel forward through full and come back through empty
+typedef struct Link
+{
+    ChunkRing full;
+    ChunkRing empty;
+} Link;
+
+typedef struct Pipeline
+{
+    Link input;     // Reader to codec
+    Link output;    // Codec to writer
+    Chunk* chunks[2 * PIPELINE_DEPTH];
+
+    z_stream strm;
+
+    // Of the first stage to fail, every stage gives up once it is set
+    atomic_int result;
+
+    ArchStats* stats;   // Of the calling thread, the stages' counters are merged into it
+    ArchStats codecStats;
+    ArchStats ioStats;
+
+    // Progress is reported by the caller, on behalf of the other stages
+    atomic_uint_fast64_t bytesShared;
+
+    // Stage on a thread of its own, I/O between the codec and inFile / outFile
+    FILE* file;
+    WriteBehind* writeBehind;   // Of outFile, paced by the writer
+    uint64_t compSize;
+    uint32_t crc;
+    uint64_t size;
+} Pipeline;
+
+static void pipelineFail(Pipeline* pipeline, ArchResult result)
+{
+    int expected = ARCH_OK;
+    atomic_compare_exchange_strong(&pipeline->result, &expected, (int)result);
+}
+
+static bool pipelineFailed(Pipeline* pipeline)
+{
+    return atomic_load_explicit(&pipeline->result, memory_order_relaxed) != ARCH_OK;
+}
+
+static void ringPush(ChunkRing* ring, Chunk* chunk)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    ring->slots[head % PIPELINE_DEPTH] = chunk;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// NULL once the pipeline has failed
+static Chunk* ringPop(Pipeline* pipeline, ChunkRing* ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    for (unsigned spins = 0; atomic_load_explicit(&ring->head, memory_order_acquire) == tail; spins++)
+    {
+        if (pipelineFailed(pipeline)) return NULL;
+
+        if (spins >= YIELD_LIMIT) threadSleep(SLEEP_US);
+        else if (spins >= SPIN_LIMIT) threadYield();
+    }
+
+    Chunk* chunk = ring->slots[tail % PIPELINE_DEPTH];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return chunk;
+}
+
+static void destroyPipeline(Pipeline* pipeline)
+{
+    for (size_t i = 0; i < 2 * PIPELINE_DEPTH; i++)
+    {
+        memFree(pipeline->chunks[i]);
+    }
+}
+
+// Buffers for both links, each starting out in its link's empty ring. False where they don't fit
+// comfortably under the memory cap, the serial loop makes do with much less.
+static bool initPipeline(Pipeline* pipeline)
+{
+    memset(pipeline, 0, sizeof *pipeline);
+    atomic_init(&pipeline->result, ARCH_OK);
+    atomic_init(&pipeline->bytesShared, 0);
+    atomic_init(&pipeline->input.full.head, 0);
+    atomic_init(&pipeline->input.full.tail, 0);
+    atomic_init(&pipeline->input.empty.head, 0);
+    atomic_init(&pipeline->input.empty.tail, 0);
+    atomic_init(&pipeline->output.full.head, 0);
+    atomic_init(&pipeline->output.full.tail, 0);
+    atomic_init(&pipeline->output.empty.head, 0);
+    atomic_init(&pipeline->output.empty.tail, 0);
+
+    size_t chunkBytes = sizeof(Chunk) + PIPELINE_CHUNK_SIZE;
+    if (memoryAvailable() / 4 < 2 * PIPELINE_DEPTH * chunkBytes) return false;
+
+    for (size_t i = 0; i < 2 * PIPELINE_DEPTH; i++)
+    {
+        pipeline->chunks[i] = memAlloc(chunkBytes);
+        if (!pipeline->chunks[i])
+        {
+            destroyPipeline(pipeline);
+            return false;
+        }
+
+        ringPush(i < PIPELINE_DEPTH ? &pipeline->input.empty : &pipeline->output.empty, pipeline->chunks[i]);
+    }
+
+    pipeline->stats = currentStats;
+    return true;
+}
+
+// Stages on threads of their own count into the pipeline, the caller merges after joining them
+static void stageEnter(StatsScope* scope, const Pipeline* pipeline)
+{
+    if (pipeline->stats) statsScopeEnter(scope);
+}
+
+static void stageLeave(StatsScope* scope, const Pipeline* pipeline, ArchStats* into)
+{
+    if (!pipeline->stats) return;
+
+    *into = scope->local;
+    statsScopeLeave(scope);
+}
+
+// Starts both stages besides the caller's, the codec first. Nothing has been read or written when
+// this fails, the caller can still go the serial way.
+static bool startStages(Pipeline* pipeline, ThreadFn codec, ThreadFn io, Thread* outCodec, Thread* outIo)
+{
+    if (!threadCreate(outCodec, codec, pipeline)) return false;
+
+    if (!threadCreate(outIo, io, pipeline))
+    {
+        pipelineFail(pipeline, ARCH_ERR_INTERNAL);
+        threadJoin(*outCodec);
+        return false;
+    }
+
+    return true;
+}
+
+static void joinStages(Pipeline* pipeline, Thread codec, Thread io)
+{
+    threadJoin(codec);
+    threadJoin(io);
+
+    if (pipeline->stats)
+    {
+        statsMerge(pipeline->stats, &pipeline->codecStats);
+        statsMerge(pipeline->stats, &pipeline->ioStats);
+    }
+}
+
+// Hands what the caller hasn't reported yet of the shared counter to progress
+static bool reportShared(Pipeline* pipeline, uint64_t* reported, uint64_t ownBytes, bool sharedIsInput)
+{
+    uint64_t shared = atomic_load_explicit(&pipeline->bytesShared, memory_order_relaxed);
+    uint64_t delta = shared - *reported;
+    *reported = shared;
+
+    return sharedIsInput ? progressAdvance(delta, ownBytes) : progressAdvance(ownBytes, delta);
+}
+
+static void deflateStage(void* arg)
+{
+    Pipeline* pipeline = arg;
+    z_stream* strm = &pipeline->strm;
+
+    StatsScope scope;
+    stageEnter(&scope, pipeline);
+
+    Chunk* out = NULL;
+    bool last = false;
+
+    while (!last)
+    {
+        Chunk* in = ringPop(pipeline, &pipeline->input.full);
+        if (!in) goto cleanup;
+
+        last = in->last;
+        int flush = last ? Z_FINISH : Z_NO_FLUSH;
+
+        strm->next_in = in->data;
+        strm->avail_in = (uInt)in->size;
+
+        do
+        {
+            if (!out)
+            {
+                out = ringPop(pipeline, &pipeline->output.empty);
+                if (!out) goto cleanup;
+
+                out->size = 0;
+                out->last = false;
+            }
+
+            strm->next_out = out->data + out->size;
+            strm->avail_out = (uInt)(PIPELINE_CHUNK_SIZE - out->size);
+
+            uint64_t t = statsBegin();
+            int ret = deflate(strm, flush);
+            statsEnd(ARCH_STAGE_COMPRESS, t);
+
+            if (ret == Z_STREAM_ERROR)
+            {
+                fprintf(stderr, "deflate error: Z_STREAM_ERROR\n");
+                pipelineFail(pipeline, ARCH_ERR_COMPRESSION);
+                goto cleanup;
+            }
+
+            out->size = PIPELINE_CHUNK_SIZE - strm->avail_out;
+            if (out->size == PIPELINE_CHUNK_SIZE)
+            {
+                ringPush(&pipeline->output.full, out);
+                out = NULL;
+            }
+        } while (strm->avail_out == 0);
+
+        ringPush(&pipeline->input.empty, in);
+    }
+
+    // The final chunk goes out even when empty, it carries the end of the stream
+    if (!out)
+    {
+        out = ringPop(pipeline, &pipeline->output.empty);
+        if (!out) goto cleanup;
+        out->size = 0;
+    }
+
+    out->last = true;
+    ringPush(&pipeline->output.full, out);
+
+cleanup:
+    stageLeave(&scope, pipeline, &pipeline->codecStats);
+}
+
+static void writeStage(void* arg)
+{
+    Pipeline* pipeline = arg;
+
+    StatsScope scope;
+    stageEnter(&scope, pipeline);
+
+    for (;;)
+    {
+        Chunk* chunk = ringPop(pipeline, &pipeline->output.full);
+        if (!chunk) break;
+
+        bool last = chunk->last;
+
+        if (chunk->size > 0)
+        {
+            uint64_t t = statsBegin();
+            pipeline->crc = crc32(pipeline->crc, chunk->data, (uInt)chunk->size);
+            statsEnd(ARCH_STAGE_CHECKSUM, t);
+
+            t = statsBegin();
+            bool writeOk = writeFile(pipeline->file, (const char*)chunk->data, chunk->size);
+            statsEnd(ARCH_STAGE_WRITE, t);
+
+            if (!writeOk)
+            {
+                pipelineFail(pipeline, ARCH_ERR_IO);
+                break;
+            }
+
+            pipeline->size += chunk->size;
+            STATS_ADD(bytesWritten, chunk->size);
+
+            // Only the writer touches outFile while the pipeline runs
+            advanceWriteBehind(pipeline->writeBehind);
+            atomic_fetch_add_explicit(&pipeline->bytesShared, chunk->size, memory_order_relaxed);
+        }
+
+        ringPush(&pipeline->output.empty, chunk);
+        if (last) break;
+    }
+
+    stageLeave(&scope, pipeline, &pipeline->ioStats);
+}
+
+bool pipelineCompress(StreamReadFn read, void* context, FILE* outFile, WriteBehind* writeBehind, uint64_t* outOrigSize, uint64_t* outCompSize, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed)
+{
+    if (!read || !outFile || !outOrigSize || !outCompSize || !outCrcUncompressed || !outCrcCompressed) return false;
+
+    Pipeline pipeline;
+    if (!initPipeline(&pipeline))
+        return compressStream(read, context, outFile, outOrigSize, outCompSize, outCrcUncompressed, outCrcCompressed);
+
+    if (!memoryDeflateInit(&pipeline.strm, 0))
+    {
+        destroyPipeline(&pipeline);
+        return compressStream(read, context, outFile, outOrigSize, outCompSize, outCrcUncompressed, outCrcCompressed);
+    }
+
+    pipeline.file = outFile;
+    pipeline.writeBehind = writeBehind;
+
+    Thread codec, writer;
+    if (!startStages(&pipeline, deflateStage, writeStage, &codec, &writer))
+    {
+        deflateEnd(&pipeline.strm);
+        destroyPipeline(&pipeline);
+        return compressStream(read, context, outFile, outOrigSize, outCompSize, outCrcUncompressed, outCrcCompressed);
+    }
+
+    // The calling thread reads, so the callback runs where it would without the pipeline
+    uint64_t totalRead = 0;
+    uint64_t reported = 0;
+    uint32_t crc = 0;
+    bool last = false;
+
+    while (!last)
+    {
+        Chunk* chunk = ringPop(&pipeline, &pipeline.input.empty);
+        if (!chunk) break;
+
+        chunk->size = 0;
+
+        // Whole chunks keep the codec's calls few, whatever the callback's granularity
+        while (chunk->size < PIPELINE_CHUNK_SIZE)
+        {
+            size_t want = PIPELINE_CHUNK_SIZE - chunk->size;
+
+            uint64_t t = statsBegin();
+            int64_t readBytes = read(context, chunk->data + chunk->size, want);
+            statsEnd(ARCH_STAGE_READ, t);
+
+            if (readBytes < 0 || (uint64_t)readBytes > want)
+            {
+                pipelineFail(&pipeline, ARCH_ERR_IO);
+                break;
+            }
+
+            if (readBytes == 0)
+            {
+                last = true;
+                break;
+            }
+
+            chunk->size += (size_t)readBytes;
+        }
+
+        if (pipelineFailed(&pipeline)) break;
+
+        uint64_t t = statsBegin();
+        crc = crc32(crc, chunk->data, (uInt)chunk->size);
+        statsEnd(ARCH_STAGE_CHECKSUM, t);
+
+        totalRead += chunk->size;
+        STATS_ADD(bytesRead, chunk->size);
+
+        chunk->last = last;
+        ringPush(&pipeline.input.full, chunk);
+
+        if (!reportShared(&pipeline, &reported, chunk->size, false))
+            pipelineFail(&pipeline, ARCH_ERR_CANCELLED);
+    }
+
+    joinStages(&pipeline, codec, writer);
+    deflateEnd(&pipeline.strm);
+
+    bool ok = !pipelineFailed(&pipeline) && reportShared(&pipeline, &reported, 0, false);
+
+    *outOrigSize = totalRead;
+    *outCompSize = pipeline.size;
+    *outCrcUncompressed = crc;
+    *outCrcCompressed = pipeline.crc;
+
+    destroyPipeline(&pipeline);
+    return ok;
+}
+
+static void readStage(void* arg)
+{
+    Pipeline* pipeline = arg;
+
+    StatsScope scope;
+    stageEnter(&scope, pipeline);
+
+    uint64_t left = pipeline->compSize;
+    bool last = false;
+
+    while (!last)
+    {
+        Chunk* chunk = ringPop(pipeline, &pipeline->input.empty);
+        if (!chunk) break;
+
+        size_t toRead = left < PIPELINE_CHUNK_SIZE ? (size_t)left : PIPELINE_CHUNK_SIZE;
+
+        uint64_t t = statsBegin();
+        bool readOk = readFile(pipeline->file, (char*)chunk->data, toRead, &chunk->size);
+        statsEnd(ARCH_STAGE_READ, t);
+
+        if (!readOk)
+        {
+            pipelineFail(pipeline, ARCH_ERR_IO);
+            break;
+        }
+
+        // Payload cut short by the end of the archive
+        if (chunk->size < toRead)
+        {
+            pipelineFail(pipeline, ARCH_ERR_CORRUPTED);
+            break;
+        }
+
+        t = statsBegin();
+        pipeline->crc = crc32(pipeline->crc, chunk->data, (uInt)chunk->size);
+        statsEnd(ARCH_STAGE_CHECKSUM, t);
+
+        STATS_ADD(bytesRead, chunk->size);
+
+        left -= chunk->size;
+        last = left == 0;
+
+        chunk->last = last;
+        ringPush(&pipeline->input.full, chunk);
+    }
+
+    stageLeave(&scope, pipeline, &pipeline->ioStats);
+}
+
+static ArchResult inflateResult(int ret)
+{
+    switch (ret)
+    {
+        case Z_MEM_ERROR:
+            return ARCH_ERR_OUT_OF_MEMORY;
+
+        case Z_DATA_ERROR:
+            return ARCH_ERR_CORRUPTED;
+
+        case Z_STREAM_ERROR:
+            return ARCH_ERR_INTERNAL;
+
+        default:
+            return ARCH_ERR_COMPRESSION;
+    }
+}
+
+static void inflateStage(void* arg)
+{
+    Pipeline* pipeline = arg;
+    z_stream* strm = &pipeline->strm;
+
+    StatsScope scope;
+    stageEnter(&scope, pipeline);
+
+    Chunk* out = NULL;
+    int ret = Z_OK;
+    bool last = false;
+
+    while (!last)
+    {
+        Chunk* in = ringPop(pipeline, &pipeline->input.full);
+        if (!in) goto cleanup;
+
+        last = in->last;
+
+        // Anything after the end of the deflate stream is only checksummed, as by the serial loop
+        strm->next_in = in->data;
+        strm->avail_in = (uInt)in->size;
+
+        // A chunk filled up may leave output pending in inflate even with no input left
+        while (ret != Z_STREAM_END && (strm->avail_in > 0 || !out))
+        {
+            if (!out)
+            {
+                out = ringPop(pipeline, &pipeline->output.empty);
+                if (!out) goto cleanup;
+
+                out->size = 0;
+                out->last = false;
+            }
+
+            strm->next_out = out->data + out->size;
+            strm->avail_out = (uInt)(PIPELINE_CHUNK_SIZE - out->size);
+
+            uLong consumedBefore = strm->total_in;
+
+            uint64_t t = statsBegin();
+            ret = inflate(strm, Z_NO_FLUSH);
+            statsEnd(ARCH_STAGE_DECOMPRESS, t);
+
+            if (ret == Z_BUF_ERROR)
+            {
+                ret = Z_OK;
+            }
+            else if (ret != Z_OK && ret != Z_STREAM_END)
+            {
+                fprintf(stderr, "inflate error: %d\n", ret);
+                pipelineFail(pipeline, inflateResult(ret));
+                goto cleanup;
+            }
+
+            atomic_fetch_add_explicit(&pipeline->bytesShared, strm->total_in - consumedBefore, memory_order_relaxed);
+
+            out->size = PIPELINE_CHUNK_SIZE - strm->avail_out;
+            if (out->size == PIPELINE_CHUNK_SIZE)
+            {
+                ringPush(&pipeline->output.full, out);
+                out = NULL;
+            }
+        }
+
+        ringPush(&pipeline->input.empty, in);
+    }
+
+    if (ret != Z_STREAM_END)
+    {
+        pipelineFail(pipeline, ARCH_ERR_CORRUPTED);
+        goto cleanup;
+    }
+
+    if (!out)
+    {
+        out = ringPop(pipeline, &pipeline->output.empty);
+        if (!out) goto cleanup;
+        out->size = 0;
+    }
+
+    out->last = true;
+    ringPush(&pipeline->output.full, out);
+
+cleanup:
+    stageLeave(&scope, pipeline, &pipeline->codecStats);
+}
+
+ArchResult pipelineDecompress(FILE* inFile, uint64_t compSize, StreamWriteFn write, void* context, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed)
+{
+    if (!inFile || !outCrcUncompressed || !outCrcCompressed)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    Pipeline pipeline;
+    if (!initPipeline(&pipeline))
+        return decompressStream(inFile, compSize, write, context, outCrcUncompressed, outCrcCompressed);
+
+    memoryBindStream(&pipeline.strm);
+
+    if (inflateInit(&pipeline.strm) != Z_OK)
+    {
+        destroyPipeline(&pipeline);
+        return ARCH_ERR_INTERNAL;
+    }
+
+    pipeline.file = inFile;
+    pipeline.compSize = compSize;
+
+    // An empty payload is no deflate stream, the codec finds out as soon as the reader says so
+    Thread codec, reader;
+    if (!startStages(&pipeline, inflateStage, readStage, &codec, &reader))
+    {
+        inflateEnd(&pipeline.strm);
+        destroyPipeline(&pipeline);
+        return decompressStream(inFile, compSize, write, context, outCrcUncompressed, outCrcCompressed);
+    }
+
+    // The calling thread writes, so the callback runs where it would without the pipeline
+    uint64_t reported = 0;
+    uint32_t crc = 0;
+
+    for (;;)
+    {
+        Chunk* chunk = ringPop(&pipeline, &pipeline.output.full);
+        if (!chunk) break;
+
+        bool last = chunk->last;
+
+        if (chunk->size > 0)
+        {
+            uint64_t t = statsBegin();
+            crc = crc32(crc, chunk->data, (uInt)chunk->size);
+            statsEnd(ARCH_STAGE_CHECKSUM, t);
+
+            if (write)
+            {
+                t = statsBegin();
+                bool writeOk = write(context, chunk->data, chunk->size);
+                statsEnd(ARCH_STAGE_WRITE, t);
+
+                if (!writeOk)
+                {
+                    pipelineFail(&pipeline, ARCH_ERR_IO);
+                    break;
+                }
+                STATS_ADD(bytesWritten, chunk->size);
+            }
+        }
+
+        if (!reportShared(&pipeline, &reported, write ? chunk->size : 0, true))
+        {
+            pipelineFail(&pipeline, ARCH_ERR_CANCELLED);
+            break;
+        }
+
+        ringPush(&pipeline.output.empty, chunk);
+        if (last) break;
+    }
+
+    joinStages(&pipeline, codec, reader);
+    inflateEnd(&pipeline.strm);
+
+    *outCrcUncompressed = crc;
+    *outCrcCompressed = pipeline.crc;
+
+    ArchResult result = (ArchResult)atomic_load(&pipeline.result);
+
+    destroyPipeline(&pipeline);
+    return result;
+}
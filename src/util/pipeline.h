@@ -0,0 +1,32 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <arch/arch_errors.h>
+
+#include "file.h"
+#include "page_cache.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Payloads from this size on are worth two extra threads
+#define PIPELINE_MIN_SIZE (4u << 20)
+
+// Streams run as three stages, each on a thread of its own, so reading, the codec and writing overlap
+// and one stream moves at the pace of its slowest stage rather than the sum of all three. Stages hand
+// chunks of 256 KiB to the next through single-producer single-consumer rings, and get them back
+// through a second ring for reuse. The calling thread is the stage that runs the caller's callback,
+// the other two are started per stream. Where threads or buffers can't be had, the serial loops of
+// file.h run instead.
+
+// compressStream with the caller reading (uncompressed CRC), deflate on one thread and the writes to
+// outFile (compressed CRC) on another. outFile belongs to the writer until the call returns, which also
+// paces its write-behind (may be NULL) after every chunk; the caller's source must leave it alone.
+bool pipelineCompress(StreamReadFn read, void* context, FILE* outFile, WriteBehind* writeBehind, uint64_t* outOrigSize, uint64_t* outCompSize, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed);
+
+// decompressStream with the reads from inFile (compressed CRC) on one thread, inflate on another and the
+// caller writing (uncompressed CRC). inFile belongs to the reader until the call returns.
+ArchResult pipelineDecompress(FILE* inFile, uint64_t compSize, StreamWriteFn write, void* context, uint32_t* outCrcUncompressed, uint32_t* outCrcCompressed);
+
+#endif // PIPELINE_H
@@ -0,0 +1,124 @@
+#include "progress.h"
+#include "clock.h"
+
+#include <string.h>
+
+ARCH_THREAD_LOCAL ProgressScope* currentProgress = NULL;
+
+bool progressInit(Progress* progress)
+{
+    memset(progress, 0, sizeof *progress);
+    return mutexInit(&progress->lock);
+}
+
+void progressDestroy(Progress* progress)
+{
+    mutexDestroy(&progress->lock);
+}
+
+void progressSetCallback(Progress* progress, ArchProgressCallback callback, void* userdata, uint32_t intervalMs)
+{
+    mutexLock(&progress->lock);
+
+    progress->callback = callback;
+    progress->userdata = userdata;
+    progress->intervalNs = (uint64_t)intervalMs * 1000000;
+    progress->lastReportNs = 0;
+    memset(&progress->totals, 0, sizeof progress->totals);
+    progress->cancelled = false;
+
+    mutexUnlock(&progress->lock);
+}
+
+static void mergeScope(ProgressScope* scope)
+{
+    Progress* progress = scope->progress;
+
+    progress->totals.bytesIn += scope->bytesIn;
+    progress->totals.bytesOut += scope->bytesOut;
+    progress->totals.entriesDone += scope->entriesDone;
+
+    scope->bytesIn = 0;
+    scope->bytesOut = 0;
+    scope->entriesDone = 0;
+    scope->cancelled = progress->cancelled;
+}
+
+void progressScopeEnter(ProgressScope* scope, Progress* progress)
+{
+    memset(scope, 0, sizeof *scope);
+    scope->previous = currentProgress;
+
+    if (!progress->callback)
+    {
+        currentProgress = NULL;
+        return;
+    }
+
+    scope->progress = progress;
+
+    mutexLock(&progress->lock);
+    scope->cancelled = progress->cancelled;
+    mutexUnlock(&progress->lock);
+
+    currentProgress = scope;
+}
+
+void progressScopeLeave(ProgressScope* scope)
+{
+    if (scope->progress)
+    {
+        mutexLock(&scope->progress->lock);
+        mergeScope(scope);
+        mutexUnlock(&scope->progress->lock);
+    }
+
+    currentProgress = scope->previous;
+}
+
+bool progressPoll(ProgressScope* scope)
+{
+    uint64_t now = clockNowNs();
+    if (now < scope->nextPollNs) return !scope->cancelled;
+
+    Progress* progress = scope->progress;
+
+    mutexLock(&progress->lock);
+    mergeScope(scope);
+
+    if (!progress->cancelled && now - progress->lastReportNs >= progress->intervalNs)
+    {
+        progress->lastReportNs = now;
+
+        ArchProgress snapshot = progress->totals;
+        snapshot.currentEntry = scope->entry;
+
+        // Called under the lock, so workers of a parallel call report one at a time
+        if (!progress->callback(progress->userdata, &snapshot))
+            progress->cancelled = true;
+    }
+
+    scope->cancelled = progress->cancelled;
+    scope->nextPollNs = now + progress->intervalNs;
+    mutexUnlock(&progress->lock);
+
+    return !scope->cancelled;
+}
+
+bool progressEntryBegin(const char* name)
+{
+    ProgressScope* scope = currentProgress;
+    if (!scope) return true;
+
+    scope->entry = name;
+    return progressPoll(scope);
+}
+
+void progressEntryEnd(bool completed)
+{
+    ProgressScope* scope = currentProgress;
+    if (!scope) return;
+
+    if (completed) scope->entriesDone++;
+    scope->entry = NULL;
+}
@@ -0,0 +1,67 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <arch/arch_progress.h>
+
+#include "thread.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Shared by every thread working on one archive
+typedef struct Progress
+{
+    Mutex lock;
+    ArchProgressCallback callback;
+    void* userdata;
+    uint64_t intervalNs;
+    uint64_t lastReportNs;
+    ArchProgress totals;
+    bool cancelled;
+} Progress;
+
+// Deltas of the calling thread, folded into the shared totals at most once per interval
+typedef struct ProgressScope
+{
+    Progress* progress;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    uint64_t entriesDone;
+    const char* entry;
+    uint64_t nextPollNs;
+    bool cancelled;
+    struct ProgressScope* previous;
+} ProgressScope;
+
+// Scope of the calling thread, NULL unless a callback is registered on the archive being worked on
+extern ARCH_THREAD_LOCAL ProgressScope* currentProgress;
+
+bool progressInit(Progress* progress);
+void progressDestroy(Progress* progress);
+void progressSetCallback(Progress* progress, ArchProgressCallback callback, void* userdata, uint32_t intervalMs);
+
+void progressScopeEnter(ProgressScope* scope, Progress* progress);
+void progressScopeLeave(ProgressScope* scope);
+
+// Returns false once the call has been cancelled
+bool progressPoll(ProgressScope* scope);
+
+bool progressEntryBegin(const char* name);
+void progressEntryEnd(bool completed);
+
+static inline bool progressAdvance(uint64_t bytesIn, uint64_t bytesOut)
+{
+    ProgressScope* scope = currentProgress;
+    if (!scope) return true;
+
+    scope->bytesIn += bytesIn;
+    scope->bytesOut += bytesOut;
+    return progressPoll(scope);
+}
+
+static inline bool progressCancelled(void)
+{
+    return currentProgress && currentProgress->cancelled;
+}
+
+#endif // PROGRESS_H
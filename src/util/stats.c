@@ -0,0 +1,31 @@
+#include "stats.h"
+
+#include <string.h>
+
+ARCH_THREAD_LOCAL ArchStats* currentStats = NULL;
+
+void statsScopeEnter(StatsScope* scope)
+{
+    memset(&scope->local, 0, sizeof scope->local);
+    scope->previous = currentStats;
+    currentStats = &scope->local;
+}
+
+void statsScopeLeave(StatsScope* scope)
+{
+    currentStats = scope->previous;
+}
+
+void statsMerge(ArchStats* into, const ArchStats* from)
+{
+    into->entries += from->entries;
+    into->bytesRead += from->bytesRead;
+    into->bytesWritten += from->bytesWritten;
+    into->uncompressedBytes += from->uncompressedBytes;
+    into->compressedBytes += from->compressedBytes;
+
+    for (int i = 0; i < ARCH_STAGE_COUNT; i++)
+    {
+        into->stageNs[i] += from->stageNs[i];
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <arch/arch_stats.h>
+
+#include "clock.h"
+#include "thread.h"
+#include "trace.h"
+
+#include <stdbool.h>
+
+// Counters of the calling thread, NULL while no archive call is in progress
+extern ARCH_THREAD_LOCAL ArchStats* currentStats;
+
+typedef struct StatsScope
+{
+    ArchStats local;
+    ArchStats* previous;
+} StatsScope;
+
+void statsScopeEnter(StatsScope* scope);
+void statsScopeLeave(StatsScope* scope);
+
+void statsMerge(ArchStats* into, const ArchStats* from);
+
+static inline uint64_t statsBegin(void)
+{
+    return (currentStats || TRACE_ACTIVE()) ? clockNowNs() : 0;
+}
+
+static inline void statsEnd(ArchStage stage, uint64_t start)
+{
+    if (currentStats) currentStats->stageNs[stage] += clockNowNs() - start;
+    TRACE_SPAN("stage", arch_stageName(stage), start);
+}
+
+#define STATS_ADD(field, amount) \
+    do { if (currentStats) currentStats->field += (amount); } while (0)
+
+#endif // STATS_H
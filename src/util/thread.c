@@ -0,0 +1,168 @@
+#include "thread.h"
+#include "memory.h"
+
+#include <stdlib.h>
+
+#ifndef _WIN32
+    #include <sched.h>
+    #include <time.h>
+    #include <unistd.h>
+#endif
+
+typedef struct ThreadStart
+{
+    ThreadFn fn;
+    void* arg;
+} ThreadStart;
+
+#ifdef _WIN32
+static DWORD WINAPI threadTrampoline(LPVOID param)
+#else
+static void* threadTrampoline(void* param)
+#endif
+{
+    ThreadStart start = *(ThreadStart*)param;
+    memFree(param);
+
+    start.fn(start.arg);
+    return 0;
+}
+
+bool threadCreate(Thread* thread, ThreadFn fn, void* arg)
+{
+    if (!thread || !fn) return false;
+
+    ThreadStart* start = memAlloc(sizeof *start);
+    if (!start) return false;
+
+    start->fn = fn;
+    start->arg = arg;
+
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, threadTrampoline, start, 0, NULL);
+    if (!*thread)
+#else
+    if (pthread_create(thread, NULL, threadTrampoline, start) != 0)
+#endif
+    {
+        memFree(start);
+        return false;
+    }
+
+    return true;
+}
+
+void threadJoin(Thread thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+void threadYield(void)
+{
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+void threadSleep(unsigned microseconds)
+{
+#ifdef _WIN32
+    Sleep((microseconds + 999) / 1000);
+#else
+    struct timespec duration = { microseconds / 1000000, (long)(microseconds % 1000000) * 1000 };
+    nanosleep(&duration, NULL);
+#endif
+}
+
+bool mutexInit(Mutex* mutex)
+{
+#ifdef _WIN32
+    InitializeCriticalSection(mutex);
+    return true;
+#else
+    return pthread_mutex_init(mutex, NULL) == 0;
+#endif
+}
+
+void mutexLock(Mutex* mutex)
+{
+#ifdef _WIN32
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+void mutexUnlock(Mutex* mutex)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+void mutexDestroy(Mutex* mutex)
+{
+#ifdef _WIN32
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+bool condInit(Cond* cond)
+{
+#ifdef _WIN32
+    InitializeConditionVariable(cond);
+    return true;
+#else
+    return pthread_cond_init(cond, NULL) == 0;
+#endif
+}
+
+void condWait(Cond* cond, Mutex* mutex)
+{
+#ifdef _WIN32
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+void condBroadcast(Cond* cond)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+void condDestroy(Cond* cond)
+{
+#ifdef _WIN32
+    (void)cond;
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+unsigned getCpuCount(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (unsigned)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned)count : 1;
+#endif
+}
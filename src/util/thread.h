@@ -0,0 +1,48 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdbool.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+
+    typedef HANDLE Thread;
+    typedef CRITICAL_SECTION Mutex;
+    typedef CONDITION_VARIABLE Cond;
+#else
+    #include <pthread.h>
+
+    typedef pthread_t Thread;
+    typedef pthread_mutex_t Mutex;
+    typedef pthread_cond_t Cond;
+#endif
+
+#ifdef _MSC_VER
+    #define ARCH_THREAD_LOCAL __declspec(thread)
+#else
+    #define ARCH_THREAD_LOCAL _Thread_local
+#endif
+
+typedef void (*ThreadFn)(void* arg);
+
+bool threadCreate(Thread* thread, ThreadFn fn, void* arg);
+void threadJoin(Thread thread);
+
+// Back-off for threads polling on one another: give up the time slice, or sleep a while
+void threadYield(void);
+void threadSleep(unsigned microseconds);
+
+bool mutexInit(Mutex* mutex);
+void mutexLock(Mutex* mutex);
+void mutexUnlock(Mutex* mutex);
+void mutexDestroy(Mutex* mutex);
+
+// For waits that may last, where polling would burn a core. condWait may wake spuriously, check again.
+bool condInit(Cond* cond);
+void condWait(Cond* cond, Mutex* mutex);
+void condBroadcast(Cond* cond);
+void condDestroy(Cond* cond);
+
+unsigned getCpuCount(void);
+
+#endif // THREAD_H
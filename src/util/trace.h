@@ -0,0 +1,29 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "clock.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef ARCH_ENABLE_TRACE
+
+extern bool traceEnabled;
+
+// name is copied (and truncated), so it may point at transient strings such as entry names
+void traceSpan(const char* category, const char* name, uint64_t startNs);
+
+    #define TRACE_ACTIVE() (traceEnabled)
+    #define TRACE_NOW() (traceEnabled ? clockNowNs() : 0)
+    #define TRACE_SPAN(category, name, startNs) \
+        do { if (traceEnabled) traceSpan((category), (name), (startNs)); } while (0)
+
+#else
+
+    #define TRACE_ACTIVE() (false)
+    #define TRACE_NOW() ((uint64_t)0)
+    #define TRACE_SPAN(category, name, startNs) do { } while (0)
+
+#endif
+
+#endif // TRACE_H
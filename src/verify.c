@@ -0,0 +1,211 @@
+#include <arch/unarchiver.h>
+
+#include "entry_reader.h"
+#include "core/archive.h"
+#include "core/entry_table.h"
+#include "core/file_header.h"
+#include "util/clock.h"
+#include "util/file.h"
+#include "util/thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct VerifyJob
+{
+    Archive* archive;
+    const EntryTable* table;
+    ArchVerifyEntry* results;
+
+    Mutex lock;
+    size_t nextIndex;
+} VerifyJob;
+
+static ArchResult verifyEntry(Archive* archive, FILE* file, size_t index, const EntryRecord* record)
+{
+    const FileHeader* header = &record->header;
+
+    if (!progressEntryBegin(record->name))
+        return ARCH_ERR_CANCELLED;
+
+    ArchResult result = ARCH_OK;
+
+    if (fileHeaderNeedsReader(header))
+    {
+        result = streamEntry(archive, index, NULL, NULL);
+    }
+    else if (record->dataOffset > INT64_MAX || fseek64(file, (int64_t)record->dataOffset, SEEK_SET) != 0)
+    {
+        result = ARCH_ERR_IO;
+    }
+    else if (header->flags & ARCH_FLAG_COMPRESSED)
+    {
+        uint32_t crcUncompressed = 0;
+        uint32_t crcCompressed = 0;
+
+        result = decompressStream(file, header->compSize, NULL, NULL, &crcUncompressed, &crcCompressed);
+
+        if (result == ARCH_OK && (crcUncompressed != header->crc32_uncompressed || crcCompressed != header->crc32_compressed))
+            result = ARCH_ERR_CORRUPTED;
+    }
+    else
+    {
+        uint32_t crc = 0;
+
+        if (!copyFileData(file, NULL, header->origSize, &crc))
+            result = progressCancelled() ? ARCH_ERR_CANCELLED : ARCH_ERR_CORRUPTED;
+        else if (crc != header->crc32_uncompressed)
+            result = ARCH_ERR_CORRUPTED;
+    }
+
+    progressEntryEnd(result == ARCH_OK);
+
+    if (result != ARCH_OK)
+        return result;
+
+    STATS_ADD(entries, 1);
+    STATS_ADD(uncompressedBytes, header->origSize);
+    STATS_ADD(compressedBytes, getFileHeaderPayloadSize(header));
+    return ARCH_OK;
+}
+
+static void verifyWorker(void* arg)
+{
+    VerifyJob* job = arg;
+
+    ArchiveCall call;
+    enterArchiveCall(job->archive, &call);
+
+    // Every worker reads through its own handle, so seeks don't interfere
+    uint64_t t = statsBegin();
+    FILE* file = openArchiveStream(job->archive);
+    statsEnd(ARCH_STAGE_OPEN, t);
+
+    for (;;)
+    {
+        mutexLock(&job->lock);
+        size_t index = job->nextIndex++;
+        mutexUnlock(&job->lock);
+
+        if (index >= job->table->count) break;
+
+        uint64_t traceStart = TRACE_NOW();
+        job->results[index].result = file ? verifyEntry(job->archive, file, index, &job->table->entries[index]) : ARCH_ERR_IO;
+        TRACE_SPAN("entry", job->table->entries[index].name, traceStart);
+    }
+
+    if (file) fclose(file);
+
+    leaveArchiveCall(job->archive, &call);
+}
+
+ArchResult arch_verify(Archive* archive, unsigned threadCount, ArchVerifyReport* outReport)
+{
+    if (!archive || !outReport || !archive->readOnly)
+        return ARCH_ERR_INVALID_ARGUMENT;
+
+    memset(outReport, 0, sizeof *outReport);
+
+    uint64_t start = clockNowNs();
+
+    const EntryTable* table = getArchiveEntryTable(archive);
+    if (!table)
+        return ARCH_ERR_CORRUPTED;
+
+    if (table->count > 0)
+    {
+        // The report belongs to the caller and may outlive the archive, it comes from the C heap
+        outReport->entries = calloc(table->count, sizeof *outReport->entries);
+        if (!outReport->entries)
+            return ARCH_ERR_OUT_OF_MEMORY;
+    }
+    outReport->entryCount = table->count;
+
+    for (size_t i = 0; i < table->count; i++)
+    {
+        const EntryRecord* record = &table->entries[i];
+
+        outReport->entries[i].name = record->name;
+        outReport->entries[i].origSize = record->header.origSize;
+        outReport->entries[i].compSize = getFileHeaderPayloadSize(&record->header);
+    }
+
+    if (threadCount == 0) threadCount = getCpuCount();
+    if (threadCount > table->count) threadCount = table->count > 0 ? (unsigned)table->count : 1;
+
+    VerifyJob job = {
+        .archive = archive,
+        .table = table,
+        .results = outReport->entries,
+        .nextIndex = 0
+    };
+
+    if (!mutexInit(&job.lock))
+    {
+        arch_freeVerifyReport(outReport);
+        return ARCH_ERR_INTERNAL;
+    }
+
+    Thread* threads = memCalloc(threadCount, sizeof *threads);
+    unsigned started = 0;
+
+    if (threads)
+    {
+        for (; started < threadCount - 1; started++)
+        {
+            if (!threadCreate(&threads[started], verifyWorker, &job)) break;
+        }
+    }
+
+    // The calling thread works too, and alone covers for any worker that failed to start
+    verifyWorker(&job);
+
+    for (unsigned i = 0; i < started; i++)
+    {
+        threadJoin(threads[i]);
+    }
+
+    memFree(threads);
+    mutexDestroy(&job.lock);
+
+    bool cancelled = false;
+
+    for (size_t i = 0; i < outReport->entryCount; i++)
+    {
+        const ArchVerifyEntry* entry = &outReport->entries[i];
+
+        if (entry->result == ARCH_ERR_CANCELLED)
+        {
+            cancelled = true;
+            continue;
+        }
+
+        if (entry->result != ARCH_OK)
+        {
+            outReport->failedCount++;
+            continue;
+        }
+
+        outReport->bytesRead += entry->compSize;
+        outReport->bytesVerified += entry->origSize;
+    }
+
+    outReport->seconds = (double)(clockNowNs() - start) / 1e9;
+    if (outReport->seconds > 0)
+    {
+        outReport->throughputMBps = (double)outReport->bytesVerified / (1024.0 * 1024.0) / outReport->seconds;
+    }
+
+    if (cancelled)
+        return ARCH_ERR_CANCELLED;
+
+    return outReport->failedCount > 0 ? ARCH_ERR_CORRUPTED : ARCH_OK;
+}
+
+void arch_freeVerifyReport(ArchVerifyReport* report)
+{
+    if (!report) return;
+
+    free(report->entries);
+    memset(report, 0, sizeof *report);
+}
@@ -1,22 +1,814 @@
 #include <arch/archiver.h>
 #include <arch/unarchiver.h>
 #include <arch/arch_errors.h>
+#include <arch/arch_trace.h>
 
 #include "../src/util/file.h"
 
 #include <locale.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool showStats = false;
+static bool showProgress = false;
+static uint64_t volumeSize = 0;
+static size_t memoryLimit = 0;
+static ArchInputOrder inputOrder = ARCH_ORDER_SCAN;
+static uint64_t longMatchWindow = 0;
+static bool compactMetadata = false;
+static uint64_t storeAlignment = 0;
+static ArchIoMode ioMode = ARCH_IO_BUFFERED;
+static const char* baseArchive = NULL;
+static ArchMergeConflict mergeConflict = ARCH_MERGE_KEEP_ALL;
+
+// Byte count with an optional K, M or G suffix, 0 when malformed
+static uint64_t parseSize(const char* text)
+{
+    char* end;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    switch (*end)
+    {
+        case 'K': case 'k': value <<= 10; end++; break;
+        case 'M': case 'm': value <<= 20; end++; break;
+        case 'G': case 'g': value <<= 30; end++; break;
+        default: break;
+    }
+
+    return *end == '\0' ? (uint64_t)value : 0;
+}
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void onInterrupt(int sig)
+{
+    (void)sig;
+    interrupted = 1;
+}
+
+static bool reportProgress(void* userdata, const ArchProgress* progress)
+{
+    (void)userdata;
+
+    if (showProgress)
+    {
+        fprintf(stderr, "\r%llu entries, %.1f MB in, %.1f MB out  %-40.40s",
+            (unsigned long long)progress->entriesDone,
+            (double)progress->bytesIn / (1024.0 * 1024.0),
+            (double)progress->bytesOut / (1024.0 * 1024.0),
+            progress->currentEntry ? progress->currentEntry : "");
+    }
+
+    // Ctrl+C stops at the next chunk, what was completed so far is kept
+    return !interrupted;
+}
+
+static void watchArchive(Archive* archive)
+{
+    arch_setProgressCallback(archive, reportProgress, NULL, 250);
+}
+
+static ArchResult openArchive(const char* path, Archive** outArchive)
+{
+    ArchOpenOptions options = { .memory.memoryLimit = memoryLimit, .baseArchive = baseArchive };
+    return arch_openEx(path, &options, outArchive);
+}
+
+static void printStats(Archive* archive)
+{
+    ArchStats stats;
+    if (arch_getStats(archive, &stats) != ARCH_OK) return;
+
+    uint64_t totalNs = 0;
+    for (int i = 0; i < ARCH_STAGE_COUNT; ++i) totalNs += stats.stageNs[i];
+
+    fprintf(stderr, "\n--- stats ---\n");
+    fprintf(stderr, "entries:            %llu\n", (unsigned long long)stats.entries);
+    fprintf(stderr, "bytes read:         %llu\n", (unsigned long long)stats.bytesRead);
+    fprintf(stderr, "bytes written:      %llu\n", (unsigned long long)stats.bytesWritten);
+    fprintf(stderr, "uncompressed bytes: %llu\n", (unsigned long long)stats.uncompressedBytes);
+    fprintf(stderr, "compressed bytes:   %llu\n", (unsigned long long)stats.compressedBytes);
+
+    size_t currentMemory, peakMemory;
+    if (arch_getMemoryUsage(archive, &currentMemory, &peakMemory) == ARCH_OK)
+        fprintf(stderr, "peak memory:        %zu\n", peakMemory);
+
+    for (int i = 0; i < ARCH_STAGE_COUNT; ++i)
+    {
+        fprintf(stderr, "%-11s %12.3f ms %6.1f%%\n", arch_stageName((ArchStage)i),
+            (double)stats.stageNs[i] / 1e6,
+            totalNs > 0 ? 100.0 * (double)stats.stageNs[i] / (double)totalNs : 0.0);
+    }
+}
+
+static void closeArchive(Archive* archive)
+{
+    if (showProgress) fprintf(stderr, "\n");
+    if (showStats && archive) printStats(archive);
+    arch_close(archive);
+}
+
+static int listArchive(const char* archiveFilePath)
+{
+    Archive* archive = NULL;
+
+    ArchResult r = openArchive(archiveFilePath, &archive);
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to open archive: %s\n", arch_strerror(r));
+        return 1;
+    }
+
+    watchArchive(archive);
+
+    printf("%12s %12s %8s  %s\n", "Size", "Packed", "CRC32", "Name");
+
+    uint64_t totalOrig = 0;
+    uint64_t totalComp = 0;
+
+    // From the directory, the entries themselves aren't read
+    size_t fileCount = arch_getFileCount(archive);
+    for (size_t i = 1; i <= fileCount; ++i)
+    {
+        ArchEntryInfo info;
+        r = arch_getEntryInfo(archive, i - 1, &info);
+        if (r != ARCH_OK)
+        {
+            fprintf(stderr, "arch: Failed to read entry #%zu: %s\n", i, arch_strerror(r));
+            closeArchive(archive);
+            return 1;
+        }
+
+        printf("%12llu %12llu %08x  %s\n",
+            (unsigned long long)info.origSize, (unsigned long long)info.compSize,
+            (unsigned)info.crc32_uncompressed, info.name);
+
+        totalOrig += info.origSize;
+        totalComp += info.compSize;
+    }
+
+    printf("%12llu %12llu %8s  %zu file(s)\n", (unsigned long long)totalOrig, (unsigned long long)totalComp, "", fileCount);
+
+    closeArchive(archive);
+    return 0;
+}
+
+typedef struct DirListing
+{
+    size_t files;
+    size_t directories;
+} DirListing;
+
+static bool printDirEntry(void* userdata, const ArchDirEntry* entry)
+{
+    DirListing* listing = userdata;
+
+    if (entry->isDirectory)
+    {
+        printf("%12s %12s %8s  %s/\n", "", "", "", entry->name);
+        listing->directories++;
+    }
+    else
+    {
+        printf("%12llu %12llu %08x  %s\n",
+            (unsigned long long)entry->info.origSize, (unsigned long long)entry->info.compSize,
+            (unsigned)entry->info.crc32_uncompressed, entry->name);
+        listing->files++;
+    }
+
+    return true;
+}
+
+// One entry, or the immediate children of a directory
+static int listPath(const char* archiveFilePath, const char* path)
+{
+    Archive* archive = NULL;
+
+    ArchResult r = openArchive(archiveFilePath, &archive);
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to open archive: %s\n", arch_strerror(r));
+        return 1;
+    }
+
+    ArchDirEntry entry;
+    r = arch_stat(archive, path, &entry);
+
+    if (r == ARCH_OK)
+    {
+        printf("%12s %12s %8s  %s\n", "Size", "Packed", "CRC32", "Name");
+
+        if (entry.isDirectory)
+        {
+            DirListing listing = {0};
+            r = arch_listDir(archive, path, printDirEntry, &listing);
+            if (r == ARCH_OK)
+                printf("%12s %12s %8s  %zu file(s), %zu director%s\n", "", "", "", listing.files, listing.directories, listing.directories == 1 ? "y" : "ies");
+        }
+        else
+        {
+            printDirEntry(&(DirListing){0}, &entry);
+        }
+    }
+
+    if (r != ARCH_OK)
+        fprintf(stderr, "arch: Failed to look up '%s': %s\n", path, r == ARCH_ERR_INVALID_ARGUMENT ? "No such file or directory" : arch_strerror(r));
+
+    closeArchive(archive);
+    return r == ARCH_OK ? 0 : 1;
+}
+
+static int extractMatching(const char* archiveFilePath, const char* const* patterns, size_t patternCount)
+{
+    Archive* archive = NULL;
+
+    ArchResult r = openArchive(archiveFilePath, &archive);
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to open archive: %s\n", arch_strerror(r));
+        return 1;
+    }
+
+    watchArchive(archive);
+
+    char* outputDir = getFileName(archiveFilePath, true);
+    if (!outputDir || (MKDIR(outputDir) != 0 && !isDirectory(outputDir)))
+    {
+        perror("arch: Failed to create output directory");
+        free(outputDir);
+        closeArchive(archive);
+        return 1;
+    }
+
+    r = arch_extractMatching(archive, outputDir, patterns, patternCount);
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to extract matching files: %s\n", arch_strerror(r));
+    }
+
+    free(outputDir);
+    closeArchive(archive);
+    return r == ARCH_OK ? 0 : 1;
+}
+
+static int verifyArchive(const char* archiveFilePath, unsigned threadCount)
+{
+    Archive* archive = NULL;
+
+    ArchResult r = openArchive(archiveFilePath, &archive);
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to open archive: %s\n", arch_strerror(r));
+        return 1;
+    }
+
+    watchArchive(archive);
+
+    ArchVerifyReport report;
+    r = arch_verify(archive, threadCount, &report);
+
+    for (size_t i = 0; i < report.entryCount; ++i)
+    {
+        const ArchVerifyEntry* entry = &report.entries[i];
+        if (entry->result != ARCH_OK)
+        {
+            printf("FAILED  %s: %s\n", entry->name, arch_strerror(entry->result));
+        }
+    }
+
+    if (r == ARCH_OK || report.entryCount > 0)
+    {
+        printf("%zu entries, %zu failed, %llu bytes verified in %.3f s (%.1f MB/s)\n",
+            report.entryCount, report.failedCount, (unsigned long long)report.bytesVerified,
+            report.seconds, report.throughputMBps);
+    }
+
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Verification failed: %s\n", arch_strerror(r));
+    }
+
+    arch_freeVerifyReport(&report);
+    closeArchive(archive);
+    return r == ARCH_OK ? 0 : 1;
+}
+
+static int extractAll(const char* archiveFilePath, unsigned threadCount)
+{
+    Archive* archive = NULL;
+
+    ArchResult r = openArchive(archiveFilePath, &archive);
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to open archive: %s\n", arch_strerror(r));
+        return 1;
+    }
+
+    watchArchive(archive);
+
+    char* outputDir = getFileName(archiveFilePath, true);
+    if (!outputDir || (MKDIR(outputDir) != 0 && !isDirectory(outputDir)))
+    {
+        perror("arch: Failed to create output directory");
+        free(outputDir);
+        closeArchive(archive);
+        return 1;
+    }
+
+    r = arch_extractAll(archive, outputDir, threadCount);
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to extract: %s\n", arch_strerror(r));
+    }
+
+    free(outputDir);
+    closeArchive(archive);
+    return r == ARCH_OK ? 0 : 1;
+}
+
+static int buildIndex(const char* archiveFilePath, uint64_t span)
+{
+    Archive* archive = NULL;
+
+    ArchResult r = openArchive(archiveFilePath, &archive);
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to open archive: %s\n", arch_strerror(r));
+        return 1;
+    }
+
+    r = arch_buildAccessIndex(archive, span, NULL);
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to build the access index: %s\n", arch_strerror(r));
+    }
+
+    closeArchive(archive);
+    return r == ARCH_OK ? 0 : 1;
+}
+
+// Writes a byte range of one entry to stdout, through the access index when one was built
+static int readRange(const char* archiveFilePath, size_t entryIndex, uint64_t offset, uint64_t length)
+{
+    Archive* archive = NULL;
+
+    ArchResult r = openArchive(archiveFilePath, &archive);
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to open archive: %s\n", arch_strerror(r));
+        return 1;
+    }
+
+    arch_loadAccessIndex(archive, NULL);
+
+    char buffer[65536];
+    while (length > 0)
+    {
+        size_t chunk = length < sizeof buffer ? (size_t)length : sizeof buffer;
+        size_t bytesRead;
+
+        r = arch_readRange(archive, entryIndex, offset, buffer, chunk, &bytesRead);
+        if (r != ARCH_OK || bytesRead == 0) break;
+
+        fwrite(buffer, 1, bytesRead, stdout);
+        offset += bytesRead;
+        length -= bytesRead;
+    }
+
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to read range: %s\n", arch_strerror(r));
+    }
+
+    closeArchive(archive);
+    return r == ARCH_OK ? 0 : 1;
+}
+
+static int createDelta(const char* deltaPath, const char* basePath, const char* newDir)
+{
+    ArchCreateOptions options = {
+        .memory.memoryLimit = memoryLimit,
+        .inputOrder = inputOrder,
+        .longMatchWindow = longMatchWindow,
+        .compactMetadata = compactMetadata
+    };
+
+    ArchResult r = arch_createDelta(newDir, basePath, deltaPath, &options);
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to create delta: %s\n", arch_strerror(r));
+    }
+    return r == ARCH_OK ? 0 : 1;
+}
+
+static int applyDelta(const char* deltaPath, const char* basePath, const char* outPath)
+{
+    ArchResult r = arch_applyDelta(deltaPath, basePath, outPath);
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to apply delta: %s\n", arch_strerror(r));
+    }
+    return r == ARCH_OK ? 0 : 1;
+}
+
+static void reportMergeConflict(void* userdata, const char* name, size_t copies)
+{
+    (void)userdata;
+    fprintf(stderr, "arch: Duplicate entry '%s' (%zu copies)\n", name, copies);
+}
+
+static int mergeArchives(const char* outPath, const char* const* inputs, size_t inputCount)
+{
+    ArchMergeOptions options = {
+        .conflictPolicy = mergeConflict,
+        // The other policies resolve duplicates, only a failing merge names them
+        .conflictCallback = mergeConflict == ARCH_MERGE_FAIL ? reportMergeConflict : NULL
+    };
+
+    ArchResult r = arch_mergeEx(outPath, inputs, inputCount, &options);
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to merge archives: %s\n", arch_strerror(r));
+    }
+    return r == ARCH_OK ? 0 : 1;
+}
+
+// -A, -D, -R and -C: changes to an existing archive, which is only rewritten where they touch it
+static int updateArchive(const char* archiveFilePath, char command, const char* const* args, size_t argCount)
+{
+    ArchCreateOptions options = {
+        .memory.memoryLimit = memoryLimit,
+        .inputOrder = inputOrder
+    };
+
+    Archive* archive = NULL;
+    ArchResult r = arch_openForUpdate(archiveFilePath, &options, &archive);
+    if (r != ARCH_OK)
+    {
+        fprintf(stderr, "arch: Failed to open archive for update: %s\n", arch_strerror(r));
+        return 1;
+    }
+
+    watchArchive(archive);
+
+    int status = 0;
+
+    switch (command)
+    {
+        case 'A':
+            for (size_t i = 0; i < argCount && r != ARCH_ERR_CANCELLED; ++i)
+            {
+                r = isDirectory(args[i]) ? arch_addDirectory(archive, args[i]) : arch_addFile(archive, args[i]);
+                if (r != ARCH_OK)
+                {
+                    fprintf(stderr, "arch: Failed to add '%s': %s\n", args[i], arch_strerror(r));
+                    status = 1;
+                }
+            }
+            break;
+
+        case 'D':
+            for (size_t i = 0; i < argCount; ++i)
+            {
+                r = arch_removeEntry(archive, args[i]);
+                if (r != ARCH_OK)
+                {
+                    fprintf(stderr, "arch: Failed to remove '%s': %s\n", args[i], arch_strerror(r));
+                    status = 1;
+                }
+            }
+            break;
+
+        case 'R':
+            r = arch_replaceEntry(archive, args[0], args[1]);
+            if (r != ARCH_OK)
+            {
+                fprintf(stderr, "arch: Failed to replace '%s': %s\n", args[0], arch_strerror(r));
+                status = 1;
+            }
+            break;
+
+        default:
+            r = arch_compact(archive);
+            if (r != ARCH_OK)
+            {
+                fprintf(stderr, "arch: Failed to compact: %s\n", arch_strerror(r));
+                status = 1;
+            }
+            break;
+    }
+
+    closeArchive(archive);
+    return status;
+}
+
+static int runCommand(int argc, char** argv, const char* program);
 
 int main(int argc, char** argv)
 {
     setlocale(LC_ALL, "");
 
+    const char* program = argv[0];
+    const char* tracePath = NULL;
+
+    // Global options come first
+    while (argc > 1 && strncmp(argv[1], "--", 2) == 0)
+    {
+        if (strcmp(argv[1], "--stats") == 0)
+        {
+            showStats = true;
+        }
+        else if (strcmp(argv[1], "--progress") == 0)
+        {
+            showProgress = true;
+        }
+        else if (strcmp(argv[1], "--compact") == 0)
+        {
+            compactMetadata = true;
+        }
+        else if (strcmp(argv[1], "--split") == 0 && argc > 2)
+        {
+            volumeSize = parseSize(argv[2]);
+            if (volumeSize == 0)
+            {
+                fprintf(stderr, "arch: Invalid volume size '%s'\n", argv[2]);
+                return 1;
+            }
+            argv++;
+            argc--;
+        }
+        else if (strcmp(argv[1], "--align") == 0 && argc > 2)
+        {
+            storeAlignment = parseSize(argv[2]);
+            if (storeAlignment == 0 || (storeAlignment & (storeAlignment - 1)) != 0)
+            {
+                fprintf(stderr, "arch: Invalid alignment '%s'\n", argv[2]);
+                return 1;
+            }
+            argv++;
+            argc--;
+        }
+        else if (strcmp(argv[1], "--memory") == 0 && argc > 2)
+        {
+            uint64_t limit = parseSize(argv[2]);
+            if (limit == 0 || limit > SIZE_MAX)
+            {
+                fprintf(stderr, "arch: Invalid memory limit '%s'\n", argv[2]);
+                return 1;
+            }
+            memoryLimit = (size_t)limit;
+            argv++;
+            argc--;
+        }
+        else if (strcmp(argv[1], "--order") == 0 && argc > 2)
+        {
+            if (strcmp(argv[2], "scan") == 0) inputOrder = ARCH_ORDER_SCAN;
+            else if (strcmp(argv[2], "inode") == 0) inputOrder = ARCH_ORDER_INODE;
+            else if (strcmp(argv[2], "disk") == 0) inputOrder = ARCH_ORDER_PHYSICAL;
+            else if (strcmp(argv[2], "type") == 0) inputOrder = ARCH_ORDER_TYPE;
+            else
+            {
+                fprintf(stderr, "arch: Unknown order '%s'\n", argv[2]);
+                return 1;
+            }
+            argv++;
+            argc--;
+        }
+        else if (strcmp(argv[1], "--io") == 0 && argc > 2)
+        {
+            if (strcmp(argv[2], "buffered") == 0) ioMode = ARCH_IO_BUFFERED;
+            else if (strcmp(argv[2], "streaming") == 0) ioMode = ARCH_IO_STREAMING;
+            else if (strcmp(argv[2], "direct") == 0) ioMode = ARCH_IO_DIRECT;
+            else
+            {
+                fprintf(stderr, "arch: Unknown I/O mode '%s'\n", argv[2]);
+                return 1;
+            }
+            argv++;
+            argc--;
+        }
+        else if (strcmp(argv[1], "--long") == 0 && argc > 2)
+        {
+            longMatchWindow = parseSize(argv[2]);
+            if (longMatchWindow == 0)
+            {
+                fprintf(stderr, "arch: Invalid long match window '%s'\n", argv[2]);
+                return 1;
+            }
+            argv++;
+            argc--;
+        }
+        else if (strcmp(argv[1], "--conflict") == 0 && argc > 2)
+        {
+            if (strcmp(argv[2], "all") == 0) mergeConflict = ARCH_MERGE_KEEP_ALL;
+            else if (strcmp(argv[2], "first") == 0) mergeConflict = ARCH_MERGE_KEEP_FIRST;
+            else if (strcmp(argv[2], "last") == 0) mergeConflict = ARCH_MERGE_KEEP_LAST;
+            else if (strcmp(argv[2], "fail") == 0) mergeConflict = ARCH_MERGE_FAIL;
+            else
+            {
+                fprintf(stderr, "arch: Unknown conflict policy '%s'\n", argv[2]);
+                return 1;
+            }
+            argv++;
+            argc--;
+        }
+        else if (strcmp(argv[1], "--base") == 0 && argc > 2)
+        {
+            baseArchive = argv[2];
+            argv++;
+            argc--;
+        }
+        else if (strcmp(argv[1], "--trace") == 0 && argc > 2)
+        {
+            tracePath = argv[2];
+            argv++;
+            argc--;
+        }
+        else
+        {
+            fprintf(stderr, "arch: Unknown option '%s'\n", argv[1]);
+            return 1;
+        }
+
+        argv++;
+        argc--;
+    }
+
+    if (tracePath)
+    {
+        ArchResult r = arch_traceStart(1u << 20);
+        if (r != ARCH_OK)
+        {
+            fprintf(stderr, "arch: Tracing unavailable: %s\n", arch_strerror(r));
+            return 1;
+        }
+    }
+
+    signal(SIGINT, onInterrupt);
+
+    int status = runCommand(argc, argv, program);
+
+    if (tracePath)
+    {
+        arch_traceStop();
+
+        ArchResult r = arch_traceWrite(tracePath);
+        if (r != ARCH_OK)
+        {
+            fprintf(stderr, "arch: Failed to write trace '%s': %s\n", tracePath, arch_strerror(r));
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+static int runCommand(int argc, char** argv, const char* program)
+{
     if (argc < 2)
     {
-        printf("Usage: %s [archive_name] [file1] [file2]...\n", argv[0]);
+        printf("Usage: %s [options] [archive_name] [file1] [file2]...\n", program);
+        printf("       %s [options] -l [archive_name] [path]\n", program);
+        printf("       %s [options] -x [archive_name] [pattern1] [pattern2]...\n", program);
+        printf("       %s [options] -t [archive_name] [threads]\n", program);
+        printf("       %s [options] -X [archive_name] [threads]\n", program);
+        printf("       %s [options] -i [archive_name] [span]\n", program);
+        printf("       %s [options] -r [archive_name] [entry#] [offset] [length]\n", program);
+        printf("       %s [options] -d [delta_name] [base_archive] [directory]\n", program);
+        printf("       %s [options] -a [delta_name] [base_archive] [archive_name]\n", program);
+        printf("       %s [options] -m [archive_name] [input1] [input2]...\n", program);
+        printf("       %s [options] -A [archive_name] [file1] [file2]...\n", program);
+        printf("       %s [options] -D [archive_name] [entry1] [entry2]...\n", program);
+        printf("       %s [options] -R [archive_name] [entry] [file]\n", program);
+        printf("       %s [options] -C [archive_name]\n", program);
+        printf("Options:\n");
+        printf("  --stats           Print per-stage timings and counters at the end of the run\n");
+        printf("  --progress        Show a progress line while working (Ctrl+C stops cleanly)\n");
+        printf("  --trace out.json  Record a Chrome trace / Perfetto timeline of the run\n");
+        printf("  --split SIZE      Create name.001, name.002, ... of at most SIZE bytes (K/M/G suffixes)\n");
+        printf("  --memory SIZE     Keep the library's allocations for the archive under SIZE bytes\n");
+        printf("  --order MODE      File order within added directories: scan, inode, disk or type\n");
+        printf("  --io MODE         Input and archive I/O: buffered, streaming (drops what it is done with) or direct\n");
+        printf("  --long SIZE       Find repeats across files within the last SIZE bytes (8M and up)\n");
+        printf("  --compact         Write the compact directory, for trees of many small files (version 5)\n");
+        printf("  --align SIZE      Store files uncompressed, each starting at a multiple of SIZE (4K, 2M) for mmap\n");
+        printf("  --base ARCHIVE    Base archive of the delta being read, listed, verified or extracted\n");
+        printf("  --conflict MODE   Names found in several merged inputs: all, first, last or fail\n");
+        printf("  -l                List all entries, or with a path that entry or the children of that directory\n");
+        printf("  -X                Extract everything in parallel, one split volume per thread\n");
+        printf("  -i                Build the random access index (archive.zidx), a point every span bytes\n");
+        printf("  -r                Write a byte range of an entry (0-based, as listed by -l) to stdout\n");
+        printf("  -d                Archive a directory as a delta against a base archive (--long sets the window)\n");
+        printf("  -a                Rebuild the full archive from a delta and its base\n");
+        printf("  -m                Merge archives into a new one without recompressing\n");
+        printf("  -A, -D, -R        Add files to, remove entries from or replace an entry of an existing archive\n");
+        printf("  -C                Compact an archive, closing the gaps removed entries left\n");
         return 1;
     }
 
+    if (strcmp(argv[1], "-l") == 0)
+    {
+        if (argc != 3 && argc != 4)
+        {
+            fprintf(stderr, "arch: -l expects an archive and an optional path\n");
+            return 1;
+        }
+        return argc == 4 ? listPath(argv[2], argv[3]) : listArchive(argv[2]);
+    }
+
+    if (strcmp(argv[1], "-x") == 0)
+    {
+        if (argc < 4)
+        {
+            fprintf(stderr, "arch: -x expects an archive and at least one pattern\n");
+            return 1;
+        }
+        return extractMatching(argv[2], (const char* const*)&argv[3], (size_t)(argc - 3));
+    }
+
+    if (strcmp(argv[1], "-t") == 0)
+    {
+        if (argc != 3 && argc != 4)
+        {
+            fprintf(stderr, "arch: -t expects an archive and an optional thread count\n");
+            return 1;
+        }
+        return verifyArchive(argv[2], argc == 4 ? (unsigned)strtoul(argv[3], NULL, 10) : 0);
+    }
+
+    if (strcmp(argv[1], "-X") == 0)
+    {
+        if (argc != 3 && argc != 4)
+        {
+            fprintf(stderr, "arch: -X expects an archive and an optional thread count\n");
+            return 1;
+        }
+        return extractAll(argv[2], argc == 4 ? (unsigned)strtoul(argv[3], NULL, 10) : 0);
+    }
+
+    if (strcmp(argv[1], "-i") == 0)
+    {
+        if (argc != 3 && argc != 4)
+        {
+            fprintf(stderr, "arch: -i expects an archive and an optional span\n");
+            return 1;
+        }
+
+        uint64_t span = argc == 4 ? parseSize(argv[3]) : (1u << 20);
+        if (span == 0)
+        {
+            fprintf(stderr, "arch: Invalid span '%s'\n", argv[3]);
+            return 1;
+        }
+        return buildIndex(argv[2], span);
+    }
+
+    if (strcmp(argv[1], "-r") == 0)
+    {
+        if (argc != 6)
+        {
+            fprintf(stderr, "arch: -r expects an archive, an entry number, an offset and a length\n");
+            return 1;
+        }
+        return readRange(argv[2], (size_t)strtoull(argv[3], NULL, 10), strtoull(argv[4], NULL, 10), strtoull(argv[5], NULL, 10));
+    }
+
+    if (strcmp(argv[1], "-d") == 0 || strcmp(argv[1], "-a") == 0)
+    {
+        if (argc != 5)
+        {
+            fprintf(stderr, "arch: %s expects a delta, its base archive and a %s\n", argv[1], argv[1][1] == 'd' ? "directory" : "output archive");
+            return 1;
+        }
+        return argv[1][1] == 'd' ? createDelta(argv[2], argv[3], argv[4]) : applyDelta(argv[2], argv[3], argv[4]);
+    }
+
+    if (strcmp(argv[1], "-m") == 0)
+    {
+        if (argc < 4)
+        {
+            fprintf(stderr, "arch: -m expects an output archive and at least one input\n");
+            return 1;
+        }
+        return mergeArchives(argv[2], (const char* const*)&argv[3], (size_t)(argc - 3));
+    }
+
+    if (strcmp(argv[1], "-A") == 0 || strcmp(argv[1], "-D") == 0 || strcmp(argv[1], "-R") == 0 || strcmp(argv[1], "-C") == 0)
+    {
+        char command = argv[1][1];
+        bool valid = command == 'C' ? argc == 3 : command == 'R' ? argc == 5 : argc >= 4;
+
+        if (!valid)
+        {
+            fprintf(stderr, "arch: %s expects an archive and %s\n", argv[1],
+                command == 'C' ? "nothing else" : command == 'R' ? "an entry name and a file" : "at least one more argument");
+            return 1;
+        }
+        return updateArchive(argv[2], command, (const char* const*)&argv[3], (size_t)(argc - 3));
+    }
+
     const char* archiveFilePath = argv[1];
     Archive* archive = NULL;
 
@@ -25,14 +817,26 @@ int main(int argc, char** argv)
         size_t fileCount = argc - 2;
         const char** filePaths = (const char**)&argv[2];
         
-        ArchResult r = arch_create(archiveFilePath, &archive);
+        ArchCreateOptions options = {
+            .volumeSize = volumeSize,
+            .memory.memoryLimit = memoryLimit,
+            .inputOrder = inputOrder,
+            .longMatchWindow = longMatchWindow,
+            .compactMetadata = compactMetadata,
+            .storeAlignment = storeAlignment,
+            .ioMode = ioMode
+        };
+
+        ArchResult r = arch_createEx(archiveFilePath, &options, &archive);
         if (r != ARCH_OK)
         {
             fprintf(stderr, "arch: Failed to create archive: %s\n", arch_strerror(r));
             return 1;
         }
 
-        for (size_t i = 0; i < fileCount; ++i)
+        watchArchive(archive);
+
+        for (size_t i = 0; i < fileCount; )
         {
             const char* currentPath = filePaths[i];
             printf("Adding '%s' to archive...\n", currentPath);
@@ -41,36 +845,60 @@ int main(int argc, char** argv)
             {
                 printf("'%s' is a directory, adding recursively...\n", currentPath);
                 r = arch_addDirectory(archive, currentPath);
+                if (r == ARCH_ERR_CANCELLED) break;
                 if (r != ARCH_OK)
                 {
                     fprintf(stderr, "arch: Failed to add directory '%s': %s\n", currentPath, arch_strerror(r));
                 }
+                i++;
             }
             else
             {
+                // Consecutive files go in one call, so the next ones are opened while one is compressed
+                size_t run = 1;
+                while (i + run < fileCount && !isDirectory(filePaths[i + run])) run++;
+
                 printf("'%s' is a file, adding...\n", currentPath);
-                r = arch_addFile(archive, currentPath);
+                for (size_t j = 1; j < run; j++)
+                {
+                    printf("Adding '%s' to archive...\n'%s' is a file, adding...\n", filePaths[i + j], filePaths[i + j]);
+                }
+
+                r = arch_addFiles(archive, &filePaths[i], run);
+                if (r == ARCH_ERR_CANCELLED) break;
                 if (r != ARCH_OK)
                 {
-                    fprintf(stderr, "arch: Failed to add file '%s': %s\n", currentPath, arch_strerror(r));
+                    fprintf(stderr, "arch: Failed to add files: %s\n", arch_strerror(r));
                 }
+                i += run;
             }
         }
+
+        if (r == ARCH_ERR_CANCELLED)
+        {
+            size_t completed = arch_getFileCount(archive);
+            closeArchive(archive);
+
+            fprintf(stderr, "arch: Interrupted, kept the %zu entries completed so far\n", completed);
+            return 1;
+        }
     }
     else
     {
-        ArchResult r = arch_open(archiveFilePath, &archive);
+        ArchResult r = openArchive(archiveFilePath, &archive);
         if (r != ARCH_OK)
         {
             fprintf(stderr, "arch: Failed to open archive: %s\n", arch_strerror(r));
             return 1;
         }
 
+        watchArchive(archive);
+
         const char* outputDir = getFileName(archiveFilePath, true);
         if (MKDIR(outputDir) != 0)
         {
             perror("arch: Failed to create output directory");
-            arch_close(archive);
+            closeArchive(archive);
             return 1;
         }
 
@@ -85,7 +913,7 @@ int main(int argc, char** argv)
         }
     }
 
-    arch_close(archive);
+    closeArchive(archive);
 
     return 0;
 }